@@ -0,0 +1,279 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file flight_decoder.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Decode a flight recorder file.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "flight_recorder.hpp"
+
+namespace
+{
+	struct decoded_event
+	{
+		boost::uint32_t thread_index;
+		flight_event event;
+	};
+
+	bool is_earlier(const decoded_event& lhs, const decoded_event& rhs)
+	{
+		return lhs.event.timestamp < rhs.event.timestamp;
+	}
+
+	void usage(const char* program)
+	{
+		std::cerr << "Usage: " << program << " flight_recorder_file" << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "Prints the events of a flight recorder file, oldest first." << std::endl;
+	}
+
+	template <typename Type>
+	bool read_value(std::istream& is, Type& value)
+	{
+		return static_cast<bool>(is.read(reinterpret_cast<char*>(&value), sizeof(value)));
+	}
+
+	std::string get_text(const flight_event& event)
+	{
+		std::string result(event.text, std::min<std::size_t>(event.text_size, sizeof(event.text)));
+
+		for (std::string::iterator it = result.begin(); it != result.end(); ++it)
+		{
+			if ((*it < 0x20) || (*it > 0x7e))
+			{
+				*it = '?';
+			}
+		}
+
+		return result;
+	}
+
+	std::string format_real_time(boost::uint64_t value)
+	{
+		const std::time_t seconds = static_cast<std::time_t>(value / 1000000000ULL);
+		const std::tm* const tm = std::localtime(&seconds);
+
+		char buffer[32] = {};
+
+		if (!tm || (std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", tm) == 0))
+		{
+			return "?";
+		}
+
+		std::ostringstream oss;
+
+		oss << buffer << "." << std::setw(6) << std::setfill('0') << (value % 1000000000ULL) / 1000;
+
+		return oss.str();
+	}
+
+	std::string format_duration(boost::uint64_t value)
+	{
+		std::ostringstream oss;
+
+		oss << std::fixed << std::setprecision(1) << value / 1000.0 << " us";
+
+		return oss.str();
+	}
+
+	const char* get_log_level_name(boost::uint32_t value)
+	{
+		static const char* const names[] = { "debug", "information", "warning", "error", "fatal" };
+
+		return (value < sizeof(names) / sizeof(names[0])) ? names[value] : "unknown";
+	}
+
+	std::string describe(const flight_event& event)
+	{
+		std::ostringstream oss;
+
+		switch (event.type)
+		{
+			case FE_LOG:
+				oss << "log " << get_log_level_name(event.value1) << ": " << get_text(event);
+				break;
+			case FE_SIGNAL:
+				oss << "signal " << event.value1;
+				break;
+			case FE_CERTIFICATE_VALIDATION:
+				oss << "certificate of \"" << get_text(event) << "\" " << (event.value1 ? "accepted" : "rejected") << " in " << format_duration(event.value2);
+				break;
+			case FE_TAP_ADAPTER_UP:
+				oss << "tap adapter " << get_text(event) << " up";
+				break;
+			case FE_TAP_ADAPTER_DOWN:
+				oss << "tap adapter " << get_text(event) << " down";
+				break;
+			case FE_SCRIPT_START:
+				oss << "script " << get_text(event) << " started (pid " << event.value1 << ")";
+				break;
+			case FE_SCRIPT_END:
+				if (static_cast<boost::int64_t>(event.value2) < 0)
+				{
+					oss << "script timed out or failed (pid " << event.value1 << ")";
+				}
+				else
+				{
+					oss << "script exited with status " << event.value2 << " (pid " << event.value1 << ")";
+				}
+				break;
+			case FE_EVENT_LOOP_DELAY:
+				oss << "event loop queueing delay: " << format_duration(event.value2);
+				break;
+			case FE_CONFIGURATION_RELOAD:
+				oss << "configuration reload " << (event.value1 ? "succeeded" : "failed");
+				break;
+			case FE_CONTROL_COMMAND:
+				oss << "control command: " << get_text(event);
+				break;
+			default:
+				oss << "unknown event " << event.type << ": " << event.value1 << ", " << event.value2 << ", \"" << get_text(event) << "\"";
+				break;
+		}
+
+		return oss.str();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if ((argc != 2) || (std::strcmp(argv[1], "-h") == 0) || (std::strcmp(argv[1], "--help") == 0))
+	{
+		usage(argv[0]);
+
+		return EXIT_FAILURE;
+	}
+
+	std::ifstream file(argv[1], std::ios::in | std::ios::binary);
+
+	if (!file)
+	{
+		std::cerr << "Unable to open " << argv[1] << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	flight_file_header header;
+
+	if (!read_value(file, header) || (std::memcmp(header.magic, FLIGHT_FILE_MAGIC, sizeof(header.magic)) != 0))
+	{
+		std::cerr << argv[1] << " is not a flight recorder file." << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	if ((header.version != FLIGHT_FILE_VERSION) || (header.event_size != sizeof(flight_event)))
+	{
+		std::cerr << "Unsupported flight recorder file version: " << header.version << "." << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	std::vector<decoded_event> events;
+	boost::uint64_t lost_count = 0;
+
+	for (boost::uint32_t i = 0; i < header.buffer_count; ++i)
+	{
+		flight_buffer_header buffer_header;
+
+		if (!read_value(file, buffer_header) || (buffer_header.capacity == 0))
+		{
+			std::cerr << "Truncated flight recorder file." << std::endl;
+
+			return EXIT_FAILURE;
+		}
+
+		std::vector<flight_event> buffer(buffer_header.capacity);
+
+		if (!file.read(reinterpret_cast<char*>(&buffer[0]), buffer.size() * sizeof(flight_event)))
+		{
+			std::cerr << "Truncated flight recorder file." << std::endl;
+
+			return EXIT_FAILURE;
+		}
+
+		const boost::uint64_t first = (buffer_header.write_count > buffer_header.capacity) ? buffer_header.write_count - buffer_header.capacity : 0;
+
+		lost_count += first;
+
+		for (boost::uint64_t index = first; index < buffer_header.write_count; ++index)
+		{
+			const flight_event& event = buffer[index % buffer_header.capacity];
+
+			// Events being written during the dump.
+			if ((event.type == FE_NONE) || (event.timestamp > header.monotonic_time))
+			{
+				continue;
+			}
+
+			decoded_event decoded;
+			decoded.thread_index = buffer_header.thread_index;
+			decoded.event = event;
+
+			events.push_back(decoded);
+		}
+	}
+
+	std::stable_sort(events.begin(), events.end(), &is_earlier);
+
+	std::cout << "Process " << header.process_id << ", dumped at " << format_real_time(header.real_time) << ": " << events.size() << " event(s) from " << header.buffer_count << " thread(s), " << lost_count << " older event(s) overwritten." << std::endl;
+
+	for (std::vector<decoded_event>::const_iterator it = events.begin(); it != events.end(); ++it)
+	{
+		const boost::uint64_t age = header.monotonic_time - it->event.timestamp;
+
+		std::cout << format_real_time(header.real_time - age) << " [thread " << it->thread_index << "] " << describe(it->event) << std::endl;
+	}
+
+	return EXIT_SUCCESS;
+}
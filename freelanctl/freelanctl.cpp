@@ -0,0 +1,225 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file freelanctl.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A client for the freelan control socket.
+ */
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+	void usage(const char* program)
+	{
+		std::cerr << "Usage: " << program << " [-s control_socket] command [arguments...]" << std::endl;
+		std::cerr << std::endl;
+		std::cerr << "The control socket defaults to $FREELAN_CONTROL_SOCKET, or to $FREELAN_PID_FILE followed by \".sock\"." << std::endl;
+		std::cerr << "Run \"" << program << " help\" to list the commands of a running daemon." << std::endl;
+	}
+
+	std::string get_default_socket_path()
+	{
+		const char* value = std::getenv("FREELAN_CONTROL_SOCKET");
+
+		if (value)
+		{
+			return value;
+		}
+
+		value = std::getenv("FREELAN_PID_FILE");
+
+		if (value)
+		{
+			return std::string(value) + ".sock";
+		}
+
+		return std::string();
+	}
+
+	bool write_all(int fd, const std::string& data)
+	{
+		for (std::string::size_type offset = 0; offset < data.size();)
+		{
+			const ssize_t count = ::write(fd, data.data() + offset, data.size() - offset);
+
+			if (count < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				return false;
+			}
+
+			offset += static_cast<std::string::size_type>(count);
+		}
+
+		return true;
+	}
+
+	bool read_all(int fd, std::string& data)
+	{
+		char buffer[4096];
+
+		for (;;)
+		{
+			const ssize_t count = ::read(fd, buffer, sizeof(buffer));
+
+			if (count < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				return false;
+			}
+
+			if (count == 0)
+			{
+				return true;
+			}
+
+			data.append(buffer, static_cast<std::string::size_type>(count));
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string socket_path = get_default_socket_path();
+	int first_argument = 1;
+
+	if ((argc > 2) && (std::strcmp(argv[1], "-s") == 0))
+	{
+		socket_path = argv[2];
+		first_argument = 3;
+	}
+
+	if ((first_argument >= argc) || (std::strcmp(argv[first_argument], "-h") == 0) || (std::strcmp(argv[first_argument], "--help") == 0))
+	{
+		usage(argv[0]);
+
+		return EXIT_FAILURE;
+	}
+
+	if (socket_path.empty())
+	{
+		std::cerr << "No control socket specified." << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	struct sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	if (socket_path.size() >= sizeof(address.sun_path))
+	{
+		std::cerr << "Control socket path too long: " << socket_path << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	std::strcpy(address.sun_path, socket_path.c_str());
+
+	std::string request;
+
+	for (int i = first_argument; i < argc; ++i)
+	{
+		if (i > first_argument)
+		{
+			request += ' ';
+		}
+
+		request += argv[i];
+	}
+
+	request += '\n';
+
+	const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd < 0)
+	{
+		std::cerr << "Unable to create a socket: " << std::strerror(errno) << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	std::string response;
+
+	if ((::connect(fd, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address)) != 0) || !write_all(fd, request) || !read_all(fd, response))
+	{
+		std::cerr << "Unable to talk to " << socket_path << ": " << std::strerror(errno) << std::endl;
+
+		::close(fd);
+
+		return EXIT_FAILURE;
+	}
+
+	::close(fd);
+
+	const std::string::size_type end_of_status = response.find('\n');
+	const std::string status = response.substr(0, end_of_status);
+	const std::string output = (end_of_status == std::string::npos) ? std::string() : response.substr(end_of_status + 1);
+
+	std::cout << output;
+
+	if (status != "OK")
+	{
+		std::cerr << (status.empty() ? std::string("ERROR: The daemon closed the connection") : status) << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
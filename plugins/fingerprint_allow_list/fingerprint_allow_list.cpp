@@ -0,0 +1,212 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file fingerprint_allow_list.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A certificate validation plugin that accepts a list of fingerprints.
+ *
+ * The plugin argument is the path of a file that lists the SHA-256
+ * fingerprints of the accepted certificates, one per line, in hexadecimal.
+ * Colons are allowed between the bytes, as in the output of:
+ *
+ * openssl x509 -in certificate.crt -noout -fingerprint -sha256
+ *
+ * Empty lines and lines starting with a # are ignored. Everything up to the
+ * last = is ignored too, so that the above output can be used as is.
+ *
+ * The list is loaded when the plugin is initialized and looked up with a
+ * binary search: several hundred thousand entries take a few megabytes and a
+ * few microseconds per validation. A configuration reload keeps the running
+ * instance, and therefore its list, unless the plugin or its argument changed.
+ */
+
+#define FREELAN_PLUGIN
+#include <validation_plugin.h>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <memory>
+#include <exception>
+#include <cstring>
+#include <cctype>
+
+#include <openssl/sha.h>
+
+namespace
+{
+	struct fingerprint_type
+	{
+		unsigned char bytes[SHA256_DIGEST_LENGTH];
+
+		bool operator<(const fingerprint_type& other) const
+		{
+			return std::memcmp(bytes, other.bytes, sizeof(bytes)) < 0;
+		}
+
+		bool operator==(const fingerprint_type& other) const
+		{
+			return std::memcmp(bytes, other.bytes, sizeof(bytes)) == 0;
+		}
+	};
+
+	// The context of an instance: written once by freelan_plugin_init(), then only read.
+	typedef std::vector<fingerprint_type> fingerprint_list;
+
+	int hex_value(char c)
+	{
+		if ((c >= '0') && (c <= '9'))
+		{
+			return c - '0';
+		}
+
+		c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+
+		if ((c >= 'a') && (c <= 'f'))
+		{
+			return c - 'a' + 10;
+		}
+
+		return -1;
+	}
+
+	bool parse_fingerprint(const std::string& line, fingerprint_type& fingerprint)
+	{
+		const std::string::size_type separator = line.rfind('=');
+		std::size_t count = 0;
+		int high = -1;
+
+		for (std::string::size_type i = (separator == std::string::npos) ? 0 : separator + 1; i < line.size(); ++i)
+		{
+			const char c = line[i];
+
+			if ((c == ':') || std::isspace(static_cast<unsigned char>(c)))
+			{
+				continue;
+			}
+
+			const int value = hex_value(c);
+
+			if ((value < 0) || (count == sizeof(fingerprint.bytes)))
+			{
+				return false;
+			}
+
+			if (high < 0)
+			{
+				high = value;
+			}
+			else
+			{
+				fingerprint.bytes[count++] = static_cast<unsigned char>((high << 4) | value);
+				high = -1;
+			}
+		}
+
+		return (count == sizeof(fingerprint.bytes)) && (high < 0);
+	}
+}
+
+unsigned int freelan_plugin_abi_version(void)
+{
+	return FREELAN_PLUGIN_ABI_VERSION;
+}
+
+void* freelan_plugin_init(const char* argument)
+{
+	std::ifstream file(argument);
+
+	if (!file)
+	{
+		return NULL;
+	}
+
+	// No exception may cross the C interface.
+	try
+	{
+		std::auto_ptr<fingerprint_list> fingerprints(new fingerprint_list());
+		std::string line;
+
+		while (std::getline(file, line))
+		{
+			const std::string::size_type start = line.find_first_not_of(" \t\r");
+
+			if ((start == std::string::npos) || (line[start] == '#'))
+			{
+				continue;
+			}
+
+			fingerprint_type fingerprint;
+
+			if (!parse_fingerprint(line, fingerprint))
+			{
+				return NULL;
+			}
+
+			fingerprints->push_back(fingerprint);
+		}
+
+		std::sort(fingerprints->begin(), fingerprints->end());
+		fingerprints->erase(std::unique(fingerprints->begin(), fingerprints->end()), fingerprints->end());
+
+		return fingerprints.release();
+	}
+	catch (std::exception&)
+	{
+		return NULL;
+	}
+}
+
+int freelan_plugin_validate(void* context, const unsigned char* der, size_t der_len)
+{
+	const fingerprint_list* const fingerprints = static_cast<const fingerprint_list*>(context);
+	fingerprint_type fingerprint;
+
+	SHA256(der, der_len, fingerprint.bytes);
+
+	return std::binary_search(fingerprints->begin(), fingerprints->end(), fingerprint) ? 0 : 1;
+}
+
+void freelan_plugin_cleanup(void* context)
+{
+	delete static_cast<fingerprint_list*>(context);
+}
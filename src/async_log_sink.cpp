@@ -0,0 +1,163 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file async_log_sink.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An asynchronous log sink.
+ */
+
+#include "async_log_sink.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/date_time/c_local_time_adjustor.hpp>
+
+#include "tracing.hpp"
+
+namespace
+{
+	// The writer thread also wakes up periodically, in case a notification was missed.
+	const boost::posix_time::time_duration WRITER_WAKEUP_PERIOD = boost::posix_time::milliseconds(10);
+}
+
+async_log_sink::async_log_sink(writer_type writer, std::size_t queue_size, runtime_configuration::log_overflow_policy_type overflow_policy) :
+	m_writer(writer),
+	m_overflow_policy(overflow_policy),
+	m_queue(queue_size),
+	m_dropped_count(0),
+	m_waiting(0),
+	m_stopping(0),
+	m_mutex(),
+	m_condition(),
+	m_thread(boost::bind(&async_log_sink::write_records, this))
+{
+}
+
+async_log_sink::~async_log_sink()
+{
+	atomic_store(m_stopping, 1u);
+
+	m_condition.notify_one();
+	m_thread.join();
+}
+
+void async_log_sink::log(freelan::log_level level, const std::string& msg)
+{
+	record _record;
+	_record.level = level;
+	_record.message = msg;
+	// Converting to the local time is deferred to the writer thread.
+	_record.timestamp = boost::posix_time::microsec_clock::universal_time();
+
+	if (!m_queue.push(_record))
+	{
+		if (m_overflow_policy == runtime_configuration::LOP_DROP)
+		{
+			atomic_fetch_add(m_dropped_count, static_cast<boost::uint64_t>(1));
+
+			FREELAN_PROBE1(log__dropped, static_cast<int>(level));
+
+			return;
+		}
+
+		do
+		{
+			boost::this_thread::yield();
+		}
+		while (!m_queue.push(_record));
+	}
+
+	if (atomic_load(m_waiting))
+	{
+		m_condition.notify_one();
+	}
+}
+
+void async_log_sink::write_records()
+{
+	typedef boost::date_time::c_local_adjustor<boost::posix_time::ptime> local_adjustor;
+
+	boost::uint64_t reported_dropped_count = 0;
+	record _record;
+
+	for (;;)
+	{
+		// Read the flag first: messages queued before the flag was set must still be written.
+		const bool stopping = (atomic_load(m_stopping) != 0);
+
+		while (m_queue.pop(_record))
+		{
+			m_writer(_record.level, _record.message, local_adjustor::utc_to_local(_record.timestamp));
+		}
+
+		const boost::uint64_t dropped_count = atomic_load(m_dropped_count);
+
+		if (dropped_count != reported_dropped_count)
+		{
+			m_writer(freelan::LL_WARNING, boost::lexical_cast<std::string>(dropped_count - reported_dropped_count) + " log message(s) dropped because the log queue was full.", boost::posix_time::microsec_clock::local_time());
+
+			reported_dropped_count = dropped_count;
+		}
+
+		if (stopping)
+		{
+			break;
+		}
+
+		boost::unique_lock<boost::mutex> lock(m_mutex);
+
+		atomic_store(m_waiting, 1u);
+
+		if (!m_queue.pop(_record))
+		{
+			m_condition.timed_wait(lock, WRITER_WAKEUP_PERIOD);
+			atomic_store(m_waiting, 0u);
+
+			continue;
+		}
+
+		atomic_store(m_waiting, 0u);
+		lock.unlock();
+
+		m_writer(_record.level, _record.message, local_adjustor::utc_to_local(_record.timestamp));
+	}
+}
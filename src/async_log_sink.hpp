@@ -0,0 +1,140 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file async_log_sink.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An asynchronous log sink.
+ */
+
+#ifndef ASYNC_LOG_SINK_HPP
+#define ASYNC_LOG_SINK_HPP
+
+#include <string>
+
+#include <boost/function.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <freelan/logger.hpp>
+
+#include "mpsc_queue.hpp"
+#include "runtime_configuration.hpp"
+
+/**
+ * \brief An asynchronous log sink.
+ *
+ * Log messages are timestamped and queued by the emitting threads, then
+ * written by a dedicated thread, so that emitting a message never waits for
+ * an output stream or for syslog.
+ */
+class async_log_sink
+{
+	public:
+
+		/**
+		 * \brief The log writer type.
+		 *
+		 * The timestamp is the local time at which the message was emitted.
+		 */
+		typedef boost::function<void (freelan::log_level, const std::string&, const boost::posix_time::ptime&)> writer_type;
+
+		/**
+		 * \brief Create an asynchronous log sink.
+		 * \param writer The function to write messages with.
+		 * \param queue_size The number of messages that can wait to be written.
+		 * \param overflow_policy What to do with messages when the queue is full.
+		 */
+		async_log_sink(writer_type writer, std::size_t queue_size, runtime_configuration::log_overflow_policy_type overflow_policy);
+
+		/**
+		 * \brief Write all the queued messages and destroy the sink.
+		 */
+		~async_log_sink();
+
+		/**
+		 * \brief Queue a message.
+		 * \param level The log level.
+		 * \param msg The message.
+		 *
+		 * May be called concurrently from any thread.
+		 */
+		void log(freelan::log_level level, const std::string& msg);
+
+		/**
+		 * \brief Get the number of dropped messages.
+		 * \return The number of messages dropped because the queue was full.
+		 */
+		boost::uint64_t dropped_count() const
+		{
+			return atomic_load(m_dropped_count);
+		}
+
+	private:
+
+		struct record
+		{
+			record() : level(freelan::LL_INFORMATION), message(), timestamp() {}
+
+			freelan::log_level level;
+			std::string message;
+			boost::posix_time::ptime timestamp;
+		};
+
+		async_log_sink(const async_log_sink&);
+		async_log_sink& operator=(const async_log_sink&);
+
+		void write_records();
+
+		writer_type m_writer;
+		runtime_configuration::log_overflow_policy_type m_overflow_policy;
+		mpsc_queue<record> m_queue;
+		volatile boost::uint64_t m_dropped_count;
+		volatile unsigned int m_waiting;
+		volatile unsigned int m_stopping;
+		boost::mutex m_mutex;
+		boost::condition_variable m_condition;
+		boost::thread m_thread;
+};
+
+#endif /* ASYNC_LOG_SINK_HPP */
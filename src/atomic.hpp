@@ -0,0 +1,171 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file atomic.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Atomic operations on integral values.
+ *
+ * All operations imply a full memory barrier.
+ */
+
+#ifndef ATOMIC_HPP
+#define ATOMIC_HPP
+
+#include <cstddef>
+
+#include <boost/static_assert.hpp>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif !defined(__GNUC__)
+#error "Atomic operations are not supported with this compiler."
+#endif
+
+#if defined(_MSC_VER)
+namespace detail
+{
+	template <std::size_t Size>
+	struct atomic_traits;
+
+	template <>
+	struct atomic_traits<4>
+	{
+		typedef long native_type;
+
+		static native_type compare_exchange(volatile native_type* target, native_type desired, native_type expected)
+		{
+			return ::_InterlockedCompareExchange(target, desired, expected);
+		}
+	};
+
+	template <>
+	struct atomic_traits<8>
+	{
+		typedef __int64 native_type;
+
+		static native_type compare_exchange(volatile native_type* target, native_type desired, native_type expected)
+		{
+			return ::_InterlockedCompareExchange64(target, desired, expected);
+		}
+	};
+}
+#endif
+
+/**
+ * \brief Compare and swap a value.
+ * \param target The value to modify.
+ * \param expected The expected value.
+ * \param desired The value to store if target equals expected.
+ * \return The value of target before the operation.
+ */
+template <typename Type>
+inline Type atomic_compare_exchange(volatile Type& target, Type expected, Type desired)
+{
+	BOOST_STATIC_ASSERT(sizeof(Type) == 4 || sizeof(Type) == 8);
+
+#if defined(_MSC_VER)
+	typedef detail::atomic_traits<sizeof(Type)> traits;
+	typedef typename traits::native_type native_type;
+
+	return static_cast<Type>(traits::compare_exchange(reinterpret_cast<volatile native_type*>(&target), static_cast<native_type>(desired), static_cast<native_type>(expected)));
+#else
+	return __sync_val_compare_and_swap(&target, expected, desired);
+#endif
+}
+
+/**
+ * \brief Add to a value.
+ * \param target The value to modify.
+ * \param value The value to add.
+ * \return The value of target before the operation.
+ */
+template <typename Type>
+inline Type atomic_fetch_add(volatile Type& target, Type value)
+{
+#if defined(_MSC_VER)
+	Type expected = target;
+
+	for (Type current; (current = atomic_compare_exchange(target, expected, static_cast<Type>(expected + value))) != expected;)
+	{
+		expected = current;
+	}
+
+	return expected;
+#else
+	return __sync_fetch_and_add(&target, value);
+#endif
+}
+
+/**
+ * \brief Read a value.
+ * \param source The value to read.
+ * \return The value.
+ */
+template <typename Type>
+inline Type atomic_load(const volatile Type& source)
+{
+#if defined(__ATOMIC_SEQ_CST)
+	return __atomic_load_n(&source, __ATOMIC_SEQ_CST);
+#else
+	// A no-op compare and swap is the only portable atomic read of a 64-bit value on 32-bit platforms.
+	return atomic_compare_exchange(const_cast<volatile Type&>(source), Type(), Type());
+#endif
+}
+
+/**
+ * \brief Write a value.
+ * \param target The value to write.
+ * \param value The new value.
+ */
+template <typename Type>
+inline void atomic_store(volatile Type& target, Type value)
+{
+#if defined(__ATOMIC_SEQ_CST)
+	__atomic_store_n(&target, value, __ATOMIC_SEQ_CST);
+#else
+	for (Type expected = target, current; (current = atomic_compare_exchange(target, expected, value)) != expected;)
+	{
+		expected = current;
+	}
+#endif
+}
+
+#endif /* ATOMIC_HPP */
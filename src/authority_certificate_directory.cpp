@@ -0,0 +1,383 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file authority_certificate_directory.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A hashed directory of authority certificates.
+ */
+
+#include "authority_certificate_directory.hpp"
+
+#include <cstdio>
+#include <stdexcept>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <openssl/pem.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+	// Certificate chains are never that long: this only protects against loops.
+	const unsigned int MAX_CHAIN_DEPTH = 32;
+
+	std::string read_file(const fs::path& filename)
+	{
+		fs::basic_ifstream<char> ifs(filename, std::ios::binary);
+
+		if (!ifs)
+		{
+			throw std::runtime_error("No such file: " + filename.string());
+		}
+
+		const std::string result((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+		if (ifs.bad())
+		{
+			throw std::runtime_error("Unable to read: " + filename.string());
+		}
+
+		return result;
+	}
+
+	// Unlike X509_check_issued(), also checks the signature: several authorities can have the same name.
+	bool is_issuer(X509* issuer, X509* cert)
+	{
+		if (X509_check_issued(issuer, cert) != X509_V_OK)
+		{
+			return false;
+		}
+
+		EVP_PKEY* const key = X509_get_pubkey(issuer);
+
+		if (!key)
+		{
+			ERR_clear_error();
+
+			return false;
+		}
+
+		const bool result = (X509_verify(cert, key) > 0);
+
+		EVP_PKEY_free(key);
+		ERR_clear_error();
+
+		return result;
+	}
+
+	freelan::security_configuration::cert_type parse_certificate(const std::string& content)
+	{
+		BIO* bio = BIO_new_mem_buf(const_cast<char*>(content.data()), static_cast<int>(content.size()));
+
+		if (!bio)
+		{
+			throw std::bad_alloc();
+		}
+
+		// Also accepts the "TRUSTED CERTIFICATE" format.
+		X509* cert = PEM_read_bio_X509_AUX(bio, NULL, NULL, NULL);
+
+		BIO_free(bio);
+
+		if (!cert)
+		{
+			ERR_clear_error();
+
+			const unsigned char* data = reinterpret_cast<const unsigned char*>(content.data());
+
+			cert = d2i_X509(NULL, &data, static_cast<long>(content.size()));
+		}
+
+		if (!cert)
+		{
+			ERR_clear_error();
+
+			throw std::runtime_error("Unable to parse the certificate");
+		}
+
+		return freelan::security_configuration::cert_type::take_ownership(cert);
+	}
+}
+
+authority_certificate_directory::authority_certificate_directory(const fs::path& directory, std::size_t cache_size, const std::vector<cert_type>& authorities, const std::vector<crl_type>& crls, revocation_validation_method_type revocation_validation_method) :
+	m_directory(directory),
+	m_cache_size(cache_size),
+	m_revocation_validation_method(revocation_validation_method)
+{
+	if (!fs::is_directory(m_directory))
+	{
+		throw std::runtime_error("No such directory: " + m_directory.string());
+	}
+
+	for (std::vector<cert_type>::const_iterator authority = authorities.begin(); authority != authorities.end(); ++authority)
+	{
+		m_authorities.insert(std::make_pair(get_name(X509_get_subject_name(authority->raw())), *authority));
+	}
+
+	for (std::vector<crl_type>::const_iterator crl = crls.begin(); crl != crls.end(); ++crl)
+	{
+		m_crls.insert(std::make_pair(get_name(X509_CRL_get_issuer(crl->raw())), *crl));
+	}
+}
+
+std::vector<authority_certificate_directory::cert_type> authority_certificate_directory::find(X509_NAME* subject)
+{
+	std::vector<cert_type> result;
+
+	char hash[9];
+	std::sprintf(hash, "%08lx", X509_NAME_hash(subject));
+
+	// Like OpenSSL, stop at the first missing sequence number.
+	for (unsigned int sequence = 0;; ++sequence)
+	{
+		const fs::path filename = m_directory / (hash + ("." + boost::lexical_cast<std::string>(sequence)));
+
+		boost::system::error_code ec;
+		const std::time_t modification_time = fs::last_write_time(filename, ec);
+
+		if (ec)
+		{
+			break;
+		}
+
+		const cert_type cert = load(filename, modification_time);
+
+		// Different names can have the same hash.
+		if (cert && (X509_NAME_cmp(X509_get_subject_name(cert.raw()), subject) == 0))
+		{
+			result.push_back(cert);
+		}
+	}
+
+	return result;
+}
+
+bool authority_certificate_directory::verify(cert_type cert, std::string& error)
+{
+	const boost::shared_ptr<X509_STORE> store(X509_STORE_new(), X509_STORE_free);
+
+	if (!store)
+	{
+		throw std::bad_alloc();
+	}
+
+	// Only the authorities of this certificate go to the store, so that building it does not depend on the number of authorities.
+	std::vector<cert_type> chain;
+	X509* current = cert.raw();
+
+	for (unsigned int depth = 0; depth < MAX_CHAIN_DEPTH; ++depth)
+	{
+		const std::string issuer_name = get_name(X509_get_issuer_name(current));
+
+		for (crl_map::const_iterator crl = m_crls.lower_bound(issuer_name); crl != m_crls.upper_bound(issuer_name); ++crl)
+		{
+			X509_STORE_add_crl(store.get(), crl->second.raw());
+		}
+
+		if ((depth > 0) && (X509_check_issued(current, current) == X509_V_OK))
+		{
+			break;
+		}
+
+		const cert_type issuer = find_issuer(current);
+
+		if (!issuer)
+		{
+			break;
+		}
+
+		X509_STORE_add_cert(store.get(), issuer.raw());
+
+		chain.push_back(issuer);
+		current = issuer.raw();
+	}
+
+	switch (m_revocation_validation_method)
+	{
+		case freelan::security_configuration::CRVM_LAST:
+			X509_STORE_set_flags(store.get(), X509_V_FLAG_CRL_CHECK);
+			break;
+		case freelan::security_configuration::CRVM_ALL:
+			X509_STORE_set_flags(store.get(), X509_V_FLAG_CRL_CHECK | X509_V_FLAG_CRL_CHECK_ALL);
+			break;
+		case freelan::security_configuration::CRVM_NONE:
+			break;
+	}
+
+	const boost::shared_ptr<X509_STORE_CTX> store_context(X509_STORE_CTX_new(), X509_STORE_CTX_free);
+
+	if (!store_context || !X509_STORE_CTX_init(store_context.get(), store.get(), cert.raw(), NULL))
+	{
+		ERR_clear_error();
+
+		throw std::bad_alloc();
+	}
+
+	const bool result = (X509_verify_cert(store_context.get()) > 0);
+
+	if (!result)
+	{
+		error = X509_verify_cert_error_string(X509_STORE_CTX_get_error(store_context.get()));
+	}
+
+	ERR_clear_error();
+
+	return result;
+}
+
+std::size_t authority_certificate_directory::size() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	return m_index.size();
+}
+
+std::string authority_certificate_directory::get_name(X509_NAME* name)
+{
+	unsigned char* buffer = NULL;
+	const int length = i2d_X509_NAME(name, &buffer);
+
+	if (length < 0)
+	{
+		throw std::runtime_error("Unable to encode a name");
+	}
+
+	const std::string result(reinterpret_cast<const char*>(buffer), length);
+
+	OPENSSL_free(buffer);
+
+	return result;
+}
+
+authority_certificate_directory::cert_type authority_certificate_directory::load(const fs::path& filename, std::time_t modification_time)
+{
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		const entry_map::iterator index = m_index.find(filename);
+
+		if (index != m_index.end())
+		{
+			const entry_list::iterator entry = index->second;
+
+			if (entry->modification_time == modification_time)
+			{
+				m_entries.splice(m_entries.begin(), m_entries, entry);
+
+				return entry->cert;
+			}
+
+			m_entries.erase(entry);
+			m_index.erase(index);
+		}
+	}
+
+	entry_type entry;
+	entry.filename = filename;
+	entry.modification_time = modification_time;
+
+	// Parsed outside of the lock: other look-ups must not wait for the file system.
+	try
+	{
+		entry.cert = parse_certificate(read_file(filename));
+	}
+	catch (std::exception&)
+	{
+		// An empty certificate: broken files are not parsed again until they change.
+	}
+
+	if (m_cache_size == 0)
+	{
+		return entry.cert;
+	}
+
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	const entry_map::iterator index = m_index.find(filename);
+
+	if (index != m_index.end())
+	{
+		// Loaded concurrently.
+		m_entries.erase(index->second);
+		m_index.erase(index);
+	}
+	else if (m_index.size() >= m_cache_size)
+	{
+		m_index.erase(m_entries.back().filename);
+		m_entries.pop_back();
+	}
+
+	m_entries.push_front(entry);
+	m_index[filename] = m_entries.begin();
+
+	return entry.cert;
+}
+
+authority_certificate_directory::cert_type authority_certificate_directory::find_issuer(X509* cert)
+{
+	X509_NAME* const issuer_name = X509_get_issuer_name(cert);
+	const std::string name = get_name(issuer_name);
+
+	for (authority_map::const_iterator authority = m_authorities.lower_bound(name); authority != m_authorities.upper_bound(name); ++authority)
+	{
+		if (is_issuer(authority->second.raw(), cert))
+		{
+			return authority->second;
+		}
+	}
+
+	const std::vector<cert_type> candidates = find(issuer_name);
+
+	for (std::vector<cert_type>::const_iterator candidate = candidates.begin(); candidate != candidates.end(); ++candidate)
+	{
+		if (is_issuer(candidate->raw(), cert))
+		{
+			return *candidate;
+		}
+	}
+
+	return cert_type();
+}
@@ -0,0 +1,164 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file authority_certificate_directory.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A hashed directory of authority certificates.
+ */
+
+#ifndef AUTHORITY_CERTIFICATE_DIRECTORY_HPP
+#define AUTHORITY_CERTIFICATE_DIRECTORY_HPP
+
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <openssl/x509.h>
+
+#include <freelan/configuration.hpp>
+
+/**
+ * \brief A hashed directory of authority certificates.
+ *
+ * The directory uses the layout of OpenSSL hashed directories, as created by
+ * "openssl rehash" or c_rehash: each certificate is stored in (or linked
+ * from) a file named after the hash of its subject name, followed by a
+ * sequence number, like "9d66eef0.0".
+ *
+ * Certificates are only parsed when a certificate they issued is verified.
+ * The parsed certificates are kept in a bounded cache, the least recently used
+ * being evicted first, and are parsed again when their file changes.
+ *
+ * All methods are thread-safe.
+ */
+class authority_certificate_directory
+{
+	public:
+
+		/**
+		 * \brief The certificate type.
+		 */
+		typedef freelan::security_configuration::cert_type cert_type;
+
+		/**
+		 * \brief The certificate revocation list type.
+		 */
+		typedef freelan::security_configuration::crl_type crl_type;
+
+		/**
+		 * \brief The certificate revocation validation method type.
+		 */
+		typedef freelan::security_configuration::certificate_revocation_validation_method_type revocation_validation_method_type;
+
+		/**
+		 * \brief Create an authority certificate directory.
+		 * \param directory The directory.
+		 * \param cache_size The maximum number of parsed certificates to keep.
+		 * \param authorities Additional authority certificates, that are always trusted.
+		 * \param crls The certificate revocation lists to check the certificates against.
+		 * \param revocation_validation_method The certificate revocation validation method.
+		 */
+		authority_certificate_directory(const boost::filesystem::path& directory, std::size_t cache_size, const std::vector<cert_type>& authorities, const std::vector<crl_type>& crls, revocation_validation_method_type revocation_validation_method);
+
+		/**
+		 * \brief Find the authority certificates with a given subject name.
+		 * \param subject The subject name.
+		 * \return The matching certificates from the directory. Files that cannot be parsed are ignored.
+		 */
+		std::vector<cert_type> find(X509_NAME* subject);
+
+		/**
+		 * \brief Verify a certificate.
+		 * \param cert The certificate.
+		 * \param error The reason why the certificate was rejected, if it was.
+		 * \return true if cert was issued by a trusted authority, directly or through intermediate authorities.
+		 *
+		 * The chain is built from the additional authority certificates and from the directory, then verified like the core does.
+		 */
+		bool verify(cert_type cert, std::string& error);
+
+		/**
+		 * \brief Get the number of parsed certificates currently kept.
+		 * \return The number of parsed certificates currently kept.
+		 */
+		std::size_t size() const;
+
+	private:
+
+		struct entry_type
+		{
+			boost::filesystem::path filename;
+			std::time_t modification_time;
+			cert_type cert;
+		};
+
+		typedef std::list<entry_type> entry_list;
+		typedef std::map<boost::filesystem::path, entry_list::iterator> entry_map;
+
+		// By DER encoded subject or issuer name.
+		typedef std::multimap<std::string, cert_type> authority_map;
+		typedef std::multimap<std::string, crl_type> crl_map;
+
+		authority_certificate_directory(const authority_certificate_directory&);
+		authority_certificate_directory& operator=(const authority_certificate_directory&);
+
+		static std::string get_name(X509_NAME* name);
+
+		cert_type load(const boost::filesystem::path& filename, std::time_t modification_time);
+		cert_type find_issuer(X509* cert);
+
+		const boost::filesystem::path m_directory;
+		const std::size_t m_cache_size;
+		const revocation_validation_method_type m_revocation_validation_method;
+		authority_map m_authorities;
+		crl_map m_crls;
+		mutable boost::mutex m_mutex;
+		// Most recently used first.
+		entry_list m_entries;
+		entry_map m_index;
+};
+
+#endif /* AUTHORITY_CERTIFICATE_DIRECTORY_HPP */
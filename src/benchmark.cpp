@@ -0,0 +1,896 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file benchmark.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Micro-benchmarks.
+ */
+
+#include "benchmark.hpp"
+
+#include <vector>
+#include <string>
+#include <iomanip>
+#include <algorithm>
+#include <sstream>
+#include <cstdlib>
+
+#include <boost/system/system_error.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/function.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/program_options.hpp>
+#include <boost/foreach.hpp>
+
+#include "system.hpp"
+#include "tools.hpp"
+#include "certificate_validation_plugin.hpp"
+#include "certificate_revocation_index.hpp"
+#include "configuration_helper.hpp"
+#include "configuration_snapshot.hpp"
+#include "ip_prefix_table.hpp"
+#include "cipher_benchmark.hpp"
+
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+#include <openssl/pem.h>
+
+#ifndef WINDOWS
+#include "posix/certificate_validation_helper.hpp"
+#endif
+
+#ifndef WINDOWS
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <errno.h>
+#endif
+
+namespace fs = boost::filesystem;
+namespace fl = freelan;
+
+namespace
+{
+#ifndef WINDOWS
+	int legacy_execute(const char* file)
+	{
+		pid_t pid = ::fork();
+
+		if (pid < 0)
+		{
+			throw boost::system::system_error(errno, boost::system::system_category(), "fork()");
+		}
+
+		if (pid == 0)
+		{
+			// This is what scripts used to be started with.
+			int fdlimit = ::sysconf(_SC_OPEN_MAX);
+
+			for (int n = 0; n < fdlimit; ++n)
+			{
+				::close(n);
+			}
+
+			char* const argv[] = { const_cast<char*>(file), NULL };
+
+			::execv(file, argv);
+			_exit(EXIT_FAILURE);
+		}
+
+		int status;
+
+		while ((::waitpid(pid, &status, 0) < 0) && (errno == EINTR)) {}
+
+		return get_exit_status(status);
+	}
+#endif
+
+	/**
+	 * \brief Run a function several times.
+	 * \return The mean duration of a call, in microseconds.
+	 */
+	template <typename Function>
+	double measure(Function function, unsigned int iterations)
+	{
+		const boost::uint64_t start = get_monotonic_time();
+
+		for (unsigned int i = 0; i < iterations; ++i)
+		{
+			function();
+		}
+
+		return static_cast<double>(get_monotonic_time() - start) / 1000.0 / std::max(iterations, 1u);
+	}
+
+	typedef fl::security_configuration::cert_type cert_type;
+	typedef fl::security_configuration::crl_type crl_type;
+
+	void check_openssl(int result, const char* operation)
+	{
+		if (result <= 0)
+		{
+			throw std::runtime_error(std::string("Unable to generate the benchmark data: ") + operation);
+		}
+	}
+
+	EVP_PKEY* generate_key()
+	{
+		EVP_PKEY_CTX* const ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+		EVP_PKEY* key = NULL;
+
+		check_openssl(ctx != NULL, "EVP_PKEY_CTX_new_id()");
+
+		const bool success = (EVP_PKEY_keygen_init(ctx) > 0) && (EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 2048) > 0) && (EVP_PKEY_keygen(ctx, &key) > 0);
+
+		EVP_PKEY_CTX_free(ctx);
+
+		check_openssl(success, "EVP_PKEY_keygen()");
+
+		return key;
+	}
+
+	cert_type generate_certificate(const char* common_name, long serial, EVP_PKEY* key, X509* issuer, EVP_PKEY* issuer_key)
+	{
+		const cert_type cert = cert_type::take_ownership(X509_new());
+
+		X509_set_version(cert.raw(), 2);
+		ASN1_INTEGER_set(X509_get_serialNumber(cert.raw()), serial);
+		X509_gmtime_adj(X509_get_notBefore(cert.raw()), 0);
+		X509_gmtime_adj(X509_get_notAfter(cert.raw()), 86400);
+		X509_NAME_add_entry_by_txt(X509_get_subject_name(cert.raw()), "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>(common_name), -1, -1, 0);
+		X509_set_issuer_name(cert.raw(), issuer ? X509_get_subject_name(issuer) : X509_get_subject_name(cert.raw()));
+		X509_set_pubkey(cert.raw(), key);
+
+		if (!issuer)
+		{
+			X509_EXTENSION* const extension = X509V3_EXT_conf_nid(NULL, NULL, NID_basic_constraints, const_cast<char*>("critical,CA:TRUE"));
+
+			check_openssl(extension != NULL, "X509V3_EXT_conf_nid()");
+
+			X509_add_ext(cert.raw(), extension, -1);
+			X509_EXTENSION_free(extension);
+		}
+
+		check_openssl(X509_sign(cert.raw(), issuer_key, EVP_sha256()), "X509_sign()");
+
+		return cert;
+	}
+
+	crl_type generate_crl(X509* issuer, EVP_PKEY* issuer_key, unsigned int size)
+	{
+		const crl_type crl = crl_type::take_ownership(X509_CRL_new());
+
+		ASN1_TIME* const now = X509_gmtime_adj(NULL, 0);
+		ASN1_TIME* const next_update = X509_gmtime_adj(NULL, 86400);
+
+		X509_CRL_set_version(crl.raw(), 1);
+		X509_CRL_set_issuer_name(crl.raw(), X509_get_subject_name(issuer));
+		X509_CRL_set_lastUpdate(crl.raw(), now);
+		X509_CRL_set_nextUpdate(crl.raw(), next_update);
+
+		for (unsigned int i = 0; i < size; ++i)
+		{
+			X509_REVOKED* const revoked = X509_REVOKED_new();
+			ASN1_INTEGER* const serial = ASN1_INTEGER_new();
+
+			// Leave room for the certificates that are not revoked.
+			ASN1_INTEGER_set(serial, 1000 + static_cast<long>(i) * 2);
+			X509_REVOKED_set_serialNumber(revoked, serial);
+			X509_REVOKED_set_revocationDate(revoked, now);
+			X509_CRL_add0_revoked(crl.raw(), revoked);
+
+			ASN1_INTEGER_free(serial);
+		}
+
+		ASN1_TIME_free(next_update);
+		ASN1_TIME_free(now);
+
+		X509_CRL_sort(crl.raw());
+
+		check_openssl(X509_CRL_sign(crl.raw(), issuer_key, EVP_sha256()), "X509_CRL_sign()");
+
+		return crl;
+	}
+
+	std::string to_der(crl_type crl)
+	{
+		const int length = i2d_X509_CRL(crl.raw(), NULL);
+
+		check_openssl(length, "i2d_X509_CRL()");
+
+		std::string result(static_cast<std::size_t>(length), '\0');
+		unsigned char* data = reinterpret_cast<unsigned char*>(&result[0]);
+
+		i2d_X509_CRL(crl.raw(), &data);
+
+		return result;
+	}
+
+	// What the core does: a complete chain verification with the revocation lists in the store.
+	struct store_revocation_check
+	{
+		store_revocation_check(X509_STORE* _store, cert_type _cert) : store(_store), cert(_cert) {}
+
+		void operator()() const
+		{
+			X509_STORE_CTX* const ctx = X509_STORE_CTX_new();
+
+			X509_STORE_CTX_init(ctx, store, cert.raw(), NULL);
+
+			if (X509_verify_cert(ctx) != 1)
+			{
+				X509_STORE_CTX_free(ctx);
+
+				throw std::runtime_error("The benchmark certificate was rejected");
+			}
+
+			X509_STORE_CTX_free(ctx);
+		}
+
+		X509_STORE* store;
+		cert_type cert;
+	};
+
+	struct index_revocation_check
+	{
+		index_revocation_check(const certificate_revocation_index& _index, cert_type _cert) : index(&_index), cert(_cert) {}
+
+		void operator()() const
+		{
+			if (index->check(cert) != certificate_revocation_index::RS_GOOD)
+			{
+				throw std::runtime_error("The benchmark certificate was rejected");
+			}
+		}
+
+		const certificate_revocation_index* index;
+		cert_type cert;
+	};
+
+	double measure_once(boost::function<void ()> function)
+	{
+		return measure(function, 1) / 1000.0;
+	}
+
+	void parse_der(const std::string& der)
+	{
+		const unsigned char* data = reinterpret_cast<const unsigned char*>(der.data());
+
+		X509_CRL_free(d2i_X509_CRL(NULL, &data, static_cast<long>(der.size())));
+	}
+
+	void write_file(const fs::path& filename, const std::string& content)
+	{
+		fs::basic_ofstream<char> ofs(filename, std::ios::binary | std::ios::trunc);
+
+		ofs.write(content.data(), content.size());
+
+		if (!ofs)
+		{
+			throw std::runtime_error("Unable to write: " + filename.string());
+		}
+	}
+
+	void add_crl_file(certificate_revocation_index& index, const fs::path& filename, const fs::path& cache_directory)
+	{
+		index.add_file(filename, cache_directory);
+	}
+
+	template <typename Type, typename Writer>
+	std::string to_pem(Type* value, Writer writer)
+	{
+		BIO* const bio = BIO_new(BIO_s_mem());
+
+		check_openssl(bio != NULL, "BIO_new()");
+
+		if (writer(bio, value) <= 0)
+		{
+			BIO_free(bio);
+
+			check_openssl(0, "PEM_write_bio()");
+		}
+
+		char* data = NULL;
+		const long length = BIO_get_mem_data(bio, &data);
+		const std::string result(data, static_cast<std::size_t>(length));
+
+		BIO_free(bio);
+
+		return result;
+	}
+
+	int write_private_key(BIO* bio, EVP_PKEY* key)
+	{
+		return PEM_write_bio_PrivateKey(bio, key, NULL, NULL, 0, NULL, NULL);
+	}
+
+	boost::program_options::options_description get_benchmark_configuration_options()
+	{
+		boost::program_options::options_description result;
+
+		result.add(get_server_options());
+		result.add(get_fscp_options());
+		result.add(get_security_options());
+		result.add(get_tap_adapter_options());
+		result.add(get_switch_options());
+		result.add(get_runtime_options());
+
+		return result;
+	}
+
+	// What a startup from the configuration file does, up to the core creation.
+	struct text_startup
+	{
+		explicit text_startup(const fs::path& _configuration_file) : configuration_file(_configuration_file) {}
+
+		void operator()() const
+		{
+			namespace po = boost::program_options;
+
+			const po::options_description options = get_benchmark_configuration_options();
+			fs::basic_ifstream<char> ifs(configuration_file);
+
+			if (!ifs)
+			{
+				throw po::reading_file(configuration_file.string().c_str());
+			}
+
+			po::variables_map vm;
+			po::store(po::parse_config_file(ifs, options, true), vm);
+			po::notify(vm);
+
+			fl::configuration configuration;
+			setup_configuration(configuration, configuration_file.parent_path(), vm);
+			get_certificate_revocation_index(configuration_file.parent_path(), vm, configuration.security.certificate_authority_list);
+		}
+
+		fs::path configuration_file;
+	};
+
+	// What a startup from a configuration snapshot does, up to the core creation.
+	struct snapshot_startup
+	{
+		explicit snapshot_startup(const fs::path& _snapshot_file) : snapshot_file(_snapshot_file) {}
+
+		void operator()() const
+		{
+			namespace po = boost::program_options;
+
+			const po::options_description options = get_benchmark_configuration_options();
+			const configuration_snapshot snapshot = load_configuration_snapshot(snapshot_file);
+
+			po::variables_map vm;
+			store_option_values(snapshot.options, options, vm);
+			po::notify(vm);
+
+			fl::configuration configuration;
+			setup_configuration(configuration, snapshot.root, vm, NULL, &snapshot);
+			get_certificate_revocation_index(snapshot.root, vm, configuration.security.certificate_authority_list, NULL, &snapshot);
+		}
+
+		fs::path snapshot_file;
+	};
+
+	void compile_configuration(const fs::path& configuration_file, const fs::path& snapshot_file)
+	{
+		namespace po = boost::program_options;
+
+		const po::options_description options = get_benchmark_configuration_options();
+		fs::basic_ifstream<char> ifs(configuration_file);
+		const po::parsed_options parsed_options = po::parse_config_file(ifs, options, true);
+
+		po::variables_map vm;
+		po::store(parsed_options, vm);
+		po::notify(vm);
+
+		const fs::path root = configuration_file.parent_path();
+		fl::configuration configuration;
+		setup_configuration(configuration, root, vm);
+
+		save_configuration_snapshot(snapshot_file, make_configuration_snapshot(root, vm, get_option_values(parsed_options), configuration, get_certificate_revocation_index(root, vm, configuration.security.certificate_authority_list)));
+	}
+
+	// Keeps the compiler from dropping the lookups.
+	volatile std::size_t lookup_sink = 0;
+
+	// A xorshift generator: every run uses the same networks and addresses.
+	class random_generator
+	{
+		public:
+
+			random_generator() : m_state(0x9e3779b9) {}
+
+			boost::uint32_t operator()()
+			{
+				m_state ^= m_state << 13;
+				m_state ^= m_state >> 17;
+				m_state ^= m_state << 5;
+
+				return m_state;
+			}
+
+		private:
+
+			boost::uint32_t m_state;
+	};
+
+	boost::uint32_t to_uint(const boost::asio::ip::address_v4& address)
+	{
+		const boost::asio::ip::address_v4::bytes_type bytes = address.to_bytes();
+
+		return (static_cast<boost::uint32_t>(bytes[0]) << 24) | (static_cast<boost::uint32_t>(bytes[1]) << 16) | (static_cast<boost::uint32_t>(bytes[2]) << 8) | static_cast<boost::uint32_t>(bytes[3]);
+	}
+
+	// What the core does with fscp.never_contact: a scan of the whole list.
+	struct network_list_lookup
+	{
+		network_list_lookup(const std::vector<fl::ipv4_network_address>& _networks, const std::vector<boost::asio::ip::address_v4>& _addresses) : networks(&_networks), addresses(&_addresses) {}
+
+		void operator()() const
+		{
+			std::size_t matches = 0;
+
+			BOOST_FOREACH(const boost::asio::ip::address_v4& address, *addresses)
+			{
+				const boost::uint32_t value = to_uint(address);
+
+				BOOST_FOREACH(const fl::ipv4_network_address& network, *networks)
+				{
+					const boost::uint32_t mask = (network.prefix_length() == 0) ? 0 : (0xffffffff << (32 - network.prefix_length()));
+
+					if (((value ^ to_uint(network.address())) & mask) == 0)
+					{
+						++matches;
+
+						break;
+					}
+				}
+			}
+
+			lookup_sink = matches;
+		}
+
+		const std::vector<fl::ipv4_network_address>* networks;
+		const std::vector<boost::asio::ip::address_v4>* addresses;
+	};
+
+	struct prefix_table_lookup
+	{
+		prefix_table_lookup(const ip_prefix_table<bool>& _table, const std::vector<boost::asio::ip::address_v4>& _addresses) : table(&_table), addresses(&_addresses) {}
+
+		void operator()() const
+		{
+			std::size_t matches = 0;
+
+			BOOST_FOREACH(const boost::asio::ip::address_v4& address, *addresses)
+			{
+				if (table->find(address))
+				{
+					++matches;
+				}
+			}
+
+			lookup_sink = matches;
+		}
+
+		const ip_prefix_table<bool>* table;
+		const std::vector<boost::asio::ip::address_v4>* addresses;
+	};
+
+#ifndef WINDOWS
+
+	struct legacy_launcher
+	{
+		explicit legacy_launcher(const fs::path& _script) : script(_script.string()) {}
+
+		void operator()() const
+		{
+			legacy_execute(script.c_str());
+		}
+
+		std::string script;
+	};
+
+	struct current_launcher
+	{
+		explicit current_launcher(const fs::path& _script) : script(_script) {}
+
+		void operator()() const
+		{
+			execute(script, std::vector<std::string>());
+		}
+
+		fs::path script;
+	};
+
+	void log_to_stream(std::ostream& os, fl::log_level level, const std::string& msg)
+	{
+		os << "[" << log_level_to_string(level) << "] " << msg << std::endl;
+	}
+
+	struct script_validator
+	{
+		script_validator(const fs::path& _script, script_input_type _input, fl::logger& _logger, cert_type _cert) : script(_script), input(_input), logger(&_logger), cert(_cert) {}
+
+		bool operator()() const
+		{
+			return (validate_certificate_with_script(script, input, boost::posix_time::pos_infin, *logger, cert) == CVR_ACCEPTED);
+		}
+
+		fs::path script;
+		script_input_type input;
+		fl::logger* logger;
+		cert_type cert;
+	};
+
+	template <typename Validator>
+	struct validator_adapter
+	{
+		validator_adapter(Validator& _validator, cert_type _cert) : validator(&_validator), cert(_cert) {}
+
+		bool operator()() const
+		{
+			return validator->validate(cert);
+		}
+
+		Validator* validator;
+		cert_type cert;
+	};
+
+	template <typename Function>
+	void report_validation(std::ostream& os, const std::string& mode, Function function, unsigned int iterations)
+	{
+		const bool accepted = function();
+		const double duration = measure(function, iterations);
+
+		os << std::setw(24) << std::left << mode << std::right << std::fixed << std::setprecision(1) << std::setw(16) << (duration > 0.0 ? 1000000.0 / duration : 0.0) << std::setw(16) << duration << std::setw(10) << (accepted ? "yes" : "no") << std::endl;
+	}
+#endif
+}
+
+#ifndef WINDOWS
+void benchmark_spawn(std::ostream& os, const fs::path& script, unsigned int iterations)
+{
+	rlimit original_limit;
+
+	if (::getrlimit(RLIMIT_NOFILE, &original_limit) != 0)
+	{
+		throw boost::system::system_error(errno, boost::system::system_category(), "getrlimit()");
+	}
+
+	static const rlim_t limits[] = { 1024, 16384, 131072, 1048576 };
+
+	os << "Launching " << script << " " << iterations << " time(s) per open files limit." << std::endl;
+	os << std::setw(12) << "nofile" << std::setw(20) << "fork+close (us)" << std::setw(16) << "current (us)" << std::endl;
+
+	for (std::size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); ++i)
+	{
+		rlimit limit = original_limit;
+		limit.rlim_cur = limits[i];
+
+		if ((original_limit.rlim_max != RLIM_INFINITY) && (limit.rlim_cur > original_limit.rlim_max))
+		{
+			os << std::setw(12) << limits[i] << "  skipped: above the hard limit (" << original_limit.rlim_max << ")" << std::endl;
+
+			continue;
+		}
+
+		if (::setrlimit(RLIMIT_NOFILE, &limit) != 0)
+		{
+			os << std::setw(12) << limits[i] << "  skipped: " << boost::system::error_code(errno, boost::system::system_category()).message() << std::endl;
+
+			continue;
+		}
+
+		const double legacy = measure(legacy_launcher(script), iterations);
+		const double current = measure(current_launcher(script), iterations);
+
+		os << std::setw(12) << limits[i] << std::fixed << std::setprecision(1) << std::setw(20) << legacy << std::setw(16) << current << std::endl;
+	}
+
+	::setrlimit(RLIMIT_NOFILE, &original_limit);
+}
+
+void benchmark_validation(std::ostream& os, cert_type cert, const fs::path& script, script_input_type script_input, const fs::path& helper, const fs::path& plugin, const std::string& plugin_argument, unsigned int iterations)
+{
+	os << "Validating a certificate " << iterations << " time(s) per mode." << std::endl;
+	os << std::setw(24) << std::left << "mode" << std::right << std::setw(16) << "validations/s" << std::setw(16) << "us/validation" << std::setw(10) << "accepted" << std::endl;
+
+	if (!script.empty())
+	{
+		fl::logger logger(boost::bind(&log_to_stream, boost::ref(os), _1, _2), fl::LL_WARNING);
+
+		report_validation(os, "script (" + boost::lexical_cast<std::string>(script_input) + ")", script_validator(script, script_input, logger, cert), iterations);
+	}
+
+	if (!helper.empty())
+	{
+		posix::certificate_validation_helper validation_helper(helper, boost::posix_time::pos_infin);
+
+		report_validation(os, "helper", validator_adapter<posix::certificate_validation_helper>(validation_helper, cert), iterations);
+	}
+
+	if (!plugin.empty())
+	{
+		certificate_validation_plugin validation_plugin(plugin, plugin_argument);
+
+		report_validation(os, "plugin", validator_adapter<certificate_validation_plugin>(validation_plugin, cert), iterations);
+	}
+}
+#endif
+
+void benchmark_crl(std::ostream& os, unsigned int iterations)
+{
+	EVP_PKEY* const ca_key = generate_key();
+	EVP_PKEY* const key = generate_key();
+
+	try
+	{
+		const cert_type ca = generate_certificate("freelan benchmark authority", 1, ca_key, NULL, ca_key);
+		// Never revoked: every lookup goes through the whole list.
+		const cert_type cert = generate_certificate("freelan benchmark host", 1001, key, ca.raw(), ca_key);
+
+		const fs::path directory = get_temporary_directory() / fs::unique_path("freelan-benchmark-crl-%%%%-%%%%");
+		const fs::path crl_file = directory / "crl.der";
+		fs::create_directories(directory);
+
+		os << "Checking the revocation status of a certificate " << iterations << " time(s) per revocation list size." << std::endl;
+		os << std::setw(10) << "entries" << std::setw(12) << "parse ms" << std::setw(12) << "index ms" << std::setw(12) << "cached ms" << std::setw(16) << "store us/check" << std::setw(16) << "index us/check" << std::endl;
+
+		const unsigned int sizes[] = { 1000, 10000, 100000, 400000 };
+
+		for (std::size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+		{
+			const crl_type crl = generate_crl(ca.raw(), ca_key, sizes[i]);
+			const std::string der = to_der(crl);
+
+			write_file(crl_file, der);
+
+			const double parse_duration = measure_once(boost::bind(&parse_der, boost::cref(der)));
+
+			// The first load builds and saves the index, the second one reads it back.
+			certificate_revocation_index index(std::vector<cert_type>(1, ca));
+			const double index_duration = measure_once(boost::bind(&add_crl_file, boost::ref(index), crl_file, directory));
+
+			certificate_revocation_index cached_index(std::vector<cert_type>(1, ca));
+			const double cached_duration = measure_once(boost::bind(&add_crl_file, boost::ref(cached_index), crl_file, directory));
+
+			X509_STORE* const store = X509_STORE_new();
+			X509_STORE_add_cert(store, ca.raw());
+			X509_STORE_add_crl(store, crl.raw());
+			X509_STORE_set_flags(store, X509_V_FLAG_CRL_CHECK);
+
+			double store_duration = 0.0;
+
+			try
+			{
+				store_duration = measure(store_revocation_check(store, cert), iterations);
+			}
+			catch (...)
+			{
+				X509_STORE_free(store);
+
+				throw;
+			}
+
+			X509_STORE_free(store);
+
+			const double index_check_duration = measure(index_revocation_check(cached_index, cert), iterations);
+
+			os << std::fixed << std::setprecision(1) << std::setw(10) << sizes[i] << std::setw(12) << parse_duration << std::setw(12) << index_duration << std::setw(12) << cached_duration << std::setw(16) << store_duration << std::setprecision(3) << std::setw(16) << index_check_duration << std::endl;
+		}
+
+		boost::system::error_code ec;
+		fs::remove_all(directory, ec);
+	}
+	catch (...)
+	{
+		EVP_PKEY_free(key);
+		EVP_PKEY_free(ca_key);
+
+		throw;
+	}
+
+	EVP_PKEY_free(key);
+	EVP_PKEY_free(ca_key);
+}
+
+void benchmark_configuration(std::ostream& os, unsigned int iterations)
+{
+	static const unsigned int contact_count = 200;
+	static const unsigned int revoked_count = 100000;
+
+	EVP_PKEY* const ca_key = generate_key();
+	EVP_PKEY* const key = generate_key();
+
+	try
+	{
+		const cert_type ca = generate_certificate("freelan benchmark authority", 1, ca_key, NULL, ca_key);
+		const cert_type cert = generate_certificate("freelan benchmark host", 1001, key, ca.raw(), ca_key);
+
+		const fs::path directory = get_temporary_directory() / fs::unique_path("freelan-benchmark-config-%%%%-%%%%");
+		const fs::path configuration_file = directory / "freelan.cfg";
+		const fs::path snapshot_file = directory / "freelan.snapshot";
+		fs::create_directories(directory / "index");
+
+		write_file(directory / "ca.crt", to_pem(ca.raw(), &PEM_write_bio_X509));
+		write_file(directory / "host.crt", to_pem(cert.raw(), &PEM_write_bio_X509));
+		write_file(directory / "host.key", to_pem(key, &write_private_key));
+		write_file(directory / "crl.pem", to_pem(generate_crl(ca.raw(), ca_key, revoked_count).raw(), &PEM_write_bio_X509_CRL));
+
+		std::ostringstream configuration;
+
+		configuration << "[fscp]" << std::endl;
+
+		for (unsigned int i = 0; i < contact_count; ++i)
+		{
+			const std::string filename = "contact" + boost::lexical_cast<std::string>(i) + ".crt";
+
+			// The contacts share the host key: only their certificates matter here.
+			write_file(directory / filename, to_pem(generate_certificate(("freelan benchmark contact " + boost::lexical_cast<std::string>(i)).c_str(), 2000 + 2 * i + 1, key, ca.raw(), ca_key).raw(), &PEM_write_bio_X509));
+
+			configuration << "dynamic_contact_file=" << filename << std::endl;
+		}
+
+		configuration << "[security]" << std::endl;
+		configuration << "signature_certificate_file=host.crt" << std::endl;
+		configuration << "signature_private_key_file=host.key" << std::endl;
+		configuration << "authority_certificate_file=ca.crt" << std::endl;
+		configuration << "certificate_revocation_list_file=crl.pem" << std::endl;
+		configuration << "certificate_revocation_index=yes" << std::endl;
+		configuration << "certificate_revocation_index_directory=index" << std::endl;
+
+		write_file(configuration_file, configuration.str());
+
+		os << "Starting " << iterations << " time(s) from a configuration with " << contact_count << " dynamic contacts and a certificate revocation list of " << revoked_count << " entries." << std::endl;
+
+		// The first startup builds the certificate revocation list index cache: it does not count.
+		measure_once(text_startup(configuration_file));
+
+		const double compile_duration = measure_once(boost::bind(&compile_configuration, configuration_file, snapshot_file));
+		const double text_duration = measure(text_startup(configuration_file), iterations) / 1000.0;
+		const double snapshot_duration = measure(snapshot_startup(snapshot_file), iterations) / 1000.0;
+
+		os << std::setw(24) << std::left << "source" << std::right << std::setw(16) << "ms/startup" << std::endl;
+		os << std::fixed << std::setprecision(1);
+		os << std::setw(24) << std::left << "configuration file" << std::right << std::setw(16) << text_duration << std::endl;
+		os << std::setw(24) << std::left << "configuration snapshot" << std::right << std::setw(16) << snapshot_duration << std::endl;
+		os << "Compiling the snapshot took " << compile_duration << " ms. Its size is " << fs::file_size(snapshot_file) << " bytes." << std::endl;
+
+		boost::system::error_code ec;
+		fs::remove_all(directory, ec);
+	}
+	catch (...)
+	{
+		EVP_PKEY_free(key);
+		EVP_PKEY_free(ca_key);
+
+		throw;
+	}
+
+	EVP_PKEY_free(key);
+	EVP_PKEY_free(ca_key);
+}
+
+void benchmark_prefix_table(std::ostream& os, unsigned int iterations)
+{
+	static const std::size_t address_count = 1024;
+
+	random_generator random;
+	std::vector<boost::asio::ip::address_v4> addresses;
+
+	for (std::size_t i = 0; i < address_count; ++i)
+	{
+		addresses.push_back(boost::asio::ip::address_v4(random()));
+	}
+
+	os << "Looking up " << address_count << " random IPv4 addresses " << iterations << " time(s) per network list size." << std::endl;
+	os << std::setw(10) << "networks" << std::setw(12) << "build ms" << std::setw(16) << "list ns/lookup" << std::setw(16) << "table ns/lookup" << std::endl;
+
+	const unsigned int sizes[] = { 10, 100, 1000, 10000, 100000 };
+
+	for (std::size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+	{
+		// Prefixes between /16 and /32, so that most addresses match nothing and the list is scanned completely.
+		std::vector<fl::ipv4_network_address> networks;
+
+		for (unsigned int j = 0; j < sizes[i]; ++j)
+		{
+			networks.push_back(fl::ipv4_network_address(boost::asio::ip::address_v4(random()), 16 + random() % 17));
+		}
+
+		ip_prefix_table<bool> table;
+
+		const boost::uint64_t start = get_monotonic_time();
+
+		BOOST_FOREACH(const fl::ipv4_network_address& network, networks)
+		{
+			table.insert(network, true);
+		}
+
+		const double build_duration = static_cast<double>(get_monotonic_time() - start) / 1000000.0;
+
+		// measure() gives microseconds per call, and a call looks up every address.
+		const double list_duration = measure(network_list_lookup(networks, addresses), iterations) * 1000.0 / address_count;
+		const double table_duration = measure(prefix_table_lookup(table, addresses), iterations) * 1000.0 / address_count;
+
+		os << std::fixed << std::setprecision(1) << std::setw(10) << sizes[i] << std::setw(12) << build_duration << std::setw(16) << list_duration << std::setw(16) << table_duration << std::endl;
+	}
+}
+
+void benchmark_ciphers(std::ostream& os, unsigned int iterations)
+{
+	const unsigned int packet_count = std::max(iterations, 1u) * 1000;
+	const std::vector<fscp::cipher_algorithm_type> cipher_algorithms = get_supported_cipher_algorithms();
+
+	os << "Sealing " << packet_count << " packet(s) per cipher algorithm and packet size." << std::endl;
+	os << std::setw(20) << std::left << "cipher" << std::right << std::setw(10) << "bytes" << std::setw(12) << "MB/s" << std::setw(14) << "ns/packet" << std::endl;
+
+	const std::size_t sizes[] = { 64, 512, 1500 };
+
+	BOOST_FOREACH(const fscp::cipher_algorithm_type& cipher_algorithm, cipher_algorithms)
+	{
+		for (std::size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+		{
+			// Warm up.
+			measure_cipher_algorithm(cipher_algorithm, sizes[i], packet_count / 10);
+
+			const double duration = measure_cipher_algorithm(cipher_algorithm, sizes[i], packet_count);
+
+			os << std::setw(20) << std::left << boost::lexical_cast<std::string>(cipher_algorithm) << std::right << std::fixed << std::setprecision(1) << std::setw(10) << sizes[i] << std::setw(12) << (sizes[i] * 1000.0 / duration) << std::setw(14) << duration << std::endl;
+		}
+	}
+
+	if (!cipher_algorithms.empty())
+	{
+		os << "Order used by fscp.cipher_capability=auto:";
+
+		BOOST_FOREACH(const fscp::cipher_algorithm_type& cipher_algorithm, sort_cipher_algorithms_by_speed(cipher_algorithms, 1500))
+		{
+			os << " " << cipher_algorithm;
+		}
+
+		os << std::endl;
+	}
+}
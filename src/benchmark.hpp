@@ -0,0 +1,123 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file benchmark.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Micro-benchmarks.
+ */
+
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <iostream>
+
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include <freelan/configuration.hpp>
+
+#include "configuration_types.hpp"
+
+#ifndef WINDOWS
+/**
+ * \brief Measure the script launch latency as a function of the open files limit.
+ * \param os The stream to write the results to.
+ * \param script The script to launch. It is called without any parameter.
+ * \param iterations The number of launches for each limit.
+ *
+ * The current launcher is compared to the former fork() and close-all loop.
+ */
+void benchmark_spawn(std::ostream& os, const boost::filesystem::path& script, unsigned int iterations);
+
+/**
+ * \brief Measure the certificate validation throughput of the script, helper and plugin modes.
+ * \param os The stream to write the results to.
+ * \param cert The certificate to validate.
+ * \param script The certificate validation script. Skipped if empty.
+ * \param script_input How to hand the certificate to the script.
+ * \param helper The certificate validation helper. Skipped if empty.
+ * \param plugin The certificate validation plugin. Skipped if empty.
+ * \param plugin_argument The argument to initialize the plugin with.
+ * \param iterations The number of validations for each mode.
+ *
+ * The validations are sequential: this measures the latency of each mode.
+ */
+void benchmark_validation(std::ostream& os, freelan::security_configuration::cert_type cert, const boost::filesystem::path& script, script_input_type script_input, const boost::filesystem::path& helper, const boost::filesystem::path& plugin, const std::string& plugin_argument, unsigned int iterations);
+#endif
+
+/**
+ * \brief Measure the certificate revocation check latency as a function of the certificate revocation list size.
+ * \param os The stream to write the results to.
+ * \param iterations The number of checks for each size.
+ *
+ * The certificate revocation lists are generated. The complete chain verification the core does is compared to the certificate revocation index.
+ */
+void benchmark_crl(std::ostream& os, unsigned int iterations);
+
+/**
+ * \brief Measure the startup latency from a configuration file and from a configuration snapshot.
+ * \param os The stream to write the results to.
+ * \param iterations The number of startups for each source.
+ *
+ * The configuration, its certificates and its certificate revocation list are generated. A startup stops where the core would be created.
+ */
+void benchmark_configuration(std::ostream& os, unsigned int iterations);
+
+/**
+ * \brief Measure the network address lookup latency as a function of the number of networks.
+ * \param os The stream to write the results to.
+ * \param iterations The number of lookup rounds for each size.
+ *
+ * The networks and addresses are generated. The linear scan the core does on fscp.never_contact is compared to an ip_prefix_table.
+ */
+void benchmark_prefix_table(std::ostream& os, unsigned int iterations);
+
+/**
+ * \brief Measure the throughput of the supported cipher algorithms.
+ * \param os The stream to write the results to.
+ * \param iterations The number of packets to seal for each cipher algorithm and packet size, in thousands.
+ *
+ * Packets of 64, 512 and 1500 bytes are sealed the way a session does it.
+ */
+void benchmark_ciphers(std::ostream& os, unsigned int iterations);
+
+#endif /* BENCHMARK_HPP */
@@ -0,0 +1,741 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file certificate_revocation_index.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An index of the revoked certificates.
+ */
+
+#include "certificate_revocation_index.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <sstream>
+
+#include <boost/cstdint.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/err.h>
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+	const char INDEX_MAGIC[8] = { 'F', 'L', 'C', 'R', 'L', 'I', 'D', 'X' };
+	const boost::uint32_t INDEX_VERSION = 1;
+
+	// Certificate chains are never that long: this only protects against loops.
+	const unsigned int MAX_CHAIN_DEPTH = 32;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	const ASN1_TIME* get_last_update(X509_CRL* crl)
+	{
+		return X509_CRL_get0_lastUpdate(crl);
+	}
+
+	const ASN1_TIME* get_next_update(X509_CRL* crl)
+	{
+		return X509_CRL_get0_nextUpdate(crl);
+	}
+
+	const ASN1_INTEGER* get_revoked_serial(X509_REVOKED* revoked)
+	{
+		return X509_REVOKED_get0_serialNumber(revoked);
+	}
+
+	const unsigned char* get_data(const ASN1_STRING* str)
+	{
+		return ASN1_STRING_get0_data(str);
+	}
+#else
+	const ASN1_TIME* get_last_update(X509_CRL* crl)
+	{
+		return X509_CRL_get_lastUpdate(crl);
+	}
+
+	const ASN1_TIME* get_next_update(X509_CRL* crl)
+	{
+		return X509_CRL_get_nextUpdate(crl);
+	}
+
+	const ASN1_INTEGER* get_revoked_serial(X509_REVOKED* revoked)
+	{
+		return revoked->serialNumber;
+	}
+
+	const unsigned char* get_data(const ASN1_STRING* str)
+	{
+		return ASN1_STRING_data(const_cast<ASN1_STRING*>(str));
+	}
+#endif
+
+	std::time_t to_time_t(const ASN1_TIME* time)
+	{
+		if (!time)
+		{
+			return 0;
+		}
+
+		ASN1_TIME* epoch = ASN1_TIME_set(NULL, 0);
+		int days = 0;
+		int seconds = 0;
+
+		const int result = ASN1_TIME_diff(&days, &seconds, epoch, time);
+
+		ASN1_TIME_free(epoch);
+
+		if (!result)
+		{
+			throw std::runtime_error("Invalid time in the certificate revocation list");
+		}
+
+		return static_cast<std::time_t>(days) * 86400 + seconds;
+	}
+
+	template <typename DigestType>
+	DigestType sha256(const std::string& data)
+	{
+		DigestType digest;
+		unsigned int length = static_cast<unsigned int>(digest.size());
+
+		if (!EVP_Digest(data.data(), data.size(), digest.c_array(), &length, EVP_sha256(), NULL) || (length != digest.size()))
+		{
+			throw std::runtime_error("Unable to compute a digest");
+		}
+
+		return digest;
+	}
+
+	template <typename DigestType>
+	std::string to_hex(const DigestType& digest)
+	{
+		static const char digits[] = "0123456789abcdef";
+
+		std::string result;
+		result.reserve(digest.size() * 2);
+
+		for (typename DigestType::const_iterator it = digest.begin(); it != digest.end(); ++it)
+		{
+			result.push_back(digits[*it >> 4]);
+			result.push_back(digits[*it & 0x0f]);
+		}
+
+		return result;
+	}
+
+	std::string read_file(const fs::path& filename)
+	{
+		fs::basic_ifstream<char> ifs(filename, std::ios::binary);
+
+		if (!ifs)
+		{
+			throw std::runtime_error("No such file: " + filename.string());
+		}
+
+		const std::string result((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+		if (ifs.bad())
+		{
+			throw std::runtime_error("Unable to read: " + filename.string());
+		}
+
+		return result;
+	}
+
+	freelan::security_configuration::crl_type parse_crl(const std::string& content)
+	{
+		BIO* bio = BIO_new_mem_buf(const_cast<char*>(content.data()), static_cast<int>(content.size()));
+
+		if (!bio)
+		{
+			throw std::bad_alloc();
+		}
+
+		X509_CRL* crl = PEM_read_bio_X509_CRL(bio, NULL, NULL, NULL);
+
+		BIO_free(bio);
+
+		if (!crl)
+		{
+			ERR_clear_error();
+
+			const unsigned char* data = reinterpret_cast<const unsigned char*>(content.data());
+
+			crl = d2i_X509_CRL(NULL, &data, static_cast<long>(content.size()));
+		}
+
+		if (!crl)
+		{
+			ERR_clear_error();
+
+			throw std::runtime_error("Unable to parse the certificate revocation list");
+		}
+
+		return freelan::security_configuration::crl_type::take_ownership(crl);
+	}
+
+	void write_uint(std::ostream& os, boost::uint64_t value, unsigned int size)
+	{
+		for (unsigned int i = size; i > 0; --i)
+		{
+			os.put(static_cast<char>((value >> (8 * (i - 1))) & 0xff));
+		}
+	}
+
+	boost::uint64_t read_uint(std::istream& is, unsigned int size)
+	{
+		boost::uint64_t value = 0;
+
+		for (unsigned int i = 0; i < size; ++i)
+		{
+			value = (value << 8) | static_cast<unsigned char>(is.get());
+		}
+
+		return value;
+	}
+
+	class memory_reader
+	{
+		public:
+
+			memory_reader(const char* data, std::size_t size) :
+				m_data(data),
+				m_end(data + size)
+			{
+			}
+
+			const char* read(boost::uint64_t size)
+			{
+				if (size > static_cast<boost::uint64_t>(m_end - m_data))
+				{
+					throw std::runtime_error("Truncated certificate revocation index");
+				}
+
+				const char* const result = m_data;
+				m_data += size;
+
+				return result;
+			}
+
+			boost::uint64_t read_uint(unsigned int size)
+			{
+				const unsigned char* const data = reinterpret_cast<const unsigned char*>(read(size));
+
+				boost::uint64_t value = 0;
+
+				for (unsigned int i = 0; i < size; ++i)
+				{
+					value = (value << 8) | data[i];
+				}
+
+				return value;
+			}
+
+			std::string read_string(boost::uint64_t size)
+			{
+				const char* const data = read(size);
+
+				return std::string(data, static_cast<std::size_t>(size));
+			}
+
+		private:
+
+			const char* m_data;
+			const char* const m_end;
+	};
+}
+
+certificate_revocation_index::certificate_revocation_index(const std::vector<cert_type>& authorities)
+{
+	for (std::vector<cert_type>::const_iterator authority = authorities.begin(); authority != authorities.end(); ++authority)
+	{
+		m_authorities.insert(std::make_pair(get_name(X509_get_subject_name(authority->raw())), *authority));
+	}
+}
+
+void certificate_revocation_index::add(crl_type crl)
+{
+	std::string issuer_name;
+	digest_type issuer_digest;
+	const boost::shared_ptr<issuer_entry> entry = boost::make_shared<issuer_entry>();
+
+	build_entry(crl, issuer_name, issuer_digest, *entry);
+	add_entry(issuer_name, entry);
+}
+
+void certificate_revocation_index::add_file(const fs::path& filename, const fs::path& cache_directory)
+{
+	const std::string content = read_file(filename);
+	const digest_type crl_digest = sha256<digest_type>(content);
+
+	std::string issuer_name;
+	const boost::shared_ptr<issuer_entry> entry = boost::make_shared<issuer_entry>();
+	fs::path cache_file;
+
+	if (!cache_directory.empty())
+	{
+		cache_file = cache_directory / (to_hex(sha256<digest_type>(fs::absolute(filename).string())) + ".idx");
+
+		if (load(cache_file, crl_digest, issuer_name, *entry))
+		{
+			entry->filename = filename;
+			add_entry(issuer_name, entry);
+
+			return;
+		}
+	}
+
+	digest_type issuer_digest;
+
+	build_entry(parse_crl(content), issuer_name, issuer_digest, *entry);
+
+	if (!cache_file.empty())
+	{
+		save(cache_file, crl_digest, issuer_name, issuer_digest, *entry);
+	}
+
+	entry->filename = filename;
+	add_entry(issuer_name, entry);
+}
+
+void certificate_revocation_index::remove_file(const fs::path& filename)
+{
+	for (issuer_map::iterator issuer = m_issuers.begin(); issuer != m_issuers.end();)
+	{
+		issuer_entry_list& entries = issuer->second;
+
+		for (issuer_entry_list::iterator entry = entries.begin(); entry != entries.end();)
+		{
+			entry = ((*entry)->filename == filename) ? entries.erase(entry) : entry + 1;
+		}
+
+		if (entries.empty())
+		{
+			m_issuers.erase(issuer++);
+		}
+		else
+		{
+			++issuer;
+		}
+	}
+}
+
+void certificate_revocation_index::write(std::string& buffer) const
+{
+	std::ostringstream oss;
+
+	write_uint(oss, m_issuers.size(), 4);
+
+	for (issuer_map::const_iterator issuer = m_issuers.begin(); issuer != m_issuers.end(); ++issuer)
+	{
+		write_uint(oss, issuer->first.size(), 4);
+		oss.write(issuer->first.data(), issuer->first.size());
+		write_uint(oss, issuer->second.size(), 4);
+
+		for (issuer_entry_list::const_iterator it = issuer->second.begin(); it != issuer->second.end(); ++it)
+		{
+			const issuer_entry& entry = **it;
+			const std::string filename = entry.filename.string();
+
+			write_uint(oss, filename.size(), 4);
+			oss.write(filename.data(), filename.size());
+			write_uint(oss, static_cast<boost::uint64_t>(static_cast<boost::int64_t>(entry.this_update)), 8);
+			write_uint(oss, static_cast<boost::uint64_t>(static_cast<boost::int64_t>(entry.next_update)), 8);
+			write_uint(oss, entry.serials.size(), 4);
+
+			if (!entry.serials.empty())
+			{
+				oss.write(reinterpret_cast<const char*>(entry.serials[0].data()), entry.serials.size() * sizeof(serial_type));
+			}
+		}
+	}
+
+	buffer += oss.str();
+}
+
+void certificate_revocation_index::read(const char* data, std::size_t size)
+{
+	memory_reader reader(data, size);
+
+	issuer_map issuers;
+
+	for (boost::uint64_t issuer_count = reader.read_uint(4); issuer_count > 0; --issuer_count)
+	{
+		issuer_entry_list& entries = issuers[reader.read_string(reader.read_uint(4))];
+
+		for (boost::uint64_t entry_count = reader.read_uint(4); entry_count > 0; --entry_count)
+		{
+			const boost::shared_ptr<issuer_entry> entry = boost::make_shared<issuer_entry>();
+
+			entry->filename = reader.read_string(reader.read_uint(4));
+			entry->this_update = static_cast<std::time_t>(static_cast<boost::int64_t>(reader.read_uint(8)));
+			entry->next_update = static_cast<std::time_t>(static_cast<boost::int64_t>(reader.read_uint(8)));
+
+			const boost::uint64_t count = reader.read_uint(4);
+			const char* const serials = reader.read(count * sizeof(serial_type));
+
+			entry->serials.resize(static_cast<std::size_t>(count));
+
+			if (count > 0)
+			{
+				std::memcpy(entry->serials[0].c_array(), serials, count * sizeof(serial_type));
+			}
+
+			entries.push_back(entry);
+		}
+	}
+
+	// Only add the lists once they were all read.
+	for (issuer_map::const_iterator issuer = issuers.begin(); issuer != issuers.end(); ++issuer)
+	{
+		for (issuer_entry_list::const_iterator entry = issuer->second.begin(); entry != issuer->second.end(); ++entry)
+		{
+			add_entry(issuer->first, *entry);
+		}
+	}
+}
+
+certificate_revocation_index::status_type certificate_revocation_index::check(cert_type cert) const
+{
+	const issuer_map::const_iterator issuer = m_issuers.find(get_name(X509_get_issuer_name(cert.raw())));
+
+	if (issuer == m_issuers.end())
+	{
+		return RS_NO_CRL;
+	}
+
+	// Most of the time, there is only one list per issuer.
+	const issuer_entry* entry = issuer->second.front().get();
+
+	for (issuer_entry_list::const_iterator it = issuer->second.begin(); it != issuer->second.end(); ++it)
+	{
+		if ((*it)->this_update > entry->this_update)
+		{
+			entry = it->get();
+		}
+	}
+
+	if ((entry->next_update != 0) && (entry->next_update < std::time(NULL)))
+	{
+		return RS_CRL_EXPIRED;
+	}
+
+	if (std::binary_search(entry->serials.begin(), entry->serials.end(), get_serial(X509_get_serialNumber(cert.raw()))))
+	{
+		return RS_REVOKED;
+	}
+
+	return RS_GOOD;
+}
+
+certificate_revocation_index::status_type certificate_revocation_index::check_chain(cert_type cert) const
+{
+	for (unsigned int depth = 0; cert && (depth < MAX_CHAIN_DEPTH); ++depth)
+	{
+		const std::string issuer_name = get_name(X509_get_issuer_name(cert.raw()));
+
+		// The trust anchor is not checked.
+		if (issuer_name == get_name(X509_get_subject_name(cert.raw())))
+		{
+			break;
+		}
+
+		const status_type status = check(cert);
+
+		if (status != RS_GOOD)
+		{
+			return status;
+		}
+
+		cert = find_authority(issuer_name);
+	}
+
+	return RS_GOOD;
+}
+
+std::size_t certificate_revocation_index::size() const
+{
+	std::size_t result = 0;
+
+	for (issuer_map::const_iterator issuer = m_issuers.begin(); issuer != m_issuers.end(); ++issuer)
+	{
+		for (issuer_entry_list::const_iterator entry = issuer->second.begin(); entry != issuer->second.end(); ++entry)
+		{
+			result += (*entry)->serials.size();
+		}
+	}
+
+	return result;
+}
+
+std::string certificate_revocation_index::get_name(X509_NAME* name)
+{
+	const int length = i2d_X509_NAME(name, NULL);
+
+	if (length < 0)
+	{
+		throw std::runtime_error("Unable to encode a name");
+	}
+
+	std::string result(static_cast<std::size_t>(length), '\0');
+	unsigned char* data = reinterpret_cast<unsigned char*>(&result[0]);
+
+	i2d_X509_NAME(name, &data);
+
+	return result;
+}
+
+certificate_revocation_index::serial_type certificate_revocation_index::get_serial(const ASN1_INTEGER* serial)
+{
+	serial_type result;
+	result.assign(0);
+
+	const int length = ASN1_STRING_length(const_cast<ASN1_INTEGER*>(serial));
+
+	if ((length < 0) || (static_cast<std::size_t>(length) >= result.size()))
+	{
+		throw std::runtime_error("Unsupported serial number length");
+	}
+
+	result[0] = static_cast<unsigned char>(length) | ((ASN1_STRING_type(const_cast<ASN1_INTEGER*>(serial)) == V_ASN1_NEG_INTEGER) ? 0x80 : 0x00);
+	std::memcpy(result.c_array() + 1, get_data(serial), length);
+
+	return result;
+}
+
+certificate_revocation_index::digest_type certificate_revocation_index::get_digest(cert_type cert)
+{
+	digest_type digest;
+	unsigned int length = static_cast<unsigned int>(digest.size());
+
+	if (!X509_digest(cert.raw(), EVP_sha256(), digest.c_array(), &length) || (length != digest.size()))
+	{
+		throw std::runtime_error("Unable to compute the certificate fingerprint");
+	}
+
+	return digest;
+}
+
+certificate_revocation_index::cert_type certificate_revocation_index::find_authority(const std::string& name) const
+{
+	// When several authorities share a name, the first one is used to walk the chain.
+	const authority_map::const_iterator authority = m_authorities.find(name);
+
+	return (authority != m_authorities.end()) ? authority->second : cert_type();
+}
+
+void certificate_revocation_index::build_entry(crl_type crl, std::string& issuer_name, digest_type& issuer_digest, issuer_entry& entry) const
+{
+	X509_CRL* const raw_crl = crl.raw();
+
+	issuer_name = get_name(X509_CRL_get_issuer(raw_crl));
+
+	bool verified = false;
+
+	for (authority_map::const_iterator authority = m_authorities.lower_bound(issuer_name); !verified && (authority != m_authorities.upper_bound(issuer_name)); ++authority)
+	{
+		EVP_PKEY* const key = X509_get_pubkey(authority->second.raw());
+
+		if (key)
+		{
+			verified = (X509_CRL_verify(raw_crl, key) == 1);
+
+			EVP_PKEY_free(key);
+		}
+
+		if (verified)
+		{
+			issuer_digest = get_digest(authority->second);
+		}
+	}
+
+	ERR_clear_error();
+
+	if (!verified)
+	{
+		throw std::runtime_error("The certificate revocation list is not signed by any of the authority certificates");
+	}
+
+	entry.this_update = to_time_t(get_last_update(raw_crl));
+	entry.next_update = to_time_t(get_next_update(raw_crl));
+	entry.serials.clear();
+
+	STACK_OF(X509_REVOKED)* const revoked = X509_CRL_get_REVOKED(raw_crl);
+	const int count = revoked ? sk_X509_REVOKED_num(revoked) : 0;
+
+	entry.serials.reserve(count);
+
+	for (int i = 0; i < count; ++i)
+	{
+		entry.serials.push_back(get_serial(get_revoked_serial(sk_X509_REVOKED_value(revoked, i))));
+	}
+
+	std::sort(entry.serials.begin(), entry.serials.end());
+	entry.serials.erase(std::unique(entry.serials.begin(), entry.serials.end()), entry.serials.end());
+}
+
+void certificate_revocation_index::add_entry(const std::string& issuer_name, boost::shared_ptr<const issuer_entry> entry)
+{
+	m_issuers[issuer_name].push_back(entry);
+}
+
+bool certificate_revocation_index::load(const fs::path& filename, const digest_type& crl_digest, std::string& issuer_name, issuer_entry& entry) const
+{
+	boost::system::error_code ec;
+	const boost::uintmax_t file_size = fs::file_size(filename, ec);
+
+	if (ec)
+	{
+		return false;
+	}
+
+	fs::basic_ifstream<char> ifs(filename, std::ios::binary);
+
+	char magic[sizeof(INDEX_MAGIC)];
+
+	if (!ifs.read(magic, sizeof(magic)) || (std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0) || (read_uint(ifs, 4) != INDEX_VERSION))
+	{
+		return false;
+	}
+
+	digest_type saved_crl_digest;
+	digest_type saved_issuer_digest;
+
+	ifs.read(reinterpret_cast<char*>(saved_crl_digest.c_array()), saved_crl_digest.size());
+	ifs.read(reinterpret_cast<char*>(saved_issuer_digest.c_array()), saved_issuer_digest.size());
+
+	if (!ifs || (saved_crl_digest != crl_digest))
+	{
+		return false;
+	}
+
+	entry.this_update = static_cast<std::time_t>(static_cast<boost::int64_t>(read_uint(ifs, 8)));
+	entry.next_update = static_cast<std::time_t>(static_cast<boost::int64_t>(read_uint(ifs, 8)));
+
+	const boost::uint64_t name_length = read_uint(ifs, 4);
+
+	if (!ifs || (name_length > file_size))
+	{
+		return false;
+	}
+
+	issuer_name.resize(static_cast<std::size_t>(name_length));
+
+	if (!ifs.read(&issuer_name[0], issuer_name.size()))
+	{
+		return false;
+	}
+
+	// The list may be unchanged while its issuer certificate was replaced.
+	bool issuer_found = false;
+
+	for (authority_map::const_iterator authority = m_authorities.lower_bound(issuer_name); !issuer_found && (authority != m_authorities.upper_bound(issuer_name)); ++authority)
+	{
+		issuer_found = (get_digest(authority->second) == saved_issuer_digest);
+	}
+
+	if (!issuer_found)
+	{
+		return false;
+	}
+
+	const boost::uint64_t count = read_uint(ifs, 4);
+
+	if (!ifs || (count * sizeof(serial_type) > file_size))
+	{
+		return false;
+	}
+
+	entry.serials.resize(static_cast<std::size_t>(count));
+
+	if ((count > 0) && !ifs.read(reinterpret_cast<char*>(entry.serials[0].c_array()), count * sizeof(serial_type)))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+void certificate_revocation_index::save(const fs::path& filename, const digest_type& crl_digest, const std::string& issuer_name, const digest_type& issuer_digest, const issuer_entry& entry) const
+{
+	// Readers must never see a partially written index.
+	const fs::path temporary_filename = filename.string() + ".tmp";
+
+	{
+		fs::basic_ofstream<char> ofs(temporary_filename, std::ios::binary | std::ios::trunc);
+
+		ofs.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+		write_uint(ofs, INDEX_VERSION, 4);
+		ofs.write(reinterpret_cast<const char*>(crl_digest.data()), crl_digest.size());
+		ofs.write(reinterpret_cast<const char*>(issuer_digest.data()), issuer_digest.size());
+		write_uint(ofs, static_cast<boost::uint64_t>(static_cast<boost::int64_t>(entry.this_update)), 8);
+		write_uint(ofs, static_cast<boost::uint64_t>(static_cast<boost::int64_t>(entry.next_update)), 8);
+		write_uint(ofs, issuer_name.size(), 4);
+		ofs.write(issuer_name.data(), issuer_name.size());
+		write_uint(ofs, entry.serials.size(), 4);
+
+		if (!entry.serials.empty())
+		{
+			ofs.write(reinterpret_cast<const char*>(entry.serials[0].data()), entry.serials.size() * sizeof(serial_type));
+		}
+
+		if (!ofs)
+		{
+			// The saved index is only an optimization: the next start will parse the list again.
+			boost::system::error_code ec;
+			fs::remove(temporary_filename, ec);
+
+			return;
+		}
+	}
+
+	boost::system::error_code ec;
+	fs::rename(temporary_filename, filename, ec);
+
+	if (ec)
+	{
+		fs::remove(temporary_filename, ec);
+	}
+}
@@ -0,0 +1,208 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file certificate_revocation_index.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An index of the revoked certificates.
+ */
+
+#ifndef CERTIFICATE_REVOCATION_INDEX_HPP
+#define CERTIFICATE_REVOCATION_INDEX_HPP
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/array.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <openssl/x509.h>
+
+#include <freelan/configuration.hpp>
+
+/**
+ * \brief An index of the revoked certificates.
+ *
+ * The serial numbers of the certificate revocation lists are kept sorted, by
+ * issuer, so that checking a certificate does not depend on the size of the
+ * lists. The signature of each list is verified against the authority
+ * certificates when it is added.
+ *
+ * The index of each list can be saved to a cache directory: the list is then
+ * only parsed again when its file or its issuer certificate change.
+ *
+ * Once built, an index is read-only and can be used from several threads.
+ * Copying an index is cheap, as the lists are shared: to update an index
+ * that is in use, copy it, replace the lists that changed in the copy and
+ * swap the copy in.
+ */
+class certificate_revocation_index
+{
+	public:
+
+		/**
+		 * \brief The certificate type.
+		 */
+		typedef freelan::security_configuration::cert_type cert_type;
+
+		/**
+		 * \brief The certificate revocation list type.
+		 */
+		typedef freelan::security_configuration::crl_type crl_type;
+
+		/**
+		 * \brief The revocation status type.
+		 */
+		enum status_type
+		{
+			RS_GOOD, /**< \brief The certificate is not revoked. */
+			RS_REVOKED, /**< \brief The certificate is revoked. */
+			RS_NO_CRL, /**< \brief There is no certificate revocation list for the issuer of the certificate. */
+			RS_CRL_EXPIRED /**< \brief The certificate revocation list for the issuer of the certificate has expired. */
+		};
+
+		/**
+		 * \brief Create an empty index.
+		 * \param authorities The authority certificates, used to verify the certificate revocation lists and to walk the certificate chains.
+		 */
+		explicit certificate_revocation_index(const std::vector<cert_type>& authorities);
+
+		/**
+		 * \brief Add a certificate revocation list.
+		 * \param crl The certificate revocation list.
+		 *
+		 * If the index has several lists for the same issuer, the most recent one is used.
+		 *
+		 * On error, a std::runtime_error is thrown.
+		 */
+		void add(crl_type crl);
+
+		/**
+		 * \brief Add a certificate revocation list file.
+		 * \param filename The certificate revocation list file, in PEM or DER format.
+		 * \param cache_directory The directory to read and write the saved index from. If empty, the file is always parsed.
+		 *
+		 * On error, a std::runtime_error is thrown.
+		 */
+		void add_file(const boost::filesystem::path& filename, const boost::filesystem::path& cache_directory = boost::filesystem::path());
+
+		/**
+		 * \brief Remove the certificate revocation list added from a file.
+		 * \param filename The certificate revocation list file, as given to add_file().
+		 */
+		void remove_file(const boost::filesystem::path& filename);
+
+		/**
+		 * \brief Write the indexed lists.
+		 * \param buffer The buffer to append the indexed lists to.
+		 *
+		 * The indexed lists can be added to another index with read().
+		 */
+		void write(std::string& buffer) const;
+
+		/**
+		 * \brief Add indexed lists, as written by write().
+		 * \param data The indexed lists.
+		 * \param size The size of data.
+		 *
+		 * The signatures of the lists are not verified again: data must come from a trusted source.
+		 *
+		 * On error, a std::runtime_error is thrown.
+		 */
+		void read(const char* data, std::size_t size);
+
+		/**
+		 * \brief Check a certificate.
+		 * \param cert The certificate.
+		 * \return The revocation status of the certificate.
+		 */
+		status_type check(cert_type cert) const;
+
+		/**
+		 * \brief Check a certificate and its issuers.
+		 * \param cert The certificate.
+		 * \return The first status that is not RS_GOOD, walking up from cert to the first self-issued authority certificate, or RS_GOOD.
+		 */
+		status_type check_chain(cert_type cert) const;
+
+		/**
+		 * \brief Get the number of revoked serial numbers.
+		 * \return The number of revoked serial numbers, for all issuers.
+		 */
+		std::size_t size() const;
+
+	private:
+
+		// A length byte, with the high bit set for negative numbers, followed by the magnitude.
+		typedef boost::array<unsigned char, 32> serial_type;
+		typedef boost::array<unsigned char, 32> digest_type;
+
+		struct issuer_entry
+		{
+			boost::filesystem::path filename;
+			std::time_t this_update;
+			std::time_t next_update;
+			std::vector<serial_type> serials;
+		};
+
+		typedef std::vector<boost::shared_ptr<const issuer_entry> > issuer_entry_list;
+
+		// By DER encoded subject or issuer name.
+		typedef std::map<std::string, issuer_entry_list> issuer_map;
+		typedef std::multimap<std::string, cert_type> authority_map;
+
+		static std::string get_name(X509_NAME* name);
+		static serial_type get_serial(const ASN1_INTEGER* serial);
+		static digest_type get_digest(cert_type cert);
+
+		cert_type find_authority(const std::string& name) const;
+		void build_entry(crl_type crl, std::string& issuer_name, digest_type& issuer_digest, issuer_entry& entry) const;
+		void add_entry(const std::string& issuer_name, boost::shared_ptr<const issuer_entry> entry);
+		bool load(const boost::filesystem::path& filename, const digest_type& crl_digest, std::string& issuer_name, issuer_entry& entry) const;
+		void save(const boost::filesystem::path& filename, const digest_type& crl_digest, const std::string& issuer_name, const digest_type& issuer_digest, const issuer_entry& entry) const;
+
+		authority_map m_authorities;
+		issuer_map m_issuers;
+};
+
+#endif /* CERTIFICATE_REVOCATION_INDEX_HPP */
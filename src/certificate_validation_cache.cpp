@@ -0,0 +1,163 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file certificate_validation_cache.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A certificate validation result cache.
+ */
+
+#include "certificate_validation_cache.hpp"
+
+#include <stdexcept>
+
+#include <openssl/x509.h>
+#include <openssl/evp.h>
+
+#include "system.hpp"
+
+certificate_validation_cache::fingerprint_type certificate_validation_cache::get_fingerprint(cert_type cert)
+{
+	fingerprint_type fingerprint;
+	unsigned int length = static_cast<unsigned int>(fingerprint.size());
+
+	if (!X509_digest(cert.raw(), EVP_sha256(), fingerprint.c_array(), &length) || (length != fingerprint.size()))
+	{
+		throw std::runtime_error("Unable to compute the certificate fingerprint");
+	}
+
+	return fingerprint;
+}
+
+certificate_validation_cache::certificate_validation_cache(std::size_t size, const boost::posix_time::time_duration& ttl) :
+	m_size(size),
+	m_ttl(ttl.is_pos_infinity() ? 0 : static_cast<boost::uint64_t>(ttl.total_microseconds()) * 1000),
+	m_hit_count(0),
+	m_miss_count(0)
+{
+}
+
+bool certificate_validation_cache::find(const fingerprint_type& fingerprint, bool& result)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	const entry_map::iterator index = m_index.find(fingerprint);
+
+	if (index != m_index.end())
+	{
+		const entry_list::iterator entry = index->second;
+
+		if ((m_ttl == 0) || (get_monotonic_time() < entry->expiration))
+		{
+			m_entries.splice(m_entries.begin(), m_entries, entry);
+			result = entry->result;
+			++m_hit_count;
+
+			return true;
+		}
+
+		m_entries.erase(entry);
+		m_index.erase(index);
+	}
+
+	++m_miss_count;
+
+	return false;
+}
+
+void certificate_validation_cache::insert(const fingerprint_type& fingerprint, bool result)
+{
+	if (m_size == 0)
+	{
+		return;
+	}
+
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	const entry_map::iterator index = m_index.find(fingerprint);
+
+	if (index != m_index.end())
+	{
+		m_entries.erase(index->second);
+		m_index.erase(index);
+	}
+	else if (m_index.size() >= m_size)
+	{
+		m_index.erase(m_entries.back().fingerprint);
+		m_entries.pop_back();
+	}
+
+	entry_type entry;
+	entry.fingerprint = fingerprint;
+	entry.result = result;
+	entry.expiration = get_monotonic_time() + m_ttl;
+
+	m_entries.push_front(entry);
+	m_index[fingerprint] = m_entries.begin();
+}
+
+void certificate_validation_cache::clear()
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	m_entries.clear();
+	m_index.clear();
+}
+
+std::size_t certificate_validation_cache::size() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	return m_index.size();
+}
+
+boost::uint64_t certificate_validation_cache::hit_count() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	return m_hit_count;
+}
+
+boost::uint64_t certificate_validation_cache::miss_count() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	return m_miss_count;
+}
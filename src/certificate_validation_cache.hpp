@@ -0,0 +1,162 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file certificate_validation_cache.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A certificate validation result cache.
+ */
+
+#ifndef CERTIFICATE_VALIDATION_CACHE_HPP
+#define CERTIFICATE_VALIDATION_CACHE_HPP
+
+#include <list>
+#include <map>
+
+#include <boost/array.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <freelan/configuration.hpp>
+
+/**
+ * \brief A certificate validation result cache.
+ *
+ * Both accepted and rejected certificates are cached, keyed by their SHA-256
+ * fingerprint. The least recently used entry is evicted when the cache is
+ * full.
+ *
+ * All methods are thread-safe.
+ */
+class certificate_validation_cache
+{
+	public:
+
+		/**
+		 * \brief The certificate type.
+		 */
+		typedef freelan::security_configuration::cert_type cert_type;
+
+		/**
+		 * \brief The fingerprint type.
+		 */
+		typedef boost::array<unsigned char, 32> fingerprint_type;
+
+		/**
+		 * \brief Get the fingerprint of a certificate.
+		 * \param cert The certificate.
+		 * \return The SHA-256 fingerprint of the DER representation of cert.
+		 */
+		static fingerprint_type get_fingerprint(cert_type cert);
+
+		/**
+		 * \brief Create a certificate validation cache.
+		 * \param size The maximum number of entries.
+		 * \param ttl The time after which an entry expires. Use boost::posix_time::pos_infin for entries that never expire.
+		 */
+		certificate_validation_cache(std::size_t size, const boost::posix_time::time_duration& ttl);
+
+		/**
+		 * \brief Look up a validation result.
+		 * \param fingerprint The certificate fingerprint.
+		 * \param result The validation result, if found.
+		 * \return true if a non-expired result was found.
+		 */
+		bool find(const fingerprint_type& fingerprint, bool& result);
+
+		/**
+		 * \brief Store a validation result.
+		 * \param fingerprint The certificate fingerprint.
+		 * \param result The validation result.
+		 */
+		void insert(const fingerprint_type& fingerprint, bool result);
+
+		/**
+		 * \brief Remove all the entries.
+		 *
+		 * Must be called whenever a validation result may have changed, for instance when the revocation lists are reloaded.
+		 */
+		void clear();
+
+		/**
+		 * \brief Get the number of entries.
+		 * \return The number of entries.
+		 */
+		std::size_t size() const;
+
+		/**
+		 * \brief Get the number of successful look-ups.
+		 * \return The number of successful look-ups.
+		 */
+		boost::uint64_t hit_count() const;
+
+		/**
+		 * \brief Get the number of failed look-ups.
+		 * \return The number of failed look-ups.
+		 */
+		boost::uint64_t miss_count() const;
+
+	private:
+
+		struct entry_type
+		{
+			fingerprint_type fingerprint;
+			bool result;
+			boost::uint64_t expiration;
+		};
+
+		typedef std::list<entry_type> entry_list;
+		typedef std::map<fingerprint_type, entry_list::iterator> entry_map;
+
+		certificate_validation_cache(const certificate_validation_cache&);
+		certificate_validation_cache& operator=(const certificate_validation_cache&);
+
+		const std::size_t m_size;
+		const boost::uint64_t m_ttl;
+		mutable boost::mutex m_mutex;
+		// Most recently used first.
+		entry_list m_entries;
+		entry_map m_index;
+		boost::uint64_t m_hit_count;
+		boost::uint64_t m_miss_count;
+};
+
+#endif /* CERTIFICATE_VALIDATION_CACHE_HPP */
@@ -0,0 +1,175 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file certificate_validation_plugin.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A certificate validation plugin.
+ */
+
+#include "certificate_validation_plugin.hpp"
+
+#include <vector>
+#include <stdexcept>
+
+#include <boost/lexical_cast.hpp>
+
+#include <openssl/x509.h>
+
+#ifdef WINDOWS
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+namespace
+{
+	std::string get_last_error()
+	{
+#ifdef WINDOWS
+		return "error " + boost::lexical_cast<std::string>(::GetLastError());
+#else
+		const char* error = ::dlerror();
+
+		return error ? error : "unknown error";
+#endif
+	}
+}
+
+certificate_validation_plugin::certificate_validation_plugin(const boost::filesystem::path& path, const std::string& argument) :
+	m_path(path),
+	m_argument(argument),
+	m_handle(NULL),
+	m_context(NULL),
+	m_validate(NULL),
+	m_cleanup(NULL)
+{
+#ifdef WINDOWS
+	m_handle = ::LoadLibrary(path.string<std::basic_string<TCHAR> >().c_str());
+#else
+	m_handle = ::dlopen(path.string().c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+
+	if (!m_handle)
+	{
+		throw std::runtime_error("Unable to load the certificate validation plugin " + path.string() + ": " + get_last_error());
+	}
+
+	try
+	{
+		const freelan_plugin_abi_version_function abi_version = reinterpret_cast<freelan_plugin_abi_version_function>(get_symbol(FREELAN_PLUGIN_ABI_VERSION_SYMBOL));
+
+		if (abi_version && (abi_version() != FREELAN_PLUGIN_ABI_VERSION))
+		{
+			throw std::runtime_error("The certificate validation plugin " + path.string() + " implements an unsupported interface version (" + boost::lexical_cast<std::string>(abi_version()) + ")");
+		}
+
+		m_validate = reinterpret_cast<freelan_plugin_validate_function>(get_symbol(FREELAN_PLUGIN_VALIDATE_SYMBOL));
+
+		if (!m_validate)
+		{
+			throw std::runtime_error("The certificate validation plugin " + path.string() + " does not export " FREELAN_PLUGIN_VALIDATE_SYMBOL "()");
+		}
+
+		const freelan_plugin_init_function init = reinterpret_cast<freelan_plugin_init_function>(get_symbol(FREELAN_PLUGIN_INIT_SYMBOL));
+
+		if (init)
+		{
+			m_context = init(argument.c_str());
+
+			if (!m_context)
+			{
+				throw std::runtime_error("The certificate validation plugin " + path.string() + " failed to initialize");
+			}
+		}
+
+		// Only clean up what was successfully initialized.
+		m_cleanup = reinterpret_cast<freelan_plugin_cleanup_function>(get_symbol(FREELAN_PLUGIN_CLEANUP_SYMBOL));
+	}
+	catch (...)
+	{
+#ifdef WINDOWS
+		::FreeLibrary(static_cast<HMODULE>(m_handle));
+#else
+		::dlclose(m_handle);
+#endif
+
+		throw;
+	}
+}
+
+certificate_validation_plugin::~certificate_validation_plugin()
+{
+	if (m_cleanup)
+	{
+		m_cleanup(m_context);
+	}
+
+#ifdef WINDOWS
+	::FreeLibrary(static_cast<HMODULE>(m_handle));
+#else
+	::dlclose(m_handle);
+#endif
+}
+
+bool certificate_validation_plugin::validate(cert_type cert) const
+{
+	const int der_len = i2d_X509(cert.raw(), NULL);
+
+	if (der_len <= 0)
+	{
+		throw std::runtime_error("Unable to encode the certificate");
+	}
+
+	std::vector<unsigned char> der(der_len);
+	unsigned char* out = &der[0];
+	i2d_X509(cert.raw(), &out);
+
+	return (m_validate(m_context, &der[0], der.size()) == 0);
+}
+
+void* certificate_validation_plugin::get_symbol(const char* name) const
+{
+#ifdef WINDOWS
+	return reinterpret_cast<void*>(::GetProcAddress(static_cast<HMODULE>(m_handle), name));
+#else
+	return ::dlsym(m_handle, name);
+#endif
+}
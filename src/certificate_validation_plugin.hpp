@@ -0,0 +1,128 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file certificate_validation_plugin.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A certificate validation plugin.
+ */
+
+#ifndef CERTIFICATE_VALIDATION_PLUGIN_HPP
+#define CERTIFICATE_VALIDATION_PLUGIN_HPP
+
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include <freelan/configuration.hpp>
+
+#include "validation_plugin.h"
+
+/**
+ * \brief A certificate validation plugin.
+ *
+ * See validation_plugin.h for the interface plugins must implement.
+ */
+class certificate_validation_plugin
+{
+	public:
+
+		/**
+		 * \brief The certificate type.
+		 */
+		typedef freelan::security_configuration::cert_type cert_type;
+
+		/**
+		 * \brief Load and initialize a plugin.
+		 * \param path The plugin shared library.
+		 * \param argument The argument to initialize the plugin with.
+		 *
+		 * If the plugin cannot be loaded or initialized, a std::runtime_error is thrown.
+		 */
+		certificate_validation_plugin(const boost::filesystem::path& path, const std::string& argument);
+
+		/**
+		 * \brief Clean up and unload the plugin.
+		 */
+		~certificate_validation_plugin();
+
+		/**
+		 * \brief Get the plugin shared library.
+		 * \return The plugin shared library.
+		 */
+		const boost::filesystem::path& path() const
+		{
+			return m_path;
+		}
+
+		/**
+		 * \brief Get the argument the plugin was initialized with.
+		 * \return The argument the plugin was initialized with.
+		 */
+		const std::string& argument() const
+		{
+			return m_argument;
+		}
+
+		/**
+		 * \brief Validate a certificate.
+		 * \param cert The certificate.
+		 * \return true if the plugin accepted the certificate.
+		 *
+		 * This method is thread-safe if the plugin is.
+		 */
+		bool validate(cert_type cert) const;
+
+	private:
+
+		certificate_validation_plugin(const certificate_validation_plugin&);
+		certificate_validation_plugin& operator=(const certificate_validation_plugin&);
+
+		void* get_symbol(const char*) const;
+
+		const boost::filesystem::path m_path;
+		const std::string m_argument;
+		void* m_handle;
+		void* m_context;
+		freelan_plugin_validate_function m_validate;
+		freelan_plugin_cleanup_function m_cleanup;
+};
+
+#endif /* CERTIFICATE_VALIDATION_PLUGIN_HPP */
@@ -0,0 +1,223 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file cipher_benchmark.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Cipher algorithm measurements.
+ */
+
+#include "cipher_benchmark.hpp"
+
+#include <string>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/lexical_cast.hpp>
+
+#include <openssl/evp.h>
+#include <openssl/opensslv.h>
+
+#include "system.hpp"
+
+namespace
+{
+	typedef const EVP_CIPHER* (*evp_cipher_getter)();
+
+	struct known_cipher_algorithm
+	{
+		const char* name;
+		evp_cipher_getter cipher;
+	};
+
+	// The AEAD ciphers fscp may know about: those it does not know are skipped.
+	const known_cipher_algorithm KNOWN_CIPHER_ALGORITHMS[] =
+	{
+		{ "aes256-gcm", &EVP_aes_256_gcm },
+		{ "aes128-gcm", &EVP_aes_128_gcm },
+#if (OPENSSL_VERSION_NUMBER >= 0x10100000L) && !defined(OPENSSL_NO_CHACHA) && !defined(OPENSSL_NO_POLY1305)
+		{ "chacha20-poly1305", &EVP_chacha20_poly1305 },
+#endif
+	};
+
+	const std::size_t NONCE_SIZE = 12;
+	const std::size_t TAG_SIZE = 16;
+
+	const EVP_CIPHER* get_evp_cipher(fscp::cipher_algorithm_type cipher_algorithm)
+	{
+		const std::string name = boost::lexical_cast<std::string>(cipher_algorithm);
+
+		for (std::size_t i = 0; i < sizeof(KNOWN_CIPHER_ALGORITHMS) / sizeof(KNOWN_CIPHER_ALGORITHMS[0]); ++i)
+		{
+			if (name == KNOWN_CIPHER_ALGORITHMS[i].name)
+			{
+				return KNOWN_CIPHER_ALGORITHMS[i].cipher();
+			}
+		}
+
+		throw std::runtime_error("Unsupported cipher algorithm: " + name);
+	}
+
+	class cipher_context
+	{
+		public:
+
+			cipher_context() : m_ctx(EVP_CIPHER_CTX_new())
+			{
+				if (!m_ctx)
+				{
+					throw std::runtime_error("Unable to allocate a cipher context");
+				}
+			}
+
+			~cipher_context()
+			{
+				EVP_CIPHER_CTX_free(m_ctx);
+			}
+
+			EVP_CIPHER_CTX* get() const
+			{
+				return m_ctx;
+			}
+
+		private:
+
+			cipher_context(const cipher_context&);
+			cipher_context& operator=(const cipher_context&);
+
+			EVP_CIPHER_CTX* m_ctx;
+	};
+
+	struct is_faster
+	{
+		bool operator()(const std::pair<double, std::size_t>& left, const std::pair<double, std::size_t>& right) const
+		{
+			return left.first < right.first;
+		}
+	};
+}
+
+std::vector<fscp::cipher_algorithm_type> get_supported_cipher_algorithms()
+{
+	std::vector<fscp::cipher_algorithm_type> result;
+
+	for (std::size_t i = 0; i < sizeof(KNOWN_CIPHER_ALGORITHMS) / sizeof(KNOWN_CIPHER_ALGORITHMS[0]); ++i)
+	{
+		try
+		{
+			result.push_back(boost::lexical_cast<fscp::cipher_algorithm_type>(std::string(KNOWN_CIPHER_ALGORITHMS[i].name)));
+		}
+		catch (boost::bad_lexical_cast&)
+		{
+			// This version of fscp does not support it.
+		}
+	}
+
+	return result;
+}
+
+double measure_cipher_algorithm(fscp::cipher_algorithm_type cipher_algorithm, std::size_t packet_size, unsigned int packet_count)
+{
+	const EVP_CIPHER* const cipher = get_evp_cipher(cipher_algorithm);
+
+	const std::vector<unsigned char> key(EVP_CIPHER_key_length(cipher), 0x2a);
+	std::vector<unsigned char> nonce(NONCE_SIZE, 0x00);
+	const std::vector<unsigned char> input(std::max<std::size_t>(packet_size, 1), 0x55);
+	std::vector<unsigned char> output(input.size() + EVP_CIPHER_block_size(cipher));
+	unsigned char tag[TAG_SIZE];
+
+	cipher_context ctx;
+
+	if (!EVP_EncryptInit_ex(ctx.get(), cipher, NULL, NULL, NULL) || !EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_IVLEN, static_cast<int>(NONCE_SIZE), NULL) || !EVP_EncryptInit_ex(ctx.get(), NULL, NULL, &key[0], NULL))
+	{
+		throw std::runtime_error("Unable to initialize the cipher context");
+	}
+
+	packet_count = std::max(packet_count, 1u);
+
+	const boost::uint64_t start = get_monotonic_time();
+
+	for (unsigned int i = 0; i < packet_count; ++i)
+	{
+		// Sessions use a new sequence number as the nonce of every packet.
+		nonce[NONCE_SIZE - 4] = static_cast<unsigned char>(i >> 24);
+		nonce[NONCE_SIZE - 3] = static_cast<unsigned char>(i >> 16);
+		nonce[NONCE_SIZE - 2] = static_cast<unsigned char>(i >> 8);
+		nonce[NONCE_SIZE - 1] = static_cast<unsigned char>(i);
+
+		int length = 0;
+		int final_length = 0;
+
+		if (!EVP_EncryptInit_ex(ctx.get(), NULL, NULL, NULL, &nonce[0]) || !EVP_EncryptUpdate(ctx.get(), &output[0], &length, &input[0], static_cast<int>(packet_size)) || !EVP_EncryptFinal_ex(ctx.get(), &output[0] + length, &final_length) || !EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_GET_TAG, static_cast<int>(TAG_SIZE), tag))
+		{
+			throw std::runtime_error("Unable to seal a packet");
+		}
+	}
+
+	return static_cast<double>(get_monotonic_time() - start) / packet_count;
+}
+
+std::vector<fscp::cipher_algorithm_type> sort_cipher_algorithms_by_speed(const std::vector<fscp::cipher_algorithm_type>& cipher_algorithms, std::size_t packet_size)
+{
+	// About 3 MB per cipher algorithm for full-sized packets: a few milliseconds.
+	static const unsigned int packet_count = 2000;
+
+	std::vector<std::pair<double, std::size_t> > durations;
+
+	for (std::size_t i = 0; i < cipher_algorithms.size(); ++i)
+	{
+		// A first round warms the caches up and lets the CPU leave its idle state.
+		measure_cipher_algorithm(cipher_algorithms[i], packet_size, packet_count / 10);
+
+		durations.push_back(std::make_pair(measure_cipher_algorithm(cipher_algorithms[i], packet_size, packet_count), i));
+	}
+
+	std::stable_sort(durations.begin(), durations.end(), is_faster());
+
+	std::vector<fscp::cipher_algorithm_type> result;
+
+	for (std::size_t i = 0; i < durations.size(); ++i)
+	{
+		result.push_back(cipher_algorithms[durations[i].second]);
+	}
+
+	return result;
+}
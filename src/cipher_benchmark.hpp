@@ -0,0 +1,82 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file cipher_benchmark.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Cipher algorithm measurements.
+ */
+
+#ifndef CIPHER_BENCHMARK_HPP
+#define CIPHER_BENCHMARK_HPP
+
+#include <vector>
+#include <cstddef>
+
+#include <freelan/configuration.hpp>
+
+/**
+ * \brief Get the cipher algorithms that are supported by both fscp and this program.
+ * \return The supported cipher algorithms.
+ */
+std::vector<fscp::cipher_algorithm_type> get_supported_cipher_algorithms();
+
+/**
+ * \brief Measure the time it takes to seal a packet with a cipher algorithm.
+ * \param cipher_algorithm The cipher algorithm. It must be one of get_supported_cipher_algorithms().
+ * \param packet_size The packet size, in bytes.
+ * \param packet_count The number of packets to seal.
+ * \return The mean time to seal a packet, in nanoseconds.
+ *
+ * Each packet is sealed the way a session does it: with a new nonce and an authentication tag.
+ *
+ * On error, a std::runtime_error is thrown.
+ */
+double measure_cipher_algorithm(fscp::cipher_algorithm_type cipher_algorithm, std::size_t packet_size, unsigned int packet_count);
+
+/**
+ * \brief Sort cipher algorithms by speed.
+ * \param cipher_algorithms The cipher algorithms. They must be in get_supported_cipher_algorithms().
+ * \param packet_size The packet size to measure the cipher algorithms with, in bytes.
+ * \return The cipher algorithms, fastest first.
+ */
+std::vector<fscp::cipher_algorithm_type> sort_cipher_algorithms_by_speed(const std::vector<fscp::cipher_algorithm_type>& cipher_algorithms, std::size_t packet_size);
+
+#endif /* CIPHER_BENCHMARK_HPP */
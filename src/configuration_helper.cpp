@@ -45,14 +45,24 @@
  */
 
 #include "configuration_helper.hpp"
+#include "configuration_snapshot.hpp"
 
 #include <vector>
+#include <algorithm>
 
 #include <boost/asio.hpp>
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/make_shared.hpp>
 
 #include "configuration_types.hpp"
+#include "system.hpp"
 #include "version.hpp"
+#include "ip_prefix_table.hpp"
+#include "cipher_benchmark.hpp"
 
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
@@ -94,6 +104,205 @@ namespace
 	{
 		return fl::security_configuration::crl_type::from_certificate_revocation_list(load_file(filename));
 	}
+
+	// Parsing large certificate lists and revocation lists dominates the startup time.
+	template <typename ValueType>
+	class parallel_loader
+	{
+		public:
+
+			typedef ValueType (*loader_type)(const fs::path&);
+
+			parallel_loader(const std::vector<fs::path>& filenames, loader_type loader) :
+				m_filenames(filenames),
+				m_loader(loader),
+				m_values(filenames.size()),
+				m_errors(filenames.size()),
+				m_next(0)
+			{
+			}
+
+			std::vector<ValueType> load()
+			{
+				const std::size_t thread_count = std::min<std::size_t>(std::max(boost::thread::hardware_concurrency(), 1u), m_filenames.size());
+
+				boost::thread_group threads;
+
+				for (std::size_t i = 1; i < thread_count; ++i)
+				{
+					try
+					{
+						threads.create_thread(boost::bind(&parallel_loader::work, this));
+					}
+					catch (boost::thread_resource_error&)
+					{
+						// The threads we have will do.
+						break;
+					}
+				}
+
+				work();
+
+				threads.join_all();
+
+				// Report the same error as a sequential load would.
+				for (std::size_t i = 0; i < m_errors.size(); ++i)
+				{
+					if (!m_errors[i].empty())
+					{
+						throw std::runtime_error(m_errors[i]);
+					}
+				}
+
+				return m_values;
+			}
+
+		private:
+
+			std::size_t next_index()
+			{
+				boost::lock_guard<boost::mutex> lock(m_mutex);
+
+				return m_next++;
+			}
+
+			void work()
+			{
+				for (std::size_t index = next_index(); index < m_filenames.size(); index = next_index())
+				{
+					try
+					{
+						m_values[index] = m_loader(m_filenames[index]);
+					}
+					catch (std::exception& ex)
+					{
+						m_errors[index] = "Cannot load " + m_filenames[index].string() + ": " + ex.what();
+					}
+				}
+			}
+
+			const std::vector<fs::path>& m_filenames;
+			loader_type m_loader;
+			std::vector<ValueType> m_values;
+			std::vector<std::string> m_errors;
+			boost::mutex m_mutex;
+			std::size_t m_next;
+	};
+
+	std::vector<fs::path> get_absolute_paths(const std::vector<std::string>& filenames, const fs::path& root)
+	{
+		std::vector<fs::path> result;
+		result.reserve(filenames.size());
+
+		BOOST_FOREACH(const std::string& filename, filenames)
+		{
+			result.push_back(fs::absolute(filename, root));
+		}
+
+		return result;
+	}
+
+	fl::endpoint offset_endpoint_port(const fl::endpoint& endpoint, unsigned int offset)
+	{
+		if (offset == 0)
+		{
+			return endpoint;
+		}
+
+		// Endpoints are always written as "host:port" or "[host]:port".
+		const std::string str = boost::lexical_cast<std::string>(endpoint);
+		const std::string::size_type separator = str.rfind(':');
+
+		if (separator == std::string::npos)
+		{
+			throw std::runtime_error("Cannot determine the port of: " + str);
+		}
+
+		const unsigned int port = boost::lexical_cast<unsigned int>(str.substr(separator + 1)) + offset;
+
+		if (port > 65535)
+		{
+			throw std::runtime_error("Cannot offset the port of " + str + " by " + boost::lexical_cast<std::string>(offset));
+		}
+
+		return boost::lexical_cast<fl::endpoint>(str.substr(0, separator + 1) + boost::lexical_cast<std::string>(port));
+	}
+
+	boost::posix_time::time_duration to_optional_duration(const millisecond_duration& duration)
+	{
+		return (static_cast<unsigned int>(duration) == 0) ? boost::posix_time::time_duration(boost::posix_time::pos_infin) : static_cast<boost::posix_time::time_duration>(duration);
+	}
+
+	class prefix_length_visitor : public boost::static_visitor<unsigned int>
+	{
+		public:
+
+			template <typename NetworkAddressType>
+			unsigned int operator()(const NetworkAddressType& network) const
+			{
+				return network.prefix_length();
+			}
+	};
+
+	class address_visitor : public boost::static_visitor<boost::asio::ip::address>
+	{
+		public:
+
+			template <typename NetworkAddressType>
+			boost::asio::ip::address operator()(const NetworkAddressType& network) const
+			{
+				return network.address();
+			}
+	};
+
+	// The fastest cipher algorithm for full-sized packets is the one that matters for throughput.
+	const std::size_t CIPHER_BENCHMARK_PACKET_SIZE = 1500;
+
+	std::vector<fscp::cipher_algorithm_type> get_cipher_capabilities(const std::vector<auto_value<fscp::cipher_algorithm_type> >& values)
+	{
+		std::vector<fscp::cipher_algorithm_type> result;
+		std::vector<std::string> names;
+
+		BOOST_FOREACH(const auto_value<fscp::cipher_algorithm_type>& value, values)
+		{
+			std::vector<fscp::cipher_algorithm_type> cipher_algorithms;
+
+			if (value.is_auto())
+			{
+				cipher_algorithms = sort_cipher_algorithms_by_speed(get_supported_cipher_algorithms(), CIPHER_BENCHMARK_PACKET_SIZE);
+			}
+			else
+			{
+				cipher_algorithms.push_back(value.value());
+			}
+
+			// An explicit cipher algorithm keeps its position: auto only adds the others.
+			BOOST_FOREACH(const fscp::cipher_algorithm_type& cipher_algorithm, cipher_algorithms)
+			{
+				const std::string name = boost::lexical_cast<std::string>(cipher_algorithm);
+
+				if (std::find(names.begin(), names.end(), name) == names.end())
+				{
+					names.push_back(name);
+					result.push_back(cipher_algorithm);
+				}
+			}
+		}
+
+		return result;
+	}
+
+	struct prefix_length_less
+	{
+		explicit prefix_length_less(const std::vector<fl::ip_network_address>& _networks) : networks(_networks) {}
+
+		bool operator()(std::size_t left, std::size_t right) const
+		{
+			return boost::apply_visitor(prefix_length_visitor(), networks[left]) < boost::apply_visitor(prefix_length_visitor(), networks[right]);
+		}
+
+		const std::vector<fl::ip_network_address>& networks;
+	};
 }
 
 po::options_description get_server_options()
@@ -130,8 +339,9 @@ po::options_description get_fscp_options()
 	("fscp.accept_contact_requests", po::value<bool>()->default_value(true, "yes"), "Whether to accept CONTACT-REQUEST messages.")
 	("fscp.accept_contacts", po::value<bool>()->default_value(true, "yes"), "Whether to accept CONTACT messages.")
 	("fscp.dynamic_contact_file", po::value<std::vector<std::string> >()->multitoken()->zero_tokens()->default_value(std::vector<std::string>(), ""), "The certificate of an host to dynamically contact.")
+	("fscp.dynamic_contact_directory", po::value<fs::path>()->default_value(""), "A directory containing the certificates of hosts to dynamically contact.")
 	("fscp.never_contact", po::value<std::vector<fl::ip_network_address> >()->multitoken()->zero_tokens()->default_value(std::vector<fl::ip_network_address>(), ""), "A network address to avoid when dynamically contacting hosts.")
-	("fscp.cipher_capability", po::value<std::vector<fscp::cipher_algorithm_type> >()->multitoken()->zero_tokens()->default_value(std::vector<fscp::cipher_algorithm_type>(), ""), "A cipher algorithm to allow.")
+	("fscp.cipher_capability", po::value<std::vector<auto_value<fscp::cipher_algorithm_type> > >()->multitoken()->zero_tokens()->default_value(std::vector<auto_value<fscp::cipher_algorithm_type> >(), ""), "A cipher algorithm to allow, or auto for all the supported ones, fastest first.")
 	;
 
 	return result;
@@ -148,9 +358,23 @@ po::options_description get_security_options()
 	("security.encryption_private_key_file", po::value<fs::path>(), "The private key file to use for encryption.")
 	("security.certificate_validation_method", po::value<fl::security_configuration::certificate_validation_method_type>()->default_value(fl::security_configuration::CVM_DEFAULT), "The certificate validation method.")
 	("security.certificate_validation_script", po::value<fs::path>()->default_value(""), "The certificate validation script to use.")
+	("security.certificate_validation_script_input", po::value<script_input_type>()->default_value(SI_FILE), "How to hand the certificate to the validation script: file, memfd or stdin.")
+	("security.certificate_validation_script_timeout", po::value<millisecond_duration>()->default_value(0), "The time after which the certificate validation script gets killed, in milliseconds. 0 means no timeout.")
+#ifndef WINDOWS
+	("security.certificate_validation_helper", po::value<fs::path>()->default_value(""), "The persistent certificate validation helper to use.")
+	("security.certificate_validation_helper_timeout", po::value<millisecond_duration>()->default_value(5000), "The time to wait for a response from the certificate validation helper, in milliseconds. 0 means no timeout.")
+#endif
+	("security.certificate_validation_plugin", po::value<fs::path>()->default_value(""), "The certificate validation plugin to use.")
+	("security.certificate_validation_plugin_argument", po::value<std::string>()->default_value(""), "The argument to initialize the certificate validation plugin with.")
+	("security.certificate_validation_cache_size", po::value<unsigned int>()->default_value(0), "The number of certificate validation results to cache. 0 disables the cache.")
+	("security.certificate_validation_cache_ttl", po::value<millisecond_duration>()->default_value(300000), "The time after which a cached certificate validation result expires, in milliseconds. 0 means never.")
 	("security.authority_certificate_file", po::value<std::vector<std::string> >()->multitoken()->zero_tokens()->default_value(std::vector<std::string>(), ""), "An authority certificate file to use.")
+	("security.authority_certificate_directory", po::value<fs::path>()->default_value(""), "A hashed directory of authority certificates, whose certificates are only loaded when needed.")
+	("security.authority_certificate_directory_cache_size", po::value<unsigned int>()->default_value(1000), "The number of certificates from the authority certificate directory to keep loaded.")
 	("security.certificate_revocation_validation_method", po::value<fl::security_configuration::certificate_revocation_validation_method_type>()->default_value(fl::security_configuration::CRVM_NONE), "The certificate revocation validation method.")
 	("security.certificate_revocation_list_file", po::value<std::vector<std::string> >()->multitoken()->zero_tokens()->default_value(std::vector<std::string>(), ""), "A certificate revocation list file to use.")
+	("security.certificate_revocation_index", po::value<bool>()->default_value(false, "no"), "Whether to check revocation against an index of the certificate revocation lists instead of letting the core scan them.")
+	("security.certificate_revocation_index_directory", po::value<fs::path>()->default_value(""), "The directory to save the certificate revocation list indexes to, so that they are not parsed again on restart.")
 	;
 
 	return result;
@@ -178,6 +402,8 @@ po::options_description get_tap_adapter_options()
 	("tap_adapter.dhcp_server_ipv6_address_prefix_length", po::value<fl::ipv6_network_address>()->default_value(default_dhcp_ipv6_network_address), "The DHCP proxy server IPv6 address and prefix length.")
 	("tap_adapter.up_script", po::value<fs::path>()->default_value(""), "The tap adapter up script.")
 	("tap_adapter.down_script", po::value<fs::path>()->default_value(""), "The tap adapter down script.")
+	("tap_adapter.up_script_timeout", po::value<millisecond_duration>()->default_value(0), "The time after which the tap adapter up script gets killed, in milliseconds. 0 means no timeout.")
+	("tap_adapter.down_script_timeout", po::value<millisecond_duration>()->default_value(0), "The time after which the tap adapter down script gets killed, in milliseconds. 0 means no timeout.")
 	;
 
 	return result;
@@ -195,7 +421,41 @@ po::options_description get_switch_options()
 	return result;
 }
 
-void setup_configuration(fl::configuration& configuration, const boost::filesystem::path& root, const po::variables_map& vm)
+po::options_description get_runtime_options()
+{
+	po::options_description result("Runtime options");
+
+	result.add_options()
+	("runtime.shards", po::value<unsigned int>()->default_value(1), "The number of independent cores to run, shard N listening on the fscp.listen_on port plus N with its share of the contacts. Peers on different shards cannot reach each other. Requires tap_adapter.enabled=no and switch.relay_mode_enabled=no. 0 means one core per CPU.")
+	("runtime.cpu_affinity", po::value<cpu_list>()->default_value(cpu_list(), ""), "The CPUs to run on, as a list of CPU indexes or ranges.")
+	("runtime.numa_node", po::value<int>()->default_value(-1), "The NUMA node to run on and allocate memory from. -1 means any node.")
+	("runtime.sched_policy", po::value<runtime_configuration::scheduling_policy_type>()->default_value(runtime_configuration::SP_OTHER), "The scheduling policy.")
+	("runtime.sched_priority", po::value<int>()->default_value(0), "The scheduling priority, for real-time scheduling policies.")
+	("runtime.mlockall", po::value<bool>()->default_value(false, "no"), "Whether to lock the process memory in RAM.")
+	("runtime.poll_mode", po::value<runtime_configuration::poll_mode_type>()->default_value(runtime_configuration::PM_BLOCKING), "The event loop poll mode.")
+	("runtime.busy_poll_budget", po::value<microsecond_duration>()->default_value(50), "The time to busy poll for after the last activity in the adaptive poll mode, in microseconds.")
+	("runtime.socket_busy_poll", po::value<unsigned int>()->default_value(0), "The time the kernel may busy poll for on socket reads, in microseconds. 0 disables socket busy polling.")
+	("runtime.log_queue_size", po::value<unsigned int>()->default_value(0), "The number of log messages that can wait to be written by the log thread. 0 disables asynchronous logging.")
+	("runtime.log_overflow_policy", po::value<runtime_configuration::log_overflow_policy_type>()->default_value(runtime_configuration::LOP_BLOCK), "What to do with log messages when the log queue is full.")
+	("runtime.log_level", po::value<std::string>()->default_value("information"), "The minimum level of the messages to log: debug, information, warning, error or fatal.")
+	("runtime.metrics_listen_on", po::value<std::string>()->default_value(""), "The address to serve the metrics on, as host:port or unix:path. Empty to disable the metrics endpoint.")
+	("runtime.latency_probe_interval", po::value<millisecond_duration>()->default_value(0), "The time between two measures of the event loop queueing delay, in milliseconds. 0 disables the measures.")
+	("runtime.flight_recorder_size", po::value<unsigned int>()->default_value(4096), "The number of recent events each thread keeps for crash and on-demand dumps. 0 disables the flight recorder.")
+	("runtime.flight_recorder_file", po::value<std::string>()->default_value(""), "The file to dump the flight recorder to. Empty for a file in the temporary directory.")
+	;
+
+	return result;
+}
+
+void add_startup_timing(startup_timings_type* timings, const std::string& step, boost::uint64_t start)
+{
+	if (timings)
+	{
+		timings->push_back(std::make_pair(step, get_monotonic_time() - start));
+	}
+}
+
+void setup_configuration(fl::configuration& configuration, const boost::filesystem::path& root, const po::variables_map& vm, startup_timings_type* timings, const configuration_snapshot* snapshot, const std::vector<fscp::cipher_algorithm_type>* cipher_capabilities)
 {
 	typedef boost::asio::ip::udp::resolver::query query;
 	typedef fl::security_configuration::cert_type cert_type;
@@ -272,17 +532,35 @@ void setup_configuration(fl::configuration& configuration, const boost::filesyst
 	configuration.fscp.contact_list = vm["fscp.contact"].as<std::vector<fl::endpoint> >();
 	configuration.fscp.accept_contact_requests = vm["fscp.accept_contact_requests"].as<bool>();
 	configuration.fscp.accept_contacts = vm["fscp.accept_contacts"].as<bool>();
-	const std::vector<std::string> dynamic_contact_file_list = vm["fscp.dynamic_contact_file"].as<std::vector<std::string> >();
 
-	configuration.fscp.dynamic_contact_list.clear();
+	boost::uint64_t start = get_monotonic_time();
 
-	BOOST_FOREACH(const fs::path& dynamic_contact_file, dynamic_contact_file_list)
+	if (snapshot)
 	{
-		configuration.fscp.dynamic_contact_list.push_back(load_certificate(fs::absolute(dynamic_contact_file, root)));
+		configuration.fscp.dynamic_contact_list = snapshot->dynamic_contacts;
+	}
+	else
+	{
+		configuration.fscp.dynamic_contact_list = parallel_loader<cert_type>(get_dynamic_contact_files(root, vm), &load_certificate).load();
+	}
+
+	add_startup_timing(timings, "dynamic contact certificates (" + boost::lexical_cast<std::string>(configuration.fscp.dynamic_contact_list.size()) + ")", start);
+
+	// The core scans this list for every contact: only keep what matters.
+	configuration.fscp.never_contact_list = get_outermost_network_addresses(vm["fscp.never_contact"].as<std::vector<fl::ip_network_address> >());
+
+	start = get_monotonic_time();
+
+	if (cipher_capabilities)
+	{
+		configuration.fscp.cipher_capabilities = *cipher_capabilities;
+	}
+	else
+	{
+		configuration.fscp.cipher_capabilities = get_cipher_capabilities(vm["fscp.cipher_capability"].as<std::vector<auto_value<fscp::cipher_algorithm_type> > >());
 	}
 
-	configuration.fscp.never_contact_list = vm["fscp.never_contact"].as<std::vector<fl::ip_network_address> >();
-	configuration.fscp.cipher_capabilities = vm["fscp.cipher_capability"].as<std::vector<fscp::cipher_algorithm_type> >();
+	add_startup_timing(timings, "cipher capabilities", start);
 
 	// Security options
 	cert_type signature_certificate;
@@ -290,24 +568,36 @@ void setup_configuration(fl::configuration& configuration, const boost::filesyst
 	cert_type encryption_certificate;
 	pkey encryption_private_key;
 
-	if (vm.count("security.signature_certificate_file"))
-	{
-		signature_certificate = load_certificate(fs::absolute(vm["security.signature_certificate_file"].as<fs::path>(), root));
-	}
+	start = get_monotonic_time();
 
-	if (vm.count("security.signature_private_key_file"))
+	if (snapshot)
 	{
-		signature_private_key = load_private_key(fs::absolute(vm["security.signature_private_key_file"].as<fs::path>(), root));
+		signature_certificate = snapshot->signature_certificate;
+		signature_private_key = snapshot->signature_private_key;
+		encryption_certificate = snapshot->encryption_certificate;
+		encryption_private_key = snapshot->encryption_private_key;
 	}
-
-	if (vm.count("security.encryption_certificate_file"))
+	else
 	{
-		encryption_certificate = load_certificate(fs::absolute(vm["security.encryption_certificate_file"].as<fs::path>(), root));
-	}
+		if (vm.count("security.signature_certificate_file"))
+		{
+			signature_certificate = load_certificate(fs::absolute(vm["security.signature_certificate_file"].as<fs::path>(), root));
+		}
 
-	if (vm.count("security.encryption_private_key_file"))
-	{
-		encryption_private_key = load_private_key(fs::absolute(vm["security.encryption_private_key_file"].as<fs::path>(), root));
+		if (vm.count("security.signature_private_key_file"))
+		{
+			signature_private_key = load_private_key(fs::absolute(vm["security.signature_private_key_file"].as<fs::path>(), root));
+		}
+
+		if (vm.count("security.encryption_certificate_file"))
+		{
+			encryption_certificate = load_certificate(fs::absolute(vm["security.encryption_certificate_file"].as<fs::path>(), root));
+		}
+
+		if (vm.count("security.encryption_private_key_file"))
+		{
+			encryption_private_key = load_private_key(fs::absolute(vm["security.encryption_private_key_file"].as<fs::path>(), root));
+		}
 	}
 
 	if (signature_certificate && signature_private_key)
@@ -315,26 +605,51 @@ void setup_configuration(fl::configuration& configuration, const boost::filesyst
 		configuration.security.identity = fscp::identity_store(signature_certificate, signature_private_key, encryption_certificate, encryption_private_key);
 	}
 
+	add_startup_timing(timings, "identity", start);
+
 	configuration.security.certificate_validation_method = vm["security.certificate_validation_method"].as<fl::security_configuration::certificate_validation_method_type>();
 
-	const std::vector<std::string> authority_certificate_file_list = vm["security.authority_certificate_file"].as<std::vector<std::string> >();
+	if (!vm["security.authority_certificate_directory"].as<fs::path>().empty())
+	{
+		// The core only knows about the authorities it is given: the certificates are verified from the certificate validation callback instead.
+		configuration.security.certificate_validation_method = fl::security_configuration::CVM_NONE;
+	}
 
-	configuration.security.certificate_authority_list.clear();
+	start = get_monotonic_time();
 
-	BOOST_FOREACH(const std::string& authority_certificate_file, authority_certificate_file_list)
+	if (snapshot)
 	{
-		configuration.security.certificate_authority_list.push_back(load_trusted_certificate(fs::absolute(authority_certificate_file, root)));
+		configuration.security.certificate_authority_list = snapshot->authority_certificates;
+	}
+	else
+	{
+		configuration.security.certificate_authority_list = parallel_loader<cert_type>(get_authority_certificate_files(root, vm), &load_trusted_certificate).load();
 	}
 
-	configuration.security.certificate_revocation_validation_method = vm["security.certificate_revocation_validation_method"].as<fl::security_configuration::certificate_revocation_validation_method_type>();
-
-	const std::vector<std::string> crl_file_list = vm["security.certificate_revocation_list_file"].as<std::vector<std::string> >();
+	add_startup_timing(timings, "authority certificates (" + boost::lexical_cast<std::string>(configuration.security.certificate_authority_list.size()) + ")", start);
 
-	configuration.security.certificate_revocation_list_list.clear();
+	configuration.security.certificate_revocation_validation_method = get_certificate_revocation_validation_method(vm);
 
-	BOOST_FOREACH(const std::string& crl_file, crl_file_list)
+	if (vm["security.certificate_revocation_index"].as<bool>())
 	{
-		configuration.security.certificate_revocation_list_list.push_back(load_crl(fs::absolute(crl_file, root)));
+		// The revocation status is checked from the certificate validation callback instead.
+		configuration.security.certificate_revocation_validation_method = fl::security_configuration::CRVM_NONE;
+		configuration.security.certificate_revocation_list_list.clear();
+	}
+	else
+	{
+		start = get_monotonic_time();
+
+		if (snapshot)
+		{
+			configuration.security.certificate_revocation_list_list = snapshot->certificate_revocation_lists;
+		}
+		else
+		{
+			configuration.security.certificate_revocation_list_list = parallel_loader<fl::security_configuration::crl_type>(get_certificate_revocation_list_files(root, vm), &load_crl).load();
+		}
+
+		add_startup_timing(timings, "certificate revocation lists (" + boost::lexical_cast<std::string>(configuration.security.certificate_revocation_list_list.size()) + ")", start);
 	}
 
 	// Tap adapter options
@@ -359,6 +674,51 @@ void setup_configuration(fl::configuration& configuration, const boost::filesyst
 	configuration.switch_.relay_mode_enabled = vm["switch.relay_mode_enabled"].as<bool>();
 }
 
+void setup_runtime_configuration(runtime_configuration& configuration, const po::variables_map& vm)
+{
+	configuration.shard_count = vm["runtime.shards"].as<unsigned int>();
+	configuration.cpu_affinity = vm["runtime.cpu_affinity"].as<cpu_list>();
+	configuration.numa_node = vm["runtime.numa_node"].as<int>();
+	configuration.scheduling_policy = vm["runtime.sched_policy"].as<runtime_configuration::scheduling_policy_type>();
+	configuration.scheduling_priority = vm["runtime.sched_priority"].as<int>();
+	configuration.lock_memory = vm["runtime.mlockall"].as<bool>();
+	configuration.poll_mode = vm["runtime.poll_mode"].as<runtime_configuration::poll_mode_type>();
+	configuration.busy_poll_budget = vm["runtime.busy_poll_budget"].as<microsecond_duration>();
+	configuration.socket_busy_poll = vm["runtime.socket_busy_poll"].as<unsigned int>();
+	configuration.log_queue_size = vm["runtime.log_queue_size"].as<unsigned int>();
+	configuration.log_overflow_policy = vm["runtime.log_overflow_policy"].as<runtime_configuration::log_overflow_policy_type>();
+	configuration.metrics_listen_on = vm["runtime.metrics_listen_on"].as<std::string>();
+	configuration.latency_probe_interval = vm["runtime.latency_probe_interval"].as<millisecond_duration>();
+	configuration.flight_recorder_size = vm["runtime.flight_recorder_size"].as<unsigned int>();
+	configuration.flight_recorder_file = vm["runtime.flight_recorder_file"].as<std::string>();
+}
+
+fl::configuration get_shard_configuration(const fl::configuration& configuration, unsigned int index, unsigned int count)
+{
+	assert(index < count);
+
+	// Copying the configuration shares the underlying certificates and keys.
+	fl::configuration result = configuration;
+
+	result.fscp.listen_on = offset_endpoint_port(configuration.fscp.listen_on, index);
+
+	result.fscp.contact_list.clear();
+
+	for (std::size_t i = index; i < configuration.fscp.contact_list.size(); i += count)
+	{
+		result.fscp.contact_list.push_back(configuration.fscp.contact_list[i]);
+	}
+
+	result.fscp.dynamic_contact_list.clear();
+
+	for (std::size_t i = index; i < configuration.fscp.dynamic_contact_list.size(); i += count)
+	{
+		result.fscp.dynamic_contact_list.push_back(configuration.fscp.dynamic_contact_list[i]);
+	}
+
+	return result;
+}
+
 boost::filesystem::path get_tap_adapter_up_script(const boost::filesystem::path& root, const boost::program_options::variables_map& vm)
 {
 	fs::path tap_adapter_up_script_file = vm["tap_adapter.up_script"].as<fs::path>();
@@ -379,3 +739,339 @@ boost::filesystem::path get_certificate_validation_script(const boost::filesyste
 
 	return certificate_validation_script_file.empty() ? certificate_validation_script_file : fs::absolute(certificate_validation_script_file, root);
 }
+
+boost::posix_time::time_duration get_tap_adapter_up_script_timeout(const boost::program_options::variables_map& vm)
+{
+	return to_optional_duration(vm["tap_adapter.up_script_timeout"].as<millisecond_duration>());
+}
+
+boost::posix_time::time_duration get_tap_adapter_down_script_timeout(const boost::program_options::variables_map& vm)
+{
+	return to_optional_duration(vm["tap_adapter.down_script_timeout"].as<millisecond_duration>());
+}
+
+script_input_type get_certificate_validation_script_input(const boost::program_options::variables_map& vm)
+{
+	const script_input_type input = vm["security.certificate_validation_script_input"].as<script_input_type>();
+
+#ifdef WINDOWS
+	if (input != SI_FILE)
+	{
+		throw std::runtime_error("Only the \"file\" certificate validation script input is supported on Windows");
+	}
+#elif !defined(__linux__)
+	if (input == SI_MEMFD)
+	{
+		throw std::runtime_error("The \"memfd\" certificate validation script input is only supported on Linux");
+	}
+#endif
+
+	return input;
+}
+
+boost::posix_time::time_duration get_certificate_validation_script_timeout(const boost::program_options::variables_map& vm)
+{
+	return to_optional_duration(vm["security.certificate_validation_script_timeout"].as<millisecond_duration>());
+}
+
+#ifndef WINDOWS
+boost::filesystem::path get_certificate_validation_helper(const boost::filesystem::path& root, const boost::program_options::variables_map& vm)
+{
+	fs::path certificate_validation_helper_file = vm["security.certificate_validation_helper"].as<fs::path>();
+
+	return certificate_validation_helper_file.empty() ? certificate_validation_helper_file : fs::absolute(certificate_validation_helper_file, root);
+}
+
+boost::posix_time::time_duration get_certificate_validation_helper_timeout(const boost::program_options::variables_map& vm)
+{
+	return to_optional_duration(vm["security.certificate_validation_helper_timeout"].as<millisecond_duration>());
+}
+#endif
+
+boost::filesystem::path get_certificate_validation_plugin(const boost::filesystem::path& root, const boost::program_options::variables_map& vm)
+{
+	fs::path certificate_validation_plugin_file = vm["security.certificate_validation_plugin"].as<fs::path>();
+
+	return certificate_validation_plugin_file.empty() ? certificate_validation_plugin_file : fs::absolute(certificate_validation_plugin_file, root);
+}
+
+std::string get_certificate_validation_plugin_argument(const boost::program_options::variables_map& vm)
+{
+	return vm["security.certificate_validation_plugin_argument"].as<std::string>();
+}
+
+unsigned int get_certificate_validation_cache_size(const boost::program_options::variables_map& vm)
+{
+	return vm["security.certificate_validation_cache_size"].as<unsigned int>();
+}
+
+boost::posix_time::time_duration get_certificate_validation_cache_ttl(const boost::program_options::variables_map& vm)
+{
+	return to_optional_duration(vm["security.certificate_validation_cache_ttl"].as<millisecond_duration>());
+}
+
+std::vector<fs::path> get_authority_certificate_files(const fs::path& root, const po::variables_map& vm)
+{
+	return get_absolute_paths(vm["security.authority_certificate_file"].as<std::vector<std::string> >(), root);
+}
+
+std::vector<fs::path> get_certificate_revocation_list_files(const fs::path& root, const po::variables_map& vm)
+{
+	return get_absolute_paths(vm["security.certificate_revocation_list_file"].as<std::vector<std::string> >(), root);
+}
+
+std::vector<fs::path> get_dynamic_contact_files(const fs::path& root, const po::variables_map& vm)
+{
+	std::vector<fs::path> result = get_absolute_paths(vm["fscp.dynamic_contact_file"].as<std::vector<std::string> >(), root);
+
+	if (!vm["fscp.dynamic_contact_directory"].as<fs::path>().empty())
+	{
+		const fs::path directory = fs::absolute(vm["fscp.dynamic_contact_directory"].as<fs::path>(), root);
+
+		std::vector<fs::path> filenames;
+
+		for (fs::directory_iterator entry(directory), end; entry != end; ++entry)
+		{
+			// Skip the hidden files, like the ones editors leave behind.
+			if (fs::is_regular_file(entry->status()) && (entry->path().filename().string()[0] != '.'))
+			{
+				filenames.push_back(entry->path());
+			}
+		}
+
+		// The directory order is not specified.
+		std::sort(filenames.begin(), filenames.end());
+
+		result.insert(result.end(), filenames.begin(), filenames.end());
+	}
+
+	return result;
+}
+
+boost::shared_ptr<authority_certificate_directory> get_authority_certificate_directory(const fs::path& root, const po::variables_map& vm, const fl::security_configuration& configuration)
+{
+	const fs::path directory = vm["security.authority_certificate_directory"].as<fs::path>();
+
+	if (directory.empty() || (vm["security.certificate_validation_method"].as<fl::security_configuration::certificate_validation_method_type>() == fl::security_configuration::CVM_NONE))
+	{
+		return boost::shared_ptr<authority_certificate_directory>();
+	}
+
+	return boost::make_shared<authority_certificate_directory>(fs::absolute(directory, root), vm["security.authority_certificate_directory_cache_size"].as<unsigned int>(), configuration.certificate_authority_list, configuration.certificate_revocation_list_list, configuration.certificate_revocation_validation_method);
+}
+
+fs::path get_certificate_revocation_index_directory(const fs::path& root, const po::variables_map& vm)
+{
+	const fs::path directory = vm["security.certificate_revocation_index_directory"].as<fs::path>();
+
+	return directory.empty() ? fs::path() : fs::absolute(directory, root);
+}
+
+boost::shared_ptr<certificate_revocation_index> get_certificate_revocation_index(const boost::filesystem::path& root, const boost::program_options::variables_map& vm, const std::vector<fl::security_configuration::cert_type>& authorities, startup_timings_type* timings, const configuration_snapshot* snapshot)
+{
+	if (!vm["security.certificate_revocation_index"].as<bool>())
+	{
+		return boost::shared_ptr<certificate_revocation_index>();
+	}
+
+	if (snapshot)
+	{
+		if (!snapshot->revocation_index)
+		{
+			throw std::runtime_error("The configuration snapshot has no certificate revocation index");
+		}
+
+		return snapshot->revocation_index;
+	}
+
+	const fs::path cache_directory = get_certificate_revocation_index_directory(root, vm);
+	const std::vector<fs::path> crl_file_list = get_certificate_revocation_list_files(root, vm);
+
+	const boost::uint64_t start = get_monotonic_time();
+
+	const boost::shared_ptr<certificate_revocation_index> index = boost::make_shared<certificate_revocation_index>(authorities);
+
+	BOOST_FOREACH(const fs::path& crl_file, crl_file_list)
+	{
+		try
+		{
+			index->add_file(crl_file, cache_directory);
+		}
+		catch (std::exception& ex)
+		{
+			throw std::runtime_error("Cannot load " + crl_file.string() + ": " + ex.what());
+		}
+	}
+
+	add_startup_timing(timings, "certificate revocation index (" + boost::lexical_cast<std::string>(index->size()) + " serials)", start);
+
+	return index;
+}
+
+fl::security_configuration::certificate_revocation_validation_method_type get_certificate_revocation_validation_method(const boost::program_options::variables_map& vm)
+{
+	return vm["security.certificate_revocation_validation_method"].as<fl::security_configuration::certificate_revocation_validation_method_type>();
+}
+
+fl::log_level get_log_level(const boost::program_options::variables_map& vm)
+{
+	return parse_log_level(vm["runtime.log_level"].as<std::string>());
+}
+
+fl::log_level parse_log_level(const std::string& value)
+{
+	if (value == "debug")
+	{
+		return fl::LL_DEBUG;
+	}
+	else if (value == "information")
+	{
+		return fl::LL_INFORMATION;
+	}
+	else if (value == "warning")
+	{
+		return fl::LL_WARNING;
+	}
+	else if (value == "error")
+	{
+		return fl::LL_ERROR;
+	}
+	else if (value == "fatal")
+	{
+		return fl::LL_FATAL;
+	}
+
+	throw po::invalid_option_value(value);
+}
+
+option_values_type get_option_values(const boost::program_options::parsed_options& parsed_options)
+{
+	option_values_type result;
+
+	BOOST_FOREACH(const po::option& option, parsed_options.options)
+	{
+		std::vector<std::string>& values = result[option.string_key];
+
+		values.insert(values.end(), option.value.begin(), option.value.end());
+	}
+
+	return result;
+}
+
+std::set<std::string> get_changed_options(const option_values_type& old_values, const option_values_type& new_values)
+{
+	std::set<std::string> result;
+
+	BOOST_FOREACH(const option_values_type::value_type& item, old_values)
+	{
+		const option_values_type::const_iterator new_item = new_values.find(item.first);
+
+		if ((new_item == new_values.end()) || (new_item->second != item.second))
+		{
+			result.insert(item.first);
+		}
+	}
+
+	BOOST_FOREACH(const option_values_type::value_type& item, new_values)
+	{
+		if (old_values.find(item.first) == old_values.end())
+		{
+			result.insert(item.first);
+		}
+	}
+
+	return result;
+}
+
+std::vector<fl::ip_network_address> get_outermost_network_addresses(const std::vector<fl::ip_network_address>& networks)
+{
+	std::vector<std::size_t> order;
+
+	for (std::size_t i = 0; i < networks.size(); ++i)
+	{
+		order.push_back(i);
+	}
+
+	// A network can only be contained in a network with a shorter or equal prefix.
+	std::stable_sort(order.begin(), order.end(), prefix_length_less(networks));
+
+	ip_prefix_table<bool> table;
+	std::vector<bool> kept(networks.size(), false);
+
+	BOOST_FOREACH(std::size_t index, order)
+	{
+		if (!table.find(boost::apply_visitor(address_visitor(), networks[index])))
+		{
+			table.insert(networks[index], true);
+			kept[index] = true;
+		}
+	}
+
+	std::vector<fl::ip_network_address> result;
+
+	for (std::size_t i = 0; i < networks.size(); ++i)
+	{
+		if (kept[i])
+		{
+			result.push_back(networks[i]);
+		}
+	}
+
+	return result;
+}
+
+void store_option_values(const option_values_type& values, const po::options_description& description, po::variables_map& vm)
+{
+	po::parsed_options parsed_options(&description);
+
+	BOOST_FOREACH(const option_values_type::value_type& item, values)
+	{
+		po::option option;
+		option.string_key = item.first;
+		option.value = item.second;
+		option.original_tokens = item.second;
+
+		// Like parse_config_file() with allow_unregistered set.
+		option.unregistered = (description.find_nothrow(item.first, false) == NULL);
+
+		parsed_options.options.push_back(option);
+	}
+
+	po::store(parsed_options, vm);
+}
+
+configuration_snapshot make_configuration_snapshot(const fs::path& root, const po::variables_map& vm, const option_values_type& options, const fl::configuration& configuration, boost::shared_ptr<certificate_revocation_index> revocation_index)
+{
+	configuration_snapshot snapshot;
+
+	snapshot.root = root;
+	snapshot.options = options;
+
+	// The identity store does not give the private keys back.
+	if (vm.count("security.signature_certificate_file"))
+	{
+		snapshot.signature_certificate = load_certificate(fs::absolute(vm["security.signature_certificate_file"].as<fs::path>(), root));
+	}
+
+	if (vm.count("security.signature_private_key_file"))
+	{
+		snapshot.signature_private_key = load_private_key(fs::absolute(vm["security.signature_private_key_file"].as<fs::path>(), root));
+	}
+
+	if (vm.count("security.encryption_certificate_file"))
+	{
+		snapshot.encryption_certificate = load_certificate(fs::absolute(vm["security.encryption_certificate_file"].as<fs::path>(), root));
+	}
+
+	if (vm.count("security.encryption_private_key_file"))
+	{
+		snapshot.encryption_private_key = load_private_key(fs::absolute(vm["security.encryption_private_key_file"].as<fs::path>(), root));
+	}
+
+	snapshot.authority_certificates = configuration.security.certificate_authority_list;
+	snapshot.certificate_revocation_lists = configuration.security.certificate_revocation_list_list;
+	snapshot.dynamic_contacts = configuration.fscp.dynamic_contact_list;
+	snapshot.revocation_index = revocation_index;
+
+	return snapshot;
+}
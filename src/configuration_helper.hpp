@@ -47,10 +47,27 @@
 #ifndef CONFIGURATION_HELPER_HPP
 #define CONFIGURATION_HELPER_HPP
 
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <utility>
+
 #include <freelan/configuration.hpp>
+#include <freelan/logger.hpp>
 
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "configuration_types.hpp"
+#include "runtime_configuration.hpp"
+#include "certificate_revocation_index.hpp"
+#include "authority_certificate_directory.hpp"
+
+struct configuration_snapshot;
 
 /**
  * \brief Get the server options.
@@ -82,14 +99,62 @@ boost::program_options::options_description get_tap_adapter_options();
  */
 boost::program_options::options_description get_switch_options();
 
+/**
+ * \brief Get the runtime options.
+ * \return The runtime options.
+ */
+boost::program_options::options_description get_runtime_options();
+
+/**
+ * \brief The time spent in each startup step, in nanoseconds.
+ */
+typedef std::vector<std::pair<std::string, boost::uint64_t> > startup_timings_type;
+
+/**
+ * \brief Add the time elapsed since the beginning of a step to startup timings.
+ * \param timings The startup timings. If NULL, nothing is done.
+ * \param step The name of the step.
+ * \param start The time the step began at, as returned by get_monotonic_time().
+ */
+void add_startup_timing(startup_timings_type* timings, const std::string& step, boost::uint64_t start);
+
 /**
  * \brief Setup a freelan configuration from a variables map.
  * \param configuration The configuration to setup.
  * \param root The root directory for file operations.
  * \param vm The variables map.
+ * \param timings If not NULL, the time spent loading the certificates, keys and revocation lists is added to it.
+ * \warning On error, a boost::program_options::error might be thrown.
+ *
+ * The certificate and revocation list files are loaded in parallel, on at most one thread per CPU.
+ *
+ * If the certificate revocation index is enabled, the revocation lists are not loaded and the core does not check revocation: see get_certificate_revocation_index().
+ *
+ * If snapshot is not NULL, the certificates, keys and revocation lists are taken from it instead of being loaded from their files.
+ *
+ * If cipher_capabilities is not NULL, it is used instead of the fscp.cipher_capability option, which may benchmark the cipher algorithms.
+ */
+void setup_configuration(freelan::configuration& configuration, const boost::filesystem::path& root, const boost::program_options::variables_map& vm, startup_timings_type* timings = NULL, const configuration_snapshot* snapshot = NULL, const std::vector<fscp::cipher_algorithm_type>* cipher_capabilities = NULL);
+
+/**
+ * \brief Setup a runtime configuration from a variables map.
+ * \param configuration The runtime configuration to setup.
+ * \param vm The variables map.
  * \warning On error, a boost::program_options::error might be thrown.
  */
-void setup_configuration(freelan::configuration& configuration, const boost::filesystem::path& root, const boost::program_options::variables_map& vm);
+void setup_runtime_configuration(runtime_configuration& configuration, const boost::program_options::variables_map& vm);
+
+/**
+ * \brief Get the configuration of a shard.
+ * \param configuration The configuration shared by all the shards.
+ * \param index The index of the shard.
+ * \param count The number of shards.
+ * \return The configuration of the shard.
+ *
+ * The shard listens on the configured port plus its index and only contacts its share of the configured hosts.
+ * Each shard is a separate node: peers on different shards cannot reach each other, so the tap adapter and the relay mode must be disabled.
+ */
+freelan::configuration get_shard_configuration(const freelan::configuration& configuration, unsigned int index, unsigned int count);
 
 /**
  * \brief Get the tap adapter up script.
@@ -115,4 +180,202 @@ boost::filesystem::path get_tap_adapter_down_script(const boost::filesystem::pat
  */
 boost::filesystem::path get_certificate_validation_script(const boost::filesystem::path& root, const boost::program_options::variables_map& vm);
 
+/**
+ * \brief Get the tap adapter up script timeout.
+ * \param vm The variables map.
+ * \return The tap adapter up script timeout.
+ */
+boost::posix_time::time_duration get_tap_adapter_up_script_timeout(const boost::program_options::variables_map& vm);
+
+/**
+ * \brief Get the tap adapter down script timeout.
+ * \param vm The variables map.
+ * \return The tap adapter down script timeout.
+ */
+boost::posix_time::time_duration get_tap_adapter_down_script_timeout(const boost::program_options::variables_map& vm);
+
+/**
+ * \brief Get the certificate validation script input.
+ * \param vm The variables map.
+ * \return How to hand the certificate to the validation script.
+ */
+script_input_type get_certificate_validation_script_input(const boost::program_options::variables_map& vm);
+
+/**
+ * \brief Get the certificate validation script timeout.
+ * \param vm The variables map.
+ * \return The certificate validation script timeout.
+ */
+boost::posix_time::time_duration get_certificate_validation_script_timeout(const boost::program_options::variables_map& vm);
+
+#ifndef WINDOWS
+/**
+ * \brief Get the certificate validation helper.
+ * \param root The root directory for file operations.
+ * \param vm The variables map.
+ * \return The certificate validation helper.
+ */
+boost::filesystem::path get_certificate_validation_helper(const boost::filesystem::path& root, const boost::program_options::variables_map& vm);
+
+/**
+ * \brief Get the certificate validation helper timeout.
+ * \param vm The variables map.
+ * \return The time to wait for a response from the certificate validation helper.
+ */
+boost::posix_time::time_duration get_certificate_validation_helper_timeout(const boost::program_options::variables_map& vm);
+#endif
+
+/**
+ * \brief Get the certificate validation plugin.
+ * \param root The root directory for file operations.
+ * \param vm The variables map.
+ * \return The certificate validation plugin.
+ */
+boost::filesystem::path get_certificate_validation_plugin(const boost::filesystem::path& root, const boost::program_options::variables_map& vm);
+
+/**
+ * \brief Get the certificate validation plugin argument.
+ * \param vm The variables map.
+ * \return The argument to initialize the certificate validation plugin with.
+ */
+std::string get_certificate_validation_plugin_argument(const boost::program_options::variables_map& vm);
+
+/**
+ * \brief Get the certificate validation cache size.
+ * \param vm The variables map.
+ * \return The maximum number of cached certificate validation results.
+ */
+unsigned int get_certificate_validation_cache_size(const boost::program_options::variables_map& vm);
+
+/**
+ * \brief Get the certificate validation cache time to live.
+ * \param vm The variables map.
+ * \return The time after which a cached certificate validation result expires.
+ */
+boost::posix_time::time_duration get_certificate_validation_cache_ttl(const boost::program_options::variables_map& vm);
+
+/**
+ * \brief Get the authority certificate files.
+ * \param root The root directory.
+ * \param vm The variables map.
+ * \return The absolute paths of the authority certificate files.
+ */
+std::vector<boost::filesystem::path> get_authority_certificate_files(const boost::filesystem::path& root, const boost::program_options::variables_map& vm);
+
+/**
+ * \brief Get the certificate revocation list files.
+ * \param root The root directory.
+ * \param vm The variables map.
+ * \return The absolute paths of the certificate revocation list files.
+ */
+std::vector<boost::filesystem::path> get_certificate_revocation_list_files(const boost::filesystem::path& root, const boost::program_options::variables_map& vm);
+
+/**
+ * \brief Get the dynamic contact certificate files.
+ * \param root The root directory.
+ * \param vm The variables map.
+ * \return The absolute paths of the dynamic contact certificate files, followed by the files of the dynamic contact directory, if any.
+ */
+std::vector<boost::filesystem::path> get_dynamic_contact_files(const boost::filesystem::path& root, const boost::program_options::variables_map& vm);
+
+/**
+ * \brief Get the authority certificate directory.
+ * \param root The root directory.
+ * \param vm The variables map.
+ * \param configuration The security configuration, as set up by setup_configuration(). Its authority certificates and revocation lists are used as well.
+ * \return The authority certificate directory, or a null pointer if there is none or if the certificates are not validated.
+ */
+boost::shared_ptr<authority_certificate_directory> get_authority_certificate_directory(const boost::filesystem::path& root, const boost::program_options::variables_map& vm, const freelan::security_configuration& configuration);
+
+/**
+ * \brief Get the certificate revocation index directory.
+ * \param root The root directory.
+ * \param vm The variables map.
+ * \return The directory to save the certificate revocation list indexes to, or an empty path if they are not saved.
+ */
+boost::filesystem::path get_certificate_revocation_index_directory(const boost::filesystem::path& root, const boost::program_options::variables_map& vm);
+
+/**
+ * \brief Get the certificate revocation index.
+ * \param root The root directory.
+ * \param vm The variables map.
+ * \param authorities The authority certificates.
+ * \param timings If not NULL, the time spent building the index is added to it.
+ * \param snapshot If not NULL, the index is taken from it instead of being built.
+ * \return The certificate revocation index, built from the certificate revocation list files, or a null pointer if the index is disabled.
+ */
+boost::shared_ptr<certificate_revocation_index> get_certificate_revocation_index(const boost::filesystem::path& root, const boost::program_options::variables_map& vm, const std::vector<freelan::security_configuration::cert_type>& authorities, startup_timings_type* timings = NULL, const configuration_snapshot* snapshot = NULL);
+
+/**
+ * \brief Get the certificate revocation validation method.
+ * \param vm The variables map.
+ * \return The certificate revocation validation method, as configured.
+ */
+freelan::security_configuration::certificate_revocation_validation_method_type get_certificate_revocation_validation_method(const boost::program_options::variables_map& vm);
+
+/**
+ * \brief Get the log level.
+ * \param vm The variables map.
+ * \return The log level.
+ */
+freelan::log_level get_log_level(const boost::program_options::variables_map& vm);
+
+/**
+ * \brief Parse a log level.
+ * \param value The log level name: debug, information, warning, error or fatal.
+ * \return The log level.
+ *
+ * If the name is invalid, a boost::program_options::invalid_option_value is thrown.
+ */
+freelan::log_level parse_log_level(const std::string& value);
+
+/**
+ * \brief The raw values of options, by option name.
+ */
+typedef std::map<std::string, std::vector<std::string> > option_values_type;
+
+/**
+ * \brief Get the raw values of parsed options.
+ * \param parsed_options The parsed options.
+ * \return The raw values of the options, in the order they were specified.
+ */
+option_values_type get_option_values(const boost::program_options::parsed_options& parsed_options);
+
+/**
+ * \brief Get the names of the options whose values differ.
+ * \param old_values The old option values.
+ * \param new_values The new option values.
+ * \return The names of the options that were added, removed or changed.
+ */
+std::set<std::string> get_changed_options(const option_values_type& old_values, const option_values_type& new_values);
+
+/**
+ * \brief Remove the network addresses that are contained in another network address of a list.
+ * \param networks The network addresses.
+ * \return The network addresses of networks that are not contained in another one, in their original order.
+ *
+ * An address belongs to one of the returned network addresses if and only if it belongs to one of networks. Duplicates are only returned once.
+ */
+std::vector<freelan::ip_network_address> get_outermost_network_addresses(const std::vector<freelan::ip_network_address>& networks);
+
+/**
+ * \brief Store raw option values into a variables map.
+ * \param values The raw option values, as returned by get_option_values().
+ * \param description The description of the options.
+ * \param vm The variables map.
+ * \warning On error, a boost::program_options::error might be thrown.
+ */
+void store_option_values(const option_values_type& values, const boost::program_options::options_description& description, boost::program_options::variables_map& vm);
+
+/**
+ * \brief Create a configuration snapshot.
+ * \param root The root directory.
+ * \param vm The variables map.
+ * \param options The configuration file options.
+ * \param configuration The configuration, as set up by setup_configuration().
+ * \param revocation_index The certificate revocation index, as returned by get_certificate_revocation_index().
+ * \return The snapshot.
+ */
+configuration_snapshot make_configuration_snapshot(const boost::filesystem::path& root, const boost::program_options::variables_map& vm, const option_values_type& options, const freelan::configuration& configuration, boost::shared_ptr<certificate_revocation_index> revocation_index);
+
 #endif /* CONFIGURATION_HELPER_HPP */
@@ -0,0 +1,566 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file configuration_snapshot.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A compiled configuration.
+ */
+
+#include "configuration_snapshot.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <boost/array.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/foreach.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <openssl/err.h>
+
+#ifndef WINDOWS
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+	const char SNAPSHOT_MAGIC[8] = { 'F', 'L', 'C', 'O', 'N', 'F', 'I', 'G' };
+	const boost::uint32_t SNAPSHOT_VERSION = 1;
+
+	// The magic, the version, a reserved field, the payload size and its SHA-256 digest, padded.
+	const std::size_t HEADER_SIZE = 64;
+
+	// Sections start on 8 bytes boundaries, so that a mapped snapshot can be read in place.
+	const std::size_t SECTION_ALIGNMENT = 8;
+
+	enum section_type
+	{
+		ST_ROOT = 1,
+		ST_OPTION = 2,
+		ST_SIGNATURE_CERTIFICATE = 3,
+		ST_SIGNATURE_PRIVATE_KEY = 4,
+		ST_ENCRYPTION_CERTIFICATE = 5,
+		ST_ENCRYPTION_PRIVATE_KEY = 6,
+		ST_AUTHORITY_CERTIFICATE = 7,
+		ST_CERTIFICATE_REVOCATION_LIST = 8,
+		ST_DYNAMIC_CONTACT = 9,
+		ST_REVOCATION_INDEX = 10
+	};
+
+	typedef boost::array<unsigned char, 32> digest_type;
+
+	digest_type sha256(const char* data, std::size_t size)
+	{
+		digest_type digest;
+		unsigned int length = static_cast<unsigned int>(digest.size());
+
+		if (!EVP_Digest(data, size, digest.c_array(), &length, EVP_sha256(), NULL) || (length != digest.size()))
+		{
+			throw std::runtime_error("Unable to compute a digest");
+		}
+
+		return digest;
+	}
+
+	void write_uint(std::string& buffer, boost::uint64_t value, unsigned int size)
+	{
+		for (unsigned int i = size; i > 0; --i)
+		{
+			buffer.push_back(static_cast<char>((value >> (8 * (i - 1))) & 0xff));
+		}
+	}
+
+	void write_string(std::string& buffer, const std::string& value)
+	{
+		write_uint(buffer, value.size(), 4);
+		buffer += value;
+	}
+
+	void write_section(std::string& buffer, section_type type, const std::string& data)
+	{
+		write_uint(buffer, type, 4);
+		write_uint(buffer, 0, 4);
+		write_uint(buffer, data.size(), 8);
+		buffer += data;
+		buffer.resize((buffer.size() + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT, '\0');
+	}
+
+	// The encoders take const pointers since OpenSSL 1.1.
+	template <typename Type, typename Encoder>
+	std::string to_der(Type* value, Encoder encoder)
+	{
+		const int length = encoder(value, NULL);
+
+		if (length < 0)
+		{
+			ERR_clear_error();
+
+			throw std::runtime_error("Unable to encode a certificate or a key");
+		}
+
+		std::string result(static_cast<std::size_t>(length), '\0');
+		unsigned char* data = reinterpret_cast<unsigned char*>(&result[0]);
+
+		encoder(value, &data);
+
+		return result;
+	}
+
+	void write_certificate_section(std::string& buffer, section_type type, configuration_snapshot::cert_type cert)
+	{
+		if (cert)
+		{
+			// Keeps the trust settings of the authority certificates.
+			write_section(buffer, type, to_der(cert.raw(), &i2d_X509_AUX));
+		}
+	}
+
+	void write_private_key_section(std::string& buffer, section_type type, configuration_snapshot::pkey key)
+	{
+		if (key)
+		{
+			write_section(buffer, type, to_der(key.raw(), &i2d_PrivateKey));
+		}
+	}
+
+	class memory_reader
+	{
+		public:
+
+			memory_reader(const char* data, std::size_t size) :
+				m_data(data),
+				m_end(data + size)
+			{
+			}
+
+			bool empty() const
+			{
+				return (m_data == m_end);
+			}
+
+			const char* read(boost::uint64_t size)
+			{
+				if (size > static_cast<boost::uint64_t>(m_end - m_data))
+				{
+					throw std::runtime_error("Truncated configuration snapshot");
+				}
+
+				const char* const result = m_data;
+				m_data += size;
+
+				return result;
+			}
+
+			boost::uint64_t read_uint(unsigned int size)
+			{
+				const unsigned char* const data = reinterpret_cast<const unsigned char*>(read(size));
+
+				boost::uint64_t value = 0;
+
+				for (unsigned int i = 0; i < size; ++i)
+				{
+					value = (value << 8) | data[i];
+				}
+
+				return value;
+			}
+
+			std::string read_string()
+			{
+				const boost::uint64_t size = read_uint(4);
+				const char* const data = read(size);
+
+				return std::string(data, static_cast<std::size_t>(size));
+			}
+
+			void align(const char* origin)
+			{
+				const std::size_t offset = static_cast<std::size_t>(m_data - origin);
+
+				read((SECTION_ALIGNMENT - offset % SECTION_ALIGNMENT) % SECTION_ALIGNMENT);
+			}
+
+		private:
+
+			const char* m_data;
+			const char* const m_end;
+	};
+
+	configuration_snapshot::cert_type read_certificate(const char* data, std::size_t size)
+	{
+		const unsigned char* ptr = reinterpret_cast<const unsigned char*>(data);
+		X509* const cert = d2i_X509_AUX(NULL, &ptr, static_cast<long>(size));
+
+		if (!cert)
+		{
+			ERR_clear_error();
+
+			throw std::runtime_error("Invalid certificate in the configuration snapshot");
+		}
+
+		return configuration_snapshot::cert_type::take_ownership(cert);
+	}
+
+	configuration_snapshot::pkey read_private_key(const char* data, std::size_t size)
+	{
+		const unsigned char* ptr = reinterpret_cast<const unsigned char*>(data);
+		EVP_PKEY* const key = d2i_AutoPrivateKey(NULL, &ptr, static_cast<long>(size));
+
+		if (!key)
+		{
+			ERR_clear_error();
+
+			throw std::runtime_error("Invalid private key in the configuration snapshot");
+		}
+
+		return configuration_snapshot::pkey::take_ownership(key);
+	}
+
+	configuration_snapshot::crl_type read_crl(const char* data, std::size_t size)
+	{
+		const unsigned char* ptr = reinterpret_cast<const unsigned char*>(data);
+		X509_CRL* const crl = d2i_X509_CRL(NULL, &ptr, static_cast<long>(size));
+
+		if (!crl)
+		{
+			ERR_clear_error();
+
+			throw std::runtime_error("Invalid certificate revocation list in the configuration snapshot");
+		}
+
+		return configuration_snapshot::crl_type::take_ownership(crl);
+	}
+
+	// The snapshot is read in place: only what it refers to gets copied.
+	class mapped_file
+	{
+		public:
+
+			explicit mapped_file(const fs::path& filename) :
+#ifdef WINDOWS
+				m_content()
+#else
+				m_data(NULL),
+				m_size(0)
+#endif
+			{
+#ifdef WINDOWS
+				fs::basic_ifstream<char> ifs(filename, std::ios::binary);
+
+				if (!ifs)
+				{
+					throw std::runtime_error("No such file: " + filename.string());
+				}
+
+				m_content.assign((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+				if (ifs.bad())
+				{
+					throw std::runtime_error("Unable to read: " + filename.string());
+				}
+#else
+				const int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+
+				if (fd < 0)
+				{
+					throw std::runtime_error("No such file: " + filename.string());
+				}
+
+				struct stat st;
+
+				if ((::fstat(fd, &st) < 0) || (st.st_size == 0))
+				{
+					::close(fd);
+
+					throw std::runtime_error("Unable to read: " + filename.string());
+				}
+
+				m_size = static_cast<std::size_t>(st.st_size);
+				m_data = ::mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+				::close(fd);
+
+				if (m_data == MAP_FAILED)
+				{
+					throw std::runtime_error("Unable to map: " + filename.string());
+				}
+#endif
+			}
+
+			~mapped_file()
+			{
+#ifndef WINDOWS
+				::munmap(m_data, m_size);
+#endif
+			}
+
+			const char* data() const
+			{
+#ifdef WINDOWS
+				return m_content.data();
+#else
+				return static_cast<const char*>(m_data);
+#endif
+			}
+
+			std::size_t size() const
+			{
+#ifdef WINDOWS
+				return m_content.size();
+#else
+				return m_size;
+#endif
+			}
+
+		private:
+
+			mapped_file(const mapped_file&);
+			mapped_file& operator=(const mapped_file&);
+
+#ifdef WINDOWS
+			std::string m_content;
+#else
+			void* m_data;
+			std::size_t m_size;
+#endif
+	};
+}
+
+void save_configuration_snapshot(const fs::path& filename, const configuration_snapshot& snapshot)
+{
+	std::string payload;
+
+	write_section(payload, ST_ROOT, snapshot.root.string());
+
+	BOOST_FOREACH(const option_values_type::value_type& option, snapshot.options)
+	{
+		std::string data;
+
+		write_string(data, option.first);
+		write_uint(data, option.second.size(), 4);
+
+		BOOST_FOREACH(const std::string& value, option.second)
+		{
+			write_string(data, value);
+		}
+
+		write_section(payload, ST_OPTION, data);
+	}
+
+	write_certificate_section(payload, ST_SIGNATURE_CERTIFICATE, snapshot.signature_certificate);
+	write_private_key_section(payload, ST_SIGNATURE_PRIVATE_KEY, snapshot.signature_private_key);
+	write_certificate_section(payload, ST_ENCRYPTION_CERTIFICATE, snapshot.encryption_certificate);
+	write_private_key_section(payload, ST_ENCRYPTION_PRIVATE_KEY, snapshot.encryption_private_key);
+
+	BOOST_FOREACH(const configuration_snapshot::cert_type& cert, snapshot.authority_certificates)
+	{
+		write_certificate_section(payload, ST_AUTHORITY_CERTIFICATE, cert);
+	}
+
+	BOOST_FOREACH(const configuration_snapshot::crl_type& crl, snapshot.certificate_revocation_lists)
+	{
+		write_section(payload, ST_CERTIFICATE_REVOCATION_LIST, to_der(crl.raw(), &i2d_X509_CRL));
+	}
+
+	BOOST_FOREACH(const configuration_snapshot::cert_type& cert, snapshot.dynamic_contacts)
+	{
+		write_certificate_section(payload, ST_DYNAMIC_CONTACT, cert);
+	}
+
+	if (snapshot.revocation_index)
+	{
+		std::string data;
+
+		snapshot.revocation_index->write(data);
+
+		write_section(payload, ST_REVOCATION_INDEX, data);
+	}
+
+	std::string header(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	write_uint(header, SNAPSHOT_VERSION, 4);
+	write_uint(header, 0, 4);
+	write_uint(header, payload.size(), 8);
+
+	const digest_type digest = sha256(payload.data(), payload.size());
+	header.append(reinterpret_cast<const char*>(digest.data()), digest.size());
+	header.resize(HEADER_SIZE, '\0');
+
+	// Readers must never see a partially written snapshot.
+	const fs::path temporary_filename = filename.string() + ".tmp";
+
+	{
+		fs::basic_ofstream<char> ofs(temporary_filename, std::ios::binary | std::ios::trunc);
+
+		if (!ofs)
+		{
+			throw std::runtime_error("Unable to write: " + temporary_filename.string());
+		}
+
+		// The snapshot contains the private keys.
+		fs::permissions(temporary_filename, fs::owner_read | fs::owner_write);
+
+		ofs.write(header.data(), header.size());
+		ofs.write(payload.data(), payload.size());
+
+		if (!ofs.flush())
+		{
+			ofs.close();
+
+			boost::system::error_code ec;
+			fs::remove(temporary_filename, ec);
+
+			throw std::runtime_error("Unable to write: " + temporary_filename.string());
+		}
+	}
+
+	fs::rename(temporary_filename, filename);
+}
+
+configuration_snapshot load_configuration_snapshot(const fs::path& filename)
+{
+	const mapped_file file(filename);
+
+	memory_reader header(file.data(), file.size());
+
+	if ((file.size() < HEADER_SIZE) || (std::memcmp(header.read(sizeof(SNAPSHOT_MAGIC)), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0))
+	{
+		throw std::runtime_error(filename.string() + " is not a configuration snapshot");
+	}
+
+	if (header.read_uint(4) != SNAPSHOT_VERSION)
+	{
+		throw std::runtime_error(filename.string() + " was compiled by another version: compile it again");
+	}
+
+	header.read_uint(4);
+
+	const boost::uint64_t payload_size = header.read_uint(8);
+
+	digest_type digest;
+	std::memcpy(digest.c_array(), header.read(digest.size()), digest.size());
+
+	const char* const payload = file.data() + HEADER_SIZE;
+
+	if ((payload_size != file.size() - HEADER_SIZE) || (sha256(payload, static_cast<std::size_t>(payload_size)) != digest))
+	{
+		throw std::runtime_error(filename.string() + " is corrupted");
+	}
+
+	configuration_snapshot snapshot;
+	memory_reader reader(payload, static_cast<std::size_t>(payload_size));
+
+	const char* revocation_index_data = NULL;
+	std::size_t revocation_index_size = 0;
+
+	while (!reader.empty())
+	{
+		const boost::uint64_t type = reader.read_uint(4);
+		reader.read_uint(4);
+		const std::size_t size = static_cast<std::size_t>(reader.read_uint(8));
+		const char* const data = reader.read(size);
+
+		switch (type)
+		{
+			case ST_ROOT:
+				snapshot.root = std::string(data, size);
+				break;
+			case ST_OPTION:
+				{
+					memory_reader option_reader(data, size);
+
+					std::vector<std::string>& values = snapshot.options[option_reader.read_string()];
+
+					for (boost::uint64_t count = option_reader.read_uint(4); count > 0; --count)
+					{
+						values.push_back(option_reader.read_string());
+					}
+
+					break;
+				}
+			case ST_SIGNATURE_CERTIFICATE:
+				snapshot.signature_certificate = read_certificate(data, size);
+				break;
+			case ST_SIGNATURE_PRIVATE_KEY:
+				snapshot.signature_private_key = read_private_key(data, size);
+				break;
+			case ST_ENCRYPTION_CERTIFICATE:
+				snapshot.encryption_certificate = read_certificate(data, size);
+				break;
+			case ST_ENCRYPTION_PRIVATE_KEY:
+				snapshot.encryption_private_key = read_private_key(data, size);
+				break;
+			case ST_AUTHORITY_CERTIFICATE:
+				snapshot.authority_certificates.push_back(read_certificate(data, size));
+				break;
+			case ST_CERTIFICATE_REVOCATION_LIST:
+				snapshot.certificate_revocation_lists.push_back(read_crl(data, size));
+				break;
+			case ST_DYNAMIC_CONTACT:
+				snapshot.dynamic_contacts.push_back(read_certificate(data, size));
+				break;
+			case ST_REVOCATION_INDEX:
+				// Read once all the authority certificates are known.
+				revocation_index_data = data;
+				revocation_index_size = size;
+				break;
+			default:
+				throw std::runtime_error(filename.string() + " contains an unknown section");
+		}
+
+		reader.align(payload);
+	}
+
+	if (revocation_index_data)
+	{
+		snapshot.revocation_index = boost::make_shared<certificate_revocation_index>(snapshot.authority_certificates);
+		snapshot.revocation_index->read(revocation_index_data, revocation_index_size);
+	}
+
+	return snapshot;
+}
@@ -0,0 +1,160 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file configuration_snapshot.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A compiled configuration.
+ */
+
+#ifndef CONFIGURATION_SNAPSHOT_HPP
+#define CONFIGURATION_SNAPSHOT_HPP
+
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cryptoplus/pkey/pkey.hpp>
+
+#include <freelan/configuration.hpp>
+
+#include "configuration_helper.hpp"
+#include "certificate_revocation_index.hpp"
+
+/**
+ * \brief A compiled configuration.
+ *
+ * A snapshot holds the configuration file options together with everything
+ * they refer to that is expensive to load: the certificates, private keys and
+ * certificate revocation lists, already decoded, and the certificate
+ * revocation index. Starting from a snapshot does not read any other file.
+ */
+struct configuration_snapshot
+{
+	/**
+	 * \brief The certificate type.
+	 */
+	typedef freelan::security_configuration::cert_type cert_type;
+
+	/**
+	 * \brief The certificate revocation list type.
+	 */
+	typedef freelan::security_configuration::crl_type crl_type;
+
+	/**
+	 * \brief The private key type.
+	 */
+	typedef cryptoplus::pkey::pkey pkey;
+
+	/**
+	 * \brief The directory the relative paths of the options are relative to.
+	 */
+	boost::filesystem::path root;
+
+	/**
+	 * \brief The configuration file options.
+	 */
+	option_values_type options;
+
+	/**
+	 * \brief The signature certificate, if any.
+	 */
+	cert_type signature_certificate;
+
+	/**
+	 * \brief The signature private key, if any.
+	 */
+	pkey signature_private_key;
+
+	/**
+	 * \brief The encryption certificate, if any.
+	 */
+	cert_type encryption_certificate;
+
+	/**
+	 * \brief The encryption private key, if any.
+	 */
+	pkey encryption_private_key;
+
+	/**
+	 * \brief The authority certificates.
+	 */
+	std::vector<cert_type> authority_certificates;
+
+	/**
+	 * \brief The certificate revocation lists, if the certificate revocation index is disabled.
+	 */
+	std::vector<crl_type> certificate_revocation_lists;
+
+	/**
+	 * \brief The dynamic contact certificates.
+	 */
+	std::vector<cert_type> dynamic_contacts;
+
+	/**
+	 * \brief The certificate revocation index, if it is enabled.
+	 */
+	boost::shared_ptr<certificate_revocation_index> revocation_index;
+};
+
+/**
+ * \brief Save a configuration snapshot.
+ * \param filename The file to write.
+ * \param snapshot The snapshot.
+ *
+ * The file is only readable by its owner, as it contains the private keys. It is replaced atomically.
+ *
+ * On error, a std::runtime_error is thrown.
+ */
+void save_configuration_snapshot(const boost::filesystem::path& filename, const configuration_snapshot& snapshot);
+
+/**
+ * \brief Load a configuration snapshot.
+ * \param filename The file to read.
+ * \return The snapshot.
+ *
+ * The file is rejected if it was written by another version of the format or if its checksum does not match.
+ *
+ * On error, a std::runtime_error is thrown.
+ */
+configuration_snapshot load_configuration_snapshot(const boost::filesystem::path& filename);
+
+#endif /* CONFIGURATION_SNAPSHOT_HPP */
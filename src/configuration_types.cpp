@@ -45,3 +45,138 @@
  */
 
 #include "configuration_types.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <stdexcept>
+#include <cassert>
+
+std::ostream& operator<<(std::ostream& os, const cpu_list& value)
+{
+	const cpu_list::values_type& values = value.m_values;
+
+	for (cpu_list::values_type::const_iterator it = values.begin(); it != values.end();)
+	{
+		cpu_list::values_type::const_iterator last = it;
+
+		while ((last + 1 != values.end()) && (*(last + 1) == *last + 1))
+		{
+			++last;
+		}
+
+		if (it != values.begin())
+		{
+			os << ",";
+		}
+
+		os << std::dec << *it;
+
+		if (last != it)
+		{
+			os << "-" << *last;
+		}
+
+		it = last + 1;
+	}
+
+	return os;
+}
+
+std::istream& operator>>(std::istream& is, cpu_list& value)
+{
+	std::string str;
+
+	if (!(is >> str))
+	{
+		return is;
+	}
+
+	cpu_list::values_type values;
+	std::istringstream iss(str);
+	std::string range;
+
+	while (std::getline(iss, range, ','))
+	{
+		std::istringstream riss(range);
+		unsigned int first = 0;
+		unsigned int last = 0;
+		char separator = '\0';
+
+		if (!(riss >> std::dec >> first))
+		{
+			is.setstate(std::ios_base::failbit);
+
+			return is;
+		}
+
+		if (riss >> separator)
+		{
+			if ((separator != '-') || !(riss >> std::dec >> last) || (last < first) || !riss.eof())
+			{
+				is.setstate(std::ios_base::failbit);
+
+				return is;
+			}
+		}
+		else
+		{
+			last = first;
+		}
+
+		for (unsigned int cpu = first; cpu <= last; ++cpu)
+		{
+			values.push_back(cpu);
+		}
+	}
+
+	std::sort(values.begin(), values.end());
+	values.erase(std::unique(values.begin(), values.end()), values.end());
+
+	value.m_values = values;
+
+	return is;
+}
+
+std::ostream& operator<<(std::ostream& os, const script_input_type& value)
+{
+	switch (value)
+	{
+		case SI_FILE:
+			return os << "file";
+		case SI_MEMFD:
+			return os << "memfd";
+		case SI_STDIN:
+			return os << "stdin";
+	}
+
+	assert(false);
+	throw std::logic_error("Unsupported enumeration value");
+}
+
+std::istream& operator>>(std::istream& is, script_input_type& value)
+{
+	std::string str;
+
+	if (is >> str)
+	{
+		if (str == "file")
+		{
+			value = SI_FILE;
+		}
+		else if (str == "memfd")
+		{
+			value = SI_MEMFD;
+		}
+		else if (str == "stdin")
+		{
+			value = SI_STDIN;
+		}
+		else
+		{
+			is.setstate(std::ios_base::failbit);
+		}
+	}
+
+	return is;
+}
@@ -49,6 +49,9 @@
 
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 
@@ -111,6 +114,59 @@ inline std::istream& operator>>(std::istream& is, millisecond_duration& value)
 	return is >> std::dec >> value.m_ms;
 }
 
+/**
+ * \brief A duration in microseconds.
+ */
+class microsecond_duration
+{
+	public:
+
+		/**
+		 * \brief Create a null duration.
+		 */
+		microsecond_duration() : m_us() {}
+
+		/**
+		 * \brief Create a microsecond duration.
+		 * \param us The microsecond count.
+		 */
+		microsecond_duration(unsigned int us) : m_us(us) {}
+
+		/**
+		 * \brief Conversion operator.
+		 * \return The converted value.
+		 */
+		operator unsigned int() const
+		{
+			return m_us;
+		}
+
+		/**
+		 * \brief Conversion operator.
+		 * \return The converted value.
+		 */
+		operator boost::posix_time::time_duration() const
+		{
+			return boost::posix_time::microseconds(m_us);
+		}
+
+	private:
+
+		unsigned int m_us;
+
+		friend std::ostream& operator<<(std::ostream&, const microsecond_duration&);
+		friend std::istream& operator>>(std::istream&, microsecond_duration&);
+};
+
+inline std::ostream& operator<<(std::ostream& os, const microsecond_duration& value)
+{
+	return os << std::dec << value.m_us;
+}
+inline std::istream& operator>>(std::istream& is, microsecond_duration& value)
+{
+	return is >> std::dec >> value.m_us;
+}
+
 /**
  * \brief A generic wrapper class.
  * \tparam Type The type of the object to wrap. Type must be default-constructible.
@@ -168,4 +224,200 @@ inline std::ostream& operator<<(std::ostream& os, const wrapper<Type>& value)
 	return os << value.m_object;
 }
 
+/**
+ * \brief A value that can also be "auto".
+ * \tparam Type The type of the value. Type must be default-constructible and have stream operators.
+ */
+template <typename Type>
+class auto_value
+{
+	public:
+
+		/**
+		 * \brief The value type.
+		 */
+		typedef Type value_type;
+
+		/**
+		 * \brief Create an "auto" value.
+		 */
+		auto_value() : m_auto(true), m_value() {}
+
+		/**
+		 * \brief Create a value.
+		 * \param value The value.
+		 */
+		auto_value(const value_type& value) : m_auto(false), m_value(value) {}
+
+		/**
+		 * \brief Check if the value is "auto".
+		 * \return true if the value is "auto".
+		 */
+		bool is_auto() const
+		{
+			return m_auto;
+		}
+
+		/**
+		 * \brief Get the value.
+		 * \return The value. Only meaningful if is_auto() is false.
+		 */
+		const value_type& value() const
+		{
+			return m_value;
+		}
+
+	private:
+
+		bool m_auto;
+		value_type m_value;
+
+		template <typename OtherType> friend std::istream& operator>>(std::istream&, auto_value<OtherType>&);
+};
+
+/**
+ * \brief Output an auto value to a stream.
+ * \param os The output stream.
+ * \param value The value.
+ * \return os.
+ */
+template <typename Type>
+inline std::ostream& operator<<(std::ostream& os, const auto_value<Type>& value)
+{
+	if (value.is_auto())
+	{
+		return os << "auto";
+	}
+
+	return os << value.value();
+}
+
+/**
+ * \brief Read an auto value from a stream.
+ * \param is The input stream.
+ * \param value The value.
+ * \return is.
+ */
+template <typename Type>
+inline std::istream& operator>>(std::istream& is, auto_value<Type>& value)
+{
+	std::string str;
+
+	if (is >> str)
+	{
+		if (str == "auto")
+		{
+			value.m_auto = true;
+		}
+		else
+		{
+			std::istringstream iss(str);
+
+			if (iss >> value.m_value)
+			{
+				value.m_auto = false;
+			}
+			else
+			{
+				is.setstate(std::ios_base::failbit);
+			}
+		}
+	}
+
+	return is;
+}
+
+/**
+ * \brief A list of CPU indexes.
+ *
+ * The textual representation is a comma-separated list of CPU indexes or ranges, like "0-3,8".
+ */
+class cpu_list
+{
+	public:
+
+		/**
+		 * \brief The CPU indexes type.
+		 */
+		typedef std::vector<unsigned int> values_type;
+
+		/**
+		 * \brief Create an empty CPU list.
+		 */
+		cpu_list() : m_values() {}
+
+		/**
+		 * \brief Create a CPU list.
+		 * \param values The CPU indexes.
+		 */
+		cpu_list(const values_type& values) : m_values(values) {}
+
+		/**
+		 * \brief Get the CPU indexes.
+		 * \return The CPU indexes, in ascending order.
+		 */
+		const values_type& values() const
+		{
+			return m_values;
+		}
+
+		/**
+		 * \brief Check if the list is empty.
+		 * \return true if the list is empty.
+		 */
+		bool empty() const
+		{
+			return m_values.empty();
+		}
+
+	private:
+
+		values_type m_values;
+
+		friend std::ostream& operator<<(std::ostream&, const cpu_list&);
+		friend std::istream& operator>>(std::istream&, cpu_list&);
+};
+
+/**
+ * \brief Write a CPU list to an output stream.
+ * \param os The output stream.
+ * \param value The CPU list.
+ * \return os.
+ */
+std::ostream& operator<<(std::ostream& os, const cpu_list& value);
+
+/**
+ * \brief Read a CPU list from an input stream.
+ * \param is The input stream.
+ * \param value The CPU list.
+ * \return is.
+ */
+std::istream& operator>>(std::istream& is, cpu_list& value);
+
+/**
+ * \brief The ways to hand a certificate to a validation script.
+ */
+enum script_input_type
+{
+	SI_FILE, /**< \brief A temporary file, whose path is the first argument. */
+	SI_MEMFD, /**< \brief An anonymous memory file, whose /proc/self/fd path is the first argument. Linux only. */
+	SI_STDIN /**< \brief The standard input of the script. The first argument is /dev/stdin. */
+};
+
+/**
+ * \brief Write a script input type to an output stream.
+ * \param os The output stream.
+ * \param value The script input type.
+ * \return os.
+ */
+std::ostream& operator<<(std::ostream& os, const script_input_type& value);
+
+/**
+ * \brief Read a script input type from an input stream.
+ * \param is The input stream.
+ * \param value The script input type.
+ * \return is.
+ */
+std::istream& operator>>(std::istream& is, script_input_type& value);
+
 #endif /* CONFIGURATION_TYPES_HPP */
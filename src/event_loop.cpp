@@ -0,0 +1,198 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file event_loop.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An event loop with configurable polling.
+ */
+
+#include "event_loop.hpp"
+
+#include <boost/system/system_error.hpp>
+#include <boost/thread/locks.hpp>
+
+#include "system.hpp"
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <errno.h>
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#endif
+
+bool set_socket_busy_poll(boost::asio::ip::udp::socket& socket, unsigned int timeout)
+{
+#ifdef __linux__
+	const int value = static_cast<int>(timeout);
+
+	if (::setsockopt(socket.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value)) != 0)
+	{
+		throw boost::system::system_error(errno, boost::system::system_category(), "setsockopt(SO_BUSY_POLL)");
+	}
+
+	return true;
+#else
+	(void)socket;
+	(void)timeout;
+
+	return false;
+#endif
+}
+
+event_loop::statistics_type& event_loop::statistics_type::operator+=(const statistics_type& other)
+{
+	busy_time += other.busy_time;
+	spin_time += other.spin_time;
+	sleep_time += other.sleep_time;
+	spin_handler_count += other.spin_handler_count;
+	wakeup_count += other.wakeup_count;
+
+	return *this;
+}
+
+event_loop::event_loop(boost::asio::io_service& io_service, runtime_configuration::poll_mode_type poll_mode, const boost::posix_time::time_duration& busy_poll_budget) :
+	m_io_service(io_service),
+	m_poll_mode(poll_mode),
+	m_busy_poll_budget(static_cast<boost::uint64_t>(busy_poll_budget.total_microseconds()) * 1000)
+{
+}
+
+void event_loop::run()
+{
+	statistics_type statistics;
+
+	try
+	{
+		if (m_poll_mode == runtime_configuration::PM_BLOCKING)
+		{
+			m_io_service.run();
+		}
+		else
+		{
+			poll(statistics);
+		}
+	}
+	catch (...)
+	{
+		publish(statistics);
+
+		throw;
+	}
+
+	publish(statistics);
+}
+
+event_loop::statistics_type event_loop::statistics() const
+{
+	boost::lock_guard<boost::mutex> lock(m_statistics_mutex);
+
+	return m_statistics;
+}
+
+void event_loop::publish(statistics_type& statistics)
+{
+	boost::lock_guard<boost::mutex> lock(m_statistics_mutex);
+
+	m_statistics += statistics;
+
+	statistics = statistics_type();
+}
+
+void event_loop::poll(statistics_type& statistics)
+{
+	// Publishing takes a lock: not on every poll.
+	const unsigned int publish_interval = 4096;
+
+	boost::uint64_t last_activity = get_monotonic_time();
+	unsigned int poll_count = 0;
+
+	for (;;)
+	{
+		if (++poll_count == publish_interval)
+		{
+			publish(statistics);
+
+			poll_count = 0;
+		}
+
+		const boost::uint64_t poll_start = get_monotonic_time();
+		const std::size_t handler_count = m_io_service.poll();
+		const boost::uint64_t poll_end = get_monotonic_time();
+
+		if (handler_count > 0)
+		{
+			statistics.busy_time += poll_end - poll_start;
+			statistics.spin_handler_count += handler_count;
+			last_activity = poll_end;
+
+			continue;
+		}
+
+		statistics.spin_time += poll_end - poll_start;
+
+		// The I/O service stops by itself when it runs out of work.
+		if (m_io_service.stopped())
+		{
+			break;
+		}
+
+		if ((m_poll_mode == runtime_configuration::PM_BUSY) || (poll_end - last_activity < m_busy_poll_budget))
+		{
+			continue;
+		}
+
+		publish(statistics);
+
+		const boost::uint64_t sleep_start = get_monotonic_time();
+		const std::size_t wakeup_handler_count = m_io_service.run_one();
+		last_activity = get_monotonic_time();
+
+		statistics.sleep_time += last_activity - sleep_start;
+		++statistics.wakeup_count;
+
+		if (wakeup_handler_count == 0)
+		{
+			break;
+		}
+	}
+}
@@ -0,0 +1,186 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file event_loop.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An event loop with configurable polling.
+ */
+
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "runtime_configuration.hpp"
+
+/**
+ * \brief Enable kernel busy polling on a socket.
+ * \param socket The socket.
+ * \param timeout The time the kernel may busy poll the device queues for on reads, in microseconds.
+ * \return true on success, false if the platform does not support socket busy polling.
+ *
+ * On error, a boost::system::system_error is thrown. Linux requires CAP_NET_ADMIN: without it, the error is EPERM.
+ */
+bool set_socket_busy_poll(boost::asio::ip::udp::socket& socket, unsigned int timeout);
+
+/**
+ * \brief An event loop.
+ *
+ * The event loop runs an I/O service either by waiting for events in the
+ * kernel, by busy polling for events, or by busy polling for a while after
+ * the last activity before waiting in the kernel.
+ */
+class event_loop
+{
+	public:
+
+		/**
+		 * \brief The event loop statistics.
+		 *
+		 * All durations are in nanoseconds.
+		 */
+		struct statistics_type
+		{
+			/**
+			 * \brief Create null statistics.
+			 */
+			statistics_type() :
+				busy_time(0),
+				spin_time(0),
+				sleep_time(0),
+				spin_handler_count(0),
+				wakeup_count(0)
+			{
+			}
+
+			/**
+			 * \brief Add statistics.
+			 * \param other The statistics to add.
+			 * \return *this.
+			 */
+			statistics_type& operator+=(const statistics_type& other);
+
+			/**
+			 * \brief The time spent polling while handlers were ready.
+			 */
+			boost::uint64_t busy_time;
+
+			/**
+			 * \brief The time spent polling while no handler was ready.
+			 */
+			boost::uint64_t spin_time;
+
+			/**
+			 * \brief The time spent waiting for events in the kernel, including the handlers that ended the waits.
+			 */
+			boost::uint64_t sleep_time;
+
+			/**
+			 * \brief The number of handlers run while polling.
+			 */
+			boost::uint64_t spin_handler_count;
+
+			/**
+			 * \brief The number of times the loop waited for events in the kernel.
+			 */
+			boost::uint64_t wakeup_count;
+		};
+
+		/**
+		 * \brief Create an event loop.
+		 * \param io_service The I/O service to run.
+		 * \param poll_mode The poll mode.
+		 * \param busy_poll_budget The time to busy poll for after the last activity, in the adaptive poll mode.
+		 */
+		event_loop(boost::asio::io_service& io_service, runtime_configuration::poll_mode_type poll_mode, const boost::posix_time::time_duration& busy_poll_budget);
+
+		/**
+		 * \brief Get the I/O service.
+		 * \return The I/O service.
+		 */
+		boost::asio::io_service& io_service()
+		{
+			return m_io_service;
+		}
+
+		/**
+		 * \brief Get the poll mode.
+		 * \return The poll mode.
+		 */
+		runtime_configuration::poll_mode_type poll_mode() const
+		{
+			return m_poll_mode;
+		}
+
+		/**
+		 * \brief Run the event loop until the I/O service runs out of work or is stopped.
+		 *
+		 * Several threads may run the same event loop concurrently.
+		 */
+		void run();
+
+		/**
+		 * \brief Get the statistics.
+		 * \return The statistics.
+		 *
+		 * Running loops publish their statistics before they wait for events in
+		 * the kernel and every few thousand polls: the result may lag slightly.
+		 */
+		statistics_type statistics() const;
+
+	private:
+
+		event_loop(const event_loop&);
+		event_loop& operator=(const event_loop&);
+
+		void poll(statistics_type& statistics);
+		void publish(statistics_type& statistics);
+
+		boost::asio::io_service& m_io_service;
+		runtime_configuration::poll_mode_type m_poll_mode;
+		boost::uint64_t m_busy_poll_budget;
+		mutable boost::mutex m_statistics_mutex;
+		statistics_type m_statistics;
+};
+
+#endif /* EVENT_LOOP_HPP */
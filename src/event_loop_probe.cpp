@@ -0,0 +1,104 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file event_loop_probe.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A probe that measures how long handlers wait in an event loop.
+ */
+
+#include "event_loop_probe.hpp"
+
+#include <boost/bind.hpp>
+
+#include "system.hpp"
+#include "flight_recorder.hpp"
+
+event_loop_probe::event_loop_probe(boost::asio::io_service& io_service, const boost::posix_time::time_duration& interval, latency_histogram& histogram) :
+	m_io_service(io_service),
+	m_timer(io_service),
+	m_interval(interval),
+	m_histogram(histogram),
+	m_stopped(false)
+{
+}
+
+void event_loop_probe::start()
+{
+	arm();
+}
+
+void event_loop_probe::stop()
+{
+	m_stopped = true;
+
+	m_timer.cancel();
+}
+
+void event_loop_probe::arm()
+{
+	if (!m_stopped)
+	{
+		m_timer.expires_from_now(m_interval);
+		m_timer.async_wait(boost::bind(&event_loop_probe::handle_timer, this, boost::asio::placeholders::error));
+	}
+}
+
+void event_loop_probe::handle_timer(const boost::system::error_code& ec)
+{
+	if (ec == boost::asio::error::operation_aborted)
+	{
+		return;
+	}
+
+	// Posted rather than called: the handler must queue like any other.
+	m_io_service.post(boost::bind(&event_loop_probe::measure, this, get_monotonic_time()));
+
+	arm();
+}
+
+void event_loop_probe::measure(boost::uint64_t posted)
+{
+	const boost::uint64_t delay = get_monotonic_time() - posted;
+
+	m_histogram.record(delay);
+
+	record_flight_event(FE_EVENT_LOOP_DELAY, 0, delay);
+}
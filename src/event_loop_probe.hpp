@@ -0,0 +1,104 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file event_loop_probe.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A probe that measures how long handlers wait in an event loop.
+ */
+
+#ifndef EVENT_LOOP_PROBE_HPP
+#define EVENT_LOOP_PROBE_HPP
+
+#include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "latency_histogram.hpp"
+
+/**
+ * \brief Measure the queueing delay of an I/O service.
+ *
+ * At each interval, the probe posts a timestamped handler to the I/O service
+ * and records how long it waited to run. That is the delay that packets pay
+ * behind the other handlers, on top of their own processing.
+ */
+class event_loop_probe : private boost::noncopyable
+{
+	public:
+
+		/**
+		 * \brief Create a probe.
+		 * \param io_service The I/O service to measure.
+		 * \param interval The time between two measures.
+		 * \param histogram The histogram to record the delays into.
+		 *
+		 * The probe must outlive any run of the I/O service.
+		 */
+		event_loop_probe(boost::asio::io_service& io_service, const boost::posix_time::time_duration& interval, latency_histogram& histogram);
+
+		/**
+		 * \brief Start measuring.
+		 *
+		 * Must be called before the I/O service runs or from one of its handlers.
+		 */
+		void start();
+
+		/**
+		 * \brief Stop measuring.
+		 *
+		 * Must be called from a handler of the I/O service: post it from other threads. Once stopped, the probe does not keep the I/O service busy.
+		 */
+		void stop();
+
+	private:
+
+		void arm();
+		void handle_timer(const boost::system::error_code& ec);
+		void measure(boost::uint64_t posted);
+
+		boost::asio::io_service& m_io_service;
+		boost::asio::deadline_timer m_timer;
+		boost::posix_time::time_duration m_interval;
+		latency_histogram& m_histogram;
+		bool m_stopped;
+};
+
+#endif /* EVENT_LOOP_PROBE_HPP */
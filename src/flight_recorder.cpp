@@ -0,0 +1,419 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file flight_recorder.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A flight recorder of the recent events.
+ */
+
+#include "flight_recorder.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <cryptoplus/os.hpp>
+
+#ifdef WINDOWS
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <process.h>
+#else
+#include <csignal>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include <boost/static_assert.hpp>
+
+#include "atomic.hpp"
+#include "system.hpp"
+
+#if defined(_MSC_VER)
+#define FLIGHT_RECORDER_THREAD_LOCAL __declspec(thread)
+#else
+#define FLIGHT_RECORDER_THREAD_LOCAL __thread
+#endif
+
+BOOST_STATIC_ASSERT(sizeof(flight_event) == 64);
+
+namespace
+{
+	// Threads beyond that do not record anything: the daemon runs a fixed number of threads.
+	const std::size_t MAX_BUFFER_COUNT = 64;
+
+	struct flight_buffer
+	{
+		volatile boost::uint64_t write_count;
+		boost::uint32_t thread_index;
+		boost::uint32_t capacity;
+		flight_event* events;
+	};
+
+	// Set once, before the recorder is used.
+	std::size_t recorder_capacity = 0;
+	char recorder_path[4096] = {};
+
+	// The buffers are never freed: they must outlive their threads and be available to the crash handler.
+	flight_buffer* buffers[MAX_BUFFER_COUNT] = {};
+	volatile boost::uint32_t buffer_ready[MAX_BUFFER_COUNT] = {};
+	volatile boost::uint32_t buffer_count = 0;
+
+	// Marks the threads that could not get a buffer, so they do not try again.
+	flight_buffer no_buffer = {};
+
+	FLIGHT_RECORDER_THREAD_LOCAL flight_buffer* thread_buffer = NULL;
+
+#ifndef WINDOWS
+	// The alternate stack is per-thread: a stack overflow leaves no stack for the crash handler to run on otherwise.
+	// Like the buffers, the stacks are never freed.
+	void install_alternate_signal_stack()
+	{
+		stack_t current_stack = {};
+
+		if ((::sigaltstack(NULL, &current_stack) == 0) && !(current_stack.ss_flags & SS_DISABLE))
+		{
+			return;
+		}
+
+		stack_t stack = {};
+		stack.ss_size = std::max<std::size_t>(SIGSTKSZ, 65536);
+		stack.ss_sp = std::malloc(stack.ss_size);
+
+		if (stack.ss_sp && (::sigaltstack(&stack, NULL) != 0))
+		{
+			std::free(stack.ss_sp);
+		}
+	}
+#endif
+
+	flight_buffer* create_thread_buffer()
+	{
+#ifndef WINDOWS
+		install_alternate_signal_stack();
+#endif
+
+		const boost::uint32_t index = atomic_fetch_add(buffer_count, static_cast<boost::uint32_t>(1));
+
+		if (index >= MAX_BUFFER_COUNT)
+		{
+			return &no_buffer;
+		}
+
+		flight_buffer* const buffer = new (std::nothrow) flight_buffer();
+		flight_event* const events = new (std::nothrow) flight_event[recorder_capacity]();
+
+		if (!buffer || !events)
+		{
+			delete buffer;
+			delete[] events;
+
+			return &no_buffer;
+		}
+
+		buffer->write_count = 0;
+		buffer->thread_index = index;
+		buffer->capacity = static_cast<boost::uint32_t>(recorder_capacity);
+		buffer->events = events;
+
+		buffers[index] = buffer;
+		atomic_store(buffer_ready[index], static_cast<boost::uint32_t>(1));
+
+		return buffer;
+	}
+
+	boost::uint64_t get_real_time()
+	{
+#ifdef WINDOWS
+		FILETIME file_time;
+		::GetSystemTimeAsFileTime(&file_time);
+
+		const boost::uint64_t intervals = (static_cast<boost::uint64_t>(file_time.dwHighDateTime) << 32) | file_time.dwLowDateTime;
+
+		// FILETIME counts 100 ns intervals since 1601-01-01.
+		return (intervals - 116444736000000000ULL) * 100;
+#else
+		timespec ts;
+		::clock_gettime(CLOCK_REALTIME, &ts);
+
+		return static_cast<boost::uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<boost::uint64_t>(ts.tv_nsec);
+#endif
+	}
+
+#ifdef WINDOWS
+	int open_dump_file()
+	{
+		return ::_open(recorder_path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+	}
+
+	bool write_all(int fd, const void* data, std::size_t size)
+	{
+		const char* const bytes = static_cast<const char*>(data);
+
+		for (std::size_t offset = 0; offset < size;)
+		{
+			const int count = ::_write(fd, bytes + offset, static_cast<unsigned int>(size - offset));
+
+			if (count <= 0)
+			{
+				return false;
+			}
+
+			offset += static_cast<std::size_t>(count);
+		}
+
+		return true;
+	}
+
+	void close_dump_file(int fd)
+	{
+		::_close(fd);
+	}
+
+	boost::uint32_t get_process_id()
+	{
+		return static_cast<boost::uint32_t>(::_getpid());
+	}
+#else
+	int open_dump_file()
+	{
+		return ::open(recorder_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	}
+
+	bool write_all(int fd, const void* data, std::size_t size)
+	{
+		const char* const bytes = static_cast<const char*>(data);
+
+		for (std::size_t offset = 0; offset < size;)
+		{
+			const ssize_t count = ::write(fd, bytes + offset, size - offset);
+
+			if (count < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				return false;
+			}
+
+			offset += static_cast<std::size_t>(count);
+		}
+
+		return true;
+	}
+
+	void close_dump_file(int fd)
+	{
+		::close(fd);
+	}
+
+	boost::uint32_t get_process_id()
+	{
+		return static_cast<boost::uint32_t>(::getpid());
+	}
+
+	const int fatal_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+	void fatal_signal_handler(int signal_number)
+	{
+		const int saved_errno = errno;
+
+		// Allocating the buffer of a thread is not async-signal-safe.
+		if (thread_buffer)
+		{
+			record_flight_event(FE_SIGNAL, static_cast<boost::uint32_t>(signal_number));
+		}
+
+		dump_flight_recorder();
+
+		errno = saved_errno;
+
+		// The handler was reset: this runs the default action, which usually dumps core.
+		::raise(signal_number);
+	}
+
+	void install_fatal_signal_handlers()
+	{
+		// The other threads get theirs when they record their first event.
+		install_alternate_signal_stack();
+
+		struct sigaction action;
+		std::memset(&action, 0, sizeof(action));
+		action.sa_handler = &fatal_signal_handler;
+		action.sa_flags = SA_RESETHAND | SA_ONSTACK;
+		::sigemptyset(&action.sa_mask);
+
+		for (std::size_t i = 0; i < sizeof(fatal_signals) / sizeof(fatal_signals[0]); ++i)
+		{
+			::sigaction(fatal_signals[i], &action, NULL);
+		}
+	}
+#endif
+}
+
+void start_flight_recorder(std::size_t capacity, const std::string& path)
+{
+	if (capacity == 0)
+	{
+		return;
+	}
+
+	if (path.size() >= sizeof(recorder_path))
+	{
+		throw std::runtime_error("The flight recorder file path is too long: " + path);
+	}
+
+	std::memcpy(recorder_path, path.c_str(), path.size() + 1);
+	recorder_capacity = capacity;
+
+#ifndef WINDOWS
+	install_fatal_signal_handlers();
+#endif
+}
+
+void record_flight_event(flight_event_type type, boost::uint32_t value1, boost::uint64_t value2, const char* text, std::size_t text_size)
+{
+	if (recorder_capacity == 0)
+	{
+		return;
+	}
+
+	flight_buffer* buffer = thread_buffer;
+
+	if (!buffer)
+	{
+		buffer = thread_buffer = create_thread_buffer();
+	}
+
+	if (buffer->capacity == 0)
+	{
+		return;
+	}
+
+	// Only the current thread writes to its buffer.
+	const boost::uint64_t index = buffer->write_count;
+	flight_event& event = buffer->events[index % buffer->capacity];
+
+	event.type = FE_NONE;
+	event.timestamp = get_monotonic_time();
+	event.value1 = value1;
+	event.value2 = value2;
+	event.text_size = static_cast<boost::uint16_t>(std::min(text_size, sizeof(event.text)));
+
+	if (event.text_size > 0)
+	{
+		std::memcpy(event.text, text, event.text_size);
+	}
+
+	event.type = static_cast<boost::uint16_t>(type);
+
+	atomic_store(buffer->write_count, index + 1);
+}
+
+bool dump_flight_recorder()
+{
+	if (recorder_capacity == 0)
+	{
+		return false;
+	}
+
+	const int fd = open_dump_file();
+
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	const boost::uint32_t count = std::min<boost::uint32_t>(atomic_load(buffer_count), MAX_BUFFER_COUNT);
+
+	flight_file_header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, FLIGHT_FILE_MAGIC, sizeof(header.magic));
+	header.version = FLIGHT_FILE_VERSION;
+	header.event_size = sizeof(flight_event);
+	header.monotonic_time = get_monotonic_time();
+	header.real_time = get_real_time();
+	header.process_id = get_process_id();
+
+	// Threads that could not get a buffer, or are still allocating it, are skipped.
+	const flight_buffer* ready_buffers[MAX_BUFFER_COUNT];
+
+	for (boost::uint32_t i = 0; i < count; ++i)
+	{
+		if (atomic_load(buffer_ready[i]))
+		{
+			ready_buffers[header.buffer_count++] = buffers[i];
+		}
+	}
+
+	bool result = write_all(fd, &header, sizeof(header));
+
+	for (boost::uint32_t i = 0; result && (i < header.buffer_count); ++i)
+	{
+		const flight_buffer* const buffer = ready_buffers[i];
+
+		flight_buffer_header buffer_header;
+		std::memset(&buffer_header, 0, sizeof(buffer_header));
+		buffer_header.write_count = atomic_load(buffer->write_count);
+		buffer_header.thread_index = buffer->thread_index;
+		buffer_header.capacity = buffer->capacity;
+
+		result = write_all(fd, &buffer_header, sizeof(buffer_header)) && write_all(fd, buffer->events, buffer->capacity * sizeof(flight_event));
+	}
+
+	close_dump_file(fd);
+
+	return result;
+}
+
+std::string get_flight_recorder_path()
+{
+	return (recorder_capacity > 0) ? std::string(recorder_path) : std::string();
+}
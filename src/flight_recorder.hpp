@@ -0,0 +1,184 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file flight_recorder.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A flight recorder of the recent events.
+ *
+ * Each thread records its events in its own ring buffer, which holds the
+ * last events of the thread. Recording an event neither locks nor allocates:
+ * it can be left on permanently. The buffers can be dumped to a file, even
+ * from a signal handler, and the file decoded offline with
+ * freelan_flight_decoder.
+ */
+
+#ifndef FLIGHT_RECORDER_HPP
+#define FLIGHT_RECORDER_HPP
+
+#include <cstddef>
+#include <string>
+
+#include <boost/cstdint.hpp>
+
+/**
+ * \brief The flight recorder event types.
+ *
+ * Values are part of the file format: never reuse one.
+ */
+enum flight_event_type
+{
+	FE_NONE = 0, /**< \brief An event that was being written when the buffer was dumped. */
+	FE_LOG = 1, /**< \brief A message was logged. value1: the log level, from 0 (debug) to 4 (fatal). text: the beginning of the message. */
+	FE_SIGNAL = 2, /**< \brief A signal was handled. value1: the signal number. */
+	FE_CERTIFICATE_VALIDATION = 3, /**< \brief A peer certificate was validated. value1: 1 if accepted. value2: the duration in nanoseconds. text: the peer name. */
+	FE_TAP_ADAPTER_UP = 4, /**< \brief The tap adapter went up. text: its name. */
+	FE_TAP_ADAPTER_DOWN = 5, /**< \brief The tap adapter went down. text: its name. */
+	FE_SCRIPT_START = 6, /**< \brief A script was spawned. value1: its process id. text: the end of its path. */
+	FE_SCRIPT_END = 7, /**< \brief A script terminated. value1: its process id. value2: its exit status, or -1 if it did not exit by itself (timeout or error). */
+	FE_EVENT_LOOP_DELAY = 8, /**< \brief The event loop probe timer fired. value2: the queueing delay in nanoseconds. */
+	FE_CONFIGURATION_RELOAD = 9, /**< \brief The configuration was reloaded. value1: 1 on success. */
+	FE_CONTROL_COMMAND = 10 /**< \brief A control command was run. text: the command name. */
+};
+
+/**
+ * \brief A recorded event.
+ *
+ * One cache line. All times are monotonic, in nanoseconds.
+ */
+struct flight_event
+{
+	boost::uint64_t timestamp; /**< \brief The time the event was recorded at. */
+	boost::uint16_t type; /**< \brief The event type, a flight_event_type. */
+	boost::uint16_t text_size; /**< \brief The size of the text. */
+	boost::uint32_t value1; /**< \brief The first value. Its meaning depends on the type. */
+	boost::uint64_t value2; /**< \brief The second value. Its meaning depends on the type. */
+	char text[40]; /**< \brief The text. Not null-terminated. */
+};
+
+/**
+ * \brief The header of a flight recorder file.
+ *
+ * It is followed by buffer_count buffers, each made of a flight_buffer_header
+ * and its events. Values are written in the native byte order.
+ */
+struct flight_file_header
+{
+	char magic[8]; /**< \brief FLIGHT_FILE_MAGIC. */
+	boost::uint32_t version; /**< \brief FLIGHT_FILE_VERSION. */
+	boost::uint32_t event_size; /**< \brief sizeof(flight_event). */
+	boost::uint64_t monotonic_time; /**< \brief The monotonic time of the dump. */
+	boost::uint64_t real_time; /**< \brief The real time of the dump, in nanoseconds since the epoch. */
+	boost::uint32_t buffer_count; /**< \brief The number of buffers. */
+	boost::uint32_t process_id; /**< \brief The process id. */
+};
+
+/**
+ * \brief The header of a thread buffer in a flight recorder file.
+ */
+struct flight_buffer_header
+{
+	boost::uint64_t write_count; /**< \brief The number of events ever recorded by the thread. */
+	boost::uint32_t thread_index; /**< \brief The thread index, in the order the threads first recorded an event. */
+	boost::uint32_t capacity; /**< \brief The number of events in the buffer. Event i is stored at i % capacity. */
+};
+
+/**
+ * \brief The magic string of flight recorder files.
+ */
+const char FLIGHT_FILE_MAGIC[8] = { 'F', 'L', 'F', 'L', 'I', 'G', 'H', 'T' };
+
+/**
+ * \brief The flight recorder file format version.
+ */
+const boost::uint32_t FLIGHT_FILE_VERSION = 1;
+
+/**
+ * \brief Start the flight recorder.
+ * \param capacity The number of events each thread keeps. 0 disables the recorder.
+ * \param path The file to dump the events to.
+ *
+ * Must be called once, before the threads that record events are started.
+ * Events recorded before are discarded. On POSIX systems, the events are also
+ * dumped when the process gets a fatal signal.
+ */
+void start_flight_recorder(std::size_t capacity, const std::string& path);
+
+/**
+ * \brief Record an event.
+ * \param type The event type.
+ * \param value1 The first value.
+ * \param value2 The second value.
+ * \param text The text. Only the first bytes are kept.
+ * \param text_size The size of text.
+ *
+ * The first event of a thread allocates its buffer. Then, recording neither
+ * locks nor allocates.
+ */
+void record_flight_event(flight_event_type type, boost::uint32_t value1, boost::uint64_t value2 = 0, const char* text = NULL, std::size_t text_size = 0);
+
+/**
+ * \brief Record an event.
+ * \param type The event type.
+ * \param value1 The first value.
+ * \param value2 The second value.
+ * \param text The text. Only the first bytes are kept.
+ */
+inline void record_flight_event(flight_event_type type, boost::uint32_t value1, boost::uint64_t value2, const std::string& text)
+{
+	record_flight_event(type, value1, value2, text.data(), text.size());
+}
+
+/**
+ * \brief Dump the recorded events to the file.
+ * \return true on success.
+ *
+ * Async-signal-safe. Events recorded during the dump may be torn: they are
+ * then reported with the FE_NONE type or with a mix of old and new values.
+ */
+bool dump_flight_recorder();
+
+/**
+ * \brief Get the file the events are dumped to.
+ * \return The file. Empty if the recorder is disabled.
+ */
+std::string get_flight_recorder_path();
+
+#endif /* FLIGHT_RECORDER_HPP */
@@ -0,0 +1,455 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file ip_prefix_table.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A longest-prefix-match table of IPv4 and IPv6 networks.
+ */
+
+#ifndef IP_PREFIX_TABLE_HPP
+#define IP_PREFIX_TABLE_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+#include <boost/array.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/variant.hpp>
+#include <boost/asio/ip/address.hpp>
+
+#include <freelan/ip_network_address.hpp>
+
+/**
+ * \brief A path-compressed binary trie, keyed by fixed-size bit strings.
+ * \tparam Size The key size, in bytes.
+ * \tparam Type The value type. Type must be copy-constructible and assignable.
+ *
+ * Nodes only exist where prefixes are stored or where two stored prefixes
+ * diverge, so a lookup visits at most one node per stored prefix length on
+ * the path to the address, whatever the number of prefixes. Nodes are kept
+ * in a single vector and refer to each other by index.
+ */
+template <std::size_t Size, typename Type>
+class prefix_trie
+{
+	public:
+
+		/**
+		 * \brief The key type.
+		 */
+		typedef boost::array<unsigned char, Size> key_type;
+
+		/**
+		 * \brief The value type.
+		 */
+		typedef Type value_type;
+
+		/**
+		 * \brief The number of bits of a key.
+		 */
+		static const unsigned int KEY_BITS = Size * 8;
+
+		/**
+		 * \brief Create an empty trie.
+		 */
+		prefix_trie() : m_nodes(), m_count(0) {}
+
+		/**
+		 * \brief Get the number of stored prefixes.
+		 * \return The number of stored prefixes.
+		 */
+		std::size_t size() const
+		{
+			return m_count;
+		}
+
+		/**
+		 * \brief Store a prefix.
+		 * \param key The key. The bits after prefix_length are ignored.
+		 * \param prefix_length The prefix length, at most KEY_BITS.
+		 * \param value The value. If the prefix is already stored, its value is replaced.
+		 */
+		void insert(const key_type& key, unsigned int prefix_length, const value_type& value);
+
+		/**
+		 * \brief Find the longest stored prefix of a key.
+		 * \param key The key.
+		 * \return The value of the longest stored prefix of key, or NULL if there is none. The pointer is invalidated by insert().
+		 */
+		const value_type* find(const key_type& key) const;
+
+	private:
+
+		static const boost::uint32_t NO_NODE = 0xffffffff;
+
+		struct node
+		{
+			node(const key_type& _key, unsigned int _prefix_length) :
+				key(_key),
+				prefix_length(_prefix_length),
+				has_value(false),
+				value()
+			{
+				children[0] = NO_NODE;
+				children[1] = NO_NODE;
+			}
+
+			key_type key;
+			unsigned int prefix_length;
+			bool has_value;
+			value_type value;
+			boost::uint32_t children[2];
+		};
+
+		static unsigned int get_bit(const key_type& key, unsigned int index)
+		{
+			return (key[index / 8] >> (7 - index % 8)) & 1;
+		}
+
+		static key_type mask(const key_type& key, unsigned int prefix_length);
+		static unsigned int common_prefix_length(const key_type& left, const key_type& right, unsigned int max_length);
+
+		boost::uint32_t add_node(const key_type& key, unsigned int prefix_length)
+		{
+			m_nodes.push_back(node(mask(key, prefix_length), prefix_length));
+
+			return static_cast<boost::uint32_t>(m_nodes.size() - 1);
+		}
+
+		void set_value(boost::uint32_t index, const value_type& value)
+		{
+			if (!m_nodes[index].has_value)
+			{
+				m_nodes[index].has_value = true;
+				++m_count;
+			}
+
+			m_nodes[index].value = value;
+		}
+
+		// The root is always m_nodes[0], when there is one.
+		std::vector<node> m_nodes;
+		std::size_t m_count;
+};
+
+template <std::size_t Size, typename Type>
+inline typename prefix_trie<Size, Type>::key_type prefix_trie<Size, Type>::mask(const key_type& key, unsigned int prefix_length)
+{
+	key_type result = key;
+
+	for (std::size_t i = 0; i < Size; ++i)
+	{
+		if (prefix_length >= (i + 1) * 8)
+		{
+			continue;
+		}
+
+		result[i] &= (prefix_length > i * 8) ? static_cast<unsigned char>(0xff << (8 - (prefix_length - i * 8))) : 0x00;
+	}
+
+	return result;
+}
+
+template <std::size_t Size, typename Type>
+inline unsigned int prefix_trie<Size, Type>::common_prefix_length(const key_type& left, const key_type& right, unsigned int max_length)
+{
+	unsigned int length = 0;
+
+	for (std::size_t i = 0; (i < Size) && (length < max_length); ++i)
+	{
+		const unsigned char difference = left[i] ^ right[i];
+
+		if (difference == 0)
+		{
+			length += 8;
+
+			continue;
+		}
+
+		for (unsigned char bit = 0x80; (bit & difference) == 0; bit >>= 1)
+		{
+			++length;
+		}
+
+		return std::min(length, max_length);
+	}
+
+	return std::min(length, max_length);
+}
+
+template <std::size_t Size, typename Type>
+inline void prefix_trie<Size, Type>::insert(const key_type& key, unsigned int prefix_length, const value_type& value)
+{
+	if (m_nodes.empty())
+	{
+		set_value(add_node(key, prefix_length), value);
+
+		return;
+	}
+
+	// The slot that refers to the current node: NO_NODE for the root.
+	boost::uint32_t parent = NO_NODE;
+	unsigned int parent_bit = 0;
+	boost::uint32_t current = 0;
+
+	for (;;)
+	{
+		const unsigned int current_length = m_nodes[current].prefix_length;
+		const unsigned int length = common_prefix_length(key, m_nodes[current].key, std::min(prefix_length, current_length));
+
+		if (length < current_length)
+		{
+			// The key diverges from the current node, or is a shorter prefix of it: split.
+			const boost::uint32_t split = add_node(key, length);
+			m_nodes[split].children[get_bit(m_nodes[current].key, length)] = current;
+
+			if (length == prefix_length)
+			{
+				set_value(split, value);
+			}
+			else
+			{
+				const boost::uint32_t leaf = add_node(key, prefix_length);
+				m_nodes[split].children[get_bit(key, length)] = leaf;
+				set_value(leaf, value);
+			}
+
+			if (parent == NO_NODE)
+			{
+				// The root must stay at index 0.
+				std::swap(m_nodes[0], m_nodes[split]);
+
+				for (unsigned int i = 0; i < 2; ++i)
+				{
+					if (m_nodes[0].children[i] == 0)
+					{
+						m_nodes[0].children[i] = split;
+					}
+				}
+			}
+			else
+			{
+				m_nodes[parent].children[parent_bit] = split;
+			}
+
+			return;
+		}
+
+		if (prefix_length == current_length)
+		{
+			set_value(current, value);
+
+			return;
+		}
+
+		const unsigned int bit = get_bit(key, current_length);
+		const boost::uint32_t child = m_nodes[current].children[bit];
+
+		if (child == NO_NODE)
+		{
+			const boost::uint32_t leaf = add_node(key, prefix_length);
+			m_nodes[current].children[bit] = leaf;
+			set_value(leaf, value);
+
+			return;
+		}
+
+		parent = current;
+		parent_bit = bit;
+		current = child;
+	}
+}
+
+template <std::size_t Size, typename Type>
+inline const typename prefix_trie<Size, Type>::value_type* prefix_trie<Size, Type>::find(const key_type& key) const
+{
+	const value_type* result = NULL;
+	boost::uint32_t current = m_nodes.empty() ? NO_NODE : 0;
+
+	while (current != NO_NODE)
+	{
+		const node& n = m_nodes[current];
+
+		if (common_prefix_length(key, n.key, n.prefix_length) < n.prefix_length)
+		{
+			break;
+		}
+
+		if (n.has_value)
+		{
+			result = &n.value;
+		}
+
+		if (n.prefix_length == KEY_BITS)
+		{
+			break;
+		}
+
+		current = n.children[get_bit(key, n.prefix_length)];
+	}
+
+	return result;
+}
+
+/**
+ * \brief A longest-prefix-match table of IPv4 and IPv6 networks.
+ * \tparam Type The value type, associated to each network. Type must be copy-constructible and assignable.
+ *
+ * The table can hold the networks to never contact, as well as routes. A
+ * network only matches addresses of its own family.
+ */
+template <typename Type>
+class ip_prefix_table
+{
+	public:
+
+		/**
+		 * \brief The value type.
+		 */
+		typedef Type value_type;
+
+		/**
+		 * \brief Get the number of networks.
+		 * \return The number of networks.
+		 */
+		std::size_t size() const
+		{
+			return m_ipv4.size() + m_ipv6.size();
+		}
+
+		/**
+		 * \brief Add an IPv4 network.
+		 * \param network The network.
+		 * \param value The value. If the network is already in the table, its value is replaced.
+		 */
+		void insert(const freelan::ipv4_network_address& network, const value_type& value)
+		{
+			m_ipv4.insert(to_key<4>(network.address().to_bytes()), network.prefix_length(), value);
+		}
+
+		/**
+		 * \brief Add an IPv6 network.
+		 * \param network The network.
+		 * \param value The value. If the network is already in the table, its value is replaced.
+		 */
+		void insert(const freelan::ipv6_network_address& network, const value_type& value)
+		{
+			m_ipv6.insert(to_key<16>(network.address().to_bytes()), network.prefix_length(), value);
+		}
+
+		/**
+		 * \brief Add a network.
+		 * \param network The network.
+		 * \param value The value. If the network is already in the table, its value is replaced.
+		 */
+		void insert(const freelan::ip_network_address& network, const value_type& value)
+		{
+			insert_visitor visitor(*this, value);
+
+			boost::apply_visitor(visitor, network);
+		}
+
+		/**
+		 * \brief Find the most specific network that contains an IPv4 address.
+		 * \param address The address.
+		 * \return The value of the most specific network that contains address, or NULL if there is none. The pointer is invalidated by insert().
+		 */
+		const value_type* find(const boost::asio::ip::address_v4& address) const
+		{
+			return m_ipv4.find(to_key<4>(address.to_bytes()));
+		}
+
+		/**
+		 * \brief Find the most specific network that contains an IPv6 address.
+		 * \param address The address.
+		 * \return The value of the most specific network that contains address, or NULL if there is none. The pointer is invalidated by insert().
+		 */
+		const value_type* find(const boost::asio::ip::address_v6& address) const
+		{
+			return m_ipv6.find(to_key<16>(address.to_bytes()));
+		}
+
+		/**
+		 * \brief Find the most specific network that contains an address.
+		 * \param address The address.
+		 * \return The value of the most specific network that contains address, or NULL if there is none. The pointer is invalidated by insert().
+		 */
+		const value_type* find(const boost::asio::ip::address& address) const
+		{
+			return address.is_v4() ? find(address.to_v4()) : find(address.to_v6());
+		}
+
+	private:
+
+		// The address bytes type depends on the Boost version.
+		template <std::size_t Size, typename BytesType>
+		static typename prefix_trie<Size, value_type>::key_type to_key(const BytesType& bytes)
+		{
+			typename prefix_trie<Size, value_type>::key_type result;
+			std::copy(bytes.begin(), bytes.end(), result.begin());
+
+			return result;
+		}
+
+		class insert_visitor : public boost::static_visitor<void>
+		{
+			public:
+
+				insert_visitor(ip_prefix_table& table, const value_type& value) : m_table(table), m_value(value) {}
+
+				template <typename NetworkAddressType>
+				void operator()(const NetworkAddressType& network) const
+				{
+					m_table.insert(network, m_value);
+				}
+
+			private:
+
+				ip_prefix_table& m_table;
+				const value_type& m_value;
+		};
+
+		prefix_trie<4, value_type> m_ipv4;
+		prefix_trie<16, value_type> m_ipv6;
+};
+
+#endif /* IP_PREFIX_TABLE_HPP */
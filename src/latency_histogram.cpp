@@ -0,0 +1,186 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file latency_histogram.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A lock-free high dynamic range histogram of latencies.
+ */
+
+#include "latency_histogram.hpp"
+
+#include <cmath>
+
+namespace
+{
+	unsigned int get_most_significant_bit(boost::uint64_t value)
+	{
+#if defined(__GNUC__)
+		return 63 - __builtin_clzll(value);
+#else
+		unsigned int result = 0;
+
+		while (value >>= 1)
+		{
+			++result;
+		}
+
+		return result;
+#endif
+	}
+}
+
+boost::uint64_t latency_histogram::snapshot_type::percentile(double quantile) const
+{
+	if (m_count == 0)
+	{
+		return 0;
+	}
+
+	boost::uint64_t rank = static_cast<boost::uint64_t>(std::ceil(quantile * m_count));
+
+	if (rank == 0)
+	{
+		rank = 1;
+	}
+
+	boost::uint64_t count = 0;
+
+	for (std::size_t i = 0; i < m_counts.size(); ++i)
+	{
+		count += m_counts[i];
+
+		if (count >= rank)
+		{
+			const boost::uint64_t value = get_bucket_upper_bound(i);
+
+			// The last bucket also counts the values that are out of range.
+			return ((value < m_max) && (i + 1 < m_counts.size())) ? value : m_max;
+		}
+	}
+
+	return m_max;
+}
+
+latency_histogram::latency_histogram() :
+	m_sum(0),
+	m_max(0)
+{
+	for (std::size_t i = 0; i < BUCKET_COUNT; ++i)
+	{
+		m_counts[i] = 0;
+	}
+}
+
+void latency_histogram::record(boost::uint64_t value)
+{
+	atomic_fetch_add(m_counts[get_bucket_index(value)], static_cast<boost::uint64_t>(1));
+	atomic_fetch_add(m_sum, value);
+
+	for (boost::uint64_t current = atomic_load(m_max); value > current;)
+	{
+		const boost::uint64_t previous = atomic_compare_exchange(m_max, current, value);
+
+		if (previous == current)
+		{
+			break;
+		}
+
+		current = previous;
+	}
+}
+
+latency_histogram::snapshot_type latency_histogram::snapshot() const
+{
+	snapshot_type result;
+
+	result.m_counts.resize(BUCKET_COUNT);
+	result.m_count = 0;
+
+	for (std::size_t i = 0; i < BUCKET_COUNT; ++i)
+	{
+		result.m_counts[i] = atomic_load(m_counts[i]);
+		result.m_count += result.m_counts[i];
+	}
+
+	result.m_sum = atomic_load(m_sum);
+	result.m_max = atomic_load(m_max);
+
+	return result;
+}
+
+std::size_t latency_histogram::get_bucket_index(boost::uint64_t value)
+{
+	const boost::uint64_t sub_bucket_count = 1 << SUB_BUCKET_BITS;
+	const boost::uint64_t half_sub_bucket_count = sub_bucket_count / 2;
+
+	if (value < sub_bucket_count)
+	{
+		return static_cast<std::size_t>(value);
+	}
+
+	const boost::uint64_t largest_value = (static_cast<boost::uint64_t>(1) << MAX_VALUE_BITS) - 1;
+
+	if (value > largest_value)
+	{
+		value = largest_value;
+	}
+
+	// Keeps the SUB_BUCKET_BITS - 1 bits that follow the most significant one.
+	const unsigned int shift = get_most_significant_bit(value) - (SUB_BUCKET_BITS - 1);
+
+	return static_cast<std::size_t>(sub_bucket_count + (shift - 1) * half_sub_bucket_count + ((value >> shift) - half_sub_bucket_count));
+}
+
+boost::uint64_t latency_histogram::get_bucket_upper_bound(std::size_t index)
+{
+	const std::size_t sub_bucket_count = 1 << SUB_BUCKET_BITS;
+	const std::size_t half_sub_bucket_count = sub_bucket_count / 2;
+
+	if (index < sub_bucket_count)
+	{
+		return index;
+	}
+
+	const unsigned int shift = static_cast<unsigned int>((index - sub_bucket_count) / half_sub_bucket_count + 1);
+	const boost::uint64_t sub_bucket = (index - sub_bucket_count) % half_sub_bucket_count + half_sub_bucket_count;
+
+	return ((sub_bucket + 1) << shift) - 1;
+}
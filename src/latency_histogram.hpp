@@ -0,0 +1,157 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file latency_histogram.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A lock-free high dynamic range histogram of latencies.
+ */
+
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "atomic.hpp"
+
+/**
+ * \brief A high dynamic range histogram of latencies.
+ *
+ * Values are counted in log-linear buckets: every power of two range is split
+ * in 64 buckets, so that any percentile is reported within 1.6% of the exact
+ * value, from 1 nanosecond to several hours. Larger values are counted as
+ * the largest one.
+ *
+ * Recording is lock-free and never allocates.
+ */
+class latency_histogram : private boost::noncopyable
+{
+	public:
+
+		/**
+		 * \brief A copy of the histogram, to compute several percentiles from the same values.
+		 */
+		class snapshot_type
+		{
+			public:
+
+				/**
+				 * \brief Get the number of recorded values.
+				 * \return The number of recorded values.
+				 */
+				boost::uint64_t count() const
+				{
+					return m_count;
+				}
+
+				/**
+				 * \brief Get the sum of the recorded values.
+				 * \return The sum of the recorded values, in nanoseconds.
+				 */
+				boost::uint64_t sum() const
+				{
+					return m_sum;
+				}
+
+				/**
+				 * \brief Get the largest recorded value.
+				 * \return The largest recorded value, in nanoseconds. 0 if nothing was recorded.
+				 */
+				boost::uint64_t max() const
+				{
+					return m_max;
+				}
+
+				/**
+				 * \brief Get a percentile.
+				 * \param quantile The quantile, between 0 and 1.
+				 * \return The smallest value that is greater than or equal to the specified share of the recorded values, in nanoseconds. 0 if nothing was recorded.
+				 */
+				boost::uint64_t percentile(double quantile) const;
+
+			private:
+
+				std::vector<boost::uint64_t> m_counts;
+				boost::uint64_t m_count;
+				boost::uint64_t m_sum;
+				boost::uint64_t m_max;
+
+				friend class latency_histogram;
+		};
+
+		/**
+		 * \brief Create an empty histogram.
+		 */
+		latency_histogram();
+
+		/**
+		 * \brief Record a value.
+		 * \param value The value, in nanoseconds.
+		 *
+		 * Lock-free. May be called concurrently from any thread.
+		 */
+		void record(boost::uint64_t value);
+
+		/**
+		 * \brief Get a copy of the histogram.
+		 * \return The copy.
+		 *
+		 * Values recorded while the copy is taken may or may not be part of it.
+		 */
+		snapshot_type snapshot() const;
+
+	private:
+
+		static const unsigned int SUB_BUCKET_BITS = 7;
+		static const unsigned int MAX_VALUE_BITS = 45;
+		static const std::size_t BUCKET_COUNT = (1 << SUB_BUCKET_BITS) + (MAX_VALUE_BITS - SUB_BUCKET_BITS) * (1 << (SUB_BUCKET_BITS - 1));
+
+		static std::size_t get_bucket_index(boost::uint64_t value);
+		static boost::uint64_t get_bucket_upper_bound(std::size_t index);
+
+		volatile boost::uint64_t m_counts[BUCKET_COUNT];
+		volatile boost::uint64_t m_sum;
+		volatile boost::uint64_t m_max;
+};
+
+#endif /* LATENCY_HISTOGRAM_HPP */
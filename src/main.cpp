@@ -45,7 +45,11 @@
  */
 
 #include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
 #include <cstdlib>
+#include <cctype>
 #include <csignal>
 
 #include <boost/asio.hpp>
@@ -54,10 +58,18 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/make_shared.hpp>
 
 #include <cryptoplus/cryptoplus.hpp>
 #include <cryptoplus/error/error_strings.hpp>
 
+#include <openssl/x509.h>
+#include <openssl/objects.h>
+
 #include <freelan/freelan.hpp>
 #include <freelan/logger_stream.hpp>
 
@@ -66,23 +78,55 @@
 #else
 #include "posix/daemon.hpp"
 #include "posix/locked_pid_file.hpp"
+#include "posix/scheduling.hpp"
+#include "posix/file_watcher.hpp"
+#include "posix/control_server.hpp"
 #endif
 
 #include "version.hpp"
 #include "tools.hpp"
 #include "system.hpp"
 #include "configuration_helper.hpp"
+#include "event_loop.hpp"
+#include "async_log_sink.hpp"
+#include "script_executor.hpp"
+#include "benchmark.hpp"
+#include "configuration_snapshot.hpp"
+#include "metrics.hpp"
+#include "metrics_server.hpp"
+#include "system_metrics.hpp"
+#include "peer_statistics.hpp"
+#include "event_loop_probe.hpp"
+#include "tracing.hpp"
+#include "flight_recorder.hpp"
 
 namespace fs = boost::filesystem;
 namespace fl = freelan;
 
 struct cli_configuration
 {
+	fs::path execution_root_directory;
+	option_values_type configuration_file_options;
 	fl::configuration fl_configuration;
-	bool debug;
+	fs::path tap_adapter_up_script;
+	boost::posix_time::time_duration tap_adapter_up_script_timeout;
+	fs::path tap_adapter_down_script;
+	boost::posix_time::time_duration tap_adapter_down_script_timeout;
+	boost::shared_ptr<certificate_validation_cache> validation_cache;
+	boost::shared_ptr<certificate_validation_plugin> validation_plugin;
+	boost::shared_ptr<const certificate_revocation_index> revocation_index;
+	fl::security_configuration::certificate_revocation_validation_method_type revocation_validation_method;
+	fs::path revocation_index_directory;
+	std::vector<fs::path> authority_certificate_files;
+	std::vector<fs::path> revocation_list_files;
+	std::vector<fs::path> dynamic_contact_files;
+	runtime_configuration runtime;
+	fl::log_level log_level;
+	startup_timings_type startup_timings;
 #ifndef WINDOWS
 	bool foreground;
 	fs::path pid_file;
+	fs::path control_socket;
 #endif
 };
 
@@ -101,24 +145,351 @@ std::vector<fs::path> get_configuration_files()
 	return configuration_files;
 }
 
+void write_log(freelan::log_level level, const std::string& msg, const boost::posix_time::ptime& timestamp)
+{
+	static boost::mutex mutex;
+
+	boost::lock_guard<boost::mutex> lock(mutex);
+
+	std::cout << boost::posix_time::to_iso_extended_string(timestamp) << " [" << log_level_to_string(level) << "] " << msg << std::endl;
+}
+
 void do_log(freelan::log_level level, const std::string& msg)
 {
-	std::cout << boost::posix_time::to_iso_extended_string(boost::posix_time::microsec_clock::local_time()) << " [" << log_level_to_string(level) << "] " << msg << std::endl;
+	write_log(level, msg, boost::posix_time::microsec_clock::local_time());
+}
+
+struct shard
+{
+	shard(const runtime_configuration& configuration) :
+		io_service(),
+		loop(io_service, configuration.poll_mode, configuration.busy_poll_budget),
+		executor(io_service),
+		core()
+	{
+	}
+
+	boost::asio::io_service io_service;
+	event_loop loop;
+	// Must outlive the core, whose tap adapter callbacks use it.
+	script_executor executor;
+	boost::scoped_ptr<fl::core> core;
+	boost::scoped_ptr<event_loop_probe> probe;
+	// Set by the tap adapter callbacks, read by the metrics collector.
+	boost::mutex tap_adapter_mutex;
+	std::string tap_adapter_name;
+};
+
+typedef std::vector<boost::shared_ptr<shard> > shard_list;
+
+typedef boost::function<void (fl::core&, const asiotap::tap_adapter&)> tap_adapter_callback_type;
+
+void tap_adapter_up(shard& _shard, tap_adapter_callback_type callback, fl::core& core, const asiotap::tap_adapter& tap_adapter)
+{
+	{
+		boost::lock_guard<boost::mutex> lock(_shard.tap_adapter_mutex);
+
+		_shard.tap_adapter_name = tap_adapter.name();
+	}
+
+	FREELAN_PROBE1(tap__adapter__up, tap_adapter.name().c_str());
+
+	record_flight_event(FE_TAP_ADAPTER_UP, 0, 0, tap_adapter.name());
+
+	if (callback)
+	{
+		callback(core, tap_adapter);
+	}
+}
+
+void tap_adapter_down(shard& _shard, tap_adapter_callback_type callback, fl::core& core, const asiotap::tap_adapter& tap_adapter)
+{
+	FREELAN_PROBE1(tap__adapter__down, tap_adapter.name().c_str());
+
+	record_flight_event(FE_TAP_ADAPTER_DOWN, 0, 0, tap_adapter.name());
+
+	if (callback)
+	{
+		callback(core, tap_adapter);
+	}
+
+	boost::lock_guard<boost::mutex> lock(_shard.tap_adapter_mutex);
+
+	_shard.tap_adapter_name.clear();
+}
+
+void collect_shard_metrics(const shard_list& shards, metrics_sample_writer& writer)
+{
+	for (std::size_t i = 0; i < shards.size(); ++i)
+	{
+		std::string tap_adapter_name;
+
+		{
+			boost::lock_guard<boost::mutex> lock(shards[i]->tap_adapter_mutex);
+
+			tap_adapter_name = shards[i]->tap_adapter_name;
+		}
+
+		collect_tap_adapter_metrics(tap_adapter_name, writer);
+		collect_udp_socket_metrics(shards[i]->core->server().socket(), make_metric_labels("shard", boost::lexical_cast<std::string>(i)), writer);
+	}
+}
+
+void collect_event_loop_metrics(const shard_list& shards, metrics_sample_writer& writer)
+{
+	for (std::size_t i = 0; i < shards.size(); ++i)
+	{
+		const event_loop::statistics_type statistics = shards[i]->loop.statistics();
+		const std::string shard_label = make_metric_labels("shard", boost::lexical_cast<std::string>(i));
+
+		writer.add("freelan_event_loop_busy_seconds_total", "Time spent polling while handlers were ready.", metrics_sample_writer::MT_COUNTER, shard_label, statistics.busy_time / 1e9);
+		writer.add("freelan_event_loop_spin_seconds_total", "Time spent polling while no handler was ready.", metrics_sample_writer::MT_COUNTER, shard_label, statistics.spin_time / 1e9);
+		writer.add("freelan_event_loop_sleep_seconds_total", "Time spent waiting for events in the kernel.", metrics_sample_writer::MT_COUNTER, shard_label, statistics.sleep_time / 1e9);
+		writer.add("freelan_event_loop_polled_handlers_total", "Handlers run while polling.", metrics_sample_writer::MT_COUNTER, shard_label, static_cast<double>(statistics.spin_handler_count));
+		writer.add("freelan_event_loop_wakeups_total", "Waits for events in the kernel.", metrics_sample_writer::MT_COUNTER, shard_label, static_cast<double>(statistics.wakeup_count));
+	}
+}
+
+void collect_log_sink_metrics(const async_log_sink& log_sink, metrics_sample_writer& writer)
+{
+	writer.add("freelan_log_messages_dropped_total", "Log messages dropped because the log queue was full.", metrics_sample_writer::MT_COUNTER, std::string(), static_cast<double>(log_sink.dropped_count()));
+}
+
+std::string get_peer_name(fl::security_configuration::cert_type cert)
+{
+	X509_NAME* const subject = X509_get_subject_name(cert.raw());
+	char buffer[256];
+
+	if (X509_NAME_get_text_by_NID(subject, NID_commonName, buffer, sizeof(buffer)) < 0)
+	{
+		X509_NAME_oneline(subject, buffer, sizeof(buffer));
+	}
+
+	return buffer;
+}
+
+// The cores keep the validation callback they were created with: this lets a configuration reload replace what it does.
+struct certificate_validator
+{
+	typedef fl::security_configuration::certificate_validation_callback_type callback_type;
+	typedef fl::security_configuration::certificate_revocation_validation_method_type revocation_method_type;
+
+	certificate_validator(callback_type _callback, boost::shared_ptr<certificate_validation_cache> _cache, boost::shared_ptr<const certificate_revocation_index> _revocation_index, revocation_method_type _revocation_method) :
+		callback(_callback),
+		cache(_cache),
+		revocation_index(_revocation_index),
+		revocation_method(_revocation_method),
+		accepted_validations(get_metrics().counter("freelan_certificate_validations_total", "Certificate validations, by result.", make_metric_labels("result", "accepted"))),
+		rejected_validations(get_metrics().counter("freelan_certificate_validations_total", "Certificate validations, by result.", make_metric_labels("result", "rejected"))),
+		validation_durations(get_metrics().histogram("freelan_certificate_validation_duration_seconds", "Certificate validation durations."))
+	{
+	}
+
+	bool validate(fl::core& core, fl::security_configuration::cert_type cert)
+	{
+		const boost::uint64_t start = get_monotonic_time();
+		const bool result = do_validate(core, cert);
+		const boost::uint64_t duration = get_monotonic_time() - start;
+		const std::string peer = get_peer_name(cert);
+
+		FREELAN_PROBE3(certificate__validation, peer.c_str(), static_cast<int>(result), duration);
+
+		record_flight_event(FE_CERTIFICATE_VALIDATION, result ? 1 : 0, duration, peer);
+
+		(result ? accepted_validations : rejected_validations).increment();
+		validation_durations.observe(duration);
+
+		get_peer_statistics().record_handshake(certificate_validation_cache::get_fingerprint(cert), peer, result);
+
+		return result;
+	}
+
+	bool do_validate(fl::core& core, fl::security_configuration::cert_type cert)
+	{
+		callback_type current_callback;
+		boost::shared_ptr<const certificate_revocation_index> current_revocation_index;
+
+		{
+			boost::lock_guard<boost::mutex> lock(mutex);
+
+			current_callback = callback;
+			current_revocation_index = revocation_index;
+		}
+
+		if (current_revocation_index)
+		{
+			// Not cached: the revocation lists may change while the validation results are cached.
+			return indexed_certificate_revocation_validation(current_revocation_index, revocation_method, current_callback, core, cert);
+		}
+
+		return !current_callback || current_callback(core, cert);
+	}
+
+	void reset(callback_type _callback, boost::shared_ptr<certificate_validation_cache> _cache)
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+
+		callback = _callback;
+		cache = _cache;
+	}
+
+	boost::shared_ptr<certificate_validation_cache> get_cache()
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+
+		return cache;
+	}
+
+	void set_revocation_index(boost::shared_ptr<const certificate_revocation_index> _revocation_index)
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+
+		revocation_index = _revocation_index;
+	}
+
+	boost::shared_ptr<const certificate_revocation_index> get_revocation_index()
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+
+		return revocation_index;
+	}
+
+	boost::mutex mutex;
+	callback_type callback;
+	boost::shared_ptr<certificate_validation_cache> cache;
+	boost::shared_ptr<const certificate_revocation_index> revocation_index;
+	const revocation_method_type revocation_method;
+	// Looked up once: a look-up takes the registry mutex and formats the labels.
+	metric_counter& accepted_validations;
+	metric_counter& rejected_validations;
+	metric_histogram& validation_durations;
+};
+
+void prefixed_log(const boost::function<void (freelan::log_level, const std::string&)>& log_func, const std::string& prefix, freelan::log_level level, const std::string& msg)
+{
+	log_func(level, prefix + msg);
+}
+
+// One counter per level, in increasing severity order.
+typedef std::vector<metric_counter*> log_message_counters_type;
+
+log_message_counters_type get_log_message_counters()
+{
+	static const freelan::log_level levels[] = { fl::LL_DEBUG, fl::LL_INFORMATION, fl::LL_WARNING, fl::LL_ERROR, fl::LL_FATAL };
+
+	log_message_counters_type counters;
+
+	for (std::size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i)
+	{
+		std::string level = log_level_to_string(levels[i]);
+		std::transform(level.begin(), level.end(), level.begin(), ::tolower);
+
+		counters.push_back(&get_metrics().counter("freelan_log_messages_total", "Log messages, by level.", make_metric_labels("level", level)));
+	}
+
+	return counters;
+}
+
+void counted_log(const boost::function<void (freelan::log_level, const std::string&)>& log_func, const log_message_counters_type& counters, freelan::log_level level, const std::string& msg)
+{
+	// Also the level value of the flight recorder events.
+	std::size_t index = 0;
+
+	switch (level)
+	{
+		case fl::LL_DEBUG:
+			index = 0;
+			break;
+		case fl::LL_INFORMATION:
+			index = 1;
+			break;
+		case fl::LL_WARNING:
+			index = 2;
+			break;
+		case fl::LL_ERROR:
+			index = 3;
+			break;
+		case fl::LL_FATAL:
+			index = 4;
+			break;
+	}
+
+	counters[index]->increment();
+
+	FREELAN_PROBE2(log__message, static_cast<int>(level), msg.c_str());
+
+	record_flight_event(FE_LOG, static_cast<boost::uint32_t>(index), 0, msg);
+
+	log_func(level, msg);
+}
+
+std::string format_latency(boost::uint64_t value)
+{
+	std::ostringstream oss;
+
+	oss << std::fixed << std::setprecision(1) << value / 1000.0 << " us";
+
+	return oss.str();
+}
+
+latency_histogram& get_event_loop_queueing_delay(std::size_t shard_index)
+{
+	return get_metrics().latency("freelan_event_loop_queueing_seconds", "Time handlers wait in the event loop before they run.", make_metric_labels("shard", boost::lexical_cast<std::string>(shard_index)));
+}
+
+std::string describe_latency(const latency_histogram::snapshot_type& snapshot)
+{
+	std::ostringstream oss;
+
+	oss << snapshot.count() << " measure(s): " << format_latency(snapshot.percentile(0.5)) << " median, " << format_latency(snapshot.percentile(0.99)) << " p99, " << format_latency(snapshot.percentile(0.999)) << " p99.9, " << format_latency(snapshot.max()) << " max";
+
+	return oss.str();
 }
 
-void signal_handler(const boost::system::error_code& error, int signal_number, fl::core& core, int& exit_signal)
+void signal_handler(const boost::system::error_code& error, int signal_number, shard_list& shards, boost::asio::signal_set& reload_signals, boost::asio::signal_set& dump_signals, boost::function<void ()> close_control, int& exit_signal)
 {
 	if (!error)
 	{
+		record_flight_event(FE_SIGNAL, static_cast<boost::uint32_t>(signal_number));
+
 		do_log(fl::LL_WARNING, "Signal caught (" + boost::lexical_cast<std::string>(signal_number) + "): exiting...");
 
-		core.close();
+		reload_signals.cancel();
+		dump_signals.cancel();
+
+		if (close_control)
+		{
+			close_control();
+		}
+
+		// Each core and probe must be stopped from its own I/O service.
+		BOOST_FOREACH(const boost::shared_ptr<shard>& _shard, shards)
+		{
+			_shard->io_service.post(boost::bind(&fl::core::close, boost::ref(*_shard->core)));
+
+			if (_shard->probe)
+			{
+				_shard->io_service.post(boost::bind(&event_loop_probe::stop, _shard->probe.get()));
+			}
+		}
 
 		exit_signal = signal_number;
 	}
 }
 
-bool parse_options(int argc, char** argv, cli_configuration& configuration)
+// Only live when the revocation index is enabled: the core owns the revocation lists otherwise.
+bool is_revocation_list_option(const std::string& name)
+{
+	return ((name == "security.certificate_revocation_list_file") || (name == "security.certificate_revocation_index_directory"));
+}
+
+bool has_revocation_list_option(const std::set<std::string>& names)
+{
+	return (std::find_if(names.begin(), names.end(), &is_revocation_list_option) != names.end());
+}
+
+// On a configuration reload, running is the configuration in use: what did not change is taken from it instead of being loaded again.
+bool parse_options(int argc, char** argv, cli_configuration& configuration, const cli_configuration* running = NULL)
 {
 	namespace po = boost::program_options;
 
@@ -131,6 +502,8 @@ bool parse_options(int argc, char** argv, cli_configuration& configuration)
 	("version,v", "Get the program version.")
 	("debug,d", "Enables debug output.")
 	("configuration_file,c", po::value<std::string>(), "The configuration file to use.")
+	("configuration_snapshot,C", po::value<std::string>(), "The configuration snapshot to use instead of a configuration file, as written by --compile_config.")
+	("compile_config", po::value<std::string>(), "Compile the configuration and the files it refers to into a configuration snapshot, then exit.")
 	;
 
 	visible_options.add(generic_options);
@@ -142,6 +515,7 @@ bool parse_options(int argc, char** argv, cli_configuration& configuration)
 	configuration_options.add(get_security_options());
 	configuration_options.add(get_tap_adapter_options());
 	configuration_options.add(get_switch_options());
+	configuration_options.add(get_runtime_options());
 
 	visible_options.add(configuration_options);
 	all_options.add(configuration_options);
@@ -161,15 +535,37 @@ bool parse_options(int argc, char** argv, cli_configuration& configuration)
 	daemon_options.add_options()
 	("foreground,f", "Do not run as a daemon.")
 	("pid_file,p", po::value<std::string>(), "A pid file to use.")
+	("control_socket,s", po::value<std::string>(), "A control socket to use. Defaults to the pid file path followed by \".sock\".")
 	;
 
 	visible_options.add(daemon_options);
 	all_options.add(daemon_options);
 #endif
 
+	po::options_description benchmark_options("Benchmarks");
+	benchmark_options.add_options()
+	("benchmark_iterations", po::value<unsigned int>()->default_value(100), "The number of iterations of each benchmark.")
+	("benchmark_crl", "Measure the certificate revocation check latency as a function of the certificate revocation list size, then exit.")
+	("benchmark_config", "Measure the startup latency from a configuration file and from a configuration snapshot, then exit.")
+	("benchmark_prefix_table", "Measure the network address lookup latency as a function of the number of networks, then exit.")
+	("benchmark_ciphers", "Measure the throughput of the supported cipher algorithms, then exit.")
+#ifndef WINDOWS
+	("benchmark_spawn", po::value<std::string>()->implicit_value("/bin/true"), "Measure the script launch latency as a function of the open files limit, then exit.")
+	("benchmark_validation", po::value<std::string>(), "Measure the throughput of the configured certificate validation script, helper and plugin with the specified certificate file, then exit.")
+#endif
+	;
+
+	visible_options.add(benchmark_options);
+	all_options.add(benchmark_options);
+
+	boost::uint64_t start = get_monotonic_time();
+
 	po::variables_map vm;
 	po::store(po::parse_command_line(argc, argv, all_options), vm);
 
+	// The process may have changed its current directory since it started.
+	fs::path execution_root_directory = configuration.execution_root_directory;
+
 	if (vm.count("help"))
 	{
 		std::cout << visible_options << std::endl;
@@ -184,6 +580,43 @@ bool parse_options(int argc, char** argv, cli_configuration& configuration)
 		return false;
 	}
 
+	if (vm.count("benchmark_crl"))
+	{
+		benchmark_crl(std::cout, vm["benchmark_iterations"].as<unsigned int>());
+
+		return false;
+	}
+
+	if (vm.count("benchmark_config"))
+	{
+		benchmark_configuration(std::cout, vm["benchmark_iterations"].as<unsigned int>());
+
+		return false;
+	}
+
+	if (vm.count("benchmark_prefix_table"))
+	{
+		benchmark_prefix_table(std::cout, vm["benchmark_iterations"].as<unsigned int>());
+
+		return false;
+	}
+
+	if (vm.count("benchmark_ciphers"))
+	{
+		benchmark_ciphers(std::cout, vm["benchmark_iterations"].as<unsigned int>());
+
+		return false;
+	}
+
+#ifndef WINDOWS
+	if (vm.count("benchmark_spawn"))
+	{
+		benchmark_spawn(std::cout, fs::absolute(vm["benchmark_spawn"].as<std::string>()), vm["benchmark_iterations"].as<unsigned int>());
+
+		return false;
+	}
+#endif
+
 #ifdef WINDOWS
 	if (vm.count("install"))
 	{
@@ -256,13 +689,43 @@ bool parse_options(int argc, char** argv, cli_configuration& configuration)
 			configuration.pid_file = fs::absolute(std::string(val));
 		}
 	}
+
+	if (vm.count("control_socket"))
+	{
+		configuration.control_socket = fs::absolute(vm["control_socket"].as<std::string>());
+	}
+	else if (!configuration.pid_file.empty())
+	{
+		configuration.control_socket = configuration.pid_file.string() + ".sock";
+	}
 #endif
 
+	boost::scoped_ptr<configuration_snapshot> snapshot;
 	fs::path configuration_file;
 
-	if (vm.count("configuration_file"))
+	if (vm.count("configuration_snapshot"))
 	{
-		configuration_file = fs::absolute(vm["configuration_file"].as<std::string>());
+		if (vm.count("configuration_file"))
+		{
+			throw std::runtime_error("Cannot specify both a configuration file and a configuration snapshot.");
+		}
+
+		const fs::path snapshot_file = fs::absolute(vm["configuration_snapshot"].as<std::string>(), execution_root_directory);
+
+		std::cout << "Reading configuration snapshot at: " << snapshot_file << std::endl;
+
+		snapshot.reset(new configuration_snapshot(load_configuration_snapshot(snapshot_file)));
+
+		store_option_values(snapshot->options, configuration_options, vm);
+
+		configuration.configuration_file_options = snapshot->options;
+
+		// The relative paths of the snapshot options are relative to where it was compiled.
+		execution_root_directory = snapshot->root;
+	}
+	else if (vm.count("configuration_file"))
+	{
+		configuration_file = fs::absolute(vm["configuration_file"].as<std::string>(), execution_root_directory);
 	}
 	else
 	{
@@ -270,7 +733,7 @@ bool parse_options(int argc, char** argv, cli_configuration& configuration)
 
 		if (val)
 		{
-			configuration_file = fs::absolute(std::string(val));
+			configuration_file = fs::absolute(std::string(val), execution_root_directory);
 		}
 	}
 
@@ -285,9 +748,13 @@ bool parse_options(int argc, char** argv, cli_configuration& configuration)
 			throw po::reading_file(configuration_file.string().c_str());
 		}
 
-		po::store(po::parse_config_file(ifs, configuration_options, true), vm);
+		const po::parsed_options parsed_options = po::parse_config_file(ifs, configuration_options, true);
+
+		po::store(parsed_options, vm);
+
+		configuration.configuration_file_options = get_option_values(parsed_options);
 	}
-	else
+	else if (!snapshot)
 	{
 		bool configuration_read = false;
 
@@ -301,7 +768,11 @@ bool parse_options(int argc, char** argv, cli_configuration& configuration)
 			{
 				std::cout << "Reading configuration file at: " << conf << std::endl;
 
-				po::store(po::parse_config_file(ifs, configuration_options, true), vm);
+				const po::parsed_options parsed_options = po::parse_config_file(ifs, configuration_options, true);
+
+				po::store(parsed_options, vm);
+
+				configuration.configuration_file_options = get_option_values(parsed_options);
 
 				configuration_file = fs::absolute(conf);
 
@@ -325,87 +796,1104 @@ bool parse_options(int argc, char** argv, cli_configuration& configuration)
 
 	po::notify(vm);
 
-	const fs::path execution_root_directory = fs::current_path();
-
-	setup_configuration(configuration.fl_configuration, execution_root_directory, vm);
-
-	const fs::path tap_adapter_up_script = get_tap_adapter_up_script(execution_root_directory, vm);
-
-	if (!tap_adapter_up_script.empty())
+#ifndef WINDOWS
+	if (vm.count("benchmark_validation"))
 	{
-		configuration.fl_configuration.tap_adapter.up_callback = boost::bind(&execute_tap_adapter_up_script, tap_adapter_up_script, _1, _2);
-	}
+		const fs::path certificate_file = fs::absolute(vm["benchmark_validation"].as<std::string>());
+		const fl::security_configuration::cert_type cert = fl::security_configuration::cert_type::from_certificate(cryptoplus::file::open(certificate_file.string()));
 
-	const fs::path tap_adapter_down_script = get_tap_adapter_down_script(execution_root_directory, vm);
+		benchmark_validation(std::cout, cert, get_certificate_validation_script(execution_root_directory, vm), get_certificate_validation_script_input(vm), get_certificate_validation_helper(execution_root_directory, vm), get_certificate_validation_plugin(execution_root_directory, vm), get_certificate_validation_plugin_argument(vm), vm["benchmark_iterations"].as<unsigned int>());
 
-	if (!tap_adapter_down_script.empty())
-	{
-		configuration.fl_configuration.tap_adapter.down_callback = boost::bind(&execute_tap_adapter_down_script, tap_adapter_down_script, _1, _2);
+		return false;
 	}
+#endif
 
-	const fs::path certificate_validation_script = get_certificate_validation_script(execution_root_directory, vm);
+	add_startup_timing(&configuration.startup_timings, "options", start);
 
-	if (!certificate_validation_script.empty())
+	// Benchmarking the cipher algorithms takes a while: a reload only does it again if their option changed.
+	const std::vector<fscp::cipher_algorithm_type>* cipher_capabilities = NULL;
+
+	if (running && (get_changed_options(running->configuration_file_options, configuration.configuration_file_options).count("fscp.cipher_capability") == 0))
 	{
-		configuration.fl_configuration.security.certificate_validation_callback = boost::bind(&execute_certificate_validation_script, certificate_validation_script, _1, _2);
+		cipher_capabilities = &running->fl_configuration.fscp.cipher_capabilities;
 	}
 
-	configuration.debug = vm.count("debug");
+	setup_configuration(configuration.fl_configuration, execution_root_directory, vm, &configuration.startup_timings, snapshot.get(), cipher_capabilities);
 
-	return true;
-}
+	// Parsing the revocation lists takes a while too: a reload keeps the running index, which the file watcher keeps up to date, unless their options changed.
+	const bool reuse_revocation_index = running && running->revocation_index && vm["security.certificate_revocation_index"].as<bool>() && !has_revocation_list_option(get_changed_options(running->configuration_file_options, configuration.configuration_file_options));
 
-void run(const cli_configuration& configuration, int& exit_signal)
-{
-#ifndef WINDOWS
-	boost::shared_ptr<posix::locked_pid_file> pid_file;
+	boost::shared_ptr<certificate_revocation_index> revocation_index;
 
-	if (!configuration.pid_file.empty())
+	if (!reuse_revocation_index)
 	{
-		std::cout << "Creating PID file at: " << configuration.pid_file << std::endl;
-
-		pid_file.reset(new posix::locked_pid_file(configuration.pid_file));
+		revocation_index = get_certificate_revocation_index(execution_root_directory, vm, configuration.fl_configuration.security.certificate_authority_list, &configuration.startup_timings, snapshot.get());
 	}
-#endif
 
-	boost::function<void (freelan::log_level, const std::string&)> log_func = &do_log;
-
-#ifndef WINDOWS
-	if (!configuration.foreground)
+	if (vm.count("compile_config"))
 	{
-		posix::daemonize();
+		const fs::path snapshot_file = fs::absolute(vm["compile_config"].as<std::string>(), configuration.execution_root_directory);
 
-		log_func = &posix::syslog;
-	}
+		save_configuration_snapshot(snapshot_file, make_configuration_snapshot(execution_root_directory, vm, configuration.configuration_file_options, configuration.fl_configuration, revocation_index));
 
-	if (pid_file)
-	{
-		pid_file->write_pid();
-	}
-#endif
+		std::cout << "Configuration snapshot written to: " << snapshot_file << std::endl;
 
-	boost::asio::io_service io_service;
+		return false;
+	}
 
-	boost::asio::signal_set signals(io_service, SIGINT, SIGTERM);
+	start = get_monotonic_time();
 
-	fl::logger logger(log_func, configuration.debug ? fl::LL_DEBUG : fl::LL_INFORMATION);
+	// The tap adapter scripts run asynchronously: their callbacks are bound once the script executors exist.
+	configuration.tap_adapter_up_script = get_tap_adapter_up_script(execution_root_directory, vm);
+	configuration.tap_adapter_up_script_timeout = get_tap_adapter_up_script_timeout(vm);
+	configuration.tap_adapter_down_script = get_tap_adapter_down_script(execution_root_directory, vm);
+	configuration.tap_adapter_down_script_timeout = get_tap_adapter_down_script_timeout(vm);
 
-	fl::core core(io_service, configuration.fl_configuration, logger);
+	certificate_validation_function_type validation_function;
 
-	core.open();
+	const fs::path certificate_validation_script = get_certificate_validation_script(execution_root_directory, vm);
 
-	signals.async_wait(boost::bind(signal_handler, _1, _2, boost::ref(core), boost::ref(exit_signal)));
+	if (!certificate_validation_script.empty())
+	{
+		validation_function = boost::bind(&execute_certificate_validation_script, certificate_validation_script, get_certificate_validation_script_input(vm), get_certificate_validation_script_timeout(vm), _1, _2);
+	}
 
-	logger(fl::LL_INFORMATION) << "Execution started." << std::endl;
+#ifndef WINDOWS
+	const fs::path certificate_validation_helper = get_certificate_validation_helper(execution_root_directory, vm);
 
-	if (!core.has_tap_adapter())
+	if (!certificate_validation_helper.empty())
 	{
-		logger(fl::LL_INFORMATION) << "Configured not to use any tap adapter.";
+		// The script, if any, is only used when the helper is unavailable.
+		const boost::shared_ptr<posix::certificate_validation_helper> helper = boost::make_shared<posix::certificate_validation_helper>(certificate_validation_helper, get_certificate_validation_helper_timeout(vm));
+
+		validation_function = boost::bind(&execute_certificate_validation_helper, helper, validation_function, _1, _2);
 	}
+#endif
 
-	logger(fl::LL_INFORMATION) << "Listening on: " << core.server().socket().local_endpoint();
+	const fs::path certificate_validation_plugin_file = get_certificate_validation_plugin(execution_root_directory, vm);
 
-	io_service.run();
+	if (!certificate_validation_plugin_file.empty())
+	{
+		if (validation_function)
+		{
+			throw std::runtime_error("A certificate validation plugin cannot be combined with a certificate validation script or helper.");
+		}
+
+		const std::string certificate_validation_plugin_argument = get_certificate_validation_plugin_argument(vm);
+
+		// The running plugin instance keeps its state, like a loaded allow list.
+		if (running && running->validation_plugin && (running->validation_plugin->path() == certificate_validation_plugin_file) && (running->validation_plugin->argument() == certificate_validation_plugin_argument))
+		{
+			configuration.validation_plugin = running->validation_plugin;
+		}
+		else
+		{
+			configuration.validation_plugin = boost::make_shared<certificate_validation_plugin>(certificate_validation_plugin_file, certificate_validation_plugin_argument);
+		}
+
+		validation_function = boost::bind(&execute_certificate_validation_plugin, configuration.validation_plugin, _1, _2);
+	}
+
+	if (validation_function)
+	{
+		if (get_certificate_validation_cache_size(vm) > 0)
+		{
+			configuration.validation_cache = boost::make_shared<certificate_validation_cache>(get_certificate_validation_cache_size(vm), get_certificate_validation_cache_ttl(vm));
+
+			configuration.fl_configuration.security.certificate_validation_callback = boost::bind(&cached_certificate_validation, configuration.validation_cache, validation_function, _1, _2);
+		}
+		else
+		{
+			configuration.fl_configuration.security.certificate_validation_callback = boost::bind(&uncached_certificate_validation, validation_function, _1, _2);
+		}
+	}
+
+	const boost::shared_ptr<authority_certificate_directory> authority_directory = get_authority_certificate_directory(execution_root_directory, vm, configuration.fl_configuration.security);
+
+	if (authority_directory)
+	{
+		// Not cached: verifying a certificate against the directory is cheap and its certificates may change.
+		configuration.fl_configuration.security.certificate_validation_callback = boost::bind(&directory_certificate_validation, authority_directory, configuration.fl_configuration.security.certificate_validation_callback, _1, _2);
+	}
+
+	add_startup_timing(&configuration.startup_timings, "certificate validation", start);
+
+	configuration.revocation_index = reuse_revocation_index ? running->revocation_index : revocation_index;
+	configuration.revocation_validation_method = get_certificate_revocation_validation_method(vm);
+	configuration.revocation_index_directory = get_certificate_revocation_index_directory(execution_root_directory, vm);
+
+	// A snapshot does not depend on these files anymore: there is nothing to watch.
+	if (!snapshot)
+	{
+		configuration.authority_certificate_files = get_authority_certificate_files(execution_root_directory, vm);
+		configuration.revocation_list_files = get_certificate_revocation_list_files(execution_root_directory, vm);
+		configuration.dynamic_contact_files = get_dynamic_contact_files(execution_root_directory, vm);
+	}
+
+	setup_runtime_configuration(configuration.runtime, vm);
+
+	configuration.log_level = vm.count("debug") ? fl::LL_DEBUG : get_log_level(vm);
+
+	return true;
+}
+
+void log_startup_timings(fl::logger& logger, const startup_timings_type& timings)
+{
+	boost::uint64_t total = 0;
+
+	BOOST_FOREACH(const startup_timings_type::value_type& timing, timings)
+	{
+		total += timing.second;
+	}
+
+	std::ostringstream oss;
+	oss << std::fixed << std::setprecision(1) << "Startup took " << total / 1000000.0 << " ms";
+
+	BOOST_FOREACH(const startup_timings_type::value_type& timing, timings)
+	{
+		oss << ", " << timing.first << ": " << timing.second / 1000000.0 << " ms";
+	}
+
+	logger(fl::LL_INFORMATION) << oss.str() << ".";
+}
+
+bool is_live_option(const std::string& name)
+{
+	static const char* const live_options[] = {
+		"runtime.log_level",
+		"security.certificate_validation_script",
+		"security.certificate_validation_script_input",
+		"security.certificate_validation_script_timeout",
+		"security.certificate_validation_helper",
+		"security.certificate_validation_helper_timeout",
+		"security.certificate_validation_plugin",
+		"security.certificate_validation_plugin_argument",
+		"security.certificate_validation_cache_size",
+		"security.certificate_validation_cache_ttl"
+	};
+
+	return (std::find(live_options, live_options + sizeof(live_options) / sizeof(live_options[0]), name) != live_options + sizeof(live_options) / sizeof(live_options[0]));
+}
+
+void set_log_level(fl::logger& logger, shard_list& shards, fl::log_level level)
+{
+	logger.set_level(level);
+
+	BOOST_FOREACH(const boost::shared_ptr<shard>& _shard, shards)
+	{
+		_shard->io_service.post(boost::bind(&fl::logger::set_level, boost::ref(_shard->core->logger()), level));
+	}
+
+	logger(fl::LL_INFORMATION) << "Log level set to " << log_level_to_string(level) << ".";
+}
+
+#ifndef WINDOWS
+// Parsing the configuration and the changed revocation lists loads certificates: it runs on a thread of its own, and only applying the result runs on the strand.
+struct configuration_reloader
+{
+	// Takes whether the configuration was reloaded. Called from any thread.
+	typedef boost::function<void (bool)> handler_type;
+
+	configuration_reloader(int _argc, char** _argv, const cli_configuration& _configuration, certificate_validator& _validator, shard_list& _shards, boost::asio::io_service::strand& _strand, fl::logger& _logger) :
+		argc(_argc),
+		argv(_argv),
+		configuration(_configuration),
+		validator(_validator),
+		shards(_shards),
+		strand(_strand),
+		logger(_logger),
+		work(new boost::asio::io_service::work(worker_io_service)),
+		worker(boost::bind(&configuration_reloader::run_worker, this))
+	{
+	}
+
+	~configuration_reloader()
+	{
+		// A reload in progress completes, the queued ones are dropped.
+		work.reset();
+		worker_io_service.stop();
+		worker.join();
+
+		file_watcher.reset();
+	}
+
+	void reload(handler_type handler)
+	{
+		worker_io_service.post(boost::bind(&configuration_reloader::build, this, handler));
+	}
+
+	void run_worker()
+	{
+		worker_io_service.run();
+	}
+
+	// Only called from the worker thread, which owns configuration.
+	void build(handler_type handler)
+	{
+		logger(fl::LL_INFORMATION) << "Reloading the configuration...";
+
+		const boost::shared_ptr<cli_configuration> new_configuration = boost::make_shared<cli_configuration>();
+		new_configuration->execution_root_directory = configuration.execution_root_directory;
+
+		try
+		{
+			if (!parse_options(argc, argv, *new_configuration, &configuration))
+			{
+				complete(handler, false);
+
+				return;
+			}
+		}
+		catch (std::exception& ex)
+		{
+			get_metrics().counter("freelan_configuration_reloads_total", "Configuration reloads, by result.", make_metric_labels("result", "failure")).increment();
+
+			record_flight_event(FE_CONFIGURATION_RELOAD, 0);
+
+			logger(fl::LL_ERROR) << "Unable to reload the configuration, keeping the current one: " << ex.what();
+
+			complete(handler, false);
+
+			return;
+		}
+
+		const std::set<std::string> changed_options = get_changed_options(configuration.configuration_file_options, new_configuration->configuration_file_options);
+
+		// Without the index on both sides, the core owns the revocation lists and cannot replace them.
+		const bool revocation_lists_live = (configuration.revocation_index && new_configuration->revocation_index);
+
+		bool validation_changed = false;
+		bool revocation_index_changed = false;
+
+		BOOST_FOREACH(const std::string& name, changed_options)
+		{
+			const bool revocation_list_option = (revocation_lists_live && is_revocation_list_option(name));
+
+			if (is_live_option(name) || revocation_list_option)
+			{
+				validation_changed = validation_changed || ((name != "runtime.log_level") && !revocation_list_option);
+				revocation_index_changed = revocation_index_changed || revocation_list_option;
+
+				configuration.configuration_file_options.erase(name);
+
+				const option_values_type::const_iterator item = new_configuration->configuration_file_options.find(name);
+
+				if (item != new_configuration->configuration_file_options.end())
+				{
+					configuration.configuration_file_options.insert(*item);
+				}
+			}
+			else
+			{
+				// Keep the running value so that the change is reported again until it is applied.
+				logger(fl::LL_WARNING) << "Setting " << name << " changed: a restart is required to apply it.";
+			}
+		}
+
+		const bool log_level_changed = (new_configuration->log_level != configuration.log_level);
+
+		configuration.log_level = new_configuration->log_level;
+
+		if (validation_changed)
+		{
+			configuration.validation_plugin = new_configuration->validation_plugin;
+		}
+
+		if (revocation_index_changed)
+		{
+			configuration.revocation_index = new_configuration->revocation_index;
+			configuration.revocation_index_directory = new_configuration->revocation_index_directory;
+			configuration.revocation_list_files = new_configuration->revocation_list_files;
+		}
+
+		// The files the next restart loads: their changes are reported until then.
+		configuration.authority_certificate_files = new_configuration->authority_certificate_files;
+		configuration.dynamic_contact_files = new_configuration->dynamic_contact_files;
+
+		watch_files();
+
+		strand.post(boost::bind(&configuration_reloader::apply, this, boost::shared_ptr<const cli_configuration>(new_configuration), log_level_changed, validation_changed, revocation_index_changed, handler));
+	}
+
+	void apply(boost::shared_ptr<const cli_configuration> new_configuration, bool log_level_changed, bool validation_changed, bool revocation_index_changed, handler_type handler)
+	{
+		if (log_level_changed)
+		{
+			set_log_level(logger, shards, new_configuration->log_level);
+		}
+
+		if (validation_changed)
+		{
+			validator.reset(new_configuration->fl_configuration.security.certificate_validation_callback, new_configuration->validation_cache);
+
+			logger(fl::LL_INFORMATION) << "Certificate validation settings applied.";
+		}
+		else
+		{
+			// The results may depend on files that changed, like revocation lists.
+			clear_validation_cache();
+		}
+
+		if (revocation_index_changed)
+		{
+			validator.set_revocation_index(new_configuration->revocation_index);
+
+			logger(fl::LL_INFORMATION) << "Certificate revocation lists reloaded.";
+		}
+
+		get_metrics().counter("freelan_configuration_reloads_total", "Configuration reloads, by result.", make_metric_labels("result", "success")).increment();
+
+		record_flight_event(FE_CONFIGURATION_RELOAD, 1);
+
+		logger(fl::LL_INFORMATION) << "Configuration reloaded.";
+
+		complete(handler, true);
+	}
+
+	std::vector<fs::path> get_directories() const
+	{
+		std::set<fs::path> directories;
+
+		if (configuration.revocation_index)
+		{
+			add_directories(directories, configuration.revocation_list_files);
+		}
+
+		add_directories(directories, configuration.authority_certificate_files);
+		add_directories(directories, configuration.dynamic_contact_files);
+
+		return std::vector<fs::path>(directories.begin(), directories.end());
+	}
+
+	// Only called from the worker thread, or before it gets any work: the watched files follow the configuration it owns.
+	void watch_files()
+	{
+		const std::vector<fs::path> directories = get_directories();
+
+		if (directories == watched_directories)
+		{
+			return;
+		}
+
+		// Waits for the watcher thread, which only posts to the worker.
+		file_watcher.reset();
+		watched_directories = directories;
+
+		if (!directories.empty())
+		{
+			try
+			{
+				file_watcher.reset(new posix::file_watcher(directories, boost::bind(&configuration_reloader::reload_files, this, _1)));
+			}
+			catch (std::exception& ex)
+			{
+				logger(fl::LL_WARNING) << "Cannot watch the certificate files, changing them will require a restart: " << ex.what();
+			}
+		}
+	}
+
+	// Called from the file watcher thread.
+	void reload_files(const std::set<fs::path>& changes)
+	{
+		worker_io_service.post(boost::bind(&configuration_reloader::rebuild_revocation_index, this, changes));
+	}
+
+	// Only called from the worker thread: the index is updated from the last one it built, and the swaps are applied on the strand in the same order.
+	void rebuild_revocation_index(const std::set<fs::path>& changes)
+	{
+		boost::shared_ptr<certificate_revocation_index> revocation_index;
+
+		BOOST_FOREACH(const fs::path& filename, changes)
+		{
+			if (configuration.revocation_index && contains(configuration.revocation_list_files, filename))
+			{
+				if (!revocation_index)
+				{
+					revocation_index = boost::make_shared<certificate_revocation_index>(*configuration.revocation_index);
+				}
+
+				// Work on a copy so that a broken file keeps its previous revocation list.
+				certificate_revocation_index new_revocation_index = *revocation_index;
+
+				try
+				{
+					new_revocation_index.remove_file(filename);
+					new_revocation_index.add_file(filename, configuration.revocation_index_directory);
+				}
+				catch (std::exception& ex)
+				{
+					logger(fl::LL_ERROR) << "Cannot reload the certificate revocation list " << filename.string() << ", keeping the current one: " << ex.what();
+
+					continue;
+				}
+
+				*revocation_index = new_revocation_index;
+
+				logger(fl::LL_INFORMATION) << "Certificate revocation list " << filename.string() << " reloaded.";
+			}
+			else if (contains(configuration.authority_certificate_files, filename))
+			{
+				logger(fl::LL_WARNING) << "Authority certificate " << filename.string() << " changed: a restart is required to apply it.";
+			}
+			else if (contains(configuration.dynamic_contact_files, filename))
+			{
+				logger(fl::LL_WARNING) << "Dynamic contact certificate " << filename.string() << " changed: a restart is required to apply it.";
+			}
+		}
+
+		if (revocation_index)
+		{
+			configuration.revocation_index = revocation_index;
+
+			strand.post(boost::bind(&configuration_reloader::apply_revocation_index, this, boost::shared_ptr<const certificate_revocation_index>(revocation_index)));
+		}
+	}
+
+	void apply_revocation_index(boost::shared_ptr<const certificate_revocation_index> revocation_index)
+	{
+		// Validations in progress keep the index they started with.
+		validator.set_revocation_index(revocation_index);
+
+		// A certificate the new lists revoke must not stay accepted from the cache.
+		clear_validation_cache();
+	}
+
+	void clear_validation_cache()
+	{
+		const boost::shared_ptr<certificate_validation_cache> cache = validator.get_cache();
+
+		if (cache)
+		{
+			cache->clear();
+
+			logger(fl::LL_INFORMATION) << "Certificate validation cache cleared.";
+		}
+	}
+
+	static void complete(handler_type handler, bool result)
+	{
+		if (handler)
+		{
+			handler(result);
+		}
+	}
+
+	static void add_directories(std::set<fs::path>& directories, const std::vector<fs::path>& filenames)
+	{
+		BOOST_FOREACH(const fs::path& filename, filenames)
+		{
+			directories.insert(filename.parent_path());
+		}
+	}
+
+	static bool contains(const std::vector<fs::path>& filenames, const fs::path& filename)
+	{
+		return (std::find(filenames.begin(), filenames.end(), filename) != filenames.end());
+	}
+
+	int argc;
+	char** argv;
+	cli_configuration configuration;
+	certificate_validator& validator;
+	shard_list& shards;
+	boost::asio::io_service::strand& strand;
+	fl::logger& logger;
+	boost::asio::io_service worker_io_service;
+	boost::scoped_ptr<boost::asio::io_service::work> work;
+	boost::thread worker;
+	std::vector<fs::path> watched_directories;
+	boost::scoped_ptr<posix::file_watcher> file_watcher;
+};
+
+void reload_signal_handler(const boost::system::error_code& error, int signal_number, boost::asio::signal_set& signals, boost::asio::io_service::strand& strand, configuration_reloader& reloader)
+{
+	if (!error)
+	{
+		record_flight_event(FE_SIGNAL, static_cast<boost::uint32_t>(signal_number));
+
+		reloader.reload(configuration_reloader::handler_type());
+
+		signals.async_wait(strand.wrap(boost::bind(&reload_signal_handler, _1, _2, boost::ref(signals), boost::ref(strand), boost::ref(reloader))));
+	}
+}
+
+void dump_signal_handler(const boost::system::error_code& error, int signal_number, boost::asio::signal_set& signals, boost::asio::io_service::strand& strand, fl::logger& logger)
+{
+	if (!error)
+	{
+		record_flight_event(FE_SIGNAL, static_cast<boost::uint32_t>(signal_number));
+
+		if (dump_flight_recorder())
+		{
+			logger(fl::LL_INFORMATION) << "Flight recorder dumped to: " << get_flight_recorder_path();
+		}
+		else
+		{
+			logger(fl::LL_WARNING) << "Unable to dump the flight recorder to: " << get_flight_recorder_path();
+		}
+
+		signals.async_wait(strand.wrap(boost::bind(&dump_signal_handler, _1, _2, boost::ref(signals), boost::ref(strand), boost::ref(logger))));
+	}
+}
+
+void check_argument_count(const posix::control_server::arguments_type& arguments, std::size_t max_count)
+{
+	if (arguments.size() > max_count)
+	{
+		throw std::runtime_error("Too many arguments");
+	}
+}
+
+void control_peers(const posix::control_server::arguments_type& arguments, std::ostream& os)
+{
+	check_argument_count(arguments, 0);
+
+	const std::vector<peer_statistics_table::record_type> records = get_peer_statistics().records();
+	const boost::uint64_t now = get_monotonic_time();
+
+	BOOST_FOREACH(const peer_statistics_table::record_type& record, records)
+	{
+		const peer_statistics& statistics = record.statistics;
+
+		os << record.name
+			<< " fingerprint=";
+
+		BOOST_FOREACH(unsigned char byte, record.fingerprint)
+		{
+			os << std::hex << std::setw(2) << std::setfill('0') << static_cast<unsigned int>(byte);
+		}
+
+		os << std::dec
+			<< " handshakes=" << statistics.handshakes
+			<< " rejected_handshakes=" << statistics.rejected_handshakes
+			<< " since_last_handshake_ms=" << (now - statistics.last_handshake) / 1000000
+			<< "\n";
+	}
+}
+
+void control_metrics(const posix::control_server::arguments_type& arguments, std::ostream& os)
+{
+	check_argument_count(arguments, 0);
+
+	get_metrics().write(os);
+}
+
+void control_latency(const shard_list& shards, const posix::control_server::arguments_type& arguments, std::ostream& os)
+{
+	check_argument_count(arguments, 0);
+
+	if (!shards.front()->probe)
+	{
+		throw std::runtime_error("The event loop queueing delay is not measured: set runtime.latency_probe_interval");
+	}
+
+	for (std::size_t i = 0; i < shards.size(); ++i)
+	{
+		os << "shard " << i << ": " << describe_latency(get_event_loop_queueing_delay(i).snapshot()) << "\n";
+	}
+}
+
+void control_log_level(fl::logger& logger, shard_list& shards, const posix::control_server::arguments_type& arguments, std::ostream& os)
+{
+	check_argument_count(arguments, 1);
+
+	if (!arguments.empty())
+	{
+		set_log_level(logger, shards, parse_log_level(arguments.front()));
+	}
+
+	std::string level = log_level_to_string(logger.level());
+	std::transform(level.begin(), level.end(), level.begin(), ::tolower);
+
+	os << level << "\n";
+}
+
+void complete_control_reload(const posix::control_server::completion_handler_type& completion, bool result)
+{
+	if (result)
+	{
+		completion(true, "Configuration reloaded.\n");
+	}
+	else
+	{
+		completion(false, "Unable to reload the configuration: see the log for details");
+	}
+}
+
+void control_reload(configuration_reloader& reloader, const posix::control_server::arguments_type& arguments, posix::control_server::completion_handler_type completion)
+{
+	check_argument_count(arguments, 0);
+
+	reloader.reload(boost::bind(&complete_control_reload, completion, _1));
+}
+
+void control_dump(const posix::control_server::arguments_type& arguments, std::ostream& os)
+{
+	check_argument_count(arguments, 0);
+
+	if (get_flight_recorder_path().empty())
+	{
+		throw std::runtime_error("The flight recorder is disabled: set runtime.flight_recorder_size");
+	}
+
+	if (!dump_flight_recorder())
+	{
+		throw std::runtime_error("Unable to dump the flight recorder to " + get_flight_recorder_path());
+	}
+
+	os << get_flight_recorder_path() << "\n";
+}
+#endif
+
+fs::path get_flight_recorder_file(const cli_configuration& configuration)
+{
+	if (!configuration.runtime.flight_recorder_file.empty())
+	{
+		return fs::absolute(configuration.runtime.flight_recorder_file, configuration.execution_root_directory);
+	}
+
+#ifdef WINDOWS
+	const unsigned long pid = ::GetCurrentProcessId();
+#else
+	const pid_t pid = ::getpid();
+#endif
+
+	return get_temporary_directory() / ("freelan_flight_recorder_" + boost::lexical_cast<std::string>(pid) + ".bin");
+}
+
+void run_worker(event_loop& loop, boost::mutex& error_mutex, std::string& error)
+{
+	try
+	{
+		loop.run();
+	}
+	catch (std::exception& ex)
+	{
+		boost::lock_guard<boost::mutex> lock(error_mutex);
+
+		if (error.empty())
+		{
+			error = ex.what();
+		}
+
+		loop.io_service().stop();
+	}
+}
+
+#ifndef WINDOWS
+std::vector<unsigned int> setup_placement(const runtime_configuration& configuration, fl::logger& logger)
+{
+	std::vector<unsigned int> cpus = configuration.cpu_affinity.values();
+
+	if (configuration.lock_memory)
+	{
+		posix::lock_memory();
+
+		logger(fl::LL_INFORMATION) << "Process memory locked in RAM.";
+	}
+
+	if (configuration.numa_node >= 0)
+	{
+		const unsigned int node = static_cast<unsigned int>(configuration.numa_node);
+
+		if (cpus.empty())
+		{
+			cpus = posix::get_numa_node_cpus(node);
+		}
+
+		if (posix::set_numa_memory_policy(node))
+		{
+			logger(fl::LL_INFORMATION) << "Allocating memory from NUMA node " << node << " preferably.";
+		}
+		else
+		{
+			logger(fl::LL_WARNING) << "NUMA memory policies are not supported on this platform.";
+		}
+	}
+
+	if (!cpus.empty())
+	{
+		if (posix::set_current_thread_cpus(cpus))
+		{
+			logger(fl::LL_INFORMATION) << "Running on CPU(s): " << cpu_list(cpus) << ".";
+		}
+		else
+		{
+			logger(fl::LL_WARNING) << "CPU affinity is not supported on this platform.";
+
+			cpus.clear();
+		}
+	}
+
+	if (configuration.scheduling_policy != runtime_configuration::SP_OTHER)
+	{
+		posix::set_current_thread_scheduling_policy(configuration.scheduling_policy, configuration.scheduling_priority);
+
+		logger(fl::LL_INFORMATION) << "Scheduling policy: " << configuration.scheduling_policy << " (priority " << configuration.scheduling_priority << ").";
+	}
+
+	return cpus;
+}
+#endif
+
+void run_shard(shard_list& shards, unsigned int index, const std::vector<unsigned int>& cpus, fl::logger& logger, boost::mutex& error_mutex, std::string& error)
+{
+#ifndef WINDOWS
+	try
+	{
+		const unsigned int cpu = cpus.empty() ? (index % std::max(boost::thread::hardware_concurrency(), 1u)) : cpus[index % cpus.size()];
+
+		if (posix::set_current_thread_cpu(cpu))
+		{
+			logger(fl::LL_INFORMATION) << "Shard " << index << " bound to CPU " << cpu << ".";
+		}
+	}
+	catch (std::exception& ex)
+	{
+		logger(fl::LL_WARNING) << "Unable to set the CPU affinity of shard " << index << ": " << ex.what();
+	}
+#endif
+
+	run_worker(shards[index]->loop, error_mutex, error);
+
+	boost::lock_guard<boost::mutex> lock(error_mutex);
+
+	// A shard failed: the whole process must stop.
+	if (!error.empty())
+	{
+		BOOST_FOREACH(const boost::shared_ptr<shard>& _shard, shards)
+		{
+			_shard->io_service.stop();
+		}
+	}
+}
+
+void run(int argc, char** argv, const cli_configuration& configuration, int& exit_signal)
+{
+#ifndef WINDOWS
+	boost::shared_ptr<posix::locked_pid_file> pid_file;
+
+	if (!configuration.pid_file.empty())
+	{
+		std::cout << "Creating PID file at: " << configuration.pid_file << std::endl;
+
+		pid_file.reset(new posix::locked_pid_file(configuration.pid_file));
+	}
+#endif
+
+	boost::function<void (freelan::log_level, const std::string&)> log_func = &do_log;
+	async_log_sink::writer_type log_writer = &write_log;
+
+#ifndef WINDOWS
+	if (!configuration.foreground)
+	{
+		posix::daemonize();
+
+		log_func = &posix::syslog;
+		log_writer = boost::bind(&posix::syslog, _1, _2);
+	}
+
+	if (pid_file)
+	{
+		pid_file->write_pid();
+	}
+#endif
+
+	// After daemonizing: the default file is named after the process id.
+	start_flight_recorder(configuration.runtime.flight_recorder_size, get_flight_recorder_file(configuration).string());
+
+	// Must outlive the cores and their loggers.
+	boost::scoped_ptr<async_log_sink> log_sink;
+
+	if (configuration.runtime.log_queue_size > 0)
+	{
+		log_sink.reset(new async_log_sink(log_writer, configuration.runtime.log_queue_size, configuration.runtime.log_overflow_policy));
+
+		log_func = boost::bind(&async_log_sink::log, boost::ref(*log_sink), _1, _2);
+	}
+
+	log_func = boost::bind(&counted_log, log_func, get_log_message_counters(), _1, _2);
+
+	fl::logger logger(log_func, configuration.log_level);
+
+	// Threads created from now on inherit the placement of the current thread.
+#ifndef WINDOWS
+	const std::vector<unsigned int> cpus = setup_placement(configuration.runtime, logger);
+#else
+	const std::vector<unsigned int> cpus;
+#endif
+
+	unsigned int shard_count = configuration.runtime.shard_count;
+
+	if (shard_count == 0)
+	{
+		shard_count = std::max(boost::thread::hardware_concurrency(), 1u);
+	}
+
+	// Every shard has its own switch: a shard cannot forward frames to the peers of another one.
+	if ((shard_count > 1) && (configuration.fl_configuration.tap_adapter.enabled || configuration.fl_configuration.switch_.relay_mode_enabled))
+	{
+		throw std::runtime_error("Running several shards requires the tap adapter and the relay mode to be disabled (tap_adapter.enabled=no, switch.relay_mode_enabled=no): peers on different shards cannot reach each other.");
+	}
+
+	shard_list shards;
+
+	certificate_validator validator(configuration.fl_configuration.security.certificate_validation_callback, configuration.validation_cache, configuration.revocation_index, configuration.revocation_validation_method);
+
+	startup_timings_type startup_timings = configuration.startup_timings;
+	boost::uint64_t start = get_monotonic_time();
+
+	for (unsigned int i = 0; i < shard_count; ++i)
+	{
+		const boost::shared_ptr<shard> _shard = boost::make_shared<shard>(configuration.runtime);
+
+		fl::configuration fl_configuration = (shard_count > 1) ? get_shard_configuration(configuration.fl_configuration, i, shard_count) : configuration.fl_configuration;
+
+		fl_configuration.security.certificate_validation_callback = boost::bind(&certificate_validator::validate, boost::ref(validator), _1, _2);
+
+		tap_adapter_callback_type up_callback;
+		tap_adapter_callback_type down_callback;
+
+		if (!configuration.tap_adapter_up_script.empty())
+		{
+			up_callback = boost::bind(&async_execute_tap_adapter_up_script, boost::ref(_shard->executor), configuration.tap_adapter_up_script, configuration.tap_adapter_up_script_timeout, _1, _2);
+		}
+
+		if (!configuration.tap_adapter_down_script.empty())
+		{
+			down_callback = boost::bind(&async_execute_tap_adapter_down_script, boost::ref(_shard->executor), configuration.tap_adapter_down_script, configuration.tap_adapter_down_script_timeout, _1, _2);
+		}
+
+		fl_configuration.tap_adapter.up_callback = boost::bind(&tap_adapter_up, boost::ref(*_shard), up_callback, _1, _2);
+		fl_configuration.tap_adapter.down_callback = boost::bind(&tap_adapter_down, boost::ref(*_shard), down_callback, _1, _2);
+
+		if (shard_count > 1)
+		{
+			const fl::logger shard_logger(boost::bind(&prefixed_log, log_func, "[shard " + boost::lexical_cast<std::string>(i) + "] ", _1, _2), logger.level());
+
+			_shard->core.reset(new fl::core(_shard->io_service, fl_configuration, shard_logger));
+		}
+		else
+		{
+			_shard->core.reset(new fl::core(_shard->io_service, fl_configuration, logger));
+		}
+
+		shards.push_back(_shard);
+	}
+
+	add_startup_timing(&startup_timings, "core creation", start);
+
+	boost::asio::io_service& io_service = shards.front()->io_service;
+
+	// The signal handler closes the cores and must not race with itself.
+	boost::asio::io_service::strand signal_strand(io_service);
+
+	boost::asio::signal_set signals(io_service, SIGINT, SIGTERM);
+	boost::asio::signal_set reload_signals(io_service);
+	boost::asio::signal_set dump_signals(io_service);
+
+	// Closes what keeps the I/O service busy, besides the cores and the signals.
+	boost::function<void ()> close_control;
+
+#ifndef WINDOWS
+	configuration_reloader reloader(argc, argv, configuration, validator, shards, signal_strand, logger);
+
+	reload_signals.add(SIGHUP);
+	reload_signals.async_wait(signal_strand.wrap(boost::bind(&reload_signal_handler, _1, _2, boost::ref(reload_signals), boost::ref(signal_strand), boost::ref(reloader))));
+
+	if (configuration.runtime.flight_recorder_size > 0)
+	{
+		dump_signals.add(SIGUSR2);
+		dump_signals.async_wait(signal_strand.wrap(boost::bind(&dump_signal_handler, _1, _2, boost::ref(dump_signals), boost::ref(signal_strand), boost::ref(logger))));
+	}
+
+	// The worker is idle until the I/O service runs.
+	reloader.watch_files();
+
+	boost::scoped_ptr<posix::control_server> control;
+
+	if (!configuration.control_socket.empty())
+	{
+		try
+		{
+			control.reset(new posix::control_server(io_service, signal_strand, configuration.control_socket));
+
+			control->add_command("peers", "", "List the peers and their handshake statistics.", &control_peers);
+			control->add_command("metrics", "", "Dump the metrics.", &control_metrics);
+			control->add_command("latency", "", "Show the event loop queueing delay of each shard.", boost::bind(&control_latency, boost::cref(shards), _1, _2));
+			control->add_command("log_level", "[debug|information|warning|error|fatal]", "Show or change the log level.", boost::bind(&control_log_level, boost::ref(logger), boost::ref(shards), _1, _2));
+			control->add_async_command("reload", "", "Reload the configuration, as SIGHUP does.", boost::bind(&control_reload, boost::ref(reloader), _1, _2));
+			control->add_command("dump", "", "Dump the flight recorder, as SIGUSR2 does.", &control_dump);
+
+			close_control = boost::bind(&posix::control_server::close, control.get());
+
+			logger(fl::LL_INFORMATION) << "Control socket: " << configuration.control_socket.string();
+		}
+		catch (std::exception& ex)
+		{
+			logger(fl::LL_WARNING) << "Cannot create the control socket at " << configuration.control_socket << ": " << ex.what();
+		}
+	}
+#else
+	(void)argc;
+	(void)argv;
+#endif
+
+	start = get_monotonic_time();
+
+	BOOST_FOREACH(const boost::shared_ptr<shard>& _shard, shards)
+	{
+		_shard->core->open();
+	}
+
+	add_startup_timing(&startup_timings, "core opening", start);
+
+	signals.async_wait(signal_strand.wrap(boost::bind(signal_handler, _1, _2, boost::ref(shards), boost::ref(reload_signals), boost::ref(dump_signals), close_control, boost::ref(exit_signal))));
+
+	logger(fl::LL_INFORMATION) << "Execution started." << std::endl;
+
+	log_startup_timings(logger, startup_timings);
+
+	if (configuration.runtime.flight_recorder_size > 0)
+	{
+		logger(fl::LL_INFORMATION) << "Flight recorder: " << configuration.runtime.flight_recorder_size << " event(s) per thread, dumped to " << get_flight_recorder_path() << ".";
+	}
+
+	if (!shards.front()->core->has_tap_adapter())
+	{
+		logger(fl::LL_INFORMATION) << "Configured not to use any tap adapter.";
+	}
+
+	BOOST_FOREACH(const boost::shared_ptr<shard>& _shard, shards)
+	{
+		logger(fl::LL_INFORMATION) << "Listening on: " << _shard->core->server().socket().local_endpoint();
+
+		if (configuration.runtime.socket_busy_poll > 0)
+		{
+			try
+			{
+				if (!set_socket_busy_poll(_shard->core->server().socket(), configuration.runtime.socket_busy_poll))
+				{
+					logger(fl::LL_WARNING) << "Socket busy polling is not supported on this platform.";
+				}
+			}
+			catch (std::exception& ex)
+			{
+				// Typically EPERM, without CAP_NET_ADMIN: a tuning option must not prevent the startup.
+				logger(fl::LL_WARNING) << "Unable to enable socket busy polling: " << ex.what();
+			}
+		}
+	}
+
+	if (configuration.runtime.poll_mode != runtime_configuration::PM_BLOCKING)
+	{
+		logger(fl::LL_INFORMATION) << "Event loop poll mode: " << configuration.runtime.poll_mode << ".";
+	}
+
+	if (static_cast<unsigned int>(configuration.runtime.latency_probe_interval) > 0)
+	{
+		for (std::size_t i = 0; i < shards.size(); ++i)
+		{
+			shards[i]->probe.reset(new event_loop_probe(shards[i]->io_service, configuration.runtime.latency_probe_interval, get_event_loop_queueing_delay(i)));
+			shards[i]->probe->start();
+		}
+
+		logger(fl::LL_INFORMATION) << "Measuring the event loop queueing delay every " << static_cast<unsigned int>(configuration.runtime.latency_probe_interval) << " ms.";
+	}
+
+	std::vector<unsigned int> metrics_collectors;
+
+	metrics_collectors.push_back(get_metrics().add_collector(boost::bind(&collect_shard_metrics, boost::cref(shards), _1)));
+	metrics_collectors.push_back(get_metrics().add_collector(boost::bind(&collect_peer_metrics, boost::cref(get_peer_statistics()), _1)));
+
+	if (configuration.runtime.poll_mode != runtime_configuration::PM_BLOCKING)
+	{
+		metrics_collectors.push_back(get_metrics().add_collector(boost::bind(&collect_event_loop_metrics, boost::cref(shards), _1)));
+	}
+
+	if (log_sink)
+	{
+		metrics_collectors.push_back(get_metrics().add_collector(boost::bind(&collect_log_sink_metrics, boost::cref(*log_sink), _1)));
+	}
+
+	// Stopped before the collectors are removed and the shards are destroyed.
+	boost::scoped_ptr<metrics_server> metrics_endpoint;
+
+	if (!configuration.runtime.metrics_listen_on.empty())
+	{
+		try
+		{
+			metrics_endpoint.reset(new metrics_server(configuration.runtime.metrics_listen_on, get_metrics()));
+
+			logger(fl::LL_INFORMATION) << "Serving metrics on: " << metrics_endpoint->description();
+		}
+		catch (std::exception& ex)
+		{
+			logger(fl::LL_WARNING) << "Cannot serve metrics on " << configuration.runtime.metrics_listen_on << ": " << ex.what();
+		}
+	}
+
+	boost::mutex error_mutex;
+	std::string error;
+	boost::thread_group threads;
+
+	if (shard_count > 1)
+	{
+		logger(fl::LL_INFORMATION) << "Running with " << shard_count << " shard(s).";
+
+		for (unsigned int i = 1; i < shard_count; ++i)
+		{
+			threads.create_thread(boost::bind(&run_shard, boost::ref(shards), i, boost::cref(cpus), boost::ref(logger), boost::ref(error_mutex), boost::ref(error)));
+		}
+
+		run_shard(shards, 0, cpus, logger, error_mutex, error);
+	}
+	else
+	{
+		// libfreelan does not wrap the handlers of a core in strands: they must all run on one thread.
+		run_worker(shards.front()->loop, error_mutex, error);
+	}
+
+	threads.join_all();
+
+	metrics_endpoint.reset();
+
+	BOOST_FOREACH(unsigned int id, metrics_collectors)
+	{
+		get_metrics().remove_collector(id);
+	}
+
+	if (configuration.runtime.poll_mode != runtime_configuration::PM_BLOCKING)
+	{
+		event_loop::statistics_type statistics;
+
+		BOOST_FOREACH(const boost::shared_ptr<shard>& _shard, shards)
+		{
+			statistics += _shard->loop.statistics();
+		}
+
+		logger(fl::LL_INFORMATION) << "Event loop statistics: " << statistics.spin_handler_count << " handler(s) run while polling in " << statistics.busy_time / 1000000 << " ms, " << statistics.spin_time / 1000000 << " ms spent polling idle, " << statistics.sleep_time / 1000000 << " ms spent waiting over " << statistics.wakeup_count << " wakeup(s).";
+	}
+
+	if (static_cast<unsigned int>(configuration.runtime.latency_probe_interval) > 0)
+	{
+		for (std::size_t i = 0; i < shards.size(); ++i)
+		{
+			logger(fl::LL_INFORMATION) << "Event loop queueing delay (shard " << i << "): " << describe_latency(get_event_loop_queueing_delay(i).snapshot()) << ".";
+		}
+	}
+
+	const boost::shared_ptr<certificate_validation_cache> validation_cache = validator.get_cache();
+
+	if (validation_cache)
+	{
+		logger(fl::LL_INFORMATION) << "Certificate validation cache: " << validation_cache->hit_count() << " hit(s), " << validation_cache->miss_count() << " miss(es).";
+	}
+
+	if (!error.empty())
+	{
+		throw std::runtime_error(error);
+	}
 
 	logger(fl::LL_INFORMATION) << "Execution stopped." << std::endl;
 }
@@ -429,16 +1917,24 @@ int main(int argc, char** argv)
 		freelan::initializer freelan_initializer;
 
 		cli_configuration configuration;
+		configuration.execution_root_directory = fs::current_path();
 
 		if (parse_options(argc, argv, configuration))
 		{
-			run(configuration, exit_signal);
+			run(argc, argv, configuration, exit_signal);
 		}
 	}
 	catch (std::exception& ex)
 	{
+		record_flight_event(FE_LOG, 4, 0, std::string(ex.what()));
+
 		std::cerr << "Error: " << ex.what() << std::endl;
 
+		if (dump_flight_recorder())
+		{
+			std::cerr << "Flight recorder dumped to: " << get_flight_recorder_path() << std::endl;
+		}
+
 		return EXIT_FAILURE;
 	}
 
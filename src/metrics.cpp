@@ -0,0 +1,433 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file metrics.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Counters, gauges and histograms, exported in the Prometheus text format.
+ */
+
+#include "metrics.hpp"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+#include <boost/make_shared.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace
+{
+	volatile std::size_t next_stripe_index = 0;
+
+	std::string escape_label_value(const std::string& value)
+	{
+		std::string result;
+		result.reserve(value.size());
+
+		for (std::string::const_iterator it = value.begin(); it != value.end(); ++it)
+		{
+			switch (*it)
+			{
+				case '\\':
+					result += "\\\\";
+					break;
+				case '"':
+					result += "\\\"";
+					break;
+				case '\n':
+					result += "\\n";
+					break;
+				default:
+					result += *it;
+			}
+		}
+
+		return result;
+	}
+
+	std::string format_value(double value)
+	{
+		std::ostringstream oss;
+
+		// Counters must not turn into scientific notation.
+		if ((value == std::floor(value)) && (std::fabs(value) < 1e18))
+		{
+			oss << static_cast<boost::int64_t>(value);
+		}
+		else
+		{
+			oss << std::setprecision(15) << value;
+		}
+
+		return oss.str();
+	}
+
+	std::string with_labels(const std::string& name, const std::string& labels, const std::string& extra_labels = std::string())
+	{
+		if (labels.empty() && extra_labels.empty())
+		{
+			return name;
+		}
+
+		if (labels.empty() || extra_labels.empty())
+		{
+			return name + "{" + labels + extra_labels + "}";
+		}
+
+		return name + "{" + labels + "," + extra_labels + "}";
+	}
+
+	// Groups the samples by metric, as the exposition format requires.
+	class sample_table : public metrics_sample_writer
+	{
+		public:
+
+			void add(const std::string& name, const std::string& help, metric_type type, const std::string& labels, double value)
+			{
+				entry& e = m_entries[name];
+
+				if (e.help.empty())
+				{
+					e.help = help;
+					e.type = (type == MT_COUNTER) ? "counter" : "gauge";
+				}
+
+				e.samples.push_back(with_labels(name, labels) + " " + format_value(value));
+			}
+
+			void add_histogram(const std::string& name, const std::string& help, const std::string& labels, const metric_histogram& histogram)
+			{
+				entry& e = m_entries[name];
+
+				if (e.help.empty())
+				{
+					e.help = help;
+					e.type = "histogram";
+				}
+
+				boost::uint64_t count = 0;
+
+				for (std::size_t i = 0; i <= histogram.bounds().size(); ++i)
+				{
+					count += histogram.bucket_count(i);
+
+					const std::string le = (i < histogram.bounds().size()) ? format_value(histogram.bounds()[i]) : "+Inf";
+
+					e.samples.push_back(with_labels(name + "_bucket", labels, "le=\"" + le + "\"") + " " + format_value(static_cast<double>(count)));
+				}
+
+				e.samples.push_back(with_labels(name + "_sum", labels) + " " + format_value(static_cast<double>(histogram.sum()) / 1000000000.0));
+				e.samples.push_back(with_labels(name + "_count", labels) + " " + format_value(static_cast<double>(count)));
+			}
+
+			void add_summary(const std::string& name, const std::string& help, const std::string& labels, const latency_histogram& histogram)
+			{
+				static const double quantiles[] = { 0.5, 0.99, 0.999 };
+
+				const latency_histogram::snapshot_type snapshot = histogram.snapshot();
+
+				entry& e = m_entries[name];
+
+				if (e.help.empty())
+				{
+					e.help = help;
+					e.type = "summary";
+				}
+
+				for (std::size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); ++i)
+				{
+					e.samples.push_back(with_labels(name, labels, "quantile=\"" + format_value(quantiles[i]) + "\"") + " " + format_value(static_cast<double>(snapshot.percentile(quantiles[i])) / 1000000000.0));
+				}
+
+				e.samples.push_back(with_labels(name + "_sum", labels) + " " + format_value(static_cast<double>(snapshot.sum()) / 1000000000.0));
+				e.samples.push_back(with_labels(name + "_count", labels) + " " + format_value(static_cast<double>(snapshot.count())));
+
+				add(name + "_max", "Largest value of " + name + ".", MT_GAUGE, labels, static_cast<double>(snapshot.max()) / 1000000000.0);
+			}
+
+			void write(std::ostream& os) const
+			{
+				for (std::map<std::string, entry>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+				{
+					os << "# HELP " << it->first << " " << it->second.help << "\n";
+					os << "# TYPE " << it->first << " " << it->second.type << "\n";
+
+					for (std::vector<std::string>::const_iterator sample = it->second.samples.begin(); sample != it->second.samples.end(); ++sample)
+					{
+						os << *sample << "\n";
+					}
+				}
+			}
+
+		private:
+
+			struct entry
+			{
+				std::string help;
+				std::string type;
+				std::vector<std::string> samples;
+			};
+
+			std::map<std::string, entry> m_entries;
+	};
+
+	template <typename MetricType, typename FamilyMap>
+	MetricType& get_metric(FamilyMap& families, const std::string& name, const std::string& help, const std::string& labels)
+	{
+		typename FamilyMap::mapped_type& f = families[name];
+
+		if (f.help.empty())
+		{
+			f.help = help;
+		}
+
+		boost::shared_ptr<MetricType>& metric = f.metrics[labels];
+
+		if (!metric)
+		{
+			metric = boost::make_shared<MetricType>();
+		}
+
+		return *metric;
+	}
+}
+
+std::size_t get_metric_stripe_index()
+{
+#if defined(__GNUC__)
+	// 0 means that the thread has no stripe yet.
+	static __thread std::size_t index = 0;
+
+	if (index == 0)
+	{
+		index = atomic_fetch_add(next_stripe_index, static_cast<std::size_t>(1)) % METRIC_STRIPE_COUNT + 1;
+	}
+
+	return index - 1;
+#else
+	return boost::hash<boost::thread::id>()(boost::this_thread::get_id()) % METRIC_STRIPE_COUNT;
+#endif
+}
+
+metric_counter::metric_counter()
+{
+	for (std::size_t i = 0; i < METRIC_STRIPE_COUNT; ++i)
+	{
+		m_stripes[i].value = 0;
+	}
+}
+
+boost::uint64_t metric_counter::value() const
+{
+	boost::uint64_t result = 0;
+
+	for (std::size_t i = 0; i < METRIC_STRIPE_COUNT; ++i)
+	{
+		result += atomic_load(m_stripes[i].value);
+	}
+
+	return result;
+}
+
+metric_histogram::metric_histogram(const bounds_type& bounds) :
+	m_bounds(bounds),
+	m_nanosecond_bounds(),
+	m_buckets(),
+	m_sum()
+{
+	for (std::size_t i = 0; i < m_bounds.size(); ++i)
+	{
+		m_nanosecond_bounds.push_back(static_cast<boost::uint64_t>(m_bounds[i] * 1000000000.0));
+	}
+
+	for (std::size_t i = 0; i <= m_bounds.size(); ++i)
+	{
+		m_buckets.push_back(boost::make_shared<metric_counter>());
+	}
+}
+
+void metric_histogram::observe(boost::uint64_t duration)
+{
+	const std::size_t index = std::lower_bound(m_nanosecond_bounds.begin(), m_nanosecond_bounds.end(), duration) - m_nanosecond_bounds.begin();
+
+	m_buckets[index]->increment();
+	m_sum.increment(duration);
+}
+
+std::string make_metric_labels(const std::string& name, const std::string& value)
+{
+	return name + "=\"" + escape_label_value(value) + "\"";
+}
+
+std::string make_metric_labels(const std::string& name1, const std::string& value1, const std::string& name2, const std::string& value2)
+{
+	return make_metric_labels(name1, value1) + "," + make_metric_labels(name2, value2);
+}
+
+metrics_registry::metrics_registry() :
+	m_next_collector_id(0)
+{
+}
+
+metric_counter& metrics_registry::counter(const std::string& name, const std::string& help, const std::string& labels)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	return get_metric<metric_counter>(m_counters, name, help, labels);
+}
+
+metric_gauge& metrics_registry::gauge(const std::string& name, const std::string& help, const std::string& labels)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	return get_metric<metric_gauge>(m_gauges, name, help, labels);
+}
+
+metric_histogram& metrics_registry::histogram(const std::string& name, const std::string& help, const std::string& labels, const metric_histogram::bounds_type& bounds)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	family<metric_histogram>& f = m_histograms[name];
+
+	if (f.help.empty())
+	{
+		f.help = help;
+	}
+
+	boost::shared_ptr<metric_histogram>& metric = f.metrics[labels];
+
+	if (!metric)
+	{
+		metric = boost::make_shared<metric_histogram>(bounds);
+	}
+
+	return *metric;
+}
+
+latency_histogram& metrics_registry::latency(const std::string& name, const std::string& help, const std::string& labels)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	return get_metric<latency_histogram>(m_latencies, name, help, labels);
+}
+
+unsigned int metrics_registry::add_collector(collector_type collector)
+{
+	boost::mutex::scoped_lock lock(m_collector_mutex);
+
+	m_collectors[m_next_collector_id] = collector;
+
+	return m_next_collector_id++;
+}
+
+void metrics_registry::remove_collector(unsigned int id)
+{
+	boost::mutex::scoped_lock lock(m_collector_mutex);
+
+	m_collectors.erase(id);
+}
+
+void metrics_registry::write(std::ostream& os)
+{
+	sample_table table;
+
+	{
+		boost::mutex::scoped_lock lock(m_collector_mutex);
+
+		for (std::map<unsigned int, collector_type>::const_iterator collector = m_collectors.begin(); collector != m_collectors.end(); ++collector)
+		{
+			collector->second(table);
+		}
+	}
+
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	for (std::map<std::string, family<metric_counter> >::const_iterator f = m_counters.begin(); f != m_counters.end(); ++f)
+	{
+		for (std::map<std::string, boost::shared_ptr<metric_counter> >::const_iterator metric = f->second.metrics.begin(); metric != f->second.metrics.end(); ++metric)
+		{
+			table.add(f->first, f->second.help, metrics_sample_writer::MT_COUNTER, metric->first, static_cast<double>(metric->second->value()));
+		}
+	}
+
+	for (std::map<std::string, family<metric_gauge> >::const_iterator f = m_gauges.begin(); f != m_gauges.end(); ++f)
+	{
+		for (std::map<std::string, boost::shared_ptr<metric_gauge> >::const_iterator metric = f->second.metrics.begin(); metric != f->second.metrics.end(); ++metric)
+		{
+			table.add(f->first, f->second.help, metrics_sample_writer::MT_GAUGE, metric->first, static_cast<double>(metric->second->value()));
+		}
+	}
+
+	for (std::map<std::string, family<metric_histogram> >::const_iterator f = m_histograms.begin(); f != m_histograms.end(); ++f)
+	{
+		for (std::map<std::string, boost::shared_ptr<metric_histogram> >::const_iterator metric = f->second.metrics.begin(); metric != f->second.metrics.end(); ++metric)
+		{
+			table.add_histogram(f->first, f->second.help, metric->first, *metric->second);
+		}
+	}
+
+	for (std::map<std::string, family<latency_histogram> >::const_iterator f = m_latencies.begin(); f != m_latencies.end(); ++f)
+	{
+		for (std::map<std::string, boost::shared_ptr<latency_histogram> >::const_iterator metric = f->second.metrics.begin(); metric != f->second.metrics.end(); ++metric)
+		{
+			table.add_summary(f->first, f->second.help, metric->first, *metric->second);
+		}
+	}
+
+	table.write(os);
+}
+
+const metric_histogram::bounds_type& metrics_registry::get_default_duration_bounds()
+{
+	static const double bounds[] = { 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0 };
+	static const metric_histogram::bounds_type result(bounds, bounds + sizeof(bounds) / sizeof(bounds[0]));
+
+	return result;
+}
+
+metrics_registry& get_metrics()
+{
+	static metrics_registry registry;
+
+	return registry;
+}
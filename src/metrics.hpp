@@ -0,0 +1,396 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file metrics.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Counters, gauges and histograms, exported in the Prometheus text format.
+ */
+
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "atomic.hpp"
+#include "latency_histogram.hpp"
+
+/**
+ * \brief Get the stripe of the calling thread.
+ * \return The stripe index, less than METRIC_STRIPE_COUNT.
+ *
+ * Threads get consecutive stripes, in the order they first update a metric.
+ */
+std::size_t get_metric_stripe_index();
+
+/**
+ * \brief The number of stripes of a counter.
+ */
+const std::size_t METRIC_STRIPE_COUNT = 16;
+
+/**
+ * \brief A monotonic counter.
+ *
+ * Each thread adds to its own cache line, so that threads that count the
+ * same events never contend. Reading the counter sums the stripes.
+ */
+class metric_counter : private boost::noncopyable
+{
+	public:
+
+		/**
+		 * \brief Create a null counter.
+		 */
+		metric_counter();
+
+		/**
+		 * \brief Add to the counter.
+		 * \param value The value to add.
+		 *
+		 * Lock-free. May be called concurrently from any thread.
+		 */
+		void increment(boost::uint64_t value = 1)
+		{
+			atomic_fetch_add(m_stripes[get_metric_stripe_index()].value, value);
+		}
+
+		/**
+		 * \brief Get the value.
+		 * \return The value.
+		 */
+		boost::uint64_t value() const;
+
+	private:
+
+		static const std::size_t CACHE_LINE_SIZE = 64;
+
+		struct stripe
+		{
+			volatile boost::uint64_t value;
+			char padding[CACHE_LINE_SIZE - sizeof(boost::uint64_t)];
+		};
+
+		stripe m_stripes[METRIC_STRIPE_COUNT];
+};
+
+/**
+ * \brief A value that can go up and down.
+ */
+class metric_gauge : private boost::noncopyable
+{
+	public:
+
+		/**
+		 * \brief Create a null gauge.
+		 */
+		metric_gauge() : m_value(0) {}
+
+		/**
+		 * \brief Set the value.
+		 * \param value The value.
+		 */
+		void set(boost::int64_t value)
+		{
+			atomic_store(m_value, value);
+		}
+
+		/**
+		 * \brief Add to the value.
+		 * \param value The value to add. May be negative.
+		 */
+		void add(boost::int64_t value)
+		{
+			atomic_fetch_add(m_value, value);
+		}
+
+		/**
+		 * \brief Get the value.
+		 * \return The value.
+		 */
+		boost::int64_t value() const
+		{
+			return atomic_load(m_value);
+		}
+
+	private:
+
+		volatile boost::int64_t m_value;
+};
+
+/**
+ * \brief A histogram of durations.
+ */
+class metric_histogram : private boost::noncopyable
+{
+	public:
+
+		/**
+		 * \brief The bucket bounds type, in seconds.
+		 */
+		typedef std::vector<double> bounds_type;
+
+		/**
+		 * \brief Create an empty histogram.
+		 * \param bounds The upper bounds of the buckets, in seconds, in ascending order. A last bucket holds everything else.
+		 */
+		explicit metric_histogram(const bounds_type& bounds);
+
+		/**
+		 * \brief Record a duration.
+		 * \param duration The duration, in nanoseconds.
+		 *
+		 * Lock-free. May be called concurrently from any thread.
+		 */
+		void observe(boost::uint64_t duration);
+
+		/**
+		 * \brief Get the bucket bounds.
+		 * \return The upper bounds of the buckets, in seconds.
+		 */
+		const bounds_type& bounds() const
+		{
+			return m_bounds;
+		}
+
+		/**
+		 * \brief Get the number of recorded durations in a bucket.
+		 * \param index The bucket index, at most bounds().size().
+		 * \return The number of recorded durations in the bucket. Not cumulative.
+		 */
+		boost::uint64_t bucket_count(std::size_t index) const
+		{
+			return m_buckets[index]->value();
+		}
+
+		/**
+		 * \brief Get the sum of the recorded durations.
+		 * \return The sum of the recorded durations, in nanoseconds.
+		 */
+		boost::uint64_t sum() const
+		{
+			return m_sum.value();
+		}
+
+	private:
+
+		bounds_type m_bounds;
+		std::vector<boost::uint64_t> m_nanosecond_bounds;
+		std::vector<boost::shared_ptr<metric_counter> > m_buckets;
+		metric_counter m_sum;
+};
+
+/**
+ * \brief Metrics whose values are read when they are exported.
+ *
+ * Collectors use it to report values that are kept elsewhere, like kernel
+ * interface statistics.
+ */
+class metrics_sample_writer
+{
+	public:
+
+		/**
+		 * \brief The metric types.
+		 */
+		enum metric_type
+		{
+			MT_COUNTER, /**< \brief A monotonic counter. */
+			MT_GAUGE /**< \brief A value that can go up and down. */
+		};
+
+		/**
+		 * \brief Add a sample.
+		 * \param name The metric name.
+		 * \param help The metric description.
+		 * \param type The metric type.
+		 * \param labels The labels, as written by make_metric_labels(). May be empty.
+		 * \param value The value.
+		 */
+		virtual void add(const std::string& name, const std::string& help, metric_type type, const std::string& labels, double value) = 0;
+
+	protected:
+
+		~metrics_sample_writer() {}
+};
+
+/**
+ * \brief Write a label set.
+ * \param name The label name.
+ * \param value The label value. It is escaped as needed.
+ * \return The label set, without braces.
+ */
+std::string make_metric_labels(const std::string& name, const std::string& value);
+
+/**
+ * \brief Write a label set.
+ * \param name1 The first label name.
+ * \param value1 The first label value.
+ * \param name2 The second label name.
+ * \param value2 The second label value.
+ * \return The label set, without braces.
+ */
+std::string make_metric_labels(const std::string& name1, const std::string& value1, const std::string& name2, const std::string& value2);
+
+/**
+ * \brief A set of metrics.
+ *
+ * Metrics are created on first use and live as long as the registry: the
+ * returned references can be kept. Creating or looking a metric up takes a
+ * lock, updating it does not.
+ */
+class metrics_registry : private boost::noncopyable
+{
+	public:
+
+		/**
+		 * \brief The collector type.
+		 *
+		 * Collectors are called each time the metrics are written, from the writing thread.
+		 */
+		typedef boost::function<void (metrics_sample_writer&)> collector_type;
+
+		/**
+		 * \brief Create an empty registry.
+		 */
+		metrics_registry();
+
+		/**
+		 * \brief Get a counter.
+		 * \param name The metric name.
+		 * \param help The metric description.
+		 * \param labels The labels, as written by make_metric_labels(). May be empty.
+		 * \return The counter.
+		 */
+		metric_counter& counter(const std::string& name, const std::string& help, const std::string& labels = std::string());
+
+		/**
+		 * \brief Get a gauge.
+		 * \param name The metric name.
+		 * \param help The metric description.
+		 * \param labels The labels, as written by make_metric_labels(). May be empty.
+		 * \return The gauge.
+		 */
+		metric_gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = std::string());
+
+		/**
+		 * \brief Get a duration histogram.
+		 * \param name The metric name.
+		 * \param help The metric description.
+		 * \param labels The labels, as written by make_metric_labels(). May be empty.
+		 * \param bounds The upper bounds of the buckets, in seconds, if the histogram does not exist yet.
+		 * \return The histogram.
+		 */
+		metric_histogram& histogram(const std::string& name, const std::string& help, const std::string& labels = std::string(), const metric_histogram::bounds_type& bounds = get_default_duration_bounds());
+
+		/**
+		 * \brief Get a latency histogram.
+		 * \param name The metric name.
+		 * \param help The metric description.
+		 * \param labels The labels, as written by make_metric_labels(). May be empty.
+		 * \return The histogram.
+		 *
+		 * Latency histograms are written as summaries, with the median, 99th
+		 * and 99.9th percentiles, and a separate gauge with the largest value.
+		 */
+		latency_histogram& latency(const std::string& name, const std::string& help, const std::string& labels = std::string());
+
+		/**
+		 * \brief Add a collector.
+		 * \param collector The collector.
+		 * \return An identifier to remove the collector with.
+		 */
+		unsigned int add_collector(collector_type collector);
+
+		/**
+		 * \brief Remove a collector.
+		 * \param id The identifier returned by add_collector().
+		 *
+		 * Once this returns, the collector is not called anymore.
+		 */
+		void remove_collector(unsigned int id);
+
+		/**
+		 * \brief Write all the metrics in the Prometheus text exposition format.
+		 * \param os The stream to write to.
+		 */
+		void write(std::ostream& os);
+
+		/**
+		 * \brief Get the default bucket bounds of duration histograms.
+		 * \return The bounds, from 100 microseconds to 10 seconds.
+		 */
+		static const metric_histogram::bounds_type& get_default_duration_bounds();
+
+	private:
+
+		template <typename MetricType>
+		struct family
+		{
+			std::string help;
+			std::map<std::string, boost::shared_ptr<MetricType> > metrics;
+		};
+
+		boost::mutex m_mutex;
+		// Held while the collectors run: collectors can create metrics, not collectors.
+		boost::mutex m_collector_mutex;
+		std::map<std::string, family<metric_counter> > m_counters;
+		std::map<std::string, family<metric_gauge> > m_gauges;
+		std::map<std::string, family<metric_histogram> > m_histograms;
+		std::map<std::string, family<latency_histogram> > m_latencies;
+		std::map<unsigned int, collector_type> m_collectors;
+		unsigned int m_next_collector_id;
+};
+
+/**
+ * \brief Get the metrics of the process.
+ * \return The metrics of the process.
+ */
+metrics_registry& get_metrics();
+
+#endif /* METRICS_HPP */
@@ -0,0 +1,266 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file metrics_server.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A HTTP server for the metrics.
+ */
+
+#include "metrics_server.hpp"
+
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+	// Requests are only read to find their end: a scraper sends a few hundred bytes.
+	const std::size_t MAX_REQUEST_SIZE = 8192;
+
+	template <typename Protocol>
+	class connection : public boost::enable_shared_from_this<connection<Protocol> >
+	{
+		public:
+
+			typedef typename Protocol::socket socket_type;
+
+			connection(boost::asio::io_service& io_service, metrics_registry& registry) :
+				m_socket(io_service),
+				m_registry(registry),
+				m_request(MAX_REQUEST_SIZE),
+				m_response()
+			{
+			}
+
+			socket_type& socket()
+			{
+				return m_socket;
+			}
+
+			void start()
+			{
+				boost::asio::async_read_until(m_socket, m_request, "\r\n\r\n", boost::bind(&connection::handle_read, this->shared_from_this(), boost::asio::placeholders::error));
+			}
+
+		private:
+
+			void handle_read(const boost::system::error_code& ec)
+			{
+				if (ec)
+				{
+					return;
+				}
+
+				std::ostringstream body;
+				m_registry.write(body);
+
+				const std::string content = body.str();
+
+				m_response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + boost::lexical_cast<std::string>(content.size()) + "\r\nConnection: close\r\n\r\n" + content;
+
+				boost::asio::async_write(m_socket, boost::asio::buffer(m_response), boost::bind(&connection::handle_write, this->shared_from_this(), boost::asio::placeholders::error));
+			}
+
+			void handle_write(const boost::system::error_code&)
+			{
+				boost::system::error_code ec;
+				m_socket.shutdown(socket_type::shutdown_both, ec);
+			}
+
+			socket_type m_socket;
+			metrics_registry& m_registry;
+			boost::asio::streambuf m_request;
+			std::string m_response;
+	};
+
+	boost::asio::ip::tcp::endpoint parse_tcp_endpoint(const std::string& value)
+	{
+		const std::string::size_type separator = value.rfind(':');
+
+		if ((separator == std::string::npos) || (separator == 0))
+		{
+			throw std::runtime_error("Invalid metrics endpoint, expected address:port: " + value);
+		}
+
+		std::string address = value.substr(0, separator);
+
+		if ((address.size() > 2) && (address[0] == '[') && (address[address.size() - 1] == ']'))
+		{
+			address = address.substr(1, address.size() - 2);
+		}
+
+		try
+		{
+			return boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(address), boost::lexical_cast<unsigned short>(value.substr(separator + 1)));
+		}
+		catch (std::exception&)
+		{
+			throw std::runtime_error("Invalid metrics endpoint, expected address:port: " + value);
+		}
+	}
+
+	void run_io_service(boost::asio::io_service& io_service)
+	{
+		io_service.run();
+	}
+}
+
+class metrics_server::listener
+{
+	public:
+
+		virtual ~listener() {}
+};
+
+template <typename Protocol>
+class metrics_server::basic_listener : public metrics_server::listener
+{
+	public:
+
+		basic_listener(boost::asio::io_service& io_service, const typename Protocol::endpoint& endpoint, metrics_registry& registry) :
+			m_io_service(io_service),
+			m_acceptor(io_service, endpoint),
+			m_registry(registry)
+		{
+			accept();
+		}
+
+	private:
+
+		typedef connection<Protocol> connection_type;
+
+		void accept()
+		{
+			const boost::shared_ptr<connection_type> new_connection = boost::make_shared<connection_type>(boost::ref(m_io_service), boost::ref(m_registry));
+
+			m_acceptor.async_accept(new_connection->socket(), boost::bind(&basic_listener::handle_accept, this, new_connection, boost::asio::placeholders::error));
+		}
+
+		void handle_accept(boost::shared_ptr<connection_type> new_connection, const boost::system::error_code& ec)
+		{
+			if (ec == boost::asio::error::operation_aborted)
+			{
+				return;
+			}
+
+			if (!ec)
+			{
+				new_connection->start();
+			}
+
+			accept();
+		}
+
+		boost::asio::io_service& m_io_service;
+		typename Protocol::acceptor m_acceptor;
+		metrics_registry& m_registry;
+};
+
+metrics_server::metrics_server(const std::string& listen_on, metrics_registry& registry) :
+	m_io_service(),
+	m_listener(),
+	m_description(),
+	m_socket_file(),
+	m_thread()
+{
+	static const std::string unix_prefix = "unix:";
+
+	if (listen_on.compare(0, unix_prefix.size(), unix_prefix) == 0)
+	{
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+		typedef boost::asio::local::stream_protocol protocol;
+
+		const fs::path path = listen_on.substr(unix_prefix.size());
+
+		if (path.empty())
+		{
+			throw std::runtime_error("Invalid metrics endpoint, expected unix:/path/to/socket: " + listen_on);
+		}
+
+		// Only a leftover socket may be replaced.
+		if (fs::status(path).type() == fs::socket_file)
+		{
+			fs::remove(path);
+		}
+
+		m_listener = boost::make_shared<basic_listener<protocol> >(boost::ref(m_io_service), protocol::endpoint(path.string()), boost::ref(registry));
+		fs::permissions(path, fs::owner_read | fs::owner_write);
+
+		m_socket_file = path;
+		m_description = path.string();
+#else
+		throw std::runtime_error("Unix sockets are not supported on this platform");
+#endif
+	}
+	else
+	{
+		typedef boost::asio::ip::tcp protocol;
+
+		const protocol::endpoint endpoint = parse_tcp_endpoint(listen_on);
+
+		m_listener = boost::make_shared<basic_listener<protocol> >(boost::ref(m_io_service), endpoint, boost::ref(registry));
+
+		m_description = boost::lexical_cast<std::string>(endpoint);
+	}
+
+	m_thread = boost::thread(boost::bind(&run_io_service, boost::ref(m_io_service)));
+}
+
+metrics_server::~metrics_server()
+{
+	m_io_service.stop();
+	m_thread.join();
+
+	m_listener.reset();
+
+	if (!m_socket_file.empty())
+	{
+		boost::system::error_code ec;
+		fs::remove(m_socket_file, ec);
+	}
+}
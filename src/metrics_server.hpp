@@ -0,0 +1,108 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file metrics_server.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A HTTP server for the metrics.
+ */
+
+#ifndef METRICS_SERVER_HPP
+#define METRICS_SERVER_HPP
+
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "metrics.hpp"
+
+/**
+ * \brief A HTTP server for the metrics.
+ *
+ * Every request, whatever its path, gets the metrics in the Prometheus text
+ * format. The server runs on its own thread, so that scrapes never delay the
+ * packet threads.
+ */
+class metrics_server : private boost::noncopyable
+{
+	public:
+
+		/**
+		 * \brief Create a metrics server and start serving.
+		 * \param listen_on Where to listen: "address:port", "[IPv6 address]:port" or, where supported, "unix:/path/to/socket".
+		 * \param registry The metrics to serve.
+		 *
+		 * A Unix socket is only accessible by its owner. A stale socket file is replaced.
+		 *
+		 * On error, a std::runtime_error or a boost::system::system_error is thrown.
+		 */
+		metrics_server(const std::string& listen_on, metrics_registry& registry);
+
+		/**
+		 * \brief Stop serving and destroy the server.
+		 */
+		~metrics_server();
+
+		/**
+		 * \brief Get a description of where the server listens.
+		 * \return A description of where the server listens.
+		 */
+		const std::string& description() const
+		{
+			return m_description;
+		}
+
+	private:
+
+		class listener;
+		template <typename Protocol> class basic_listener;
+
+		boost::asio::io_service m_io_service;
+		boost::shared_ptr<listener> m_listener;
+		std::string m_description;
+		boost::filesystem::path m_socket_file;
+		boost::thread m_thread;
+};
+
+#endif /* METRICS_SERVER_HPP */
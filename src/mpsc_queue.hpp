@@ -0,0 +1,214 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file mpsc_queue.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A bounded lock-free multiple-producer single-consumer queue.
+ */
+
+#ifndef MPSC_QUEUE_HPP
+#define MPSC_QUEUE_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+#include "atomic.hpp"
+
+/**
+ * \brief A bounded lock-free multiple-producer single-consumer queue.
+ * \tparam Type The element type. Type must be default-constructible and swappable.
+ *
+ * Elements are swapped in and out of the queue storage, so that pushing and
+ * popping elements that own memory never allocates.
+ */
+template <typename Type>
+class mpsc_queue
+{
+	public:
+
+		/**
+		 * \brief The element type.
+		 */
+		typedef Type value_type;
+
+		/**
+		 * \brief Create a queue.
+		 * \param capacity The minimum capacity of the queue. The effective capacity is rounded up to a power of two.
+		 */
+		explicit mpsc_queue(std::size_t capacity);
+
+		/**
+		 * \brief Get the capacity.
+		 * \return The capacity.
+		 */
+		std::size_t capacity() const
+		{
+			return m_cells.size();
+		}
+
+		/**
+		 * \brief Push an element.
+		 * \param value The element to push. On success, value is swapped with a default-constructed element.
+		 * \return true on success, false if the queue is full.
+		 *
+		 * May be called concurrently from any thread.
+		 */
+		bool push(value_type& value);
+
+		/**
+		 * \brief Pop an element.
+		 * \param value The popped element.
+		 * \return true on success, false if the queue is empty.
+		 *
+		 * Must only be called from one thread at a time.
+		 */
+		bool pop(value_type& value);
+
+	private:
+
+		struct cell
+		{
+			cell() : sequence(0), value() {}
+
+			volatile std::size_t sequence;
+			value_type value;
+		};
+
+		// Keep the producers and consumer positions in different cache lines.
+		static const std::size_t CACHE_LINE_SIZE = 64;
+
+		std::vector<cell> m_cells;
+		std::size_t m_mask;
+		char m_padding0[CACHE_LINE_SIZE];
+		volatile std::size_t m_push_position;
+		char m_padding1[CACHE_LINE_SIZE];
+		std::size_t m_pop_position;
+		char m_padding2[CACHE_LINE_SIZE];
+};
+
+template <typename Type>
+inline mpsc_queue<Type>::mpsc_queue(std::size_t capacity) :
+	m_cells(),
+	m_mask(0),
+	m_push_position(0),
+	m_pop_position(0)
+{
+	std::size_t size = 2;
+
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+
+	m_cells.resize(size);
+	m_mask = size - 1;
+
+	for (std::size_t i = 0; i < size; ++i)
+	{
+		m_cells[i].sequence = i;
+	}
+}
+
+template <typename Type>
+inline bool mpsc_queue<Type>::push(value_type& value)
+{
+	std::size_t position = atomic_load(m_push_position);
+
+	for (;;)
+	{
+		cell& _cell = m_cells[position & m_mask];
+
+		const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(atomic_load(_cell.sequence) - position);
+
+		if (difference == 0)
+		{
+			const std::size_t current_position = atomic_compare_exchange(m_push_position, position, position + 1);
+
+			if (current_position == position)
+			{
+				using std::swap;
+
+				swap(_cell.value, value);
+
+				atomic_store(_cell.sequence, position + 1);
+
+				return true;
+			}
+
+			position = current_position;
+		}
+		else if (difference < 0)
+		{
+			return false;
+		}
+		else
+		{
+			position = atomic_load(m_push_position);
+		}
+	}
+}
+
+template <typename Type>
+inline bool mpsc_queue<Type>::pop(value_type& value)
+{
+	cell& _cell = m_cells[m_pop_position & m_mask];
+
+	const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(atomic_load(_cell.sequence) - (m_pop_position + 1));
+
+	if (difference < 0)
+	{
+		return false;
+	}
+
+	using std::swap;
+
+	swap(value, _cell.value);
+	_cell.value = value_type();
+
+	atomic_store(_cell.sequence, m_pop_position + m_mask + 1);
+
+	++m_pop_position;
+
+	return true;
+}
+
+#endif /* MPSC_QUEUE_HPP */
@@ -0,0 +1,173 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file peer_statistics.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Per-peer handshake statistics.
+ */
+
+#include "peer_statistics.hpp"
+
+#include <algorithm>
+
+namespace
+{
+	const double NANOSECONDS_PER_SECOND = 1000000000.0;
+
+	// Beyond that, the peers with the oldest handshakes are forgotten.
+	const std::size_t MAX_PEERS = 4096;
+
+	bool is_before(const peer_statistics_table::record_type& lhs, const peer_statistics_table::record_type& rhs)
+	{
+		return (lhs.name != rhs.name) ? (lhs.name < rhs.name) : (lhs.fingerprint < rhs.fingerprint);
+	}
+
+	std::string to_hex(const peer_statistics_table::fingerprint_type& fingerprint)
+	{
+		static const char digits[] = "0123456789abcdef";
+
+		std::string result;
+		result.reserve(fingerprint.size() * 2);
+
+		for (std::size_t i = 0; i < fingerprint.size(); ++i)
+		{
+			result.push_back(digits[fingerprint[i] >> 4]);
+			result.push_back(digits[fingerprint[i] & 0x0f]);
+		}
+
+		return result;
+	}
+
+	void add_counter(metrics_sample_writer& writer, const char* name, const char* help, const std::string& labels, boost::uint64_t value)
+	{
+		writer.add(name, help, metrics_sample_writer::MT_COUNTER, labels, static_cast<double>(value));
+	}
+}
+
+peer_statistics_table::peer_statistics_table(std::size_t size) :
+	m_size(size)
+{
+}
+
+void peer_statistics_table::record_handshake(const fingerprint_type& fingerprint, const std::string& name, bool accepted)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	const record_map::iterator index = m_index.find(fingerprint);
+
+	if (index != m_index.end())
+	{
+		m_records.splice(m_records.begin(), m_records, index->second);
+	}
+	else
+	{
+		if (!accepted || (m_size == 0))
+		{
+			return;
+		}
+
+		if (m_index.size() >= m_size)
+		{
+			m_index.erase(m_records.back().fingerprint);
+			m_records.pop_back();
+		}
+
+		record_type record;
+		record.fingerprint = fingerprint;
+		record.statistics.handshakes = 0;
+		record.statistics.rejected_handshakes = 0;
+
+		m_records.push_front(record);
+		m_index[fingerprint] = m_records.begin();
+	}
+
+	record_type& record = m_records.front();
+
+	record.name = name;
+	record.statistics.last_handshake = get_monotonic_time();
+
+	if (accepted)
+	{
+		++record.statistics.handshakes;
+	}
+	else
+	{
+		++record.statistics.rejected_handshakes;
+	}
+}
+
+std::vector<peer_statistics_table::record_type> peer_statistics_table::records() const
+{
+	std::vector<record_type> result;
+
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		result.assign(m_records.begin(), m_records.end());
+	}
+
+	std::sort(result.begin(), result.end(), &is_before);
+
+	return result;
+}
+
+peer_statistics_table& get_peer_statistics()
+{
+	static peer_statistics_table table(MAX_PEERS);
+
+	return table;
+}
+
+void collect_peer_metrics(const peer_statistics_table& table, metrics_sample_writer& writer)
+{
+	const std::vector<peer_statistics_table::record_type> records = table.records();
+	const boost::uint64_t now = get_monotonic_time();
+
+	for (std::vector<peer_statistics_table::record_type>::const_iterator record = records.begin(); record != records.end(); ++record)
+	{
+		const std::string labels = make_metric_labels("peer", record->name, "fingerprint", to_hex(record->fingerprint));
+		const peer_statistics& statistics = record->statistics;
+
+		add_counter(writer, "freelan_peer_handshakes_total", "Accepted handshakes with the peer.", labels, statistics.handshakes);
+		add_counter(writer, "freelan_peer_rejected_handshakes_total", "Rejected handshakes with the peer.", labels, statistics.rejected_handshakes);
+		writer.add("freelan_peer_last_handshake_age_seconds", "Time since the last handshake with the peer.", metrics_sample_writer::MT_GAUGE, labels, (now - statistics.last_handshake) / NANOSECONDS_PER_SECOND);
+	}
+}
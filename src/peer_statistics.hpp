@@ -0,0 +1,152 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file peer_statistics.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Per-peer handshake statistics.
+ *
+ * Sessions and their traffic are handled inside libfreelan, which exposes no
+ * per-packet or per-session hook to the daemon: the only place a peer shows
+ * up is the certificate validation callback, run on each handshake. So only
+ * handshakes are counted per peer. The aggregate traffic is reported from the
+ * tap adapter and UDP socket counters instead: see system_metrics.hpp.
+ */
+
+#ifndef PEER_STATISTICS_HPP
+#define PEER_STATISTICS_HPP
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+#include <boost/array.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "system.hpp"
+#include "metrics.hpp"
+
+/**
+ * \brief The handshake statistics of a peer.
+ */
+struct peer_statistics
+{
+	boost::uint64_t handshakes; /**< \brief The number of accepted handshakes. */
+	boost::uint64_t rejected_handshakes; /**< \brief The number of rejected handshakes. */
+	boost::uint64_t last_handshake; /**< \brief The monotonic time of the last handshake, in nanoseconds. */
+};
+
+/**
+ * \brief The handshake statistics of the peers.
+ *
+ * Peers are told apart by the fingerprint of their certificate: two peers
+ * that share a common name get their own statistics. Only the peers with the
+ * most recent handshakes are kept, up to a maximum number.
+ */
+class peer_statistics_table : private boost::noncopyable
+{
+	public:
+
+		/**
+		 * \brief The fingerprint type.
+		 */
+		typedef boost::array<unsigned char, 32> fingerprint_type;
+
+		/**
+		 * \brief A copy of the statistics of a peer.
+		 */
+		struct record_type
+		{
+			fingerprint_type fingerprint; /**< \brief The SHA-256 fingerprint of the peer certificate. */
+			std::string name; /**< \brief The peer name. */
+			peer_statistics statistics; /**< \brief The statistics. */
+		};
+
+		/**
+		 * \brief Create an empty table.
+		 * \param size The maximum number of peers. When a new peer is added to a full table, the peer with the oldest handshake is removed.
+		 */
+		explicit peer_statistics_table(std::size_t size);
+
+		/**
+		 * \brief Record a handshake.
+		 * \param fingerprint The SHA-256 fingerprint of the peer certificate.
+		 * \param name The peer name.
+		 * \param accepted Whether the handshake was accepted. A rejected handshake is only recorded for a known peer: anyone can present a certificate.
+		 *
+		 * Takes a lock: it is done once per handshake.
+		 */
+		void record_handshake(const fingerprint_type& fingerprint, const std::string& name, bool accepted);
+
+		/**
+		 * \brief Get a copy of the statistics of all the peers.
+		 * \return The statistics, sorted by peer name.
+		 */
+		std::vector<record_type> records() const;
+
+	private:
+
+		typedef std::list<record_type> record_list;
+		typedef std::map<fingerprint_type, record_list::iterator> record_map;
+
+		const std::size_t m_size;
+		mutable boost::mutex m_mutex;
+		// Most recent handshake first.
+		record_list m_records;
+		record_map m_index;
+};
+
+/**
+ * \brief Get the peer statistics of the process.
+ * \return The peer statistics of the process.
+ */
+peer_statistics_table& get_peer_statistics();
+
+/**
+ * \brief Report the statistics of all the peers.
+ * \param table The statistics table.
+ * \param writer The writer to report the statistics to.
+ */
+void collect_peer_metrics(const peer_statistics_table& table, metrics_sample_writer& writer);
+
+#endif /* PEER_STATISTICS_HPP */
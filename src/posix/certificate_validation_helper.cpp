@@ -0,0 +1,426 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file certificate_validation_helper.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A persistent certificate validation helper process.
+ */
+
+#include "certificate_validation_helper.hpp"
+
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <climits>
+
+#include <boost/bind.hpp>
+#include <boost/system/system_error.hpp>
+
+#include <openssl/x509.h>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+
+#include "../system.hpp"
+
+namespace posix
+{
+	namespace
+	{
+		// A helper that keeps dying is not restarted more often than this.
+		const boost::uint64_t RESTART_DELAY = 1000000000ULL;
+
+		// Writes never block: a helper that stops reading must not hold the writers past their deadline.
+#ifdef MSG_NOSIGNAL
+		const int SEND_FLAGS = MSG_DONTWAIT | MSG_NOSIGNAL;
+#else
+		const int SEND_FLAGS = MSG_DONTWAIT;
+#endif
+
+		void throw_system_error(const std::string& what)
+		{
+			throw boost::system::system_error(errno, boost::system::system_category(), what);
+		}
+
+		// Returns false if the deadline passed first.
+		bool wait_writable(int fd, const boost::system_time& deadline)
+		{
+			int timeout = -1;
+
+			if (!deadline.is_pos_infinity())
+			{
+				const boost::posix_time::time_duration remaining = deadline - boost::get_system_time();
+
+				if (remaining.is_negative() || (remaining.total_milliseconds() == 0))
+				{
+					return false;
+				}
+
+				timeout = static_cast<int>(std::min<boost::int64_t>(remaining.total_milliseconds(), INT_MAX));
+			}
+
+			struct pollfd pfd;
+			pfd.fd = fd;
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+
+			const int result = ::poll(&pfd, 1, timeout);
+
+			if ((result < 0) && (errno != EINTR))
+			{
+				throw_system_error("Waiting for the certificate validation helper");
+			}
+
+			// On an error or a hang up, the next write reports it.
+			return (result != 0);
+		}
+
+		// Returns false if the deadline passed before everything was written.
+		bool write_all(int fd, const unsigned char* buf, size_t buf_len, const boost::system_time& deadline)
+		{
+			while (buf_len > 0)
+			{
+				const ssize_t cnt = ::send(fd, buf, buf_len, SEND_FLAGS);
+
+				if (cnt < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+
+					if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+					{
+						if (!wait_writable(fd, deadline))
+						{
+							return false;
+						}
+
+						continue;
+					}
+
+					throw_system_error("Writing to the certificate validation helper");
+				}
+
+				buf += cnt;
+				buf_len -= cnt;
+			}
+
+			return true;
+		}
+
+		bool read_all(int fd, unsigned char* buf, size_t buf_len)
+		{
+			while (buf_len > 0)
+			{
+				const ssize_t cnt = ::recv(fd, buf, buf_len, 0);
+
+				if (cnt < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+
+					return false;
+				}
+				else if (cnt == 0)
+				{
+					return false;
+				}
+
+				buf += cnt;
+				buf_len -= cnt;
+			}
+
+			return true;
+		}
+
+		void write_uint32(unsigned char* buf, boost::uint32_t value)
+		{
+			value = htonl(value);
+			std::memcpy(buf, &value, sizeof(value));
+		}
+
+		boost::uint32_t read_uint32(const unsigned char* buf)
+		{
+			boost::uint32_t value;
+			std::memcpy(&value, buf, sizeof(value));
+
+			return ntohl(value);
+		}
+	}
+
+	certificate_validation_helper::certificate_validation_helper(const boost::filesystem::path& path, const boost::posix_time::time_duration& timeout) :
+		m_path(path),
+		m_timeout(timeout),
+		m_next_id(0),
+		m_fd(-1),
+		m_running(false),
+		m_next_start(0)
+	{
+	}
+
+	certificate_validation_helper::~certificate_validation_helper()
+	{
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			if (m_running)
+			{
+				// The reader gets an end of file, then stops the helper.
+				::shutdown(m_fd, SHUT_RDWR);
+			}
+		}
+
+		if (m_reader.joinable())
+		{
+			m_reader.join();
+		}
+
+		if (m_fd >= 0)
+		{
+			::close(m_fd);
+		}
+	}
+
+	bool certificate_validation_helper::validate(cert_type cert)
+	{
+		const int der_len = i2d_X509(cert.raw(), NULL);
+
+		if (der_len <= 0)
+		{
+			throw std::runtime_error("Unable to encode the certificate");
+		}
+
+		std::vector<unsigned char> frame(8 + der_len);
+		unsigned char* der = &frame[8];
+		i2d_X509(cert.raw(), &der);
+
+		// Sending the request and waiting for the response share the timeout.
+		const boost::system_time deadline = m_timeout.is_pos_infinity() ? boost::system_time(boost::posix_time::pos_infin) : boost::get_system_time() + m_timeout;
+
+		request_type request;
+		boost::uint32_t id;
+		int fd;
+
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			if (!m_running)
+			{
+				start(lock);
+			}
+
+			id = m_next_id++;
+			m_requests[id] = &request;
+			fd = m_fd;
+		}
+
+		write_uint32(&frame[0], id);
+		write_uint32(&frame[4], static_cast<boost::uint32_t>(der_len));
+
+		bool written;
+
+		try
+		{
+			boost::mutex::scoped_lock lock(m_write_mutex);
+
+			written = write_all(fd, &frame[0], frame.size(), deadline);
+		}
+		catch (...)
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			m_requests.erase(id);
+
+			throw;
+		}
+
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		if (!written)
+		{
+			m_requests.erase(id);
+			stop_hung_helper(fd);
+
+			throw std::runtime_error("The certificate validation helper did not read the request in time and was stopped");
+		}
+
+		while (!request.done)
+		{
+			if (!m_condition.timed_wait(lock, deadline) && !request.done)
+			{
+				m_requests.erase(id);
+				stop_hung_helper(fd);
+
+				throw std::runtime_error("The certificate validation helper did not respond in time and was stopped");
+			}
+		}
+
+		if (request.failed)
+		{
+			throw std::runtime_error("The certificate validation helper terminated");
+		}
+
+		return (request.result == 0);
+	}
+
+	void certificate_validation_helper::stop_hung_helper(int fd)
+	{
+		// A hung helper would make every later request wait for the whole timeout.
+		if (m_running && (m_fd == fd))
+		{
+			// The reader gets an end of file, kills the helper and fails the other pending requests.
+			::shutdown(m_fd, SHUT_RDWR);
+		}
+	}
+
+	void certificate_validation_helper::start(boost::mutex::scoped_lock&)
+	{
+		const boost::uint64_t now = get_monotonic_time();
+
+		if (now < m_next_start)
+		{
+			throw std::runtime_error("The certificate validation helper terminated recently and is not restarted yet");
+		}
+
+		m_next_start = now + RESTART_DELAY;
+
+		// The previous reader, if any, is done with the lock by now.
+		if (m_reader.joinable())
+		{
+			m_reader.join();
+		}
+
+		{
+			// A write may still be in progress on the previous socket.
+			boost::mutex::scoped_lock write_lock(m_write_mutex);
+
+			if (m_fd >= 0)
+			{
+				::close(m_fd);
+				m_fd = -1;
+			}
+		}
+
+		int fds[2];
+
+		if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		{
+			throw_system_error("socketpair()");
+		}
+
+		::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+		::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+		const int value = 1;
+		::setsockopt(fds[0], SOL_SOCKET, SO_NOSIGPIPE, &value, sizeof(value));
+#endif
+
+		pid_t pid;
+
+		try
+		{
+			pid = spawn(m_path, std::vector<std::string>(), fds[1], fds[1]);
+		}
+		catch (...)
+		{
+			::close(fds[0]);
+			::close(fds[1]);
+
+			throw;
+		}
+
+		::close(fds[1]);
+
+		m_fd = fds[0];
+		m_running = true;
+		m_reader = boost::thread(boost::bind(&certificate_validation_helper::read_responses, this, m_fd, pid));
+	}
+
+	void certificate_validation_helper::read_responses(int fd, pid_t pid)
+	{
+		unsigned char response[8];
+
+		while (read_all(fd, response, sizeof(response)))
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			// Responses to requests that timed out are ignored.
+			const request_map::iterator request = m_requests.find(read_uint32(&response[0]));
+
+			if (request != m_requests.end())
+			{
+				request->second->result = read_uint32(&response[4]);
+				request->second->done = true;
+				m_requests.erase(request);
+
+				m_condition.notify_all();
+			}
+		}
+
+		::kill(pid, SIGKILL);
+
+		while ((::waitpid(pid, NULL, 0) < 0) && (errno == EINTR)) {}
+
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		for (request_map::iterator request = m_requests.begin(); request != m_requests.end(); ++request)
+		{
+			request->second->failed = true;
+			request->second->done = true;
+		}
+
+		m_requests.clear();
+		m_running = false;
+
+		m_condition.notify_all();
+	}
+}
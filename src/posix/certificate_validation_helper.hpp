@@ -0,0 +1,161 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file certificate_validation_helper.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A persistent certificate validation helper process.
+ */
+
+#ifndef POSIX_CERTIFICATE_VALIDATION_HELPER_HPP
+#define POSIX_CERTIFICATE_VALIDATION_HELPER_HPP
+
+#include <map>
+
+#include <boost/filesystem.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <freelan/configuration.hpp>
+
+#include <sys/types.h>
+
+namespace posix
+{
+	/**
+	 * \brief A persistent certificate validation helper process.
+	 *
+	 * The helper is started once and reads requests on its standard input.
+	 * It writes its responses on its standard output. All integers are 32
+	 * bits wide and in network byte order:
+	 *
+	 * - A request is an identifier, a length and that many bytes of a DER
+	 *   encoded certificate.
+	 * - A response is the identifier of a request and a result: 0 accepts
+	 *   the certificate, anything else rejects it.
+	 *
+	 * Several requests may be pending at the same time and the helper may
+	 * answer them in any order.
+	 *
+	 * If the helper terminates, the pending requests fail and the helper is
+	 * started again on the next request. A helper that does not read a
+	 * request or respond to it in time is killed the same way. Restarts are
+	 * throttled.
+	 */
+	class certificate_validation_helper
+	{
+		public:
+
+			/**
+			 * \brief The certificate type.
+			 */
+			typedef freelan::security_configuration::cert_type cert_type;
+
+			/**
+			 * \brief Create a certificate validation helper.
+			 * \param path The helper executable. It is started on the first request.
+			 * \param timeout The time to send a request and get its response. Use boost::posix_time::pos_infin to wait forever.
+			 */
+			certificate_validation_helper(const boost::filesystem::path& path, const boost::posix_time::time_duration& timeout);
+
+			/**
+			 * \brief Stop the helper.
+			 */
+			~certificate_validation_helper();
+
+			/**
+			 * \brief Get the helper executable.
+			 * \return The helper executable.
+			 */
+			const boost::filesystem::path& path() const
+			{
+				return m_path;
+			}
+
+			/**
+			 * \brief Validate a certificate.
+			 * \param cert The certificate.
+			 * \return true if the helper accepted the certificate.
+			 *
+			 * If the helper cannot be started, terminates or does not respond in time, an exception is thrown.
+			 *
+			 * This method is thread-safe.
+			 */
+			bool validate(cert_type cert);
+
+		private:
+
+			struct request_type
+			{
+				request_type() : done(false), failed(false), result(0) {}
+
+				bool done;
+				bool failed;
+				boost::uint32_t result;
+			};
+
+			typedef std::map<boost::uint32_t, request_type*> request_map;
+
+			certificate_validation_helper(const certificate_validation_helper&);
+			certificate_validation_helper& operator=(const certificate_validation_helper&);
+
+			// Requires m_mutex.
+			void stop_hung_helper(int);
+			void start(boost::mutex::scoped_lock&);
+			void read_responses(int, pid_t);
+
+			const boost::filesystem::path m_path;
+			const boost::posix_time::time_duration m_timeout;
+			boost::mutex m_mutex;
+			boost::condition_variable m_condition;
+			boost::mutex m_write_mutex;
+			request_map m_requests;
+			boost::uint32_t m_next_id;
+			int m_fd;
+			bool m_running;
+			boost::uint64_t m_next_start;
+			boost::thread m_reader;
+	};
+}
+
+#endif /* POSIX_CERTIFICATE_VALIDATION_HELPER_HPP */
@@ -0,0 +1,331 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file control_server.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A control socket server.
+ */
+
+#include "control_server.hpp"
+
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/make_shared.hpp>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../flight_recorder.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+	// A command line is a few dozen bytes.
+	const std::size_t MAX_REQUEST_SIZE = 4096;
+
+	// The time a client has to send its command, in seconds.
+	const long REQUEST_TIMEOUT = 5;
+
+	bool is_authorized(int fd)
+	{
+		uid_t uid;
+
+#ifdef __linux__
+		struct ucred credentials;
+		socklen_t length = sizeof(credentials);
+
+		if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0)
+		{
+			return false;
+		}
+
+		uid = credentials.uid;
+#else
+		gid_t gid;
+
+		if (::getpeereid(fd, &uid, &gid) != 0)
+		{
+			return false;
+		}
+#endif
+
+		return ((uid == 0) || (uid == ::geteuid()));
+	}
+
+	posix::control_server::arguments_type split_arguments(const std::string& line)
+	{
+		std::istringstream iss(line);
+		posix::control_server::arguments_type arguments;
+
+		for (std::string argument; iss >> argument;)
+		{
+			arguments.push_back(argument);
+		}
+
+		return arguments;
+	}
+
+	void execute_handler(const posix::control_server::handler_type& handler, const posix::control_server::arguments_type& arguments, const posix::control_server::completion_handler_type& completion)
+	{
+		std::ostringstream output;
+
+		handler(arguments, output);
+
+		completion(true, output.str());
+	}
+}
+
+namespace posix
+{
+	class control_server::connection : public boost::enable_shared_from_this<control_server::connection>
+	{
+		public:
+
+			typedef boost::asio::local::stream_protocol::socket socket_type;
+
+			connection(boost::asio::io_service& io_service, boost::asio::io_service::strand& strand, boost::shared_ptr<const command_map> commands) :
+				m_strand(strand),
+				m_socket(io_service),
+				m_timer(io_service),
+				m_commands(commands),
+				m_request(MAX_REQUEST_SIZE),
+				m_response()
+			{
+			}
+
+			socket_type& socket()
+			{
+				return m_socket;
+			}
+
+			void start()
+			{
+				if (!is_authorized(m_socket.native_handle()))
+				{
+					return;
+				}
+
+				m_timer.expires_from_now(boost::posix_time::seconds(REQUEST_TIMEOUT));
+				m_timer.async_wait(m_strand.wrap(boost::bind(&connection::handle_timeout, shared_from_this(), boost::asio::placeholders::error)));
+
+				boost::asio::async_read_until(m_socket, m_request, '\n', m_strand.wrap(boost::bind(&connection::handle_read, shared_from_this(), boost::asio::placeholders::error)));
+			}
+
+		private:
+
+			void handle_timeout(const boost::system::error_code& ec)
+			{
+				if (ec != boost::asio::error::operation_aborted)
+				{
+					boost::system::error_code close_ec;
+					m_socket.close(close_ec);
+				}
+			}
+
+			void handle_read(const boost::system::error_code& ec)
+			{
+				boost::system::error_code cancel_ec;
+				m_timer.cancel(cancel_ec);
+
+				if (ec)
+				{
+					return;
+				}
+
+				std::istream is(&m_request);
+				std::string line;
+				std::getline(is, line);
+
+				execute(split_arguments(line));
+			}
+
+			void handle_completion(bool success, const std::string& output)
+			{
+				m_response = success ? "OK\n" + output : "ERROR: " + output + "\n";
+
+				boost::asio::async_write(m_socket, boost::asio::buffer(m_response), m_strand.wrap(boost::bind(&connection::handle_write, shared_from_this(), boost::asio::placeholders::error)));
+			}
+
+			void handle_write(const boost::system::error_code&)
+			{
+				boost::system::error_code ec;
+				m_socket.shutdown(socket_type::shutdown_both, ec);
+			}
+
+			void execute(const arguments_type& arguments)
+			{
+				if (arguments.empty())
+				{
+					handle_completion(false, "No command");
+
+					return;
+				}
+
+				const command_map::const_iterator command = m_commands->find(arguments.front());
+
+				if (command == m_commands->end())
+				{
+					handle_completion(false, "Unknown command: " + arguments.front());
+
+					return;
+				}
+
+				record_flight_event(FE_CONTROL_COMMAND, 0, 0, command->first);
+
+				try
+				{
+					command->second.handler(arguments_type(arguments.begin() + 1, arguments.end()), m_strand.wrap(boost::bind(&connection::handle_completion, shared_from_this(), _1, _2)));
+				}
+				catch (std::exception& ex)
+				{
+					handle_completion(false, ex.what());
+				}
+			}
+
+			boost::asio::io_service::strand& m_strand;
+			socket_type m_socket;
+			boost::asio::deadline_timer m_timer;
+			boost::shared_ptr<const command_map> m_commands;
+			boost::asio::streambuf m_request;
+			std::string m_response;
+	};
+
+	control_server::control_server(boost::asio::io_service& io_service, boost::asio::io_service::strand& strand, const fs::path& path) :
+		m_io_service(io_service),
+		m_strand(strand),
+		m_acceptor(io_service),
+		m_path(path),
+		m_commands(boost::make_shared<command_map>())
+	{
+		// Only a leftover socket may be replaced.
+		if (fs::status(m_path).type() == fs::socket_file)
+		{
+			fs::remove(m_path);
+		}
+
+		const boost::asio::local::stream_protocol::endpoint endpoint(m_path.string());
+
+		m_acceptor.open(endpoint.protocol());
+		m_acceptor.bind(endpoint);
+		fs::permissions(m_path, fs::owner_read | fs::owner_write);
+		m_acceptor.listen();
+
+		add_command("help", "", "List the commands.", boost::bind(&control_server::help, this, _1, _2));
+
+		accept();
+	}
+
+	control_server::~control_server()
+	{
+		boost::system::error_code ec;
+
+		m_acceptor.close(ec);
+		fs::remove(m_path, ec);
+	}
+
+	void control_server::add_command(const std::string& name, const std::string& usage, const std::string& description, handler_type handler)
+	{
+		add_async_command(name, usage, description, boost::bind(&execute_handler, handler, _1, _2));
+	}
+
+	void control_server::add_async_command(const std::string& name, const std::string& usage, const std::string& description, async_handler_type handler)
+	{
+		command_type& command = (*m_commands)[name];
+
+		command.usage = usage;
+		command.description = description;
+		command.handler = handler;
+	}
+
+	void control_server::close()
+	{
+		m_strand.post(boost::bind(&control_server::do_close, this));
+	}
+
+	void control_server::accept()
+	{
+		const boost::shared_ptr<connection> new_connection = boost::make_shared<connection>(boost::ref(m_io_service), boost::ref(m_strand), m_commands);
+
+		m_acceptor.async_accept(new_connection->socket(), m_strand.wrap(boost::bind(&control_server::handle_accept, this, new_connection, boost::asio::placeholders::error)));
+	}
+
+	void control_server::handle_accept(boost::shared_ptr<connection> new_connection, const boost::system::error_code& ec)
+	{
+		if (ec == boost::asio::error::operation_aborted)
+		{
+			return;
+		}
+
+		if (!ec)
+		{
+			new_connection->start();
+		}
+
+		accept();
+	}
+
+	void control_server::do_close()
+	{
+		boost::system::error_code ec;
+
+		m_acceptor.close(ec);
+	}
+
+	void control_server::help(const arguments_type&, std::ostream& os) const
+	{
+		for (command_map::const_iterator command = m_commands->begin(); command != m_commands->end(); ++command)
+		{
+			os << command->first;
+
+			if (!command->second.usage.empty())
+			{
+				os << " " << command->second.usage;
+			}
+
+			os << "\n\t" << command->second.description << "\n";
+		}
+	}
+}
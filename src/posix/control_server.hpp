@@ -0,0 +1,181 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file control_server.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A control socket server.
+ */
+
+#ifndef POSIX_CONTROL_SERVER_HPP
+#define POSIX_CONTROL_SERVER_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <boost/asio.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace posix
+{
+	/**
+	 * \brief Serve commands on a Unix socket.
+	 *
+	 * A client sends a single line: a command name followed by its
+	 * space-separated arguments. The server answers "OK" or "ERROR: " followed
+	 * by a message on the first line, then the command output, and closes the
+	 * connection.
+	 *
+	 * Commands run on the I/O service they are served from, except the
+	 * asynchronous ones: a slow command delays the handlers of that I/O
+	 * service.
+	 *
+	 * Only the user the daemon runs as, and root, may connect.
+	 */
+	class control_server : private boost::noncopyable
+	{
+		public:
+
+			/**
+			 * \brief The arguments type.
+			 */
+			typedef std::vector<std::string> arguments_type;
+
+			/**
+			 * \brief The command handler type.
+			 *
+			 * A handler writes its output to the stream. It reports errors by throwing a std::exception.
+			 */
+			typedef boost::function<void (const arguments_type&, std::ostream&)> handler_type;
+
+			/**
+			 * \brief The completion handler type.
+			 *
+			 * Takes whether the command succeeded and its output, or its error message if it failed.
+			 */
+			typedef boost::function<void (bool, const std::string&)> completion_handler_type;
+
+			/**
+			 * \brief The asynchronous command handler type.
+			 *
+			 * A handler calls the completion handler exactly once, from any thread. It may also report errors by throwing a std::exception instead.
+			 */
+			typedef boost::function<void (const arguments_type&, completion_handler_type)> async_handler_type;
+
+			/**
+			 * \brief Create a control server and start serving.
+			 * \param io_service The I/O service to serve from.
+			 * \param strand A strand of io_service. Commands run one at a time on it.
+			 * \param path The socket path. A stale socket file is replaced.
+			 *
+			 * On error, a boost::system::system_error is thrown.
+			 */
+			control_server(boost::asio::io_service& io_service, boost::asio::io_service::strand& strand, const boost::filesystem::path& path);
+
+			/**
+			 * \brief Stop serving and remove the socket file.
+			 *
+			 * Must not be called while the I/O service runs.
+			 */
+			~control_server();
+
+			/**
+			 * \brief Add a command.
+			 * \param name The command name.
+			 * \param usage The command arguments, for the help.
+			 * \param description The command description, for the help.
+			 * \param handler The command handler.
+			 *
+			 * Commands must be added before the I/O service runs.
+			 */
+			void add_command(const std::string& name, const std::string& usage, const std::string& description, handler_type handler);
+
+			/**
+			 * \brief Add an asynchronous command.
+			 * \param name The command name.
+			 * \param usage The command arguments, for the help.
+			 * \param description The command description, for the help.
+			 * \param handler The command handler.
+			 *
+			 * For commands that must not run on the I/O service. Other commands keep running while the handler works.
+			 *
+			 * Commands must be added before the I/O service runs.
+			 */
+			void add_async_command(const std::string& name, const std::string& usage, const std::string& description, async_handler_type handler);
+
+			/**
+			 * \brief Close the socket.
+			 *
+			 * Once closed, the server does not keep the I/O service busy. Thread-safe.
+			 */
+			void close();
+
+		private:
+
+			struct command_type
+			{
+				std::string usage;
+				std::string description;
+				async_handler_type handler;
+			};
+
+			typedef std::map<std::string, command_type> command_map;
+
+			class connection;
+
+			void accept();
+			void handle_accept(boost::shared_ptr<connection> new_connection, const boost::system::error_code& ec);
+			void do_close();
+			void help(const arguments_type& arguments, std::ostream& os) const;
+
+			boost::asio::io_service& m_io_service;
+			boost::asio::io_service::strand& m_strand;
+			boost::asio::local::stream_protocol::acceptor m_acceptor;
+			boost::filesystem::path m_path;
+			boost::shared_ptr<command_map> m_commands;
+	};
+}
+
+#endif /* POSIX_CONTROL_SERVER_HPP */
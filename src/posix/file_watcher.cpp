@@ -0,0 +1,313 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file file_watcher.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A file watcher.
+ */
+
+#include "file_watcher.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/system/system_error.hpp>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+	// The time to wait for a directory to be quiet before reporting its changes, in milliseconds.
+	const int SETTLE_DELAY = 200;
+
+	// The time between two scans when inotify is not available, in milliseconds.
+	const int SCAN_PERIOD = 5000;
+
+	void throw_system_error(const std::string& what)
+	{
+		throw boost::system::system_error(errno, boost::system::system_category(), what);
+	}
+}
+
+namespace posix
+{
+	file_watcher::file_watcher(const std::vector<fs::path>& directories, handler_type handler) :
+		m_handler(handler),
+		m_inotify_fd(-1)
+	{
+		const std::set<fs::path> unique_directories(directories.begin(), directories.end());
+		m_directories.assign(unique_directories.begin(), unique_directories.end());
+
+		if (::pipe(m_stop_pipe) < 0)
+		{
+			throw_system_error("pipe()");
+		}
+
+		::fcntl(m_stop_pipe[0], F_SETFD, FD_CLOEXEC);
+		::fcntl(m_stop_pipe[1], F_SETFD, FD_CLOEXEC);
+
+		try
+		{
+#ifdef __linux__
+			m_inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+			if (m_inotify_fd < 0)
+			{
+				throw_system_error("inotify_init1()");
+			}
+
+			for (std::vector<fs::path>::const_iterator directory = m_directories.begin(); directory != m_directories.end(); ++directory)
+			{
+				const int wd = ::inotify_add_watch(m_inotify_fd, directory->c_str(), IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+
+				if (wd < 0)
+				{
+					throw_system_error("inotify_add_watch(" + directory->string() + ")");
+				}
+
+				m_watches[wd] = *directory;
+			}
+#else
+			m_modification_times = get_modification_times();
+#endif
+
+			boost::thread(boost::bind(&file_watcher::run, this)).swap(m_thread);
+		}
+		catch (...)
+		{
+			close_descriptors();
+
+			throw;
+		}
+	}
+
+	file_watcher::~file_watcher()
+	{
+		const char stop = 0;
+
+		if (::write(m_stop_pipe[1], &stop, sizeof(stop))) {}
+
+		m_thread.join();
+
+		close_descriptors();
+	}
+
+	void file_watcher::close_descriptors()
+	{
+		if (m_inotify_fd >= 0)
+		{
+			::close(m_inotify_fd);
+		}
+
+		::close(m_stop_pipe[0]);
+		::close(m_stop_pipe[1]);
+	}
+
+	void file_watcher::run()
+	{
+		std::set<fs::path> changes;
+
+		for (;;)
+		{
+			pollfd fds[2];
+			fds[0].fd = m_stop_pipe[0];
+			fds[0].events = POLLIN;
+			fds[0].revents = 0;
+			fds[1].fd = m_inotify_fd;
+			fds[1].events = POLLIN;
+			fds[1].revents = 0;
+
+#ifdef __linux__
+			const int result = ::poll(fds, 2, changes.empty() ? -1 : SETTLE_DELAY);
+#else
+			const int result = ::poll(fds, 1, SCAN_PERIOD);
+#endif
+
+			if (result < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				return;
+			}
+
+			if (fds[0].revents != 0)
+			{
+				return;
+			}
+
+			if (result > 0)
+			{
+				read_events(changes);
+
+				continue;
+			}
+
+#ifndef __linux__
+			scan(changes);
+#endif
+
+			if (!changes.empty())
+			{
+				try
+				{
+					m_handler(changes);
+				}
+				catch (...)
+				{
+				}
+
+				changes.clear();
+			}
+		}
+	}
+
+	void file_watcher::read_events(std::set<fs::path>& changes)
+	{
+#ifdef __linux__
+		// Suitably aligned for inotify_event.
+		long buffer[1024];
+
+		for (;;)
+		{
+			const ssize_t length = ::read(m_inotify_fd, buffer, sizeof(buffer));
+
+			if (length <= 0)
+			{
+				break;
+			}
+
+			const char* const begin = reinterpret_cast<const char*>(buffer);
+
+			for (const char* ptr = begin; ptr < begin + length;)
+			{
+				const inotify_event* const event = reinterpret_cast<const inotify_event*>(ptr);
+
+				if (event->mask & IN_Q_OVERFLOW)
+				{
+					// Some events were lost.
+					add_all_files(changes);
+				}
+				else if (event->len > 0)
+				{
+					const std::map<int, fs::path>::const_iterator watch = m_watches.find(event->wd);
+
+					if (watch != m_watches.end())
+					{
+						changes.insert(watch->second / event->name);
+					}
+				}
+
+				ptr += sizeof(inotify_event) + event->len;
+			}
+		}
+#else
+		(void)changes;
+#endif
+	}
+
+	void file_watcher::scan(std::set<fs::path>& changes)
+	{
+		const modification_time_map modification_times = get_modification_times();
+
+		for (modification_time_map::const_iterator item = modification_times.begin(); item != modification_times.end(); ++item)
+		{
+			const modification_time_map::const_iterator previous_item = m_modification_times.find(item->first);
+
+			if ((previous_item == m_modification_times.end()) || (previous_item->second != item->second))
+			{
+				changes.insert(item->first);
+			}
+		}
+
+		for (modification_time_map::const_iterator previous_item = m_modification_times.begin(); previous_item != m_modification_times.end(); ++previous_item)
+		{
+			if (modification_times.find(previous_item->first) == modification_times.end())
+			{
+				changes.insert(previous_item->first);
+			}
+		}
+
+		m_modification_times = modification_times;
+	}
+
+	void file_watcher::add_all_files(std::set<fs::path>& changes) const
+	{
+		const modification_time_map modification_times = get_modification_times();
+
+		for (modification_time_map::const_iterator item = modification_times.begin(); item != modification_times.end(); ++item)
+		{
+			changes.insert(item->first);
+		}
+	}
+
+	file_watcher::modification_time_map file_watcher::get_modification_times() const
+	{
+		modification_time_map result;
+
+		for (std::vector<fs::path>::const_iterator directory = m_directories.begin(); directory != m_directories.end(); ++directory)
+		{
+			boost::system::error_code ec;
+
+			for (fs::directory_iterator entry(*directory, ec), end; !ec && (entry != end); entry.increment(ec))
+			{
+				boost::system::error_code time_ec;
+				const std::time_t modification_time = fs::last_write_time(entry->path(), time_ec);
+
+				if (!time_ec && fs::is_regular_file(entry->path(), time_ec))
+				{
+					result[entry->path()] = modification_time;
+				}
+			}
+		}
+
+		return result;
+	}
+}
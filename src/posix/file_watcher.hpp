@@ -0,0 +1,125 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file file_watcher.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief A file watcher.
+ */
+
+#ifndef POSIX_FILE_WATCHER_HPP
+#define POSIX_FILE_WATCHER_HPP
+
+#include <ctime>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace posix
+{
+	/**
+	 * \brief Watch directories for changed files.
+	 *
+	 * A file is reported when it is written, created by a rename or removed.
+	 * Files are usually replaced in several steps: the changes are only
+	 * reported once a directory has been quiet for a short while, each file
+	 * once.
+	 *
+	 * On Linux, the directories are watched with inotify. Elsewhere, the
+	 * modification time of their files is polled every few seconds.
+	 *
+	 * The handler is called from the watcher thread. Exceptions it throws are
+	 * ignored.
+	 */
+	class file_watcher
+	{
+		public:
+
+			/**
+			 * \brief The handler type.
+			 */
+			typedef boost::function<void (const std::set<boost::filesystem::path>&)> handler_type;
+
+			/**
+			 * \brief Start watching directories.
+			 * \param directories The directories to watch. Duplicates are ignored.
+			 * \param handler The handler to call with the changed files.
+			 *
+			 * On error, a boost::system::system_error is thrown.
+			 */
+			file_watcher(const std::vector<boost::filesystem::path>& directories, handler_type handler);
+
+			/**
+			 * \brief Stop watching.
+			 *
+			 * Waits for the handler to return, if it is running.
+			 */
+			~file_watcher();
+
+		private:
+
+			typedef std::map<boost::filesystem::path, std::time_t> modification_time_map;
+
+			file_watcher(const file_watcher&);
+			file_watcher& operator=(const file_watcher&);
+
+			void close_descriptors();
+			void run();
+			void read_events(std::set<boost::filesystem::path>& changes);
+			void scan(std::set<boost::filesystem::path>& changes);
+			void add_all_files(std::set<boost::filesystem::path>& changes) const;
+			modification_time_map get_modification_times() const;
+
+			std::vector<boost::filesystem::path> m_directories;
+			handler_type m_handler;
+			int m_inotify_fd;
+			int m_stop_pipe[2];
+			// By watch descriptor.
+			std::map<int, boost::filesystem::path> m_watches;
+			modification_time_map m_modification_times;
+			boost::thread m_thread;
+	};
+}
+
+#endif /* POSIX_FILE_WATCHER_HPP */
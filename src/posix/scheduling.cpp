@@ -0,0 +1,200 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file scheduling.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief POSIX related scheduling functions.
+ */
+
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
+
+#include "scheduling.hpp"
+
+#include <stdexcept>
+
+#include <boost/system/system_error.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// From <numaif.h>, which is only available with libnuma.
+#define FREELAN_MPOL_PREFERRED 1
+#endif
+
+namespace posix
+{
+	bool set_current_thread_cpu(unsigned int cpu)
+	{
+#ifdef __linux__
+		cpu_set_t cpu_set;
+
+		CPU_ZERO(&cpu_set);
+		CPU_SET(cpu, &cpu_set);
+
+		const int result = ::pthread_setaffinity_np(::pthread_self(), sizeof(cpu_set), &cpu_set);
+
+		if (result != 0)
+		{
+			throw boost::system::system_error(result, boost::system::system_category(), "pthread_setaffinity_np()");
+		}
+
+		return true;
+#else
+		(void)cpu;
+
+		return false;
+#endif
+	}
+
+	bool set_current_thread_cpus(const std::vector<unsigned int>& cpus)
+	{
+#ifdef __linux__
+		cpu_set_t cpu_set;
+
+		CPU_ZERO(&cpu_set);
+
+		for (std::vector<unsigned int>::const_iterator cpu = cpus.begin(); cpu != cpus.end(); ++cpu)
+		{
+			CPU_SET(*cpu, &cpu_set);
+		}
+
+		const int result = ::pthread_setaffinity_np(::pthread_self(), sizeof(cpu_set), &cpu_set);
+
+		if (result != 0)
+		{
+			throw boost::system::system_error(result, boost::system::system_category(), "pthread_setaffinity_np()");
+		}
+
+		return true;
+#else
+		(void)cpus;
+
+		return false;
+#endif
+	}
+
+	std::vector<unsigned int> get_numa_node_cpus(unsigned int node)
+	{
+		const boost::filesystem::path path = "/sys/devices/system/node/node" + boost::lexical_cast<std::string>(node) + "/cpulist";
+
+		boost::filesystem::ifstream ifs(path);
+
+		cpu_list cpus;
+
+		if (!ifs || !(ifs >> cpus) || cpus.empty())
+		{
+			throw std::runtime_error("Unable to get the CPUs of NUMA node " + boost::lexical_cast<std::string>(node) + " from " + path.string());
+		}
+
+		return cpus.values();
+	}
+
+	bool set_numa_memory_policy(unsigned int node)
+	{
+#ifdef __linux__
+		const unsigned int bits_per_mask = sizeof(unsigned long) * 8;
+		std::vector<unsigned long> node_mask(node / bits_per_mask + 1, 0);
+
+		node_mask[node / bits_per_mask] |= (1UL << (node % bits_per_mask));
+
+		if (::syscall(SYS_set_mempolicy, FREELAN_MPOL_PREFERRED, &node_mask[0], node_mask.size() * bits_per_mask + 1) != 0)
+		{
+			throw boost::system::system_error(errno, boost::system::system_category(), "set_mempolicy()");
+		}
+
+		return true;
+#else
+		(void)node;
+
+		return false;
+#endif
+	}
+
+	void set_current_thread_scheduling_policy(runtime_configuration::scheduling_policy_type policy, int priority)
+	{
+		int native_policy = SCHED_OTHER;
+
+		switch (policy)
+		{
+			case runtime_configuration::SP_OTHER:
+				native_policy = SCHED_OTHER;
+				priority = 0;
+				break;
+			case runtime_configuration::SP_FIFO:
+				native_policy = SCHED_FIFO;
+				break;
+			case runtime_configuration::SP_RR:
+				native_policy = SCHED_RR;
+				break;
+		}
+
+		sched_param param = sched_param();
+		param.sched_priority = priority;
+
+		const int result = ::pthread_setschedparam(::pthread_self(), native_policy, &param);
+
+		if (result != 0)
+		{
+			throw boost::system::system_error(result, boost::system::system_category(), "pthread_setschedparam()");
+		}
+	}
+
+	void lock_memory()
+	{
+		if (::mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+		{
+			throw boost::system::system_error(errno, boost::system::system_category(), "mlockall()");
+		}
+	}
+}
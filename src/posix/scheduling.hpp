@@ -0,0 +1,113 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file scheduling.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief POSIX related scheduling functions.
+ */
+
+#ifndef POSIX_SCHEDULING_HPP
+#define POSIX_SCHEDULING_HPP
+
+#include <vector>
+
+#include "../runtime_configuration.hpp"
+
+namespace posix
+{
+	/**
+	 * \brief Bind the calling thread to the specified CPU.
+	 * \param cpu The CPU index.
+	 * \return true on success, false if the platform does not support CPU affinity.
+	 *
+	 * On error, a boost::system::system_error is thrown.
+	 */
+	bool set_current_thread_cpu(unsigned int cpu);
+
+	/**
+	 * \brief Bind the calling thread to the specified CPUs.
+	 * \param cpus The CPU indexes.
+	 * \return true on success, false if the platform does not support CPU affinity.
+	 *
+	 * Threads created afterwards by the calling thread inherit its affinity.
+	 *
+	 * On error, a boost::system::system_error is thrown.
+	 */
+	bool set_current_thread_cpus(const std::vector<unsigned int>& cpus);
+
+	/**
+	 * \brief Get the CPUs of a NUMA node.
+	 * \param node The NUMA node.
+	 * \return The CPU indexes of the specified NUMA node.
+	 *
+	 * On error, a std::runtime_error is thrown.
+	 */
+	std::vector<unsigned int> get_numa_node_cpus(unsigned int node);
+
+	/**
+	 * \brief Make the memory allocations of the process prefer the specified NUMA node.
+	 * \param node The NUMA node.
+	 * \return true on success, false if the platform does not support NUMA policies.
+	 *
+	 * On error, a boost::system::system_error is thrown.
+	 */
+	bool set_numa_memory_policy(unsigned int node);
+
+	/**
+	 * \brief Set the scheduling policy of the calling thread.
+	 * \param policy The scheduling policy.
+	 * \param priority The scheduling priority. Only meaningful for real-time policies.
+	 *
+	 * Threads created afterwards by the calling thread inherit its scheduling policy.
+	 *
+	 * On error, a boost::system::system_error is thrown.
+	 */
+	void set_current_thread_scheduling_policy(runtime_configuration::scheduling_policy_type policy, int priority);
+
+	/**
+	 * \brief Lock all the current and future memory pages of the process in RAM.
+	 *
+	 * On error, a boost::system::system_error is thrown.
+	 */
+	void lock_memory();
+}
+
+#endif /* POSIX_SCHEDULING_HPP */
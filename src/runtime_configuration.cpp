@@ -0,0 +1,174 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file runtime_configuration.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief The runtime configuration.
+ */
+
+#include "runtime_configuration.hpp"
+
+#include <string>
+#include <cassert>
+#include <stdexcept>
+
+std::ostream& operator<<(std::ostream& os, const runtime_configuration::scheduling_policy_type& value)
+{
+	switch (value)
+	{
+		case runtime_configuration::SP_OTHER:
+			return os << "other";
+		case runtime_configuration::SP_FIFO:
+			return os << "fifo";
+		case runtime_configuration::SP_RR:
+			return os << "rr";
+	}
+
+	assert(false);
+	throw std::logic_error("Unsupported enumeration value");
+}
+
+std::istream& operator>>(std::istream& is, runtime_configuration::scheduling_policy_type& value)
+{
+	std::string str;
+
+	if (is >> str)
+	{
+		if (str == "other")
+		{
+			value = runtime_configuration::SP_OTHER;
+		}
+		else if (str == "fifo")
+		{
+			value = runtime_configuration::SP_FIFO;
+		}
+		else if (str == "rr")
+		{
+			value = runtime_configuration::SP_RR;
+		}
+		else
+		{
+			is.setstate(std::ios_base::failbit);
+		}
+	}
+
+	return is;
+}
+
+std::ostream& operator<<(std::ostream& os, const runtime_configuration::poll_mode_type& value)
+{
+	switch (value)
+	{
+		case runtime_configuration::PM_BLOCKING:
+			return os << "blocking";
+		case runtime_configuration::PM_BUSY:
+			return os << "busy";
+		case runtime_configuration::PM_ADAPTIVE:
+			return os << "adaptive";
+	}
+
+	assert(false);
+	throw std::logic_error("Unsupported enumeration value");
+}
+
+std::istream& operator>>(std::istream& is, runtime_configuration::poll_mode_type& value)
+{
+	std::string str;
+
+	if (is >> str)
+	{
+		if (str == "blocking")
+		{
+			value = runtime_configuration::PM_BLOCKING;
+		}
+		else if (str == "busy")
+		{
+			value = runtime_configuration::PM_BUSY;
+		}
+		else if (str == "adaptive")
+		{
+			value = runtime_configuration::PM_ADAPTIVE;
+		}
+		else
+		{
+			is.setstate(std::ios_base::failbit);
+		}
+	}
+
+	return is;
+}
+
+std::ostream& operator<<(std::ostream& os, const runtime_configuration::log_overflow_policy_type& value)
+{
+	switch (value)
+	{
+		case runtime_configuration::LOP_DROP:
+			return os << "drop";
+		case runtime_configuration::LOP_BLOCK:
+			return os << "block";
+	}
+
+	assert(false);
+	throw std::logic_error("Unsupported enumeration value");
+}
+
+std::istream& operator>>(std::istream& is, runtime_configuration::log_overflow_policy_type& value)
+{
+	std::string str;
+
+	if (is >> str)
+	{
+		if (str == "drop")
+		{
+			value = runtime_configuration::LOP_DROP;
+		}
+		else if (str == "block")
+		{
+			value = runtime_configuration::LOP_BLOCK;
+		}
+		else
+		{
+			is.setstate(std::ios_base::failbit);
+		}
+	}
+
+	return is;
+}
@@ -0,0 +1,256 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file runtime_configuration.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief The runtime configuration.
+ */
+
+#ifndef RUNTIME_CONFIGURATION_HPP
+#define RUNTIME_CONFIGURATION_HPP
+
+#include <iostream>
+#include <string>
+
+#include "configuration_types.hpp"
+
+/**
+ * \brief The runtime configuration.
+ *
+ * Unlike freelan::configuration, those settings are not used by the core but
+ * by the daemon itself, to decide how the core is run.
+ */
+struct runtime_configuration
+{
+	/**
+	 * \brief The scheduling policy type.
+	 */
+	enum scheduling_policy_type
+	{
+		SP_OTHER, /**< \brief The default time-sharing policy. */
+		SP_FIFO, /**< \brief The real-time first-in first-out policy. */
+		SP_RR /**< \brief The real-time round-robin policy. */
+	};
+
+	/**
+	 * \brief The event loop poll mode type.
+	 */
+	enum poll_mode_type
+	{
+		PM_BLOCKING, /**< \brief Always wait for events in the kernel. */
+		PM_BUSY, /**< \brief Never wait for events in the kernel. */
+		PM_ADAPTIVE /**< \brief Busy poll for a while after activity, then wait in the kernel. */
+	};
+
+	/**
+	 * \brief The log overflow policy type.
+	 */
+	enum log_overflow_policy_type
+	{
+		LOP_DROP, /**< \brief Drop and count the messages that do not fit in the log queue. */
+		LOP_BLOCK /**< \brief Wait for the log queue to have room. */
+	};
+
+	/**
+	 * \brief Create a default runtime configuration.
+	 */
+	runtime_configuration() :
+		shard_count(1),
+		cpu_affinity(),
+		numa_node(-1),
+		scheduling_policy(SP_OTHER),
+		scheduling_priority(0),
+		lock_memory(false),
+		poll_mode(PM_BLOCKING),
+		busy_poll_budget(50),
+		socket_busy_poll(0),
+		log_queue_size(0),
+		log_overflow_policy(LOP_BLOCK),
+		metrics_listen_on(),
+		latency_probe_interval(0),
+		flight_recorder_size(4096),
+		flight_recorder_file()
+	{
+	}
+
+	/**
+	 * \brief The number of independent cores to run.
+	 *
+	 * Each shard has its own core, I/O service and thread. Peers on different shards cannot reach each other.
+	 */
+	unsigned int shard_count;
+
+	/**
+	 * \brief The CPUs to run on.
+	 *
+	 * An empty list means no restriction.
+	 */
+	cpu_list cpu_affinity;
+
+	/**
+	 * \brief The NUMA node to allocate memory from.
+	 *
+	 * A negative value means no restriction.
+	 */
+	int numa_node;
+
+	/**
+	 * \brief The scheduling policy.
+	 */
+	scheduling_policy_type scheduling_policy;
+
+	/**
+	 * \brief The scheduling priority, for the real-time policies.
+	 */
+	int scheduling_priority;
+
+	/**
+	 * \brief Whether to lock all the process memory in RAM.
+	 */
+	bool lock_memory;
+
+	/**
+	 * \brief The event loop poll mode.
+	 */
+	poll_mode_type poll_mode;
+
+	/**
+	 * \brief The time to busy poll for after the last activity, in the adaptive poll mode.
+	 */
+	microsecond_duration busy_poll_budget;
+
+	/**
+	 * \brief The time the kernel may busy poll the device queues for on socket reads, in microseconds.
+	 *
+	 * 0 disables socket busy polling.
+	 */
+	unsigned int socket_busy_poll;
+
+	/**
+	 * \brief The number of log messages that can wait for the log writer thread.
+	 *
+	 * 0 means messages are written synchronously by the thread that emits them.
+	 */
+	unsigned int log_queue_size;
+
+	/**
+	 * \brief The log overflow policy.
+	 */
+	log_overflow_policy_type log_overflow_policy;
+
+	/**
+	 * \brief The address to serve the metrics on.
+	 *
+	 * Either host:port or unix:path. An empty value disables the metrics endpoint.
+	 */
+	std::string metrics_listen_on;
+
+	/**
+	 * \brief The time between two event loop latency measures.
+	 *
+	 * 0 disables the measures.
+	 */
+	millisecond_duration latency_probe_interval;
+
+	/**
+	 * \brief The number of events each thread keeps in the flight recorder.
+	 *
+	 * 0 disables the flight recorder.
+	 */
+	unsigned int flight_recorder_size;
+
+	/**
+	 * \brief The file to dump the flight recorder to.
+	 *
+	 * An empty value means a file named after the process id in the temporary directory.
+	 */
+	std::string flight_recorder_file;
+};
+
+/**
+ * \brief Write a scheduling policy to an output stream.
+ * \param os The output stream.
+ * \param value The scheduling policy.
+ * \return os.
+ */
+std::ostream& operator<<(std::ostream& os, const runtime_configuration::scheduling_policy_type& value);
+
+/**
+ * \brief Read a scheduling policy from an input stream.
+ * \param is The input stream.
+ * \param value The scheduling policy.
+ * \return is.
+ */
+std::istream& operator>>(std::istream& is, runtime_configuration::scheduling_policy_type& value);
+
+/**
+ * \brief Write a poll mode to an output stream.
+ * \param os The output stream.
+ * \param value The poll mode.
+ * \return os.
+ */
+std::ostream& operator<<(std::ostream& os, const runtime_configuration::poll_mode_type& value);
+
+/**
+ * \brief Read a poll mode from an input stream.
+ * \param is The input stream.
+ * \param value The poll mode.
+ * \return is.
+ */
+std::istream& operator>>(std::istream& is, runtime_configuration::poll_mode_type& value);
+
+/**
+ * \brief Write a log overflow policy to an output stream.
+ * \param os The output stream.
+ * \param value The log overflow policy.
+ * \return os.
+ */
+std::ostream& operator<<(std::ostream& os, const runtime_configuration::log_overflow_policy_type& value);
+
+/**
+ * \brief Read a log overflow policy from an input stream.
+ * \param is The input stream.
+ * \param value The log overflow policy.
+ * \return is.
+ */
+std::istream& operator>>(std::istream& is, runtime_configuration::log_overflow_policy_type& value);
+
+#endif /* RUNTIME_CONFIGURATION_HPP */
@@ -0,0 +1,209 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file script_executor.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An asynchronous script executor.
+ */
+
+#include "script_executor.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/system/system_error.hpp>
+
+#include "system.hpp"
+#include "tracing.hpp"
+#include "flight_recorder.hpp"
+
+#ifdef UNIX
+#include <sys/wait.h>
+#include <signal.h>
+#include <errno.h>
+#endif
+
+namespace fs = boost::filesystem;
+
+const int script_executor::no_exit_status;
+
+#ifdef UNIX
+script_executor::script_executor(boost::asio::io_service& io_service) :
+	m_io_service(io_service),
+	m_signal_set(io_service, SIGCHLD),
+	m_waiting(false)
+{
+}
+
+void script_executor::async_execute(const fs::path& script, const std::vector<std::string>& args, const boost::posix_time::time_duration& timeout, handler_type handler)
+{
+	// The child must be registered before the SIGCHLD handler gets a chance to look for it.
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	const pid_t pid = spawn(script, args);
+
+	child_type& child = m_children[pid];
+	child.handler = handler;
+	child.timed_out = false;
+
+	if (!timeout.is_pos_infinity())
+	{
+		child.timer.reset(new boost::asio::deadline_timer(m_io_service, timeout));
+		child.timer->async_wait(boost::bind(&script_executor::handle_timeout, this, pid, child.timer.get(), boost::asio::placeholders::error));
+	}
+
+	// We only wait for SIGCHLD while children are running, so that the I/O service can run out of work.
+	if (!m_waiting)
+	{
+		m_signal_set.async_wait(boost::bind(&script_executor::handle_signal, this, boost::asio::placeholders::error, _2));
+		m_waiting = true;
+	}
+}
+
+void script_executor::handle_signal(const boost::system::error_code& ec, int)
+{
+	if (ec == boost::asio::error::operation_aborted)
+	{
+		return;
+	}
+
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	m_waiting = false;
+
+	// Signals coalesce: a single SIGCHLD may stand for several terminated children.
+	for (child_map::iterator child = m_children.begin(); child != m_children.end();)
+	{
+		int status = 0;
+		const pid_t result = ::waitpid(child->first, &status, WNOHANG);
+
+		if ((result == child->first) || ((result < 0) && (errno != EINTR)))
+		{
+			boost::system::error_code result_ec;
+
+			if (result < 0)
+			{
+				result_ec = boost::system::error_code(errno, boost::system::system_category());
+			}
+			else if (child->second.timed_out)
+			{
+				result_ec = boost::asio::error::timed_out;
+			}
+
+			if (child->second.timer)
+			{
+				child->second.timer->cancel();
+			}
+
+			const int exit_status = result_ec ? no_exit_status : get_exit_status(status);
+
+			FREELAN_PROBE2(script__end, child->first, exit_status);
+
+			record_flight_event(FE_SCRIPT_END, static_cast<boost::uint32_t>(child->first), static_cast<boost::uint64_t>(static_cast<boost::int64_t>(exit_status)));
+
+			m_io_service.post(boost::bind(child->second.handler, result_ec, exit_status));
+
+			m_children.erase(child++);
+		}
+		else
+		{
+			++child;
+		}
+	}
+
+	if (!m_children.empty())
+	{
+		m_signal_set.async_wait(boost::bind(&script_executor::handle_signal, this, boost::asio::placeholders::error, _2));
+		m_waiting = true;
+	}
+}
+
+void script_executor::handle_timeout(pid_t pid, boost::asio::deadline_timer* timer, const boost::system::error_code& ec)
+{
+	if (ec == boost::asio::error::operation_aborted)
+	{
+		return;
+	}
+
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	const child_map::iterator child = m_children.find(pid);
+
+	// The pid may have been reused by another script since the timer was set.
+	if ((child != m_children.end()) && (child->second.timer.get() == timer))
+	{
+		child->second.timed_out = true;
+
+		::kill(pid, SIGKILL);
+	}
+}
+#else
+namespace
+{
+	void do_execute(boost::asio::io_service& io_service, const fs::path& script, const std::vector<std::string>& args, const boost::posix_time::time_duration& timeout, script_executor::handler_type handler, boost::shared_ptr<boost::asio::io_service::work>)
+	{
+		boost::system::error_code ec;
+		int exit_status = script_executor::no_exit_status;
+
+		try
+		{
+			exit_status = execute(script, args, timeout);
+		}
+		catch (boost::system::system_error& ex)
+		{
+			ec = ex.code();
+		}
+
+		io_service.post(boost::bind(handler, ec, exit_status));
+	}
+}
+
+script_executor::script_executor(boost::asio::io_service& io_service) :
+	m_io_service(io_service)
+{
+}
+
+void script_executor::async_execute(const fs::path& script, const std::vector<std::string>& args, const boost::posix_time::time_duration& timeout, handler_type handler)
+{
+	const boost::shared_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(m_io_service));
+
+	boost::thread(boost::bind(&do_execute, boost::ref(m_io_service), script, args, timeout, handler, work));
+}
+#endif
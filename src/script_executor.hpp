@@ -0,0 +1,135 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file script_executor.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief An asynchronous script executor.
+ */
+
+#ifndef SCRIPT_EXECUTOR_HPP
+#define SCRIPT_EXECUTOR_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <boost/asio.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+/**
+ * \brief Executes scripts without blocking the I/O service.
+ *
+ * On POSIX systems, children are reaped from a SIGCHLD handler running on the
+ * I/O service. Other platforms wait for the scripts on a dedicated thread.
+ *
+ * The pending executions keep the I/O service busy: run() only returns once
+ * every script has terminated.
+ */
+class script_executor : private boost::noncopyable
+{
+	public:
+
+		/**
+		 * \brief The completion handler type.
+		 *
+		 * The handler receives an error (boost::asio::error::timed_out if the script was killed) and the exit status of the script.
+		 * Whenever an error is set, the exit status is no_exit_status.
+		 */
+		typedef boost::function<void (const boost::system::error_code&, int)> handler_type;
+
+		/**
+		 * \brief The exit status given to the handler when the script did not exit by itself.
+		 *
+		 * Scripts cannot exit with that value: it cannot be mistaken for a real exit status.
+		 */
+		static const int no_exit_status = -1;
+
+		/**
+		 * \brief Create a new script executor.
+		 * \param io_service The I/O service to deliver the completions to.
+		 */
+		explicit script_executor(boost::asio::io_service& io_service);
+
+		/**
+		 * \brief Start a script.
+		 * \param script The script to execute.
+		 * \param args The parameters.
+		 * \param timeout The time after which the script gets killed. Use boost::posix_time::pos_infin to wait forever.
+		 * \param handler The handler to call, from the I/O service, when the script terminates.
+		 *
+		 * If the script cannot be started, an exception is thrown and handler is never called.
+		 *
+		 * This method is thread-safe.
+		 */
+		void async_execute(const boost::filesystem::path& script, const std::vector<std::string>& args, const boost::posix_time::time_duration& timeout, handler_type handler);
+
+	private:
+
+		boost::asio::io_service& m_io_service;
+
+#ifdef UNIX
+		typedef boost::shared_ptr<boost::asio::deadline_timer> timer_ptr;
+
+		struct child_type
+		{
+			handler_type handler;
+			timer_ptr timer;
+			bool timed_out;
+		};
+
+		typedef std::map<pid_t, child_type> child_map;
+
+		void handle_signal(const boost::system::error_code&, int);
+		void handle_timeout(pid_t, boost::asio::deadline_timer*, const boost::system::error_code&);
+
+		boost::asio::signal_set m_signal_set;
+		boost::mutex m_mutex;
+		child_map m_children;
+		bool m_waiting;
+#endif
+};
+
+#endif /* SCRIPT_EXECUTOR_HPP */
@@ -50,10 +50,15 @@
 #include <cstdlib>
 #include <cstdarg>
 #include <sstream>
+#include <algorithm>
 
 #include <cryptoplus/os.hpp>
 
 #include <boost/system/system_error.hpp>
+#include <boost/asio/error.hpp>
+
+#include "tracing.hpp"
+#include "flight_recorder.hpp"
 
 #ifdef WINDOWS
 #include <shlobj.h>
@@ -64,6 +69,28 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <cstring>
+#include <time.h>
+#include <signal.h>
+#include <spawn.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+
+// posix_spawn() avoids duplicating the page tables of the daemon, but we can only use it when it can close the inherited descriptors.
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ >= 34)))
+#define SPAWN_WITH_POSIX_SPAWN
+#elif defined(__APPLE__)
+#define SPAWN_WITH_POSIX_SPAWN
+#endif
+
+#ifdef UNIX
+extern char** environ;
 #endif
 
 #ifdef EXECUTE_ENABLE_STDOUT
@@ -76,13 +103,36 @@ namespace fs = boost::filesystem;
 
 namespace
 {
+	void throw_timeout_error()
+	{
+		throw boost::system::system_error(boost::asio::error::timed_out, "Script execution timed out");
+	}
+
 #ifdef WINDOWS
 	void throw_system_error(LONG error)
 	{
 		throw boost::system::system_error(error, boost::system::system_category());
 	}
 
-	DWORD create_process(const TCHAR* application, TCHAR* command_line, bool enable_stdout = ENABLE_STDOUT_DEFAULT)
+	void append_argument(TCHAR* command_line, size_t& offset, const TCHAR* arg)
+	{
+		command_line[offset++] = '"';
+
+		for (; *arg != '\0'; ++arg)
+		{
+			if (*arg == '"')
+			{
+				command_line[offset++] = '\\';
+			}
+
+			command_line[offset++] = *arg;
+		}
+
+		command_line[offset++] = '"';
+		command_line[offset++] = ' ';
+	}
+
+	DWORD create_process(const TCHAR* application, TCHAR* command_line, DWORD timeout = INFINITE, bool enable_stdout = ENABLE_STDOUT_DEFAULT)
 	{
 		DWORD exit_status;
 
@@ -126,7 +176,7 @@ namespace
 
 		::CloseHandle(pi.hThread);
 
-		DWORD wait_result = ::WaitForSingleObject(pi.hProcess, INFINITE);
+		DWORD wait_result = ::WaitForSingleObject(pi.hProcess, timeout);
 
 		try
 		{
@@ -147,6 +197,13 @@ namespace
 
 						break;
 					}
+				case WAIT_TIMEOUT:
+					{
+						::TerminateProcess(pi.hProcess, 255);
+						::WaitForSingleObject(pi.hProcess, INFINITE);
+
+						throw_timeout_error();
+					}
 				default:
 					{
 						throw_system_error(::GetLastError());
@@ -180,9 +237,223 @@ namespace
 		}
 	}
 
-	int execute_script(const char* file, char* const argv[], bool enable_stdout = ENABLE_STDOUT_DEFAULT)
+	// The parent may have blocked or caught some signals: the scripts must not inherit that. They start with an empty signal mask and with these signals back to their default action.
+	const int DEFAULT_SIGNALS[] = { SIGPIPE, SIGCHLD };
+
+	void record_script_start(const char* file, pid_t pid)
+	{
+		FREELAN_PROBE2(script__start, file, pid);
+
+		// Keep the end of the path: it names the script.
+		const std::size_t size = std::strlen(file);
+		const std::size_t kept = std::min(size, sizeof(flight_event().text));
+
+		record_flight_event(FE_SCRIPT_START, static_cast<boost::uint32_t>(pid), 0, file + size - kept, kept);
+	}
+
+	void record_script_end(pid_t pid, int exit_status)
+	{
+		FREELAN_PROBE2(script__end, pid, exit_status);
+
+		record_flight_event(FE_SCRIPT_END, static_cast<boost::uint32_t>(pid), static_cast<boost::uint64_t>(static_cast<boost::int64_t>(exit_status)));
+	}
+
+#ifdef SPAWN_WITH_POSIX_SPAWN
+	void close_in_child(posix_spawn_file_actions_t* file_actions, int fd)
+	{
+#ifdef __APPLE__
+		// POSIX_SPAWN_CLOEXEC_DEFAULT already closes it.
+		(void)file_actions;
+		(void)fd;
+#else
+		::posix_spawn_file_actions_addclose(file_actions, fd);
+#endif
+	}
+
+	pid_t spawn_script(const char* file, char* const argv[], int stdin_fd = -1, int stdout_fd = -1, int inherited_fd = -1, bool enable_stdout = ENABLE_STDOUT_DEFAULT)
+	{
+		posix_spawn_file_actions_t file_actions;
+		posix_spawnattr_t attributes;
+
+		int result = ::posix_spawn_file_actions_init(&file_actions);
+
+		if (result != 0)
+		{
+			throw_system_error(result);
+		}
+
+		result = ::posix_spawnattr_init(&attributes);
+
+		if (result != 0)
+		{
+			::posix_spawn_file_actions_destroy(&file_actions);
+
+			throw_system_error(result);
+		}
+
+		short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+
+#ifdef __APPLE__
+		// Every descriptor not explicitly inherited is closed.
+		flags |= POSIX_SPAWN_CLOEXEC_DEFAULT;
+#endif
+
+		if (stdin_fd >= 0)
+		{
+			::posix_spawn_file_actions_adddup2(&file_actions, stdin_fd, STDIN_FILENO);
+		}
+		else
+		{
+			close_in_child(&file_actions, STDIN_FILENO);
+		}
+
+		if (stdout_fd >= 0)
+		{
+			::posix_spawn_file_actions_adddup2(&file_actions, stdout_fd, STDOUT_FILENO);
+		}
+		else if (!enable_stdout)
+		{
+			close_in_child(&file_actions, STDOUT_FILENO);
+		}
+#ifdef __APPLE__
+		else
+		{
+			::posix_spawn_file_actions_addinherit_np(&file_actions, STDOUT_FILENO);
+		}
+#endif
+
+		close_in_child(&file_actions, STDERR_FILENO);
+
+		if (inherited_fd >= 0)
+		{
+			::posix_spawn_file_actions_adddup2(&file_actions, inherited_fd, STDERR_FILENO + 1);
+		}
+
+#ifndef __APPLE__
+		::posix_spawn_file_actions_addclosefrom_np(&file_actions, (inherited_fd >= 0) ? STDERR_FILENO + 2 : STDERR_FILENO + 1);
+#endif
+
+		sigset_t mask;
+		sigemptyset(&mask);
+		::posix_spawnattr_setsigmask(&attributes, &mask);
+
+		sigset_t default_signals;
+		sigemptyset(&default_signals);
+
+		for (std::size_t i = 0; i < sizeof(DEFAULT_SIGNALS) / sizeof(DEFAULT_SIGNALS[0]); ++i)
+		{
+			sigaddset(&default_signals, DEFAULT_SIGNALS[i]);
+		}
+
+		::posix_spawnattr_setsigdefault(&attributes, &default_signals);
+
+		::posix_spawnattr_setflags(&attributes, flags);
+
+		pid_t pid;
+
+		result = ::posix_spawn(&pid, file, &file_actions, &attributes, argv, environ);
+
+		::posix_spawnattr_destroy(&attributes);
+		::posix_spawn_file_actions_destroy(&file_actions);
+
+		if (result != 0)
+		{
+			throw_system_error(result);
+		}
+
+		return pid;
+	}
+#else
+#if defined(__linux__) && defined(SYS_getdents64)
+	// The layout the getdents64 system call fills, which the C library does not declare.
+	struct linux_dirent64
+	{
+		boost::uint64_t d_ino;
+		boost::int64_t d_off;
+		unsigned short d_reclen;
+		unsigned char d_type;
+		char d_name[1];
+	};
+
+	// Returns -1 for anything but a descriptor number, like "." and "..".
+	int parse_descriptor(const char* name)
+	{
+		int result = 0;
+
+		if (*name == '\0')
+		{
+			return -1;
+		}
+
+		for (; *name != '\0'; ++name)
+		{
+			if ((*name < '0') || (*name > '9'))
+			{
+				return -1;
+			}
+
+			result = result * 10 + (*name - '0');
+		}
+
+		return result;
+	}
+#endif
+
+	// Called in the child, after fork(): other threads may have held the allocator locks at that time, so only async-signal-safe calls are allowed.
+	void close_descriptors_from(int first)
+	{
+#if defined(__linux__) && defined(SYS_close_range)
+		if (::syscall(SYS_close_range, first, ~0U, 0) == 0)
+		{
+			return;
+		}
+#endif
+
+#if defined(__linux__) && defined(SYS_getdents64)
+		// Kernels older than 5.9: only walk the descriptors that are actually open. opendir() allocates: read the directory into a stack buffer instead.
+		const int dir_fd = ::open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+		if (dir_fd >= 0)
+		{
+			boost::uint64_t buffer[512];
+			long size;
+
+			// The offsets of /proc/self/fd are the descriptor numbers: closing them does not disturb the walk.
+			while ((size = ::syscall(SYS_getdents64, dir_fd, buffer, sizeof(buffer))) > 0)
+			{
+				for (long offset = 0; offset < size;)
+				{
+					const linux_dirent64* const entry = reinterpret_cast<const linux_dirent64*>(reinterpret_cast<const char*>(buffer) + offset);
+					const int fd = parse_descriptor(entry->d_name);
+
+					if ((fd >= first) && (fd != dir_fd))
+					{
+						::close(fd);
+					}
+
+					offset += entry->d_reclen;
+				}
+			}
+
+			::close(dir_fd);
+
+			if (size == 0)
+			{
+				return;
+			}
+		}
+#endif
+
+		const int fdlimit = ::sysconf(_SC_OPEN_MAX);
+
+		for (int n = first; n < fdlimit; ++n)
+		{
+			::close(n);
+		}
+	}
+
+	pid_t spawn_script(const char* file, char* const argv[], int stdin_fd = -1, int stdout_fd = -1, int inherited_fd = -1, bool enable_stdout = ENABLE_STDOUT_DEFAULT)
 	{
-		int exit_status = 255;
 		int fd[2];
 
 		if (::pipe(fd) < 0)
@@ -206,26 +477,68 @@ namespace
 			case 0:
 				{
 					// Child process
-					int fdlimit = ::sysconf(_SC_OPEN_MAX);
 
-					for (int n = 0; n < fdlimit; ++n)
+					// Get the error pipe out of the way of the descriptors we hand to the script.
+					int error_fd = ::fcntl(fd[1], F_DUPFD, STDERR_FILENO + 2);
+
+					if (stdin_fd >= 0)
 					{
-						if (n != fd[1])
-						{
-							if (!enable_stdout || (n != STDOUT_FILENO))
-							{
-								::close(n);
-							}
-						}
+						::dup2(stdin_fd, STDIN_FILENO);
+					}
+					else
+					{
+						::close(STDIN_FILENO);
+					}
+
+					if (stdout_fd >= 0)
+					{
+						::dup2(stdout_fd, STDOUT_FILENO);
+					}
+					else if (!enable_stdout)
+					{
+						::close(STDOUT_FILENO);
+					}
+
+					::close(STDERR_FILENO);
+
+					if (inherited_fd == STDERR_FILENO + 1)
+					{
+						// dup2() would be a no-op and keep the close-on-exec flag.
+						::fcntl(inherited_fd, F_SETFD, 0);
+					}
+					else if (inherited_fd >= 0)
+					{
+						::dup2(inherited_fd, STDERR_FILENO + 1);
+					}
+					else
+					{
+						::close(STDERR_FILENO + 1);
 					}
 
-					fcntl(fd[1], F_SETFD, FD_CLOEXEC);
+					if (error_fd != STDERR_FILENO + 2)
+					{
+						::dup2(error_fd, STDERR_FILENO + 2);
+						error_fd = STDERR_FILENO + 2;
+					}
+
+					close_descriptors_from(error_fd + 1);
+
+					fcntl(error_fd, F_SETFD, FD_CLOEXEC);
+
+					sigset_t mask;
+					sigemptyset(&mask);
+					sigprocmask(SIG_SETMASK, &mask, NULL);
+
+					for (std::size_t i = 0; i < sizeof(DEFAULT_SIGNALS) / sizeof(DEFAULT_SIGNALS[0]); ++i)
+					{
+						signal(DEFAULT_SIGNALS[i], SIG_DFL);
+					}
 
 					// Execute the file specified
 					::execv(file, argv);
 
 					// Something went wrong. Sending back errno to parent process then exiting.
-					if (::write(fd[1], &errno, sizeof(errno))) {}
+					if (::write(error_fd, &errno, sizeof(errno))) {}
 					_exit(EXIT_FAILURE);
 					break;
 				}
@@ -236,39 +549,115 @@ namespace
 					int errno_child = 0;
 					::close(fd[1]);
 
-					ssize_t readcnt = ::read(fd[0], &errno_child, sizeof(errno_child));
-					::close(fd[0]);
+					ssize_t readcnt;
 
-					if (readcnt < 0)
+					do
 					{
-						throw_system_error(errno);
+						readcnt = ::read(fd[0], &errno_child, sizeof(errno_child));
 					}
-					else if (readcnt == sizeof(errno_child))
-					{
-						throw_system_error(errno_child);
-					}
-					else
+					while ((readcnt < 0) && (errno == EINTR));
+
+					const int read_errno = errno;
+
+					::close(fd[0]);
+
+					if ((readcnt < 0) || (readcnt == sizeof(errno_child)))
 					{
-						int status;
+						// The child is either gone or about to be: reap it.
+						while ((::waitpid(pid, NULL, 0) < 0) && (errno == EINTR)) {}
 
-						if (::waitpid(pid, &status, 0) < 0)
-						{
-							throw_system_error(errno);
-						}
-						else
-						{
-							if (WIFEXITED(status))
-							{
-								exit_status = WEXITSTATUS(status);
-							}
-						}
+						throw_system_error((readcnt < 0) ? read_errno : errno_child);
 					}
 
 					break;
 				}
 		}
 
-		return exit_status;
+		return pid;
+	}
+#endif
+
+	int wait_script(pid_t pid, const boost::posix_time::time_duration& timeout)
+	{
+		int status;
+
+		if (timeout.is_pos_infinity())
+		{
+			while (::waitpid(pid, &status, 0) < 0)
+			{
+				if (errno != EINTR)
+				{
+					throw_system_error(errno);
+				}
+			}
+
+			const int exit_status = get_exit_status(status);
+
+			record_script_end(pid, exit_status);
+
+			return exit_status;
+		}
+
+		const boost::uint64_t deadline = get_monotonic_time() + static_cast<boost::uint64_t>(std::max(timeout.total_microseconds(), static_cast<boost::int64_t>(0))) * 1000;
+
+		// Poll with an exponential backoff: waking up often at first keeps the latency low for short scripts.
+		useconds_t delay = 500;
+
+		for (;;)
+		{
+			const pid_t result = ::waitpid(pid, &status, WNOHANG);
+
+			if (result == pid)
+			{
+				const int exit_status = get_exit_status(status);
+
+				record_script_end(pid, exit_status);
+
+				return exit_status;
+			}
+			else if ((result < 0) && (errno != EINTR))
+			{
+				throw_system_error(errno);
+			}
+
+			if (get_monotonic_time() >= deadline)
+			{
+				::kill(pid, SIGKILL);
+
+				while ((::waitpid(pid, &status, 0) < 0) && (errno == EINTR)) {}
+
+				record_script_end(pid, -1);
+
+				throw_timeout_error();
+			}
+
+			::usleep(delay);
+
+			delay = std::min<useconds_t>(delay * 2, 50000);
+		}
+	}
+
+	int execute_script(const char* file, char* const argv[], const boost::posix_time::time_duration& timeout = boost::posix_time::pos_infin)
+	{
+		const pid_t pid = spawn_script(file, argv);
+
+		record_script_start(file, pid);
+
+		return wait_script(pid, timeout);
+	}
+
+	std::vector<char*> make_argv(std::vector<std::string>& arguments)
+	{
+		std::vector<char*> argv;
+
+		for (std::vector<std::string>::iterator arg = arguments.begin(); arg != arguments.end(); ++arg)
+		{
+			argv.push_back(&(*arg)[0]);
+		}
+
+		argv.push_back(NULL);
+
+		return argv;
 	}
 
 #endif
@@ -360,6 +749,38 @@ fs::path get_temporary_directory()
 #endif
 }
 
+boost::uint64_t get_monotonic_time()
+{
+#ifdef WINDOWS
+	static LARGE_INTEGER frequency = {};
+
+	if (frequency.QuadPart == 0)
+	{
+		::QueryPerformanceFrequency(&frequency);
+	}
+
+	LARGE_INTEGER counter;
+	::QueryPerformanceCounter(&counter);
+
+	return static_cast<boost::uint64_t>(counter.QuadPart / frequency.QuadPart) * 1000000000ULL + static_cast<boost::uint64_t>(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / frequency.QuadPart;
+#elif defined(__APPLE__)
+	static mach_timebase_info_data_t timebase = {};
+
+	if (timebase.denom == 0)
+	{
+		::mach_timebase_info(&timebase);
+	}
+
+	return ::mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+	timespec ts;
+
+	::clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return static_cast<boost::uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<boost::uint64_t>(ts.tv_nsec);
+#endif
+}
+
 int execute(fs::path script, ...)
 {
 	int exit_status;
@@ -375,20 +796,7 @@ int execute(fs::path script, ...)
 
 		for (const TCHAR* arg = va_arg(vl, const TCHAR*); arg != NULL; arg = va_arg(vl, const TCHAR*))
 		{
-			command_line[offset++] = '"';
-
-			for (; *arg != '\0'; ++arg)
-			{
-				if (*arg == '"')
-				{
-					command_line[offset++] = '\\';
-				}
-
-				command_line[offset++] = *arg;
-			}
-
-			command_line[offset++] = '"';
-			command_line[offset++] = ' ';
+			append_argument(command_line, offset, arg);
 		}
 
 		exit_status = create_process(script.string<std::basic_string<TCHAR> >().c_str(), command_line);
@@ -429,3 +837,49 @@ int execute(fs::path script, ...)
 	return exit_status;
 }
 
+int execute(const fs::path& script, const std::vector<std::string>& args, const boost::posix_time::time_duration& timeout)
+{
+#ifdef WINDOWS
+	TCHAR command_line[32768] = {};
+	size_t offset = 0;
+
+	for (std::vector<std::string>::const_iterator arg = args.begin(); arg != args.end(); ++arg)
+	{
+		append_argument(command_line, offset, fs::path(*arg).string<std::basic_string<TCHAR> >().c_str());
+	}
+
+	const DWORD timeout_ms = timeout.is_pos_infinity() ? INFINITE : static_cast<DWORD>(std::max(timeout.total_milliseconds(), static_cast<boost::int64_t>(0)));
+
+	return create_process(script.string<std::basic_string<TCHAR> >().c_str(), command_line, timeout_ms);
+#elif defined(UNIX)
+	return wait_script(spawn(script, args), timeout);
+#endif
+}
+
+#ifdef UNIX
+pid_t spawn(const fs::path& script, const std::vector<std::string>& args, int stdin_fd, int stdout_fd, int inherited_fd)
+{
+	std::vector<std::string> arguments;
+	arguments.reserve(args.size() + 1);
+	arguments.push_back(script.string());
+	arguments.insert(arguments.end(), args.begin(), args.end());
+
+	std::vector<char*> argv = make_argv(arguments);
+
+	const pid_t pid = spawn_script(arguments.front().c_str(), &argv[0], stdin_fd, stdout_fd, inherited_fd);
+
+	record_script_start(arguments.front().c_str(), pid);
+
+	return pid;
+}
+
+int wait_process(pid_t pid, const boost::posix_time::time_duration& timeout)
+{
+	return wait_script(pid, timeout);
+}
+
+int get_exit_status(int status)
+{
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 255;
+}
+#endif
@@ -51,6 +51,12 @@
 #include <string>
 
 #include <boost/filesystem.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#ifdef UNIX
+#include <sys/types.h>
+#endif
 
 #ifdef WINDOWS
 /**
@@ -84,6 +90,14 @@ boost::filesystem::path get_application_directory();
  */
 boost::filesystem::path get_temporary_directory();
 
+/**
+ * \brief Get the current time from a monotonic clock.
+ * \return The current time, in nanoseconds, from an unspecified starting point.
+ *
+ * Only differences between two values are meaningful.
+ */
+boost::uint64_t get_monotonic_time();
+
 /**
  * \brief Execute a script and get the exit status.
  * \param script The script to execute.
@@ -92,4 +106,41 @@ boost::filesystem::path get_temporary_directory();
  */
 int execute(boost::filesystem::path script, ...);
 
+/**
+ * \brief Execute a script and get the exit status.
+ * \param script The script to execute.
+ * \param args The parameters.
+ * \param timeout The time after which the script gets killed. If the timeout expires, a boost::system::system_error is thrown.
+ * \return The exit status.
+ */
+int execute(const boost::filesystem::path& script, const std::vector<std::string>& args, const boost::posix_time::time_duration& timeout = boost::posix_time::pos_infin);
+
+#ifdef UNIX
+/**
+ * \brief Start a script without waiting for it to terminate.
+ * \param script The script to execute.
+ * \param args The parameters.
+ * \param stdin_fd A descriptor to use as the standard input of the script. If negative, the script has no standard input.
+ * \param stdout_fd A descriptor to use as the standard output of the script. If negative, the script has no standard output.
+ * \param inherited_fd A descriptor that the script inherits as descriptor 3. Ignored if negative.
+ * \return The process id of the script. The caller is responsible for reaping it, for instance with wait_process().
+ */
+pid_t spawn(const boost::filesystem::path& script, const std::vector<std::string>& args, int stdin_fd = -1, int stdout_fd = -1, int inherited_fd = -1);
+
+/**
+ * \brief Wait for a process to terminate.
+ * \param pid The process id.
+ * \param timeout The time after which the process gets killed. If the timeout expires, a boost::system::system_error is thrown.
+ * \return The exit status.
+ */
+int wait_process(pid_t pid, const boost::posix_time::time_duration& timeout = boost::posix_time::pos_infin);
+
+/**
+ * \brief Get the exit status of a terminated process.
+ * \param status The status, as returned by waitpid().
+ * \return The exit status, or 255 if the process did not exit normally.
+ */
+int get_exit_status(int status);
+#endif
+
 #endif /* SYSTEM_HPP */
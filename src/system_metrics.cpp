@@ -0,0 +1,128 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file system_metrics.cpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Metrics kept by the operating system.
+ */
+
+#include "system_metrics.hpp"
+
+#ifdef __linux__
+#include <fstream>
+
+#include <sys/socket.h>
+#include <linux/sock_diag.h>
+
+#ifndef SO_MEMINFO
+#define SO_MEMINFO 55
+#endif
+#endif
+
+namespace
+{
+#ifdef __linux__
+	bool read_statistic(const std::string& name, const char* statistic, double& value)
+	{
+		std::ifstream ifs(("/sys/class/net/" + name + "/statistics/" + statistic).c_str());
+
+		return static_cast<bool>(ifs >> value);
+	}
+
+	void add_statistic(metrics_sample_writer& writer, const std::string& name, const char* statistic, const std::string& metric, const std::string& help, const std::string& labels)
+	{
+		double value = 0;
+
+		if (read_statistic(name, statistic, value))
+		{
+			writer.add(metric, help, metrics_sample_writer::MT_COUNTER, labels, value);
+		}
+	}
+#endif
+}
+
+void collect_tap_adapter_metrics(const std::string& name, metrics_sample_writer& writer)
+{
+#ifdef __linux__
+	// The names come from the kernel: they never contain a slash.
+	if (name.empty() || (name.find('/') != std::string::npos))
+	{
+		return;
+	}
+
+	static const std::string frames_help = "Frames read from or written to the tap adapter.";
+	static const std::string bytes_help = "Bytes read from or written to the tap adapter.";
+	static const std::string drops_help = "Dropped packets or frames, by reason.";
+
+	add_statistic(writer, name, "tx_packets", "freelan_tap_frames_total", frames_help, make_metric_labels("direction", "read"));
+	add_statistic(writer, name, "rx_packets", "freelan_tap_frames_total", frames_help, make_metric_labels("direction", "written"));
+	add_statistic(writer, name, "tx_bytes", "freelan_tap_bytes_total", bytes_help, make_metric_labels("direction", "read"));
+	add_statistic(writer, name, "rx_bytes", "freelan_tap_bytes_total", bytes_help, make_metric_labels("direction", "written"));
+	// The kernel drops frames when the daemon does not read them fast enough.
+	add_statistic(writer, name, "tx_dropped", "freelan_drops_total", drops_help, make_metric_labels("reason", "tap_read_queue_full"));
+	add_statistic(writer, name, "rx_dropped", "freelan_drops_total", drops_help, make_metric_labels("reason", "tap_write"));
+#else
+	(void)name;
+	(void)writer;
+#endif
+}
+
+void collect_udp_socket_metrics(boost::asio::ip::udp::socket& socket, const std::string& labels, metrics_sample_writer& writer)
+{
+#ifdef __linux__
+	boost::uint32_t meminfo[SK_MEMINFO_VARS] = {};
+	socklen_t length = sizeof(meminfo);
+
+	// Fails once the socket is closed, or before Linux 4.6.
+	if (::getsockopt(socket.native_handle(), SOL_SOCKET, SO_MEMINFO, meminfo, &length) != 0)
+	{
+		return;
+	}
+
+	writer.add("freelan_udp_receive_buffer_drops_total", "Datagrams dropped by the kernel because the socket receive buffer was full.", metrics_sample_writer::MT_COUNTER, labels, meminfo[SK_MEMINFO_DROPS]);
+	writer.add("freelan_udp_receive_queue_bytes", "Memory used by the datagrams waiting to be read.", metrics_sample_writer::MT_GAUGE, labels, meminfo[SK_MEMINFO_RMEM_ALLOC]);
+	writer.add("freelan_udp_receive_buffer_bytes", "Size of the socket receive buffer.", metrics_sample_writer::MT_GAUGE, labels, meminfo[SK_MEMINFO_RCVBUF]);
+#else
+	(void)socket;
+	(void)labels;
+	(void)writer;
+#endif
+}
@@ -0,0 +1,77 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file system_metrics.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Metrics kept by the operating system.
+ */
+
+#ifndef SYSTEM_METRICS_HPP
+#define SYSTEM_METRICS_HPP
+
+#include <string>
+
+#include <boost/asio.hpp>
+
+#include "metrics.hpp"
+
+/**
+ * \brief Report the traffic statistics of the tap adapter.
+ * \param name The name of the tap adapter interface.
+ * \param writer The writer to report the statistics to.
+ *
+ * The kernel counts the frames the daemon reads as transmitted and the ones it writes as received.
+ *
+ * Only supported on Linux: elsewhere, nothing is reported.
+ */
+void collect_tap_adapter_metrics(const std::string& name, metrics_sample_writer& writer);
+
+/**
+ * \brief Report the statistics of an UDP socket.
+ * \param socket The socket.
+ * \param labels The labels to report the statistics with.
+ * \param writer The writer to report the statistics to.
+ *
+ * Only supported on Linux: elsewhere, nothing is reported.
+ */
+void collect_udp_socket_metrics(boost::asio::ip::udp::socket& socket, const std::string& labels, metrics_sample_writer& writer);
+
+#endif /* SYSTEM_METRICS_HPP */
@@ -48,15 +48,318 @@
 
 #ifndef WINDOWS
 #include <syslog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #endif
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <stdexcept>
+#include <new>
+
+#include <boost/bind.hpp>
+#include <boost/system/system_error.hpp>
+
+#include <openssl/bio.h>
+#include <openssl/pem.h>
+
 #include <freelan/logger_stream.hpp>
 
 #include "system.hpp"
+#include "atomic.hpp"
+#include "metrics.hpp"
 
 namespace fs = boost::filesystem;
 namespace fl = freelan;
 
+namespace
+{
+	enum script_type
+	{
+		ST_UP,
+		ST_DOWN,
+		ST_CERTIFICATE_VALIDATION
+	};
+
+	// Looked up once: a look-up takes the registry mutex and formats the labels.
+	struct script_metrics
+	{
+		explicit script_metrics(const std::string& name) :
+			successes(get_execution_counter(name, "success")),
+			failures(get_execution_counter(name, "failure")),
+			errors(get_execution_counter(name, "error")),
+			durations(get_metrics().histogram("freelan_script_duration_seconds", "Script execution durations.", make_metric_labels("script", name)))
+		{
+		}
+
+		static metric_counter& get_execution_counter(const std::string& name, const char* result)
+		{
+			return get_metrics().counter("freelan_script_executions_total", "Script executions, by script and result.", make_metric_labels("script", name, "result", result));
+		}
+
+		metric_counter& successes;
+		metric_counter& failures;
+		metric_counter& errors;
+		metric_histogram& durations;
+	};
+
+	void record_script_execution(script_type type, bool failed, int exit_status, boost::uint64_t start)
+	{
+		static script_metrics metrics[] = { script_metrics("up"), script_metrics("down"), script_metrics("certificate_validation") };
+
+		script_metrics& script = metrics[type];
+
+		(failed ? script.errors : ((exit_status == 0) ? script.successes : script.failures)).increment();
+		script.durations.observe(get_monotonic_time() - start);
+	}
+
+	void record_cache_lookup(bool hit)
+	{
+		static metric_counter& hits = get_metrics().counter("freelan_certificate_validation_cache_lookups_total", "Certificate validation cache look-ups, by result.", make_metric_labels("result", "hit"));
+		static metric_counter& misses = get_metrics().counter("freelan_certificate_validation_cache_lookups_total", "Certificate validation cache look-ups, by result.", make_metric_labels("result", "miss"));
+
+		(hit ? hits : misses).increment();
+	}
+
+	void handle_tap_adapter_script(const std::string& name, const fs::path& script, fl::core& core, boost::uint64_t start, const boost::system::error_code& ec, int exit_status)
+	{
+		record_script_execution((name == "Up") ? ST_UP : ST_DOWN, static_cast<bool>(ec), exit_status, start);
+
+		if (ec)
+		{
+			core.logger()(freelan::LL_WARNING) << name << " script (" << script << ") failed: " << ec.message();
+		}
+		else if (exit_status != 0)
+		{
+			core.logger()(freelan::LL_WARNING) << name << " script exited with a non-zero exit status: " << exit_status;
+		}
+	}
+
+	int execute_with_temporary_file(const fs::path& script, const boost::posix_time::time_duration& timeout, fl::logger& logger, fl::security_configuration::cert_type cert)
+	{
+		static volatile unsigned int counter = 0;
+
+		const fs::path filename = get_temporary_directory() / ("freelan_certificate_" + boost::lexical_cast<std::string>(atomic_fetch_add(counter, 1u)) + ".crt");
+
+		if (logger.level() <= freelan::LL_DEBUG)
+		{
+			logger(freelan::LL_DEBUG) << "Writing temporary certificate file at: " << filename;
+		}
+
+#ifdef WINDOWS
+#ifdef UNICODE
+		cert.write_certificate(cryptoplus::file::open(filename.string<std::basic_string<TCHAR> >(), L"w"));
+#else
+		cert.write_certificate(cryptoplus::file::open(filename.string<std::basic_string<TCHAR> >(), "w"));
+#endif
+#else
+		cert.write_certificate(cryptoplus::file::open(filename.string<std::basic_string<char> >(), "w"));
+#endif
+
+		int exit_status;
+
+		try
+		{
+			exit_status = execute(script, std::vector<std::string>(1, filename.string()), timeout);
+		}
+		catch (...)
+		{
+			fs::remove(filename);
+
+			throw;
+		}
+
+		fs::remove(filename);
+
+		return exit_status;
+	}
+
+#ifndef WINDOWS
+	std::string get_certificate_pem(fl::security_configuration::cert_type cert)
+	{
+		BIO* bio = BIO_new(BIO_s_mem());
+
+		if (!bio)
+		{
+			throw std::bad_alloc();
+		}
+
+		char* data = NULL;
+		long data_len = 0;
+
+		if (PEM_write_bio_X509(bio, cert.raw()))
+		{
+			data_len = BIO_get_mem_data(bio, &data);
+		}
+
+		const std::string result = (data_len > 0) ? std::string(data, data_len) : std::string();
+
+		BIO_free(bio);
+
+		if (result.empty())
+		{
+			throw std::runtime_error("Unable to encode the certificate");
+		}
+
+		return result;
+	}
+
+	void throw_system_error(const std::string& what)
+	{
+		throw boost::system::system_error(errno, boost::system::system_category(), what);
+	}
+
+	int execute_with_memfd(const fs::path& script, const boost::posix_time::time_duration& timeout, fl::security_configuration::cert_type cert)
+	{
+#if defined(__linux__) && defined(SYS_memfd_create)
+		const std::string pem = get_certificate_pem(cert);
+
+		// MFD_CLOEXEC: only the script gets it.
+		const int fd = static_cast<int>(::syscall(SYS_memfd_create, "freelan_certificate", 1U));
+
+		if (fd < 0)
+		{
+			throw_system_error("memfd_create()");
+		}
+
+		pid_t pid;
+
+		try
+		{
+			for (std::size_t offset = 0; offset < pem.size();)
+			{
+				const ssize_t cnt = ::write(fd, pem.data() + offset, pem.size() - offset);
+
+				if (cnt < 0)
+				{
+					if (errno != EINTR)
+					{
+						throw_system_error("Writing the certificate");
+					}
+				}
+				else
+				{
+					offset += cnt;
+				}
+			}
+
+			// The script inherits the file as its descriptor 3.
+			pid = spawn(script, std::vector<std::string>(1, "/proc/self/fd/3"), -1, -1, fd);
+		}
+		catch (...)
+		{
+			::close(fd);
+
+			throw;
+		}
+
+		::close(fd);
+
+		return wait_process(pid, timeout);
+#else
+		(void)script;
+		(void)timeout;
+		(void)cert;
+
+		throw std::runtime_error("memfd is not supported on this platform");
+#endif
+	}
+
+	int execute_with_stdin(const fs::path& script, const boost::posix_time::time_duration& timeout, fl::security_configuration::cert_type cert)
+	{
+		const std::string pem = get_certificate_pem(cert);
+
+		int fds[2];
+
+		if (::pipe(fds) != 0)
+		{
+			throw_system_error("pipe()");
+		}
+
+		::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+		::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+		::fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+		// The certificate is written before the script starts, so we never block nor get a SIGPIPE: it must fit in the pipe.
+		ssize_t cnt;
+
+		do
+		{
+			cnt = ::write(fds[1], pem.data(), pem.size());
+		}
+		while ((cnt < 0) && (errno == EINTR));
+
+		const int write_errno = errno;
+
+		::close(fds[1]);
+
+		if (cnt != static_cast<ssize_t>(pem.size()))
+		{
+			::close(fds[0]);
+
+			if (cnt < 0)
+			{
+				errno = write_errno;
+
+				throw_system_error("Writing the certificate");
+			}
+
+			throw std::runtime_error("The certificate is too large to be written on the standard input of the script");
+		}
+
+		pid_t pid;
+
+		try
+		{
+			pid = spawn(script, std::vector<std::string>(1, "/dev/stdin"), fds[0]);
+		}
+		catch (...)
+		{
+			::close(fds[0]);
+
+			throw;
+		}
+
+		::close(fds[0]);
+
+		return wait_process(pid, timeout);
+	}
+#endif
+
+	void async_execute_tap_adapter_script(const std::string& name, script_executor& executor, const fs::path& script, const boost::posix_time::time_duration& timeout, fl::core& core, const asiotap::tap_adapter& tap_adapter)
+	{
+		try
+		{
+			executor.async_execute(script, std::vector<std::string>(1, tap_adapter.name()), timeout, boost::bind(&handle_tap_adapter_script, name, script, boost::ref(core), get_monotonic_time(), _1, _2));
+		}
+		catch (std::exception& ex)
+		{
+			core.logger()(freelan::LL_WARNING) << "Unable to execute " << name << " script (" << script << "): " << ex.what();
+		}
+	}
+
+	const char* revocation_status_to_string(certificate_revocation_index::status_type status)
+	{
+		switch (status)
+		{
+			case certificate_revocation_index::RS_GOOD:
+				return "not revoked";
+			case certificate_revocation_index::RS_REVOKED:
+				return "revoked";
+			case certificate_revocation_index::RS_NO_CRL:
+				return "no certificate revocation list for its issuer";
+			case certificate_revocation_index::RS_CRL_EXPIRED:
+				return "the certificate revocation list for its issuer has expired";
+		}
+
+		assert(false);
+		throw std::logic_error("Unsupported enumeration value");
+	}
+}
+
 #ifndef WINDOWS
 int log_level_to_syslog_priority(freelan::log_level level)
 {
@@ -101,8 +404,11 @@ const char* log_level_to_string(freelan::log_level level)
 
 void execute_tap_adapter_up_script(const boost::filesystem::path& script, freelan::core& core, const asiotap::tap_adapter& tap_adapter)
 {
+	const boost::uint64_t start = get_monotonic_time();
 	int exit_status = execute(script, tap_adapter.name().c_str(), NULL);
 
+	record_script_execution(ST_UP, false, exit_status, start);
+
 	if (exit_status != 0)
 	{
 		core.logger()(freelan::LL_WARNING) << "Up script exited with a non-zero exit status: " << exit_status;
@@ -111,52 +417,210 @@ void execute_tap_adapter_up_script(const boost::filesystem::path& script, freela
 
 void execute_tap_adapter_down_script(const boost::filesystem::path& script, freelan::core& core, const asiotap::tap_adapter& tap_adapter)
 {
+	const boost::uint64_t start = get_monotonic_time();
 	int exit_status = execute(script, tap_adapter.name().c_str(), NULL);
 
+	record_script_execution(ST_DOWN, false, exit_status, start);
+
 	if (exit_status != 0)
 	{
 		core.logger()(freelan::LL_WARNING) << "Down script exited with a non-zero exit status: " << exit_status;
 	}
 }
 
-bool execute_certificate_validation_script(const fs::path& script, fl::core& core, fl::security_configuration::cert_type cert)
+void async_execute_tap_adapter_up_script(script_executor& executor, const fs::path& script, const boost::posix_time::time_duration& timeout, fl::core& core, const asiotap::tap_adapter& tap_adapter)
 {
-	static unsigned int counter = 0;
+	async_execute_tap_adapter_script("Up", executor, script, timeout, core, tap_adapter);
+}
+
+void async_execute_tap_adapter_down_script(script_executor& executor, const fs::path& script, const boost::posix_time::time_duration& timeout, fl::core& core, const asiotap::tap_adapter& tap_adapter)
+{
+	async_execute_tap_adapter_script("Down", executor, script, timeout, core, tap_adapter);
+}
+
+certificate_validation_result validate_certificate_with_script(const fs::path& script, script_input_type input, const boost::posix_time::time_duration& timeout, fl::logger& logger, fl::security_configuration::cert_type cert)
+{
+	const boost::uint64_t start = get_monotonic_time();
 
 	try
 	{
-		const fs::path filename = get_temporary_directory() / ("freelan_certificate_" + boost::lexical_cast<std::string>(counter++) + ".crt");
+		int exit_status;
+
+		switch (input)
+		{
+			case SI_FILE:
+				{
+					exit_status = execute_with_temporary_file(script, timeout, logger, cert);
+
+					break;
+				}
+#ifndef WINDOWS
+			case SI_MEMFD:
+				{
+					exit_status = execute_with_memfd(script, timeout, cert);
+
+					break;
+				}
+			case SI_STDIN:
+				{
+					exit_status = execute_with_stdin(script, timeout, cert);
+
+					break;
+				}
+#endif
+			default:
+				{
+					throw std::runtime_error("Unsupported certificate validation script input");
+				}
+		}
+
+		if (logger.level() <= freelan::LL_DEBUG)
+		{
+			logger(freelan::LL_DEBUG) << script << " terminated execution with exit status " << exit_status ;
+		}
+
+		record_script_execution(ST_CERTIFICATE_VALIDATION, false, exit_status, start);
+
+		return (exit_status == 0) ? CVR_ACCEPTED : CVR_REJECTED;
+	}
+	catch (std::exception& ex)
+	{
+		record_script_execution(ST_CERTIFICATE_VALIDATION, true, 0, start);
+
+		logger(freelan::LL_WARNING) << "Error while executing certificate validation script (" << script << "): " << ex.what() ;
+
+		return CVR_ERROR;
+	}
+}
+
+certificate_validation_result execute_certificate_validation_script(const fs::path& script, script_input_type input, const boost::posix_time::time_duration& timeout, fl::core& core, fl::security_configuration::cert_type cert)
+{
+	return validate_certificate_with_script(script, input, timeout, core.logger(), cert);
+}
+
+#ifndef WINDOWS
+certificate_validation_result execute_certificate_validation_helper(boost::shared_ptr<posix::certificate_validation_helper> helper, certificate_validation_function_type fallback, fl::core& core, fl::security_configuration::cert_type cert)
+{
+	try
+	{
+		const bool result = helper->validate(cert);
 
 		if (core.logger().level() <= freelan::LL_DEBUG)
 		{
-			core.logger()(freelan::LL_DEBUG) << "Writing temporary certificate file at: " << filename;
+			core.logger()(freelan::LL_DEBUG) << helper->path() << " " << (result ? "accepted" : "rejected") << " the certificate";
 		}
 
-#ifdef WINDOWS
-#ifdef UNICODE
-		cert.write_certificate(cryptoplus::file::open(filename.string<std::basic_string<TCHAR> >(), L"w"));
-#else
-		cert.write_certificate(cryptoplus::file::open(filename.string<std::basic_string<TCHAR> >(), "w"));
-#endif
-#else
-		cert.write_certificate(cryptoplus::file::open(filename.string<std::basic_string<char> >(), "w"));
+		return result ? CVR_ACCEPTED : CVR_REJECTED;
+	}
+	catch (std::exception& ex)
+	{
+		core.logger()(freelan::LL_WARNING) << "Error while using the certificate validation helper (" << helper->path() << "): " << ex.what();
+	}
+
+	if (fallback)
+	{
+		core.logger()(freelan::LL_WARNING) << "Falling back to the certificate validation script.";
+
+		return fallback(core, cert);
+	}
+
+	return CVR_ERROR;
+}
 #endif
 
-		const int exit_status = execute(script, filename.c_str(), NULL);
+certificate_validation_result execute_certificate_validation_plugin(boost::shared_ptr<certificate_validation_plugin> plugin, fl::core& core, fl::security_configuration::cert_type cert)
+{
+	try
+	{
+		const bool result = plugin->validate(cert);
 
 		if (core.logger().level() <= freelan::LL_DEBUG)
 		{
-			core.logger()(freelan::LL_DEBUG) << script << " terminated execution with exit status " << exit_status ;
+			core.logger()(freelan::LL_DEBUG) << plugin->path() << " " << (result ? "accepted" : "rejected") << " the certificate";
 		}
 
-		fs::remove(filename);
-
-		return (exit_status == 0);
+		return result ? CVR_ACCEPTED : CVR_REJECTED;
 	}
 	catch (std::exception& ex)
 	{
-		core.logger()(freelan::LL_WARNING) << "Error while executing certificate validation script (" << script << "): " << ex.what() ;
+		core.logger()(freelan::LL_WARNING) << "Error while using the certificate validation plugin (" << plugin->path() << "): " << ex.what();
+
+		return CVR_ERROR;
+	}
+}
+
+bool cached_certificate_validation(boost::shared_ptr<certificate_validation_cache> cache, certificate_validation_function_type function, fl::core& core, fl::security_configuration::cert_type cert)
+{
+	const certificate_validation_cache::fingerprint_type fingerprint = certificate_validation_cache::get_fingerprint(cert);
+
+	bool result;
+
+	if (cache->find(fingerprint, result))
+	{
+		record_cache_lookup(true);
+
+		if (core.logger().level() <= freelan::LL_DEBUG)
+		{
+			core.logger()(freelan::LL_DEBUG) << "Using the cached certificate validation result: " << (result ? "accepted" : "rejected");
+		}
+
+		return result;
+	}
+
+	record_cache_lookup(false);
+
+	const certificate_validation_result validation_result = function(core, cert);
+
+	// A transient failure must not lock a valid peer out until the entry expires.
+	if (validation_result != CVR_ERROR)
+	{
+		cache->insert(fingerprint, validation_result == CVR_ACCEPTED);
+	}
+
+	return (validation_result == CVR_ACCEPTED);
+}
+
+bool uncached_certificate_validation(certificate_validation_function_type function, fl::core& core, fl::security_configuration::cert_type cert)
+{
+	return (function(core, cert) == CVR_ACCEPTED);
+}
+
+bool indexed_certificate_revocation_validation(boost::shared_ptr<const certificate_revocation_index> index, fl::security_configuration::certificate_revocation_validation_method_type method, fl::security_configuration::certificate_validation_callback_type callback, fl::core& core, fl::security_configuration::cert_type cert)
+{
+	certificate_revocation_index::status_type status = certificate_revocation_index::RS_GOOD;
+
+	switch (method)
+	{
+		case fl::security_configuration::CRVM_LAST:
+			status = index->check(cert);
+			break;
+		case fl::security_configuration::CRVM_ALL:
+			status = index->check_chain(cert);
+			break;
+		case fl::security_configuration::CRVM_NONE:
+			break;
+	}
+
+	if (status != certificate_revocation_index::RS_GOOD)
+	{
+		core.logger()(freelan::LL_WARNING) << "Certificate rejected: " << revocation_status_to_string(status) << ".";
 
 		return false;
 	}
+
+	return !callback || callback(core, cert);
+}
+
+bool directory_certificate_validation(boost::shared_ptr<authority_certificate_directory> directory, fl::security_configuration::certificate_validation_callback_type callback, fl::core& core, fl::security_configuration::cert_type cert)
+{
+	std::string error;
+
+	if (!directory->verify(cert, error))
+	{
+		core.logger()(freelan::LL_WARNING) << "Certificate rejected: " << error << ".";
+
+		return false;
+	}
+
+	return !callback || callback(core, cert);
 }
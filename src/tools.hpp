@@ -49,6 +49,7 @@
 
 #include <boost/asio.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/function.hpp>
 
 #include <freelan/os.hpp>
 #include <freelan/logger.hpp>
@@ -56,6 +57,17 @@
 
 #include <asiotap/tap_adapter.hpp>
 
+#include "script_executor.hpp"
+#include "certificate_validation_cache.hpp"
+#include "configuration_types.hpp"
+#include "certificate_validation_plugin.hpp"
+#include "certificate_revocation_index.hpp"
+#include "authority_certificate_directory.hpp"
+
+#ifndef WINDOWS
+#include "posix/certificate_validation_helper.hpp"
+#endif
+
 #ifndef WINDOWS
 /**
  * \brief Convert the specified log level to its syslog equivalent priority.
@@ -88,13 +100,128 @@ void execute_tap_adapter_up_script(const boost::filesystem::path& script, freela
  */
 void execute_tap_adapter_down_script(const boost::filesystem::path& script, freelan::core& core, const asiotap::tap_adapter& tap_adapter);
 
+/**
+ * \brief The asynchronous tap adapter up function.
+ * \param executor The script executor to use.
+ * \param script The script to call.
+ * \param timeout The time after which the script gets killed.
+ * \param core The core instance.
+ * \param tap_adapter The tap_adapter instance.
+ */
+void async_execute_tap_adapter_up_script(script_executor& executor, const boost::filesystem::path& script, const boost::posix_time::time_duration& timeout, freelan::core& core, const asiotap::tap_adapter& tap_adapter);
+
+/**
+ * \brief The asynchronous tap adapter down function.
+ * \param executor The script executor to use.
+ * \param script The script to call.
+ * \param timeout The time after which the script gets killed.
+ * \param core The core instance.
+ * \param tap_adapter The tap_adapter instance.
+ */
+void async_execute_tap_adapter_down_script(script_executor& executor, const boost::filesystem::path& script, const boost::posix_time::time_duration& timeout, freelan::core& core, const asiotap::tap_adapter& tap_adapter);
+
+/**
+ * \brief A certificate validation result.
+ */
+enum certificate_validation_result
+{
+	CVR_ACCEPTED, /**< \brief The certificate is accepted. */
+	CVR_REJECTED, /**< \brief The certificate is rejected. */
+	CVR_ERROR /**< \brief The certificate could not be validated, for instance because a script timed out. It is rejected, but the result must not be cached. */
+};
+
+/**
+ * \brief A certificate validation function that tells rejected certificates and errors apart.
+ *
+ * Use cached_certificate_validation() or uncached_certificate_validation() to get a freelan certificate validation callback.
+ */
+typedef boost::function<certificate_validation_result (freelan::core&, freelan::security_configuration::cert_type)> certificate_validation_function_type;
+
+/**
+ * \brief Validate a certificate with a script.
+ * \param script The script to call.
+ * \param input How to hand the certificate to the script.
+ * \param timeout The time after which the script gets killed and the certificate rejected.
+ * \param logger The logger to use.
+ * \param cert The certificate.
+ * \return CVR_ACCEPTED if the script exited with 0, CVR_REJECTED if it exited with another status, CVR_ERROR if it could not be run or timed out.
+ */
+certificate_validation_result validate_certificate_with_script(const boost::filesystem::path& script, script_input_type input, const boost::posix_time::time_duration& timeout, freelan::logger& logger, freelan::security_configuration::cert_type cert);
+
 /**
  * \brief The certificate validation function.
  * \param script The script to call.
+ * \param input How to hand the certificate to the script.
+ * \param timeout The time after which the script gets killed and the certificate rejected.
+ * \param core The core instance.
+ * \param cert The certificate.
+ * \return The validation result, as returned by validate_certificate_with_script().
+ *
+ * The core expects an immediate answer, so the script runs synchronously: keep it short or set a timeout.
+ */
+certificate_validation_result execute_certificate_validation_script(const boost::filesystem::path& script, script_input_type input, const boost::posix_time::time_duration& timeout, freelan::core& core, freelan::security_configuration::cert_type cert);
+
+#ifndef WINDOWS
+/**
+ * \brief The certificate validation function that uses a persistent helper.
+ * \param helper The helper to use.
+ * \param fallback The certificate validation function to call if the helper is unavailable. May be empty, in which case CVR_ERROR is returned.
+ * \param core The core instance.
+ * \param cert The certificate.
+ * \return The validation result.
+ */
+certificate_validation_result execute_certificate_validation_helper(boost::shared_ptr<posix::certificate_validation_helper> helper, certificate_validation_function_type fallback, freelan::core& core, freelan::security_configuration::cert_type cert);
+#endif
+
+/**
+ * \brief The certificate validation function that uses a plugin.
+ * \param plugin The plugin to use.
+ * \param core The core instance.
+ * \param cert The certificate.
+ * \return The validation result. CVR_ERROR if the plugin failed.
+ */
+certificate_validation_result execute_certificate_validation_plugin(boost::shared_ptr<certificate_validation_plugin> plugin, freelan::core& core, freelan::security_configuration::cert_type cert);
+
+/**
+ * \brief A certificate validation function that caches the results of another one.
+ * \param cache The cache to use.
+ * \param function The certificate validation function to call on a cache miss.
+ * \param core The core instance.
+ * \param cert The certificate.
+ * \return true if the certificate is accepted.
+ *
+ * Errors are not cached: the next validation of the certificate tries again.
+ */
+bool cached_certificate_validation(boost::shared_ptr<certificate_validation_cache> cache, certificate_validation_function_type function, freelan::core& core, freelan::security_configuration::cert_type cert);
+
+/**
+ * \brief A certificate validation function that calls another one without caching its results.
+ * \param function The certificate validation function to call.
+ * \param core The core instance.
+ * \param cert The certificate.
+ * \return true if the certificate is accepted.
+ */
+bool uncached_certificate_validation(certificate_validation_function_type function, freelan::core& core, freelan::security_configuration::cert_type cert);
+
+/**
+ * \brief A certificate validation function that checks the revocation status of a certificate before calling another one.
+ * \param index The certificate revocation index.
+ * \param method The certificate revocation validation method.
+ * \param callback The certificate validation function to call if the certificate is not revoked. If empty, the certificate is accepted.
+ * \param core The core instance.
+ * \param cert The certificate.
+ * \return The validation result.
+ */
+bool indexed_certificate_revocation_validation(boost::shared_ptr<const certificate_revocation_index> index, freelan::security_configuration::certificate_revocation_validation_method_type method, freelan::security_configuration::certificate_validation_callback_type callback, freelan::core& core, freelan::security_configuration::cert_type cert);
+
+/**
+ * \brief A certificate validation function that verifies a certificate against an authority certificate directory before calling another one.
+ * \param directory The authority certificate directory.
+ * \param callback The certificate validation function to call if the certificate is trusted. If empty, the certificate is accepted.
  * \param core The core instance.
  * \param cert The certificate.
- * \return The execution result of the specified script.
+ * \return The validation result.
  */
-bool execute_certificate_validation_script(const boost::filesystem::path& script, freelan::core& core, freelan::security_configuration::cert_type cert);
+bool directory_certificate_validation(boost::shared_ptr<authority_certificate_directory> directory, freelan::security_configuration::certificate_validation_callback_type callback, freelan::core& core, freelan::security_configuration::cert_type cert);
 
 #endif /* TOOLS_HPP */
@@ -0,0 +1,86 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file tracing.hpp
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief Static tracepoints.
+ *
+ * When built with FREELAN_WITH_USDT defined (scons usdt=yes), the daemon
+ * contains USDT probes of the "freelan" provider, that tools like bpftrace,
+ * perf or SystemTap can attach to. An unused probe costs a single no-op
+ * instruction. Otherwise, the probes compile to nothing and their arguments
+ * are not evaluated.
+ *
+ * The probes are:
+ * - script__start(const char* file, int pid): a script was spawned.
+ * - script__end(int pid, int exit_status): a script terminated. The exit status is -1 if it timed out.
+ * - certificate__validation(const char* peer, int accepted, uint64_t duration): a peer certificate was validated, in duration nanoseconds.
+ * - tap__adapter__up(const char* name): the tap adapter went up.
+ * - tap__adapter__down(const char* name): the tap adapter went down.
+ * - log__message(int level, const char* message): a message was logged.
+ * - log__dropped(int level): a message was dropped because the log queue was full.
+ *
+ * For instance, to print the scripts that take more than 100 ms:
+ *
+ * bpftrace -e 'usdt:/usr/sbin/freelan:freelan:script__start { @start[arg1] = nsecs; }
+ *   usdt:/usr/sbin/freelan:freelan:script__end /@start[arg0] && nsecs - @start[arg0] > 100000000/ { printf("%d: %d ms\n", arg0, (nsecs - @start[arg0]) / 1000000); }'
+ */
+
+#ifndef TRACING_HPP
+#define TRACING_HPP
+
+#if defined(FREELAN_WITH_USDT)
+
+#include <sys/sdt.h>
+
+#define FREELAN_PROBE1(name, a1) DTRACE_PROBE1(freelan, name, a1)
+#define FREELAN_PROBE2(name, a1, a2) DTRACE_PROBE2(freelan, name, a1, a2)
+#define FREELAN_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(freelan, name, a1, a2, a3)
+
+#else
+
+#define FREELAN_PROBE1(name, a1) ((void)sizeof(a1))
+#define FREELAN_PROBE2(name, a1, a2) ((void)sizeof(a1), (void)sizeof(a2))
+#define FREELAN_PROBE3(name, a1, a2, a3) ((void)sizeof(a1), (void)sizeof(a2), (void)sizeof(a3))
+
+#endif
+
+#endif /* TRACING_HPP */
@@ -0,0 +1,137 @@
+/*
+ * freelan - An open, multi-platform software to establish peer-to-peer virtual
+ * private networks.
+ *
+ * Copyright (C) 2010-2011 Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ *
+ * This file is part of freelan.
+ *
+ * freelan is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * freelan is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ *
+ * If you intend to use freelan in a commercial software, please
+ * contact me : we may arrange this for a small fee or no fee at all,
+ * depending on the nature of your project.
+ */
+
+/**
+ * \file validation_plugin.h
+ * \author Julien KAUFFMANN <julien.kauffmann@freelan.org>
+ * \brief The certificate validation plugin interface.
+ *
+ * A certificate validation plugin is a shared library loaded by freelan when
+ * security.certificate_validation_plugin is set. It must export the functions
+ * declared below with C linkage. Only freelan_plugin_validate() is
+ * mandatory.
+ *
+ * A reference plugin lives in plugins/fingerprint_allow_list.
+ *
+ * A plugin keeps its state in the context returned by freelan_plugin_init(),
+ * not in global variables: a configuration reload that changes the plugin
+ * argument initializes a new instance before the previous one is cleaned up.
+ *
+ * freelan_plugin_validate() may be called concurrently from several threads
+ * and must not block for long: it runs on the threads that forward the
+ * traffic.
+ */
+
+#ifndef FREELAN_VALIDATION_PLUGIN_H
+#define FREELAN_VALIDATION_PLUGIN_H
+
+#include <stddef.h>
+
+/**
+ * \brief The version of the plugin interface described in this file.
+ */
+#define FREELAN_PLUGIN_ABI_VERSION 1
+
+#ifdef _WIN32
+#define FREELAN_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define FREELAN_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * \brief Get the version of the plugin interface the plugin implements.
+ * \return FREELAN_PLUGIN_ABI_VERSION.
+ *
+ * A plugin that does not export this function is assumed to implement version 1.
+ */
+typedef unsigned int (*freelan_plugin_abi_version_function)(void);
+
+/**
+ * \brief Initialize an instance of the plugin.
+ * \param argument The value of security.certificate_validation_plugin_argument. Never NULL.
+ * \return The context of the instance, passed to the other functions. NULL prevents freelan from starting, or the configuration reload from being applied.
+ *
+ * Called once per instance, before any validation. A plugin that does not export this function gets a NULL context.
+ */
+typedef void* (*freelan_plugin_init_function)(const char* argument);
+
+/**
+ * \brief Validate a certificate.
+ * \param context The context of the instance.
+ * \param der The DER encoded X509 certificate.
+ * \param der_len The length of der.
+ * \return 0 to accept the certificate. Any other value rejects it.
+ */
+typedef int (*freelan_plugin_validate_function)(void* context, const unsigned char* der, size_t der_len);
+
+/**
+ * \brief Release the resources of an instance of the plugin.
+ * \param context The context of the instance.
+ *
+ * Called once per instance, after its last validation.
+ */
+typedef void (*freelan_plugin_cleanup_function)(void* context);
+
+/*
+ * The exported symbols. Define FREELAN_PLUGIN before including this file
+ * when building a plugin to get their prototypes.
+ */
+#define FREELAN_PLUGIN_ABI_VERSION_SYMBOL "freelan_plugin_abi_version"
+#define FREELAN_PLUGIN_INIT_SYMBOL "freelan_plugin_init"
+#define FREELAN_PLUGIN_VALIDATE_SYMBOL "freelan_plugin_validate"
+#define FREELAN_PLUGIN_CLEANUP_SYMBOL "freelan_plugin_cleanup"
+
+#ifdef FREELAN_PLUGIN
+FREELAN_PLUGIN_EXPORT unsigned int freelan_plugin_abi_version(void);
+FREELAN_PLUGIN_EXPORT void* freelan_plugin_init(const char* argument);
+FREELAN_PLUGIN_EXPORT int freelan_plugin_validate(void* context, const unsigned char* der, size_t der_len);
+FREELAN_PLUGIN_EXPORT void freelan_plugin_cleanup(void* context);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREELAN_VALIDATION_PLUGIN_H */
@@ -402,11 +402,55 @@ namespace win32
 			fl_configuration.tap_adapter.down_callback = boost::bind(&execute_tap_adapter_down_script, tap_adapter_down_script, _1, _2);
 		}
 
+		certificate_validation_function_type validation_function;
+
 		const fs::path certificate_validation_script = get_certificate_validation_script(execution_root_directory, vm);
 
 		if (!certificate_validation_script.empty())
 		{
-			fl_configuration.security.certificate_validation_callback = boost::bind(&execute_certificate_validation_script, certificate_validation_script, _1, _2);
+			validation_function = boost::bind(&execute_certificate_validation_script, certificate_validation_script, get_certificate_validation_script_input(vm), get_certificate_validation_script_timeout(vm), _1, _2);
+		}
+
+		const fs::path certificate_validation_plugin_file = get_certificate_validation_plugin(execution_root_directory, vm);
+
+		if (!certificate_validation_plugin_file.empty())
+		{
+			if (validation_function)
+			{
+				throw std::runtime_error("A certificate validation plugin cannot be combined with a certificate validation script.");
+			}
+
+			const boost::shared_ptr<certificate_validation_plugin> plugin = boost::make_shared<certificate_validation_plugin>(certificate_validation_plugin_file, get_certificate_validation_plugin_argument(vm));
+
+			validation_function = boost::bind(&execute_certificate_validation_plugin, plugin, _1, _2);
+		}
+
+		if (validation_function)
+		{
+			if (get_certificate_validation_cache_size(vm) > 0)
+			{
+				const boost::shared_ptr<certificate_validation_cache> cache = boost::make_shared<certificate_validation_cache>(get_certificate_validation_cache_size(vm), get_certificate_validation_cache_ttl(vm));
+
+				fl_configuration.security.certificate_validation_callback = boost::bind(&cached_certificate_validation, cache, validation_function, _1, _2);
+			}
+			else
+			{
+				fl_configuration.security.certificate_validation_callback = boost::bind(&uncached_certificate_validation, validation_function, _1, _2);
+			}
+		}
+
+		const boost::shared_ptr<authority_certificate_directory> authority_directory = get_authority_certificate_directory(execution_root_directory, vm, fl_configuration.security);
+
+		if (authority_directory)
+		{
+			fl_configuration.security.certificate_validation_callback = boost::bind(&directory_certificate_validation, authority_directory, fl_configuration.security.certificate_validation_callback, _1, _2);
+		}
+
+		const boost::shared_ptr<certificate_revocation_index> revocation_index = get_certificate_revocation_index(execution_root_directory, vm, fl_configuration.security.certificate_authority_list);
+
+		if (revocation_index)
+		{
+			fl_configuration.security.certificate_validation_callback = boost::bind(&indexed_certificate_revocation_validation, revocation_index, get_certificate_revocation_validation_method(vm), fl_configuration.security.certificate_validation_callback, _1, _2);
 		}
 
 		return fl_configuration;